@@ -2,6 +2,108 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define MAX_READERS 64            // Read snapshots that can be open at the same time
+#define GC_INTERVAL_MS 50         // How often the background collector wakes up
+#define RESHAPE_INTERVAL_MS 2000  // How often an adaptive store considers reshaping its tree
+#define RESHAPE_MAX_NODES 32768   // Nodes the collector rebuilds per reshape pass at most
+#define RETIRE_BLOCK_SIZE 16      // Retired nodes recorded per arena slot (fewer in smaller slots)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define ARENA_CHUNK_BYTES HUGE_PAGE_SIZE // Memory added each time a private arena grows
+#define STORE_MAGIC 0x47594D31u   // "GYM1": marks an initialized shared segment
+#define DEFAULT_SEGMENT_MB 64     // Shared segment size when none is given
+#define JOURNAL_POLL_MS 20        // How often a follower checks the journal for new commits
+#define REQUEST_QUEUE_SIZE 4096   // Capacity of the booking request queue (a power of two)
+#define MAX_BATCH 4096            // Requests the writer applies in one transaction at most
+#define WAITING_ROOM_SIZE 65536   // Clients the on-sale waiting room holds (a power of two)
+#define ADMIT_INTERVAL_MS 1       // How often the waiting room lets clients through
+#define CACHE_LINE 64
+#define LOOKUP_GROUP 16           // Lookups searchNodeBatch() keeps in flight
+#define MAX_LOOKUP_GROUP 32
+#define MAX_SCAN_SEATS 256        // Seats accepted by one gate scan
+#define TRANSFER_BATCH 4096       // Feed transfers applied in one transaction
+#define MAX_VENUES 16             // Venues one process can host
+#define MAX_SECTIONS 64           // Sections a venue layout may have
+#define MAX_VENUE_SEATS 99999     // Seat IDs go into ticket keys as 5 digits
+#define SEAT_NAME_SIZE 8          // A section letter, up to 5 digits and the terminator
+#define SALE_MAX_ATTEMPTS 5       // Seats an on-sale client tries before giving up
+#define SALE_MAX_HOLD 8           // Longest a client holds a seat before paying (rounds)
+#define SALE_ABANDON_PERCENT 10   // Clients who walk away from a held seat
+#define TRACE_MAGIC 0x544D5947u   // "GYMT": first bytes of a workload trace
+#define TRACE_FORMAT 2
+#define INDEX_MIN_CAPACITY 1024  // Slots of a new hash index (a power of two)
+#define SKIP_MAX_LEVEL 24        // Levels of the skip list (enough for 16M keys)
+#define SKIP_RECLAIM_BATCH 64    // Retired skip list nodes that trigger a reclaim pass
+#define LOG_SEGMENT_BYTES (64 * 1024 * 1024) // Size at which the data log starts a new segment file
+#define LOG_MAX_SEGMENTS 256     // Segment files a data log can have at the same time
+#define LOG_LOCATION(slot, offset) ((uint64_t)(slot) << 40 | (uint64_t)(offset))
+#define LOG_SLOT(location) ((int)((location) >> 40))
+#define LOG_OFFSET(location) ((size_t)((location) & ((1ULL << 40) - 1)))
+#define LOG_PENDING (1ULL << 63) // Location bit of a record not written to the data log yet (see nodeRecord())
+#define LOG_RETIRING ULONG_MAX   // retiredAt of a merged-away segment before its nodes are repointed
+#define LOG_REPOINT_BATCH 4096   // Nodes a merge repoints per hold of the store's writer lock
+#define LOG_COMPACT_MS 500       // How often the data log compactor syncs and checks for dead records
+#define LOG_COMPACT_PERCENT 50   // Share of dead bytes that starts a background merge
+#define LOG_COMPACT_MIN_BYTES (1024 * 1024) // Dead bytes not worth a merge below this
+#define LOG_PATH_SIZE 300        // Longest path of a data log or LSM file
+#define LSM_MEMTABLE_ENTRIES 65536 // Records an LSM memtable takes before it is flushed to a run
+#define LSM_MAX_RUNS 64          // Sorted runs an LSM tree can have at the same time
+#define LSM_MERGE_RUNS 4         // Runs of similar size the LSM tree merges into one
+#define LSM_BLOOM_BITS 10        // Bloom filter bits per key of a run (about 1% false positives)
+#define LSM_BLOOM_HASHES 7
+#define LSM_MAGIC 0x4D534C47u    // "GLSM": first bytes of a sorted run
+#define PAGE_SIZE 4096           // Bytes of a page of the paged tree, on disk and in the buffer pool
+#define PAGE_MAGIC 0x50594D47u   // "GMYP": first bytes of a paged tree file
+#define MIN_POOL_PAGES 16        // Smallest buffer pool: a root-to-leaf path and a split must fit
+
+// Hint the CPU to start loading an address that will be needed soon.
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+// Declares a binary search tree specialized for one record type (see
+// TYPED_TREE_DEFINE): a node holding the record itself, with no key string,
+// type tag or union, and the functions that work on it.
+// A benchmark prototype, used only by --bench typed: the stores keep the
+// union TreeNode, which their snapshots, hash index, journal, data log and
+// reshape all share, so moving them to these trees would mean one copy of
+// each of those per record type.
+#define TYPED_TREE_DECLARE(Name, prefix, Type, KeyType)                               \
+    typedef struct Name##Node                                                       \
+    {                                                                               \
+        Type value;                                                                 \
+        struct Name##Node *left;                                                    \
+        struct Name##Node *right;                                                   \
+    } Name##Node;                                                                   \
+    Name##Node *prefix##Insert(Name##Node *root, const Type *value, int *inserted); \
+    Name##Node *prefix##Search(Name##Node *root, KeyType key);                      \
+    Name##Node *prefix##Delete(Name##Node *root, KeyType key, int *deleted);        \
+    long prefix##CountRange(const Name##Node *root, KeyType from, KeyType to);      \
+    void prefix##Free(Name##Node *root);
 
 // --- Data Structures ---
 
@@ -33,686 +135,13334 @@ typedef struct
  */
 typedef struct
 {
-    char seat[5]; // Format "c149"
+    int seatId;   // Dense seat ID in the venue layout (see validateSeat())
     char afm[11]; // Spectator's Tax ID
     char firstName[50];
     char lastName[50];
     int eventCode; // Code of the event this ticket belongs to
 } Ticket;
 
+/**
+ * @struct VenueLayout
+ * @brief The seat map of a venue: sections named by a letter, each with
+ * seats numbered from 1. Every seat has a dense ID, from 0 to seatCount - 1
+ * in section order, so anything indexed by seat is a plain array.
+ */
+typedef struct
+{
+    int sectionCount;
+    char sectionName[MAX_SECTIONS];
+    int sectionFirst[MAX_SECTIONS + 1]; // ID of each section's first seat; the last entry is seatCount
+    signed char sectionOf[256];         // Section index by lowercase letter, -1 if none
+    int seatCount;
+} VenueLayout;
+
+/**
+ * @union NodeData
+ * @brief The payload of a node: a node is either an event or a ticket.
+ */
+typedef union
+{
+    Event eventData;
+    Ticket ticketData;
+} NodeData;
+
+/**
+ * @typedef RelPtr
+ * @brief A self-relative link: the distance from the field itself to its
+ * target (0 = NULL). Unlike a raw pointer it stays valid when the memory
+ * holding both ends is mapped at a different address in another process.
+ */
+typedef intptr_t RelPtr;
+
 /**
  * @struct TreeNode
  * @brief The structure of the digital tree's node.
  */
 typedef struct TreeNode
 {
-    char key[20];  // Composite key (e.g., "E_101" for event, "T_101_c149" for ticket)
+    char key[20];  // Composite key (e.g., "E_101" for event, "T_101_01148" for the ticket of seat ID 1148, c149)
     NodeType type; // The type of the node (EVENT_NODE or TICKET_NODE)
 
-    // Using a union to save memory, as a node is either an event or a ticket.
+    RelPtr left;           // Use nodeLeft()/setLeft()
+    RelPtr right;          // Use nodeRight()/setRight()
+    unsigned long version; // Commit that created this node (0 = not in a store)
+    atomic_uint hits;      // Lookups that found this node (adaptive mode only)
+
+    // Last, so the nodes of a store backed by a data log can be allocated
+    // without the record they do not hold. Use nodeRecord() in a store.
     union
     {
-        Event eventData;
-        Ticket ticketData;
-    } data;
-
-    struct TreeNode *left;
-    struct TreeNode *right;
+        NodeData data;             // Using a union to save memory, as a node is either an event or a ticket
+        _Atomic uint64_t location; // Where the data log keeps the record (log-backed stores only; merges move it)
+    };
 } TreeNode;
 
-// --- Function Declarations ---
-
-// Helper Functions
-void clearInputBuffer();
-int getIntegerInput();
-void getStringInput(char *buffer, int size);
-int validateSeat(const char *seat);
-
-// Tree Management Functions
-TreeNode *createNode(const char *key, NodeType type, void *data);
-TreeNode *insertNode(TreeNode *root, const char *key, NodeType type, void *data);
-TreeNode *searchNode(TreeNode *root, const char *key);
-TreeNode *findMin(TreeNode *node);
-TreeNode *deleteNode(TreeNode *root, const char *key);
-void freeTree(TreeNode *root);
-void inorderTraversalPrint(TreeNode *root, NodeType filterType, int eventCodeFilter);
-void collectTicketKeysForEvent(TreeNode *root, int eventCode, char ***keys, int *count, int *capacity);
-
-// Event Management Functions
-void eventMenu(TreeNode **root);
-void addEvent(TreeNode **root);
-void findEvent(TreeNode *root);
-void removeEvent(TreeNode **root);
-void printEvents(TreeNode *root);
-
-// Ticket Management Functions
-void ticketMenu(TreeNode **root);
-void addTicket(TreeNode **root);
-void findTicket(TreeNode *root);
-void printTicketsForEvent(TreeNode *root);
-
-// --- Main Function ---
-
-int main()
+/**
+ * @struct RetireBlock
+ * @brief A batch of nodes replaced by one commit, waiting for the collector.
+ */
+typedef struct RetireBlock
 {
-    TreeNode *root = NULL; // Initialize the tree as empty
-    int choice;
-
-    do
-    {
-        printf("\n--- GYM MANAGEMENT MAIN MENU ---\n");
-        printf("1. Manage Events\n");
-        printf("2. Manage Tickets\n");
-        printf("3. Exit and Delete All Data\n");
-        printf("Select [1-3]: ");
-        choice = getIntegerInput();
+    RelPtr next; // Next block of the same commit
+    int count;
+    RelPtr nodes[RETIRE_BLOCK_SIZE];
+} RetireBlock;
 
-        switch (choice)
-        {
-        case 1:
-            eventMenu(&root);
-            break;
-        case 2:
-            ticketMenu(&root);
-            break;
-        case 3:
-            printf("Deleting all data and terminating the program...\n");
-            freeTree(root); // Free all memory used by the tree
-            root = NULL;
-            break;
-        default:
-            printf("(!) Invalid choice. Please try again.\n");
-        }
-    } while (choice != 3);
+/**
+ * @struct Version
+ * @brief One committed state of the tree, stamped with its commit number.
+ * Versions form a list from the oldest still referenced one to the newest.
+ */
+typedef struct Version
+{
+    unsigned long number; // Commit version stamp (the empty store is version 1)
+    RelPtr root;          // Root of the tree as of this commit
+    RelPtr retired;       // RetireBlocks with the previous version's nodes this commit replaced
+    RelPtr next;          // The next (newer) version, NULL for the head
+} Version;
 
-    printf("Program terminated successfully.\n");
-    return 0;
-}
+/**
+ * @union ArenaSlot
+ * @brief The fixed-size unit the node arena hands out.
+ */
+typedef union ArenaSlot
+{
+    TreeNode node;
+    Version version;
+    RetireBlock retire;
+    RelPtr nextFree; // Link while the slot sits on the free list
+} ArenaSlot;
 
-// --- Helper Functions ---
+/**
+ * @struct ArenaChunk
+ * @brief A contiguous run of slots owned by a node arena.
+ */
+typedef struct ArenaChunk
+{
+    RelPtr next; // Previously filled chunk
+    size_t bytes;
+    int backing; // ChunkBacking: how to release the chunk
+    size_t capacity;
+    size_t used;       // Slots handed out from this chunk so far (bump allocation)
+    ArenaSlot slots[]; // Spaced by the arena's slot size, which may be below sizeof(ArenaSlot)
+} ArenaChunk;
 
 /**
- * @brief Clears the input buffer (stdin) to prevent issues with fgets.
+ * @enum ChunkBacking
+ * @brief Where the memory of an arena chunk came from.
  */
-void clearInputBuffer()
+typedef enum
 {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF)
-        ;
-}
+    CHUNK_EXTERNAL, // Owned by someone else (a shared segment)
+    CHUNK_MALLOC,   // malloc(), regular pages
+    CHUNK_MAPPED    // mmap(), huge pages requested
+} ChunkBacking;
 
 /**
- * @brief Reads an integer from the user safely.
- * @return The integer entered by the user, or -1 in case of an error.
+ * @enum PageMode
+ * @brief The pages private arenas are backed with.
  */
-int getIntegerInput()
+typedef enum
 {
-    int value;
-    char buffer[100];
-    if (fgets(buffer, sizeof(buffer), stdin) != NULL)
-    {
-        if (sscanf(buffer, "%d", &value) == 1)
-        {
-            return value;
-        }
-    }
-    return -1; // Return an invalid value on failure
-}
+    PAGES_SMALL,            // Regular 4 KB pages
+    PAGES_TRANSPARENT_HUGE, // 2 MB-aligned chunks the kernel is asked to back with huge pages
+    PAGES_EXPLICIT_HUGE     // Reserved hugetlb pages, falling back to transparent ones
+} PageMode;
 
 /**
- * @brief Reads a string from the user and removes the newline character.
- * @param buffer The buffer where the string will be stored.
- * @param size The size of the buffer.
+ * @struct NodeArena
+ * @brief Slab allocator for tree nodes and store bookkeeping.
+ * All links are relative, so an arena can live in a shared memory segment.
  */
-void getStringInput(char *buffer, int size)
+typedef struct NodeArena
 {
-    if (fgets(buffer, size, stdin) != NULL)
-    {
-        buffer[strcspn(buffer, "\n")] = 0; // Remove the newline
-    }
-}
+    pthread_mutex_t lock;
+    RelPtr chunks;     // Most recent chunk
+    RelPtr freeList;   // Slots returned by the collector
+    int growable;      // Private arenas add chunks on demand, a shared segment cannot grow
+    PageMode pageMode; // Pages new chunks are backed with
+    size_t slotSize;   // Bytes per slot: sizeof(ArenaSlot), or less for nodes without a record
+    int retireCapacity; // Nodes a RetireBlock of this slot size holds
+    size_t slotsInUse;
+    size_t chunkCount;
+    size_t hugeChunks; // Chunks mapped with a huge page request
+} NodeArena;
 
 /**
- * @brief Validates a seat string (e.g., 'a'-'h' and 1-500).
- * @param seat The seat string (e.g., "c149").
- * @return 1 if valid, 0 otherwise.
+ * @enum PerfEvent
+ * @brief Counters the benchmarks read from the kernel's perf events.
  */
-int validateSeat(const char *seat)
+typedef enum
 {
-    if (strlen(seat) < 2 || strlen(seat) > 4)
-        return 0;
-    char section = tolower(seat[0]);
-    if (section < 'a' || section > 'h')
-        return 0;
+    PERF_CYCLES,        // CPU cycles (hardware)
+    PERF_INSTRUCTIONS,  // Instructions retired (hardware)
+    PERF_CACHE_MISSES,  // Last-level cache misses (hardware)
+    PERF_BRANCH_MISSES, // Mispredicted branches (hardware)
+    PERF_DTLB_MISSES,   // Data TLB load misses (hardware)
+    PERF_PAGE_FAULTS,   // Page faults (software)
+    PERF_EVENT_COUNT
+} PerfEvent;
 
-    int number = atoi(&seat[1]);
-    if (number < 1 || number > 500)
-        return 0;
+/**
+ * @struct PerfCounters
+ * @brief A set of perf event counters for the calling thread.
+ */
+typedef struct
+{
+    int fd[PERF_EVENT_COUNT];           // -1 if the counter is not available
+    long long value[PERF_EVENT_COUNT];  // Counts of the last measured interval, -1 if unavailable
+} PerfCounters;
 
-    return 1;
-}
+/**
+ * @struct IndexEntry
+ * @brief A slot of the hash index: a packed key and the node holding it.
+ */
+typedef struct
+{
+    _Atomic uint64_t key;     // INDEX_EMPTY, INDEX_DELETED or a packed key (see indexKey())
+    _Atomic(TreeNode *) node;
+    atomic_ulong version;     // Commit that last pointed the key at a node
+} IndexEntry;
 
-// --- Tree Management Functions ---
+/**
+ * @struct IndexTable
+ * @brief The open-addressing (linear probing) slot array of a hash index.
+ */
+typedef struct IndexTable
+{
+    size_t mask;                    // Capacity - 1 (a power of two)
+    unsigned long retiredAt;        // Commit that replaced the table, once retired
+    struct IndexTable *nextRetired;
+    IndexEntry entries[];
+} IndexTable;
 
 /**
- * @brief Creates a new node for the tree.
+ * @struct HashIndex
+ * @brief Point lookup index of a private store: maps an event code or an
+ * (event, seat) pair to the node of the latest committed version. Only the
+ * writer changes it, at commit; readers probe it without locks while they
+ * hold a snapshot, which keeps every node and table they can reach alive.
+ * The versions recorded with the entries tell a reader of an older
+ * snapshot when the index is ahead of it (see storeLookup()).
  */
-TreeNode *createNode(const char *key, NodeType type, void *data)
+typedef struct HashIndex
 {
-    TreeNode *newNode = (TreeNode *)malloc(sizeof(TreeNode));
-    if (!newNode)
-    {
-        perror("(!) Failed to allocate memory for new node");
-        exit(EXIT_FAILURE);
-    }
-    strcpy(newNode->key, key);
-    newNode->type = type;
+    _Atomic(IndexTable *) table;
+    atomic_ulong removedAt; // Latest commit that removed a key
+    size_t used;          // Slots holding a key or a tombstone (writer only)
+    size_t live;          // Slots holding a key (writer only)
+    IndexTable *retired;  // Tables replaced by a resize, freed once no reader can hold them (writer only)
+} HashIndex;
 
-    if (type == EVENT_NODE)
-    {
-        newNode->data.eventData = *(Event *)data;
-    }
-    else
-    {
-        newNode->data.ticketData = *(Ticket *)data;
-    }
+/**
+ * @struct WaitEntry
+ * @brief A spectator waiting for a seat of a sold-out event.
+ */
+typedef struct
+{
+    int tier;                  // Membership tier: higher tiers are offered seats first
+    unsigned long long joined; // Join order, which decides within a tier
+    char afm[11];
+    char firstName[50];
+    char lastName[50];
+} WaitEntry;
 
-    newNode->left = newNode->right = NULL;
-    return newNode;
-}
+/**
+ * @struct Waitlist
+ * @brief The waiters of one event in a binary heap, next waiter first, so
+ * joining and taking the next waiter each cost O(log w).
+ */
+typedef struct
+{
+    int eventCode;
+    int count;
+    int capacity;
+    WaitEntry *heap;
+} Waitlist;
 
 /**
- * @brief Inserts a new node into the binary search tree.
+ * @struct Waitlists
+ * @brief The waitlists of a store, sorted by event code. Only joins and
+ * released seats touch them, never a booking.
  */
-TreeNode *insertNode(TreeNode *root, const char *key, NodeType type, void *data)
+typedef struct
 {
-    if (root == NULL)
-    {
-        return createNode(key, type, data);
-    }
+    pthread_mutex_t lock;
+    Waitlist *lists;
+    int count;
+    int capacity;
+    unsigned long long joined; // Number of joins so far
+} Waitlists;
 
-    int cmp = strcmp(key, root->key);
-    if (cmp < 0)
-    {
-        root->left = insertNode(root->left, key, type, data);
-    }
-    else if (cmp > 0)
-    {
-        root->right = insertNode(root->right, key, type, data);
-    }
-    // If the key already exists, do nothing.
-    return root;
-}
+/**
+ * @struct Store
+ * @brief The event/ticket store with multi-version concurrency control.
+ * Readers work on an immutable snapshot without taking any lock, a single
+ * writer at a time builds the next version by copying the nodes it changes,
+ * and a background thread frees nodes no snapshot can reach anymore.
+ * The store may sit in a shared memory segment used by several processes,
+ * in which case every lock is process-shared and only the creating process
+ * runs the collector. Each store books one venue and keeps its seat map.
+ */
+typedef struct Store
+{
+    atomic_uint magic;                  // STORE_MAGIC once a shared store is initialized
+    size_t segmentSize;                 // Size of the shared segment (0 for a private store)
+    _Atomic RelPtr head;                // Latest committed version
+    atomic_ulong committed;             // Number of the latest committed version
+    atomic_ulong readers[MAX_READERS];  // Version pinned by each reader slot (0 = free)
+    RelPtr oldest;                      // Oldest version still kept (owned by the collector)
+    pthread_mutex_t writeLock;          // Serializes writers
+    atomic_int writersWaiting;          // Writers blocked on writeLock (the reshape gives way to them)
+    pthread_mutex_t gcLock;
+    pthread_cond_t gcWake;
+    int gcStop;
+    pthread_t gcThread;                 // Only meaningful in the process running the collector
+    NodeArena arena;
+    VenueLayout layout;                 // Seat map of the venue this store books
+    int adaptive;                       // The collector reshapes the tree by access frequency
+    unsigned long long carriedHits;     // Hits left in the tree by the last reshape (writer only)
+    char reshapeFrom[20];               // Key the next bounded reshape pass starts after ("" = the first key, writer only)
+    HashIndex *index;                   // Point lookup index (private stores only, NULL in a shared segment)
+    Waitlists *waitlists;               // Waitlists of sold-out events (private stores only, NULL in a shared segment)
+    struct DataLog *log;                // Log holding the records, the nodes only their location (NULL = records in the nodes)
+    NodeData *pending;                  // Records of the open transaction not in the log yet (writer only)
+    size_t pendingCount;
+    size_t pendingCapacity;
+} Store;
 
 /**
- * @brief Searches for a node in the tree based on its key.
+ * @struct Snapshot
+ * @brief A consistent, read-only view of the store at one version.
  */
-TreeNode *searchNode(TreeNode *root, const char *key)
+typedef struct
 {
-    if (root == NULL || strcmp(root->key, key) == 0)
-    {
-        return root;
-    }
+    TreeNode *root;
+    unsigned long version;
+    int slot; // Reader slot that keeps this version alive
+} Snapshot;
 
-    if (strcmp(key, root->key) < 0)
-    {
-        return searchNode(root->left, key);
-    }
-    else
-    {
-        return searchNode(root->right, key);
-    }
-}
+/**
+ * @struct WriteTxn
+ * @brief A write transaction building the next version of the store.
+ */
+typedef struct
+{
+    Store *store;
+    TreeNode *root;        // Root of the version being built
+    unsigned long version; // Version stamp this transaction will commit as
+    RetireBlock *retired;  // Committed nodes replaced by copies in this transaction
+    struct JournalRecord *log; // Operations to append to the journal on commit
+    int logCount;
+    int logCapacity;
+    uint64_t *removed;     // Packed keys the transaction deleted, for the hash index
+    int removedCount;
+    int removedCapacity;
+} WriteTxn;
 
 /**
- * @brief Finds the node with the minimum value (key) in a subtree.
+ * @struct ReshapePass
+ * @brief Progress of one reshape pass over the tree (see storeReshape()).
  */
-TreeNode *findMin(TreeNode *node)
+typedef struct
 {
-    TreeNode *current = node;
-    while (current && current->left != NULL)
-    {
-        current = current->left;
-    }
-    return current;
-}
+    long budget;              // Nodes the pass may still rebuild
+    long placed;              // Nodes rebuilt so far
+    unsigned long long faded; // Hits dropped by halving the rebuilt nodes' counters
+    int yielding;             // Stop as soon as a writer is waiting (bounded passes)
+    int stopped;              // Out of budget, or writers are waiting: the rest of the tree waits for the next pass
+    char last[20];            // Largest key rebuilt so far
+} ReshapePass;
 
 /**
- * @brief Deletes a node from the tree based on its key.
+ * @enum BatchOpType
+ * @brief The kind of an operation in a batch applied by txnApplyBatch().
  */
-TreeNode *deleteNode(TreeNode *root, const char *key)
+typedef enum
 {
-    if (root == NULL)
-        return root;
+    BATCH_INSERT,
+    BATCH_LOOKUP,
+    BATCH_DELETE
+} BatchOpType;
 
-    int cmp = strcmp(key, root->key);
-    if (cmp < 0)
-    {
-        root->left = deleteNode(root->left, key);
-    }
-    else if (cmp > 0)
-    {
-        root->right = deleteNode(root->right, key);
-    }
-    else
-    {
-        // Node with only one child or no child
-        if (root->left == NULL)
-        {
-            TreeNode *temp = root->right;
-            free(root);
-            return temp;
-        }
-        else if (root->right == NULL)
-        {
-            TreeNode *temp = root->left;
-            free(root);
-            return temp;
-        }
+/**
+ * @struct BatchOp
+ * @brief One tree operation of a batch, with room for its result.
+ */
+typedef struct
+{
+    BatchOpType op;
+    char key[20];
+    NodeType type; // BATCH_INSERT: type of the new node; BATCH_LOOKUP: type found
+    NodeData data; // BATCH_INSERT: the payload; BATCH_LOOKUP: a copy of the payload found
+    int result;    // 1 if the key was inserted / found / deleted, 0 otherwise
+} BatchOp;
 
-        // Node with two children
-        TreeNode *temp = findMin(root->right);
-        strcpy(root->key, temp->key);
-        root->type = temp->type;
-        root->data = temp->data;
-        root->right = deleteNode(root->right, temp->key);
-    }
-    return root;
-}
+/**
+ * @struct SkipNode
+ * @brief A node of the lock-free skip list. The low bit of each next link
+ * marks the node as deleted at that level; once its level 0 link is marked
+ * the node is logically gone and any thread passing by may unlink it.
+ */
+typedef struct SkipNode
+{
+    char key[20];
+    NodeType type;
+    NodeData data;
+    int topLevel;                 // Highest level the node is linked at (0-based)
+    atomic_int owners;            // The inserter still linking it and the list itself; the last to let go retires it
+    unsigned long retiredEpoch;   // Epoch the node was retired in
+    struct SkipNode *nextRetired;
+    _Atomic uintptr_t next[];     // topLevel + 1 links, one per level
+} SkipNode;
 
 /**
- * @brief Recursively frees the memory of all nodes in the tree.
+ * @struct SkipList
+ * @brief An ordered event/ticket index that threads insert into, search,
+ * delete from and scan at the same time without locks. Unlinked nodes are
+ * freed once every operation that might still hold them has finished; each
+ * operation pins the current epoch in a slot, like store readers pin versions.
  */
-void freeTree(TreeNode *root)
+typedef struct
 {
-    if (root == NULL)
-        return;
-    freeTree(root->left);
-    freeTree(root->right);
-    free(root);
-}
+    SkipNode *head;                 // Sentinel before every key, linked at all levels
+    atomic_ulong epoch;             // Advanced each time a node is retired
+    atomic_ulong pins[MAX_READERS]; // Epoch pinned by each operation slot (0 = free)
+    atomic_long size;
+    pthread_mutex_t retireLock;     // Guards the retired list
+    SkipNode *retired;              // Unlinked nodes waiting to be freed, newest first
+    long retiredCount;
+} SkipList;
 
 /**
- * @brief Traverses the tree inorder and prints information,
- * filtering by node type and optionally by event code.
+ * @enum LogOp
+ * @brief The kind of a data log record.
  */
-void inorderTraversalPrint(TreeNode *root, NodeType filterType, int eventCodeFilter)
+typedef enum
 {
-    if (root == NULL)
-        return;
+    LOG_PUT,   // The key now holds the record's payload
+    LOG_DELETE // The key was removed
+} LogOp;
 
-    inorderTraversalPrint(root->left, filterType, eventCodeFilter);
+/**
+ * @struct LogRecord
+ * @brief Header of a data log record, followed by the Event or Ticket of a
+ * LOG_PUT. The checksum covers the rest of the record, so a write torn by a
+ * crash is found on recovery.
+ */
+typedef struct
+{
+    uint32_t checksum;
+    uint16_t size; // Bytes of the whole record
+    uint8_t op;    // LogOp
+    uint8_t type;  // NodeType of a LOG_PUT
+    char key[20];
+} LogRecord;
 
-    if (root->type == filterType)
+/**
+ * @struct LogSegment
+ * @brief One file of the data log, mapped read-only. Only the newest
+ * segment is appended to; older ones stay unchanged until a merge replaces
+ * them.
+ */
+typedef struct
+{
+    unsigned long number; // Recovery replays the files in this order
+    int fd;
+    const char *map;
+    size_t mapSize;
+    size_t size;          // Bytes written
+    size_t dead;          // Bytes of records deleted or overwritten since
+    unsigned long retiredAt; // 0 while live; merged away: the store commit after which no snapshot reads it
+} LogSegment;
+
+/**
+ * @struct KeyDirEntry
+ * @brief Where the data log holds the current record of a key.
+ */
+typedef struct
+{
+    uint64_t key;      // Packed key (see indexKey()), INDEX_EMPTY or INDEX_DELETED
+    uint64_t location; // Segment slot << 40 | offset of the record
+} KeyDirEntry;
+
+/**
+ * @struct LoadedRecord
+ * @brief A live record of a data log and its location, while a store is
+ * filled from the log (see logLoad()).
+ */
+typedef struct
+{
+    const LogRecord *record;
+    uint64_t location;
+} LoadedRecord;
+
+/**
+ * @struct LogUndo
+ * @brief A change a commit made to the data log, undone if the rest of the
+ * commit cannot be written (see logWriteCommit()).
+ */
+typedef struct
+{
+    uint64_t key;      // Packed key whose record changed, INDEX_EMPTY for a record marked dead
+    uint64_t location; // The key's previous record, or the record marked dead
+    int existed;       // The key had a record before the change
+} LogUndo;
+
+/**
+ * @struct DataLog
+ * @brief An append-only store of event and ticket records: every change is
+ * appended to segment files that readers access through memory maps, and
+ * only a directory of key -> record location is kept in memory. A
+ * background thread merges the older segments, dropping dead records; the
+ * nodes of a store pointing at the records follow them (see logMerge()).
+ */
+typedef struct DataLog
+{
+    char directory[256];
+    pthread_rwlock_t lock;       // Shared by readers; appends and merges take it exclusively
+    LogSegment *segments[LOG_MAX_SEGMENTS]; // By slot, NULL if free
+    int active;                  // Slot of the segment being appended to
+    unsigned long nextNumber;    // File number of the next active segment (always even)
+    KeyDirEntry *keyDir;         // Open addressing, keyed by packed key
+    size_t keyDirMask;
+    size_t keyDirUsed;           // Entries holding a key or a tombstone
+    size_t keyDirLive;
+    LogUndo *undo;               // Changes of the commit being written, while it is (see logWriteCommit())
+    size_t undoCount;
+    size_t undoCapacity;
+    int writingCommit;           // A commit is being written: record its changes in undo
+    struct Store *store;         // Store whose nodes point at the records (see logSetStore()), NULL if none
+    atomic_int retiredSegments;  // Merged-away segments kept mapped for the store's snapshots
+    pthread_mutex_t mergeLock;   // One merge at a time
+    pthread_mutex_t compactLock; // Guards stop
+    pthread_cond_t compactWake;
+    int stop;
+    pthread_t compactor;
+    atomic_int compactPercent;   // Share of dead bytes that starts a background merge (over 100: never)
+    atomic_ulong compactions;
+    atomic_size_t reclaimedBytes;
+} DataLog;
+
+/**
+ * @struct LogMove
+ * @brief A live record a merge copied, to repoint its key once the merged
+ * segment is in place.
+ */
+typedef struct
+{
+    uint64_t key;
+    uint64_t from; // Location in the merged segments
+    size_t to;     // Offset in the new segment
+} LogMove;
+
+/**
+ * @struct LsmEntry
+ * @brief A record of the LSM tree, in a memtable or a run: a key and its
+ * payload, or a tombstone hiding the older records of the key.
+ */
+typedef struct
+{
+    char key[20];
+    uint8_t type;    // NodeType
+    uint8_t deleted; // Tombstone
+    NodeData data;
+} LsmEntry;
+
+/**
+ * @struct Memtable
+ * @brief The newest records of an LSM tree, in memory: appended in arrival
+ * order, found through a hash index of packed key -> position, and sorted
+ * only once, when the memtable is flushed to a run.
+ */
+typedef struct
+{
+    LsmEntry *entries;
+    int count;
+    KeyDirEntry *slots; // location = position in entries
+    size_t mask;
+} Memtable;
+
+/**
+ * @struct LsmRunHeader
+ * @brief Start of a sorted run file, followed by its entries in key order
+ * and its Bloom filter.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t hashes;
+    uint64_t count;
+    uint64_t bloomBits;
+    uint64_t firstNumber; // Oldest run merged into this one: it replaces every run numbered from here
+} LsmRunHeader;
+
+/**
+ * @struct LsmRun
+ * @brief A sorted, immutable run of the LSM tree, mapped read-only.
+ */
+typedef struct
+{
+    unsigned long number; // Newer runs have higher numbers
+    unsigned long firstNumber;
+    int fd;
+    const LsmRunHeader *header;
+    size_t mapSize;
+    const LsmEntry *entries;
+    const uint64_t *bloom;
+} LsmRun;
+
+/**
+ * @struct LsmRunWriter
+ * @brief A run being written, entry by entry in key order.
+ */
+typedef struct
+{
+    char temporary[LOG_PATH_SIZE];
+    char path[LOG_PATH_SIZE];
+    int fd;
+    unsigned char *buffer;
+    size_t buffered;
+    size_t written;
+    uint64_t count;
+    uint64_t *bloom;
+    uint64_t bloomBits;
+    int ok;
+} LsmRunWriter;
+
+/**
+ * @struct LsmTree
+ * @brief A log-structured merge tree of event and ticket records. Writes
+ * go to an in-memory memtable; a full memtable is flushed by a background
+ * thread to a sorted run on disk, and runs of similar size are merged, so
+ * writes never rebalance anything. Lookups check the memtables, then the
+ * runs from newest to oldest, skipping runs whose Bloom filter rules the
+ * key out.
+ */
+typedef struct
+{
+    char directory[256];
+    pthread_mutex_t lock;      // Guards the memtables and stop
+    pthread_cond_t work;       // Wakes the background thread
+    pthread_cond_t flushed;    // The immutable memtable has become a run
+    Memtable *active;          // Takes the writes
+    Memtable *immutable;       // Full, being flushed, or NULL
+    pthread_rwlock_t runsLock; // Shared by lookups; the background thread swaps runs exclusively
+    LsmRun *runs[LSM_MAX_RUNS]; // Newest first
+    int runCount;
+    unsigned long nextNumber;  // Number of the next run written
+    int stop;
+    pthread_t worker;
+    atomic_ulong flushes;
+    atomic_ulong merges;
+    atomic_ulong stalls;           // Writes that waited for a flush
+    atomic_ullong bytesWritten;    // By flushes and merges
+    atomic_ullong bloomSkips;      // Runs a lookup skipped on their filter
+    atomic_ullong falsePositives;  // Runs searched on their filter's word that lacked the key
+} LsmTree;
+
+/**
+ * @struct PageFileHeader
+ * @brief Page 0 of a paged tree file.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t root;      // Page number of the root
+    uint32_t pageCount; // Pages in the file, including this one
+    uint32_t height;    // Levels of the tree; 1 while the root is a leaf
+    uint64_t keys;
+} PageFileHeader;
+
+/**
+ * @struct PageHeader
+ * @brief Start of every tree page. A leaf holds PageRecords in key order;
+ * an inner page holds PageBranches, and its leftmost child in next.
+ */
+typedef struct
+{
+    uint16_t leaf;
+    uint16_t count;
+    uint32_t next; // Leaf: the leaf to its right, 0 if none. Inner page: leftmost child
+} PageHeader;
+
+/**
+ * @struct PageRecord
+ * @brief An event or ticket in a leaf page.
+ */
+typedef struct
+{
+    char key[20];
+    uint32_t type; // NodeType
+    NodeData data;
+} PageRecord;
+
+/**
+ * @struct PageBranch
+ * @brief A separator of an inner page: keys from this one up to the next
+ * separator are under child.
+ */
+typedef struct
+{
+    char key[20];
+    uint32_t child;
+} PageBranch;
+
+/**
+ * @struct BufferFrame
+ * @brief A slot of the buffer pool holding one page.
+ */
+typedef struct
+{
+    uint32_t page;      // Page held, 0 if the frame is free (page 0 is never cached)
+    int pins;           // Users of the page right now; pinned pages are not evicted
+    uint8_t referenced; // Used since the clock hand last passed
+    uint8_t dirty;      // Changed since it was read
+} BufferFrame;
+
+/**
+ * @struct PagedTree
+ * @brief A B+ tree of events and tickets kept in a file of fixed-size
+ * pages, of which only a fixed number are in memory at a time: a buffer
+ * pool that evicts with the clock algorithm, so pages in constant use,
+ * such as the inner pages and the leaves of hot events, stay cached.
+ *
+ * This is a standalone engine, reached through --bench paged; the menus
+ * still run on the versioned store. That store hands readers snapshots
+ * by copying nodes and keeps the hash index, journal and data log in step
+ * with each commit, while this tree rewrites its pages in place under one
+ * lock. Putting it behind the store would need versioned pages or a
+ * write-ahead log first. Records that must outlive memory already have
+ * --datalog, which keeps only each key's location in RAM.
+ */
+typedef struct
+{
+    int fd;
+    PageFileHeader header;
+    pthread_mutex_t lock;    // One operation at a time
+    BufferFrame *frames;
+    unsigned char *memory;   // Page data of the frames, PAGE_SIZE each
+    size_t frameCount;
+    size_t hand;             // Clock hand
+    int32_t *frameOf;        // Frame of each page, -1 if not cached
+    size_t frameOfCapacity;
+    unsigned long long hits; // Page requests found in the pool
+    unsigned long long reads;
+    unsigned long long writes;
+} PagedTree;
+
+/**
+ * @enum JournalOp
+ * @brief The kind of a booking journal record.
+ */
+typedef enum
+{
+    JOURNAL_INSERT, // A node was inserted
+    JOURNAL_DELETE, // A node was deleted
+    JOURNAL_COMMIT  // Ends the records of one committed transaction
+} JournalOp;
+
+/**
+ * @struct JournalRecord
+ * @brief A fixed-size record of the booking journal, an append-only file of
+ * every committed change that read replicas replay.
+ */
+typedef struct JournalRecord
+{
+    JournalOp op;
+    NodeType type;         // JOURNAL_INSERT only
+    char key[20];          // JOURNAL_INSERT and JOURNAL_DELETE
+    NodeData data;         // JOURNAL_INSERT only
+    unsigned long version; // JOURNAL_COMMIT: version stamp of the commit
+    long long timestamp;   // JOURNAL_COMMIT: commit time in microseconds since the epoch
+} JournalRecord;
+
+/**
+ * @enum BookingResult
+ * @brief Outcome of a booking operation.
+ */
+typedef enum
+{
+    BOOKING_OK,
+    BOOKING_DUPLICATE,   // The event already exists
+    BOOKING_NO_EVENT,    // The event does not exist
+    BOOKING_SEAT_TAKEN,  // The seat is already booked for this event
+    BOOKING_INVALID_SEAT, // The seat is outside the venue
+    BOOKING_NO_TICKET,   // No ticket is booked for the seat
+    BOOKING_WRONG_HOLDER, // The ticket is held by someone else
+    BOOKING_NOT_SAVED    // The commit could not be written to the data log; nothing changed
+} BookingResult;
+
+/**
+ * @struct TicketTransfer
+ * @brief A resale: the ticket of a seat passes from its holder to a new
+ * spectator, keeping its event and seat.
+ */
+typedef struct
+{
+    int eventCode;
+    int seatId;
+    char fromAfm[11]; // Tax ID of the seller, who must hold the ticket
+    char afm[11];     // The buyer
+    char firstName[50];
+    char lastName[50];
+    BookingResult result; // Set when the transfer is applied
+} TicketTransfer;
+
+/**
+ * @enum RequestType
+ * @brief The operation a booking request asks the writer to perform.
+ */
+typedef enum
+{
+    REQUEST_ADD_EVENT,
+    REQUEST_ADD_TICKET,
+    REQUEST_REMOVE_EVENT
+} RequestType;
+
+#define REQUEST_PENDING -1 // Status of a request the writer has not applied yet
+
+/**
+ * @struct BookingRequest
+ * @brief A write submitted to the booking core by an I/O thread.
+ */
+typedef struct
+{
+    RequestType type;
+    NodeData data;     // The event or ticket to add; eventData.code for REQUEST_REMOVE_EVENT
+    atomic_int status; // REQUEST_PENDING until applied, then a BookingResult
+} BookingRequest;
+
+/**
+ * @struct QueueCell
+ * @brief A slot of the lock-free ring. Its sequence number tells producers
+ * and the consumer whose turn it is to use the slot.
+ */
+typedef struct
+{
+    atomic_size_t sequence;
+    BookingRequest *request;
+} QueueCell;
+
+/**
+ * @struct RequestQueue
+ * @brief A bounded queue from many producers to the single writer, either
+ * lock-free (a sequence-numbered ring) or guarded by a mutex for comparison.
+ */
+typedef struct
+{
+    int lockFree;
+    QueueCell *cells; // REQUEST_QUEUE_SIZE slots
+    _Alignas(CACHE_LINE) atomic_size_t enqueuePos; // Claimed by producers with a CAS
+    _Alignas(CACHE_LINE) size_t dequeuePos;        // Only touched by the consumer
+    pthread_mutex_t lock;                          // Mutex variant only
+    size_t count;                                  // Mutex variant only
+} RequestQueue;
+
+/**
+ * @struct BookingCore
+ * @brief The single writer thread applying queued requests to a store,
+ * one transaction per batch.
+ */
+typedef struct
+{
+    Store *store;
+    RequestQueue queue;
+    pthread_t writer;
+    atomic_int stop;
+    atomic_ullong applied; // Requests applied so far
+    unsigned long long batches;
+    int largestBatch;
+} BookingCore;
+
+#define ROOM_WAITING 0  // Pass of a client still in the waiting room
+#define ROOM_ADMITTED 1 // Pass of a client let through to the sale
+#define ROOM_CLOSED 2   // Pass of a client still waiting when the sale ended
+
+/**
+ * @struct AdmissionCell
+ * @brief A slot of the waiting room ring, sequenced like a QueueCell.
+ */
+typedef struct
+{
+    atomic_size_t sequence;
+    atomic_int *pass; // Where the waiting client learns its turn has come
+} AdmissionCell;
+
+/**
+ * @struct WaitingRoom
+ * @brief A virtual waiting room in front of the bookings of an on-sale:
+ * clients line up in a bounded lock-free ring, first come first served,
+ * and a gatekeeper thread lets them through at a set rate, so no more
+ * clients compete for seats at a time than the booking path can serve.
+ */
+typedef struct
+{
+    AdmissionCell *cells;                          // WAITING_ROOM_SIZE slots
+    _Alignas(CACHE_LINE) atomic_size_t enqueuePos; // Claimed by arriving clients with a CAS
+    _Alignas(CACHE_LINE) size_t dequeuePos;        // Only touched by the gatekeeper
+    double rate;                                   // Admissions per second
+    pthread_t gatekeeper;
+    atomic_int stop;
+    atomic_int closed;          // The sale is over: nobody else gets in
+    atomic_ullong admitted;     // Clients let through so far
+    atomic_ullong turnedAway;   // Clients refused because the room was full or closed
+    unsigned long long shutOut; // Clients still waiting when the room closed (gatekeeper only)
+} WaitingRoom;
+
+/**
+ * @struct ProducerArgs
+ * @brief The share of benchmark requests one producer thread submits.
+ */
+typedef struct
+{
+    BookingCore *core;
+    BookingRequest *requests;
+    int count;
+} ProducerArgs;
+
+/**
+ * @struct MergeArgs
+ * @brief A merge run by a benchmark thread, with its outcome.
+ */
+typedef struct
+{
+    DataLog *log;
+    long reclaimed;
+    double seconds;
+} MergeArgs;
+
+/**
+ * @enum ClientState
+ * @brief Where a simulated on-sale client is in buying a ticket.
+ */
+typedef enum
+{
+    CLIENT_QUEUED,  // In the waiting room until admitted
+    CLIENT_BROWSE,  // Picking a seat and checking it is still free
+    CLIENT_HOLD,    // Holding the seat while filling in the details
+    CLIENT_WAITING, // Booking submitted to the writer, result pending
+    CLIENT_DONE     // Booked, abandoned or gave up
+} ClientState;
+
+/**
+ * @struct SaleClient
+ * @brief One simulated customer of the on-sale load generator.
+ */
+typedef struct
+{
+    ClientState state;
+    int attempts;        // Seats tried so far
+    int holdRounds;      // Rounds left before paying for the held seat
+    atomic_int pass;     // Waiting room verdict (see waitingRoomEnter())
+    BookingRequest request;
+} SaleClient;
+
+/**
+ * @struct SaleWorker
+ * @brief A load generator thread stepping its share of the clients in
+ * turns, so the holds of many clients overlap, with its tallies.
+ */
+typedef struct
+{
+    Store *store;
+    BookingCore *core;   // Bookings go through the writer queue, or NULL to commit directly
+    WaitingRoom *room;   // Clients are admitted through a waiting room, or NULL
+    atomic_long *sold;   // Seats sold by all workers, to close the room at sell-out
+    int eventCode;
+    SaleClient *clients;
+    int count;
+    unsigned long long seed;
+    long browses;        // Seat checks against a snapshot
+    long seenTaken;      // Checks that found the seat already sold
+    long attempts;       // Bookings submitted
+    long lostRaces;      // Bookings refused because the seat sold during the hold
+    long booked;
+    long abandoned;
+    long gaveUp;         // Clients out of attempts
+    long shutOut;        // Clients refused by the waiting room or still in it at sell-out
+} SaleWorker;
+
+/**
+ * @enum IndexEngine
+ * @brief The concurrent indexes the skip list benchmark compares.
+ */
+typedef enum
+{
+    ENGINE_SKIP_LIST,  // Lock-free skip list
+    ENGINE_MUTEX_TREE, // Plain tree behind one mutex
+    ENGINE_MVCC_STORE, // Versioned store: lock-free readers, one writer at a time
+    ENGINE_COUNT
+} IndexEngine;
+
+/**
+ * @struct EngineWorker
+ * @brief A benchmark thread running its share of a mixed workload against
+ * one of the indexes, with its tally.
+ */
+typedef struct
+{
+    IndexEngine engine;
+    SkipList *list;         // ENGINE_SKIP_LIST
+    TreeNode **root;        // ENGINE_MUTEX_TREE
+    pthread_mutex_t *lock;  // ENGINE_MUTEX_TREE
+    Store *store;           // ENGINE_MVCC_STORE
+    int keySpace;
+    int operations;
+    unsigned long long seed;
+    long hits; // Searches that found their key, inserts and deletes that changed the index
+} EngineWorker;
+
+/**
+ * @struct Replica
+ * @brief A read-only copy of the store kept up to date from the journal.
+ */
+typedef struct
+{
+    Store store;                  // Local copy, written only by the follower thread
+    const char *path;             // Journal being followed
+    pthread_t thread;
+    atomic_int stop;
+    atomic_ulong appliedVersion;  // Leader version of the last applied commit
+    atomic_ullong commitsApplied;
+    atomic_llong lastLag;         // Commit-to-apply delay of the last commit (microseconds)
+    atomic_llong totalLag;        // Sum of all commit-to-apply delays (microseconds)
+    atomic_llong maxLag;
+    atomic_llong pendingBytes;    // Journal bytes written but not applied yet
+} Replica;
+
+/**
+ * @struct VenueStore
+ * @brief A venue hosted by this process: its name and its store, which has
+ * its own node arena, seat map and collector, so venues never share memory.
+ */
+typedef struct
+{
+    char name[32];
+    Store *store;
+    const char *segment; // Shared memory segment holding the store, NULL for a private store
+    int created;         // This process created the segment
+} VenueStore;
+
+/**
+ * @enum TraceOp
+ * @brief The store operations a workload trace records, one per menu action.
+ */
+typedef enum
+{
+    TRACE_ADD_EVENT,
+    TRACE_FIND_EVENT,
+    TRACE_REMOVE_EVENT,
+    TRACE_PRINT_EVENTS,
+    TRACE_ADD_TICKET,
+    TRACE_FIND_TICKET,
+    TRACE_PRINT_TICKETS,
+    TRACE_SCAN_TICKETS,
+    TRACE_OP_COUNT
+} TraceOp;
+
+/**
+ * @struct TraceRecord
+ * @brief One operation of a workload trace. On disk a record is a varint
+ * time delta, the op byte and only the fields the op uses, with strings
+ * stored as a length byte and their characters.
+ */
+typedef struct
+{
+    TraceOp op;
+    long long offset; // Microseconds since the start of the recording
+    NodeData data;    // TRACE_ADD_EVENT: eventData; TRACE_ADD_TICKET: ticketData
+    int code;         // Event code of every other op except TRACE_PRINT_EVENTS
+    char seat[SEAT_NAME_SIZE]; // TRACE_FIND_TICKET, as typed
+    int seatCount;             // TRACE_SCAN_TICKETS
+    char seats[MAX_SCAN_SEATS][SEAT_NAME_SIZE];
+} TraceRecord;
+
+// --- Function Declarations ---
+
+// Helper Functions
+void clearInputBuffer();
+int getIntegerInput();
+void getStringInput(char *buffer, int size);
+int validateSeat(const Store *store, const char *seat);
+void ticketKey(char *key, int eventCode, int seatId);
+void ticketKeyRange(char *from, char *to, int eventCode);
+
+// Venue Layout Functions
+void venueDefault(VenueLayout *layout);
+int venueLoad(VenueLayout *layout, const char *path);
+int venueSeatId(const VenueLayout *layout, const char *seat);
+void venueSeatName(const VenueLayout *layout, int seatId, char *name);
+
+// Relative Pointer Helpers
+void *relGet(const RelPtr *field);
+void relSet(RelPtr *field, const void *target);
+TreeNode *nodeLeft(const TreeNode *node);
+TreeNode *nodeRight(const TreeNode *node);
+void setLeft(TreeNode *node, TreeNode *child);
+void setRight(TreeNode *node, TreeNode *child);
+
+// Tree Management Functions
+TreeNode *createNode(const char *key, NodeType type, void *data);
+TreeNode *insertNode(TreeNode *root, const char *key, NodeType type, void *data);
+TreeNode *searchNode(TreeNode *root, const char *key);
+void searchNodeBatch(TreeNode *root, const char *const *keys, TreeNode **results, int count);
+TreeNode *findMin(TreeNode *node);
+TreeNode *deleteNode(TreeNode *root, const char *key);
+void freeTree(TreeNode *root);
+void inorderTraversalPrint(const Store *store, TreeNode *root, NodeType filterType, int eventCodeFilter);
+long countNodes(TreeNode *root, NodeType filterType, int eventCodeFilter);
+long countKeyRange(TreeNode *root, const char *from, const char *to);
+unsigned long long treeChecksum(TreeNode *root, unsigned long long hash);
+void collectTicketKeysForEvent(TreeNode *root, int eventCode, char ***keys, int *count, int *capacity);
+
+// Typed Tree Functions (bodies generated by TYPED_TREE_DEFINE)
+TYPED_TREE_DECLARE(EventTree, eventTree, Event, int)
+TYPED_TREE_DECLARE(TicketTree, ticketTree, Ticket, int64_t)
+int64_t ticketOrderKey(int eventCode, int seatId);
+
+// Node Arena Functions
+void arenaInit(NodeArena *arena, int shared, size_t slotSize);
+void arenaAddChunk(NodeArena *arena, void *memory, size_t bytes);
+ArenaSlot *arenaAlloc(NodeArena *arena);
+void arenaFree(NodeArena *arena, void *slot);
+void arenaDestroy(NodeArena *arena);
+
+// Performance Counter Functions
+void perfCountersOpen(PerfCounters *counters);
+void perfCountersStart(PerfCounters *counters);
+void perfCountersStop(PerfCounters *counters);
+void perfCountersClose(PerfCounters *counters);
+void printPhaseHeader(const char *title);
+void printPhaseResult(const char *phase, long operations, double seconds, const PerfCounters *counters);
+
+// Versioned Store (MVCC) Functions
+void storeInit(Store *store);
+void storeInitLog(Store *store, DataLog *log);
+void storeDestroy(Store *store);
+Store *storeOpenShared(const char *name, size_t size, int *created);
+void storeCloseShared(Store *store, const char *name, int created);
+Snapshot storeBeginRead(Store *store);
+void storeEndRead(Store *store, Snapshot *snapshot);
+void storeBeginWrite(Store *store, WriteTxn *txn);
+void txnInsert(WriteTxn *txn, const char *key, NodeType type, void *data);
+void txnDelete(WriteTxn *txn, const char *key);
+int txnUpdate(WriteTxn *txn, const char *key, void *data);
+void txnApplyBatch(WriteTxn *txn, BatchOp *ops, int count);
+unsigned long storeCommit(WriteTxn *txn);
+void storeAbort(WriteTxn *txn);
+void storeCollect(Store *store);
+long storeReshape(Store *store, int onlyIfUsed, long maxNodes);
+
+// Hash Index Functions
+HashIndex *indexCreate(void);
+void indexDestroy(HashIndex *index);
+int indexKey(const char *key, uint64_t *packed);
+TreeNode *storeLookup(Store *store, TreeNode *root, const char *key);
+void storeLookupBatch(Store *store, TreeNode *root, const char *const *keys, TreeNode **results, int count);
+TreeNode *txnLookup(WriteTxn *txn, const char *key);
+const NodeData *nodeRecord(const Store *store, const TreeNode *node);
+
+// Skip List Functions
+SkipList *skipListCreate(void);
+void skipListDestroy(SkipList *list);
+int skipListInsert(SkipList *list, const char *key, NodeType type, void *data);
+int skipListSearch(SkipList *list, const char *key, NodeType *type, NodeData *data);
+int skipListDelete(SkipList *list, const char *key);
+long skipListScan(SkipList *list, const char *from, const char *to, NodeData *items, long max);
+
+// Data Log Functions
+DataLog *logOpen(const char *directory);
+void logClose(DataLog *log);
+void logRemove(const char *directory);
+int logPut(DataLog *log, const char *key, NodeType type, const void *data, int overwrite);
+int logGet(DataLog *log, const char *key, NodeType *type, NodeData *data);
+int logDelete(DataLog *log, const char *key);
+int logWriteCommit(WriteTxn *txn);
+void logSetStore(DataLog *log, Store *store);
+void logReleaseSegments(DataLog *log, unsigned long limit);
+void logSync(DataLog *log);
+long logCompact(DataLog *log);
+void logStats(DataLog *log, size_t *bytes, size_t *deadBytes, size_t *keys);
+long logLoad(DataLog *log, Store *store);
+
+// LSM Tree Functions
+LsmTree *lsmOpen(const char *directory);
+void lsmClose(LsmTree *lsm);
+void lsmRemove(const char *directory);
+int lsmPut(LsmTree *lsm, const char *key, NodeType type, const void *data);
+int lsmDelete(LsmTree *lsm, const char *key);
+int lsmGet(LsmTree *lsm, const char *key, NodeType *type, NodeData *data);
+void lsmFlush(LsmTree *lsm);
+
+// Paged Tree Functions
+PagedTree *pagedOpen(const char *path, size_t poolPages);
+void pagedClose(PagedTree *tree);
+void pagedFlush(PagedTree *tree);
+int pagedInsert(PagedTree *tree, const char *key, NodeType type, const void *data);
+int pagedSearch(PagedTree *tree, const char *key, NodeType *type, NodeData *data);
+int pagedDelete(PagedTree *tree, const char *key);
+long pagedScan(PagedTree *tree, const char *from, const char *to, NodeData *items, long max);
+
+// Booking Core Functions
+BookingResult txnAddEvent(WriteTxn *txn, const Event *event);
+BookingResult txnAddTicket(WriteTxn *txn, const Ticket *ticket);
+BookingResult txnRemoveEvent(WriteTxn *txn, int code, int *ticketCount);
+BookingResult txnUpdateEvent(WriteTxn *txn, const Event *event);
+BookingResult txnTransferTicket(WriteTxn *txn, TicketTransfer *transfer);
+int txnApplyTransfers(WriteTxn *txn, TicketTransfer *transfers, int count);
+BookingResult txnMoveSeat(WriteTxn *txn, int eventCode, int fromSeat, int toSeat, int allowSwap, int *swapped);
+BookingResult txnCancelTicket(WriteTxn *txn, int eventCode, int seatId);
+BookingResult txnMoveTickets(WriteTxn *txn, int fromCode, int toCode, int *ticketCount);
+void queueInit(RequestQueue *queue, int lockFree);
+void queueDestroy(RequestQueue *queue);
+int queueSubmit(RequestQueue *queue, BookingRequest *request);
+int queueDrain(RequestQueue *queue, BookingRequest **batch, int max);
+void bookingCoreStart(BookingCore *core, Store *store, int lockFree);
+void bookingSubmit(BookingCore *core, BookingRequest *request);
+void bookingCoreStop(BookingCore *core);
+void waitingRoomOpen(WaitingRoom *room, double rate);
+int waitingRoomEnter(WaitingRoom *room, atomic_int *pass);
+void waitingRoomClose(WaitingRoom *room);
+void waitingRoomStop(WaitingRoom *room);
+
+// Waitlist Functions
+Waitlists *waitlistsCreate(void);
+void waitlistsDestroy(Waitlists *waitlists);
+int waitlistJoin(Store *store, int eventCode, WaitEntry *entry);
+void waitlistReturn(Store *store, int eventCode, const WaitEntry *entry);
+int waitlistLength(Store *store, int eventCode);
+void waitlistDrop(Store *store, int eventCode);
+int txnOfferSeat(WriteTxn *txn, int eventCode, int seatId, WaitEntry *served);
+
+// Benchmark Functions
+double monotonicSeconds(void);
+unsigned int benchmarkRandom(unsigned long long *state);
+int runBenchmark(const char *name, int argc, char *argv[]);
+void benchmarkQueue(int producers, int requestsPerProducer);
+void benchmarkBatch(int keys, int operations);
+void benchmarkPrefetch(int keys, int lookups);
+void benchmarkHugePages(int keys, int lookups);
+void benchmarkPhases(int events, int ticketsPerEvent);
+void benchmarkOnSale(int clients, int threads, int mode, double rate);
+void benchmarkZipf(int keys, int lookups, double theta);
+void benchmarkSkipList(int threads, int keys, int operations);
+void benchmarkHashIndex(int keys, int lookups);
+void benchmarkDataLog(int records, const char *directory);
+void benchmarkLsm(int inserts, const char *directory);
+void benchmarkPaged(int records, int poolMegabytes, const char *path);
+void benchmarkTyped(int events, int ticketsPerEvent);
+void benchmarkMove(int events, int ticketsPerEvent, int moves);
+void benchmarkEdit(int events, int ticketsPerEvent, int edits);
+void benchmarkTransfer(int events, int ticketsPerEvent, int transfers);
+void benchmarkWaitlist(int waiters, int bookings);
+
+// Journal Functions
+long long currentTimeMicros(void);
+void sleepMillis(int milliseconds);
+int journalOpen(const char *path);
+void journalClose(void);
+
+// Workload Trace Functions
+int traceOpen(const char *path);
+void traceClose(void);
+void traceRecord(const TraceRecord *record);
+void traceCode(TraceOp op, int code);
+void traceAddEvent(const Event *event);
+void traceAddTicket(const Ticket *ticket);
+int traceRead(FILE *file, TraceRecord *record);
+int runReplay(Store *store, const char *path, int realTime);
+
+// Read Replica Functions
+int replicaStart(Replica *replica, const char *path);
+void replicaStop(Replica *replica);
+void printReplicationStatus(Replica *replica);
+void replicaMenu(Replica *replica);
+
+// Event Management Functions
+void eventMenu(Store *store);
+void addEvent(Store *store);
+void findEvent(Store *store);
+void removeEvent(Store *store);
+void editEvent(Store *store);
+void moveTickets(Store *store);
+void printEvents(Store *store);
+
+// Ticket Management Functions
+void ticketMenu(Store *store);
+void addTicket(Store *store);
+void findTicket(Store *store);
+void printTicketsForEvent(Store *store);
+void scanTickets(Store *store);
+void moveSeat(Store *store);
+void cancelTicket(Store *store);
+void transferTicket(Store *store);
+int applyTransferFeed(Store *store, const char *path);
+void transferFeed(Store *store);
+
+// Venue Management Functions
+int venueStoreOpen(VenueStore *venues, int *count, const char *name, const VenueLayout *layout);
+void venueStoreClose(VenueStore *venueStore);
+void printVenues(const VenueStore *venues, int count, int current);
+void venueMenu(VenueStore *venues, int *count, int *current);
+
+// --- Process-Wide State ---
+
+static FILE *journalFile = NULL; // Booking journal this process appends its commits to (NULL = off)
+static PageMode arenaPageMode = PAGES_SMALL; // Pages new private arenas are backed with
+static VenueLayout defaultLayout;  // Seat map new stores get unless a venue brings its own
+static int adaptiveTree = 0;       // Count lookups per node and let stores reshape by them
+static DataLog *dataLog = NULL;    // Data log holding the main venue's records (NULL = off)
+static FILE *traceFile = NULL;     // Workload trace the menus record their operations to (NULL = off)
+static long long traceStart;       // Wall-clock start of the recording (microseconds)
+static long long traceLast;        // Offset of the last recorded operation (microseconds)
+
+// --- Main Function ---
+
+int main(int argc, char *argv[])
+{
+    VenueStore venues[MAX_VENUES]; // The venues this process hosts, each with its own store
+    int venueCount = 0;
+    int current = 0;               // Venue the menus work on
+    Store *store = NULL;
+    const char *sharedName = NULL;
+    size_t segmentMegabytes = DEFAULT_SEGMENT_MB;
+    const char *journalPath = NULL;
+    const char *dataLogPath = NULL;
+    const char *followPath = NULL;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    int replayRealTime = 0;
+    int createdShared = 0;
+    int choice;
+
+    venueDefault(&defaultLayout);
+
+    // --shared NAME [MB]: place the store in a shared memory segment that
+    //                     several front-end processes can open at the same time.
+    // --journal FILE:     append every commit to a booking journal.
+    // --datalog DIR:      keep the records in an append-only data log in DIR
+    //                     and load them from it at startup.
+    // --follow FILE:      run as a read-only replica fed by a booking journal.
+    // --hugepages MODE:   back the node arena with huge pages (off, thp, explicit).
+    // --adaptive:         keep frequently looked up keys near the root of the tree.
+    // --venue FILE:       load the venue's seat map (default: sections a-h of 500 seats).
+    //                     Processes sharing a store or a journal must use the same map.
+    // --record FILE:      record every operation of this session to a workload trace.
+    // --replay FILE [max|original]:
+    //                     run a recorded trace against the store configured by the
+    //                     other options, as fast as possible or at the recorded pace.
+    // --bench NAME ARGS:  run a benchmark instead of the menus.
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc)
+        {
+            sharedName = argv[++i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+            {
+                segmentMegabytes = (size_t)atol(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc)
+        {
+            journalPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--datalog") == 0 && i + 1 < argc)
+        {
+            dataLogPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--follow") == 0 && i + 1 < argc)
+        {
+            followPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0)
+        {
+            adaptiveTree = 1;
+        }
+        else if (strcmp(argv[i], "--venue") == 0 && i + 1 < argc)
+        {
+            if (!venueLoad(&defaultLayout, argv[++i]))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replayPath = argv[++i];
+            if (i + 1 < argc && (strcmp(argv[i + 1], "max") == 0 || strcmp(argv[i + 1], "original") == 0))
+            {
+                replayRealTime = strcmp(argv[++i], "original") == 0;
+            }
+        }
+        else if (strcmp(argv[i], "--hugepages") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "thp") == 0)
+                arenaPageMode = PAGES_TRANSPARENT_HUGE;
+            else if (strcmp(argv[i], "explicit") == 0)
+                arenaPageMode = PAGES_EXPLICIT_HUGE;
+            else if (strcmp(argv[i], "off") == 0)
+                arenaPageMode = PAGES_SMALL;
+            else
+            {
+                fprintf(stderr, "(!) --hugepages takes off, thp or explicit.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            return runBenchmark(argv[i + 1], argc - i - 2, &argv[i + 2]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--venue FILE] [--adaptive] [--hugepages MODE] [--shared NAME [MB]] [--journal FILE] [--datalog DIR] [--record FILE | --replay FILE [max|original]] | [--follow FILE] | [--bench NAME [ARGS]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (recordPath != NULL && replayPath != NULL)
+    {
+        fprintf(stderr, "(!) A session either records a trace or replays one.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (followPath != NULL)
+    {
+        if (sharedName != NULL || journalPath != NULL || dataLogPath != NULL || recordPath != NULL || replayPath != NULL)
+        {
+            fprintf(stderr, "(!) A replica keeps its own private store and cannot write a journal.\n");
+            return EXIT_FAILURE;
+        }
+
+        Replica replica;
+        if (!replicaStart(&replica, followPath))
+        {
+            return EXIT_FAILURE;
+        }
+        replicaMenu(&replica);
+        replicaStop(&replica);
+        printf("Program terminated successfully.\n");
+        return 0;
+    }
+
+    if (sharedName != NULL && dataLogPath != NULL)
+    {
+        fprintf(stderr, "(!) The data log keeps the records of a private store only.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sharedName != NULL)
+    {
+        store = storeOpenShared(sharedName, segmentMegabytes * 1024 * 1024, &createdShared);
+        if (store == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        printf("-> %s shared store '%s'.\n", createdShared ? "Created" : "Attached to", sharedName);
+    }
+    else
+    {
+        store = malloc(sizeof(Store));
+        if (!store)
+        {
+            perror("(!) Failed to allocate memory for the store");
+            exit(EXIT_FAILURE);
+        }
+        if (dataLogPath != NULL)
+        {
+            dataLog = logOpen(dataLogPath);
+            if (dataLog == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            storeInitLog(store, dataLog); // The records stay in the log, the tree holds where
+        }
+        else
+        {
+            storeInit(store);
+        }
+    }
+
+    if (journalPath != NULL && !journalOpen(journalPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (dataLog != NULL)
+    {
+        long loaded = logLoad(dataLog, store);
+        if (loaded < 0)
+            return EXIT_FAILURE;
+        printf("-> Loaded %ld records from the data log in '%s'.\n", loaded, dataLogPath);
+    }
+
+    if (replayPath != NULL)
+    {
+        int ok = runReplay(store, replayPath, replayRealTime);
+        if (sharedName != NULL)
+        {
+            storeCloseShared(store, sharedName, createdShared);
+        }
+        else
+        {
+            storeDestroy(store);
+            free(store);
+        }
+        journalClose();
+        if (dataLog != NULL)
+        {
+            logClose(dataLog);
+        }
+        return ok ? 0 : EXIT_FAILURE;
+    }
+
+    if (recordPath != NULL && !traceOpen(recordPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // The store opened above is the first venue; more can be opened from the venue menu.
+    strcpy(venues[0].name, "main");
+    venues[0].store = store;
+    venues[0].segment = sharedName;
+    venues[0].created = createdShared;
+    venueCount = 1;
+
+    do
+    {
+        printf("\n--- GYM MANAGEMENT MAIN MENU (venue: %s) ---\n", venues[current].name);
+        printf("1. Manage Events\n");
+        printf("2. Manage Tickets\n");
+        printf("3. Manage Venues\n");
+        printf("4. Exit and Delete All Data\n");
+        printf("Select [1-4]: ");
+        choice = getIntegerInput();
+
+        switch (choice)
+        {
+        case 1:
+            eventMenu(venues[current].store);
+            break;
+        case 2:
+            ticketMenu(venues[current].store);
+            break;
+        case 3:
+            venueMenu(venues, &venueCount, &current);
+            break;
+        case 4:
+            if (sharedName != NULL)
+            {
+                // The data is removed once the creating process and every attached one have left.
+                printf("Detaching from the shared store and terminating the program...\n");
+            }
+            else if (dataLog != NULL)
+            {
+                printf("Closing the data log, which keeps the records, and terminating the program...\n");
+            }
+            else
+            {
+                printf("Deleting all data and terminating the program...\n");
+            }
+            for (int i = 0; i < venueCount; i++)
+            {
+                venueStoreClose(&venues[i]); // Free all memory used by every version of each tree
+            }
+            break;
+        default:
+            printf("(!) Invalid choice. Please try again.\n");
+        }
+    } while (choice != 4);
+
+    traceClose();
+    journalClose();
+    if (dataLog != NULL)
+    {
+        logClose(dataLog);
+        dataLog = NULL;
+    }
+    printf("Program terminated successfully.\n");
+    return 0;
+}
+
+// --- Helper Functions ---
+
+/**
+ * @brief Clears the input buffer (stdin) to prevent issues with fgets.
+ */
+void clearInputBuffer()
+{
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF)
+        ;
+}
+
+/**
+ * @brief Reads an integer from the user safely.
+ * @return The integer entered by the user, or -1 in case of an error.
+ */
+int getIntegerInput()
+{
+    int value;
+    char buffer[100];
+    if (fgets(buffer, sizeof(buffer), stdin) != NULL)
+    {
+        if (sscanf(buffer, "%d", &value) == 1)
+        {
+            return value;
+        }
+    }
+    return -1; // Return an invalid value on failure
+}
+
+/**
+ * @brief Reads a string from the user and removes the newline character.
+ * @param buffer The buffer where the string will be stored.
+ * @param size The size of the buffer.
+ */
+void getStringInput(char *buffer, int size)
+{
+    if (fgets(buffer, size, stdin) != NULL)
+    {
+        buffer[strcspn(buffer, "\n")] = 0; // Remove the newline
+    }
+}
+
+/**
+ * @brief Validates a seat string against the seat map of a store's venue.
+ * @param seat The seat string (e.g., "c149").
+ * @return The dense seat ID, or -1 if the venue has no such seat.
+ */
+int validateSeat(const Store *store, const char *seat)
+{
+    return venueSeatId(&store->layout, seat);
+}
+
+/**
+ * @brief Builds the tree key of a ticket. The seat ID is zero-padded so an
+ * event's tickets are listed in seat map order.
+ */
+void ticketKey(char *key, int eventCode, int seatId)
+{
+    sprintf(key, "T_%d_%05u", eventCode, (unsigned int)seatId % 100000); // IDs stay below MAX_VENUE_SEATS
+}
+
+/**
+ * @brief Builds the key range [from, to) holding exactly the tickets of an
+ * event: '`' is the character after '_', so no other event's keys fall in it.
+ */
+void ticketKeyRange(char *from, char *to, int eventCode)
+{
+    sprintf(from, "T_%d_", eventCode);
+    sprintf(to, "T_%d`", eventCode);
+}
+
+// --- Venue Layout Functions ---
+
+/**
+ * @brief Adds a section to a layout being built.
+ * @return 1 on success, 0 if the name is taken or the layout is full.
+ */
+static int venueAddSection(VenueLayout *layout, char name, int seats)
+{
+    unsigned char letter = (unsigned char)tolower((unsigned char)name);
+    if (layout->sectionCount == MAX_SECTIONS || layout->sectionOf[letter] != -1 ||
+        seats < 1 || seats > MAX_VENUE_SEATS - layout->seatCount)
+        return 0;
+
+    layout->sectionName[layout->sectionCount] = name;
+    layout->sectionFirst[layout->sectionCount] = layout->seatCount;
+    layout->sectionOf[letter] = (signed char)layout->sectionCount;
+    layout->sectionCount++;
+    layout->seatCount += seats;
+    layout->sectionFirst[layout->sectionCount] = layout->seatCount;
+    return 1;
+}
+
+static void venueClear(VenueLayout *layout)
+{
+    layout->sectionCount = 0;
+    layout->seatCount = 0;
+    layout->sectionFirst[0] = 0;
+    memset(layout->sectionOf, -1, sizeof(layout->sectionOf));
+}
+
+/**
+ * @brief Sets up the original layout: sections 'a' to 'h' of 500 seats.
+ */
+void venueDefault(VenueLayout *layout)
+{
+    venueClear(layout);
+    for (char name = 'a'; name <= 'h'; name++)
+    {
+        venueAddSection(layout, name, 500);
+    }
+}
+
+/**
+ * @brief Loads a layout from a text file with one "LETTER SEATS" line per
+ * section, in seat map order. Blank lines and lines starting with '#' are
+ * skipped.
+ * @return 1 on success, 0 otherwise (the layout is left empty).
+ */
+int venueLoad(VenueLayout *layout, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror("(!) Failed to open the venue layout");
+        return 0;
+    }
+
+    char line[256];
+    int lineNumber = 0;
+    venueClear(layout);
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name;
+        int seats;
+        char extra;
+        lineNumber++;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+            continue;
+        if (sscanf(line, " %c %d %c", &name, &seats, &extra) != 2 || !isalpha((unsigned char)name) ||
+            !venueAddSection(layout, name, seats))
+        {
+            fprintf(stderr, "(!) %s:%d: expected a new section letter and 1-%d seats in all.\n",
+                    path, lineNumber, MAX_VENUE_SEATS);
+            fclose(file);
+            venueClear(layout);
+            return 0;
+        }
+    }
+    fclose(file);
+
+    if (layout->seatCount == 0)
+    {
+        fprintf(stderr, "(!) The venue layout '%s' has no sections.\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Maps a seat name (section letter, then the seat number) to its
+ * dense ID with one table lookup and no search.
+ * @return The seat ID, or -1 if the venue has no such seat.
+ */
+int venueSeatId(const VenueLayout *layout, const char *seat)
+{
+    int section = layout->sectionOf[(unsigned char)tolower((unsigned char)seat[0])];
+    if (section < 0 || !isdigit((unsigned char)seat[1]))
+        return -1;
+
+    int number = 0;
+    for (const char *digit = &seat[1]; *digit; digit++)
+    {
+        if (!isdigit((unsigned char)*digit) || number > MAX_VENUE_SEATS)
+            return -1;
+        number = number * 10 + (*digit - '0');
+    }
+
+    int first = layout->sectionFirst[section];
+    if (number < 1 || number > layout->sectionFirst[section + 1] - first)
+        return -1;
+    return first + number - 1;
+}
+
+/**
+ * @brief Writes the name of a seat (e.g., "c149") into a buffer of at
+ * least SEAT_NAME_SIZE characters.
+ */
+void venueSeatName(const VenueLayout *layout, int seatId, char *name)
+{
+    if (seatId < 0 || seatId >= layout->seatCount)
+    {
+        strcpy(name, "?");
+        return;
+    }
+
+    // Binary search for the last section starting at or before the seat.
+    int low = 0;
+    int high = layout->sectionCount - 1;
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (layout->sectionFirst[middle] <= seatId)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    sprintf(name, "%c%d", layout->sectionName[low], seatId - layout->sectionFirst[low] + 1);
+}
+
+// --- Relative Pointer Helpers ---
+
+/**
+ * @brief Resolves a relative link to the address it points to.
+ */
+void *relGet(const RelPtr *field)
+{
+    if (*field == 0)
+        return NULL;
+    return (void *)((uintptr_t)field + (uintptr_t)*field);
+}
+
+/**
+ * @brief Stores a link to target as its distance from the field.
+ */
+void relSet(RelPtr *field, const void *target)
+{
+    *field = target ? (RelPtr)((uintptr_t)target - (uintptr_t)field) : 0;
+}
+
+TreeNode *nodeLeft(const TreeNode *node)
+{
+    return (TreeNode *)relGet(&node->left);
+}
+
+TreeNode *nodeRight(const TreeNode *node)
+{
+    return (TreeNode *)relGet(&node->right);
+}
+
+void setLeft(TreeNode *node, TreeNode *child)
+{
+    relSet(&node->left, child);
+}
+
+void setRight(TreeNode *node, TreeNode *child)
+{
+    relSet(&node->right, child);
+}
+
+// --- Tree Management Functions ---
+
+/**
+ * @brief Creates a new node for the tree.
+ */
+TreeNode *createNode(const char *key, NodeType type, void *data)
+{
+    TreeNode *newNode = (TreeNode *)malloc(sizeof(TreeNode));
+    if (!newNode)
+    {
+        perror("(!) Failed to allocate memory for new node");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(newNode->key, key);
+    newNode->type = type;
+
+    if (type == EVENT_NODE)
+    {
+        newNode->data.eventData = *(Event *)data;
+    }
+    else
+    {
+        newNode->data.ticketData = *(Ticket *)data;
+    }
+
+    newNode->left = newNode->right = 0; // NULL links
+    newNode->version = 0;
+    atomic_init(&newNode->hits, 0);
+    return newNode;
+}
+
+/**
+ * @brief Inserts a new node into the binary search tree.
+ */
+TreeNode *insertNode(TreeNode *root, const char *key, NodeType type, void *data)
+{
+    if (root == NULL)
+    {
+        return createNode(key, type, data);
+    }
+
+    int cmp = strcmp(key, root->key);
+    if (cmp < 0)
+    {
+        setLeft(root, insertNode(nodeLeft(root), key, type, data));
+    }
+    else if (cmp > 0)
+    {
+        setRight(root, insertNode(nodeRight(root), key, type, data));
+    }
+    // If the key already exists, do nothing.
+    return root;
+}
+
+/**
+ * @brief Searches for a node in the tree based on its key.
+ */
+TreeNode *searchNode(TreeNode *root, const char *key)
+{
+    if (root == NULL || strcmp(root->key, key) == 0)
+    {
+        if (root != NULL && adaptiveTree)
+            atomic_fetch_add_explicit(&root->hits, 1, memory_order_relaxed);
+        return root;
+    }
+
+    if (strcmp(key, root->key) < 0)
+    {
+        return searchNode(nodeLeft(root), key);
+    }
+    else
+    {
+        return searchNode(nodeRight(root), key);
+    }
+}
+
+/**
+ * @brief Starts loading the parts of a node a search step reads: the key
+ * and the child links, which sit in different cache lines.
+ */
+static void prefetchNode(const TreeNode *node)
+{
+    PREFETCH(node->key);
+    PREFETCH(&node->left);
+}
+
+/**
+ * @brief Runs up to width searches at once (AMAC-style interleaving): each
+ * search takes one step, prefetches the child it moves to and yields to the
+ * next search, so the cache misses of different searches overlap instead of
+ * stalling one after the other. A finished search slot picks up the next key.
+ */
+static void searchNodeInterleaved(TreeNode *root, const char *const *keys, TreeNode **results, int count, int width)
+{
+    TreeNode *current[MAX_LOOKUP_GROUP];
+    int index[MAX_LOOKUP_GROUP];
+    int active = 0;
+    int next = 0;
+
+    if (width > MAX_LOOKUP_GROUP)
+        width = MAX_LOOKUP_GROUP;
+    while (active < width && next < count)
+    {
+        index[active] = next++;
+        current[active++] = root;
+    }
+
+    while (active > 0)
+    {
+        for (int slot = 0; slot < active;)
+        {
+            TreeNode *node = current[slot];
+            int cmp = node != NULL ? strcmp(keys[index[slot]], node->key) : 0;
+            if (cmp == 0)
+            {
+                if (node != NULL && adaptiveTree)
+                    atomic_fetch_add_explicit(&node->hits, 1, memory_order_relaxed);
+                results[index[slot]] = node; // Found, or fell off the tree
+                if (next < count)
+                {
+                    index[slot] = next++;
+                    current[slot++] = root; // The root is always cached
+                }
+                else
+                {
+                    // Retire the slot by moving the last active search into it.
+                    active--;
+                    index[slot] = index[active];
+                    current[slot] = current[active];
+                }
+                continue;
+            }
+
+            node = cmp < 0 ? nodeLeft(node) : nodeRight(node);
+            if (node != NULL)
+                prefetchNode(node);
+            current[slot++] = node;
+        }
+    }
+}
+
+/**
+ * @brief Searches for many independent keys at once, overlapping their
+ * cache misses. results[i] receives the node for keys[i] (or NULL).
+ */
+void searchNodeBatch(TreeNode *root, const char *const *keys, TreeNode **results, int count)
+{
+    searchNodeInterleaved(root, keys, results, count, LOOKUP_GROUP);
+}
+
+/**
+ * @brief Finds the node with the minimum value (key) in a subtree.
+ */
+TreeNode *findMin(TreeNode *node)
+{
+    TreeNode *current = node;
+    while (current && nodeLeft(current) != NULL)
+    {
+        current = nodeLeft(current);
+    }
+    return current;
+}
+
+/**
+ * @brief Deletes a node from the tree based on its key.
+ */
+TreeNode *deleteNode(TreeNode *root, const char *key)
+{
+    if (root == NULL)
+        return root;
+
+    int cmp = strcmp(key, root->key);
+    if (cmp < 0)
+    {
+        setLeft(root, deleteNode(nodeLeft(root), key));
+    }
+    else if (cmp > 0)
+    {
+        setRight(root, deleteNode(nodeRight(root), key));
+    }
+    else
+    {
+        // Node with only one child or no child
+        if (nodeLeft(root) == NULL)
+        {
+            TreeNode *temp = nodeRight(root);
+            free(root);
+            return temp;
+        }
+        else if (nodeRight(root) == NULL)
+        {
+            TreeNode *temp = nodeLeft(root);
+            free(root);
+            return temp;
+        }
+
+        // Node with two children
+        TreeNode *temp = findMin(nodeRight(root));
+        strcpy(root->key, temp->key);
+        root->type = temp->type;
+        root->data = temp->data;
+        setRight(root, deleteNode(nodeRight(root), temp->key));
+    }
+    return root;
+}
+
+/**
+ * @brief Recursively frees the memory of all nodes in the tree.
+ */
+void freeTree(TreeNode *root)
+{
+    if (root == NULL)
+        return;
+    freeTree(nodeLeft(root));
+    freeTree(nodeRight(root));
+    free(root);
+}
+
+/**
+ * @brief Traverses the tree inorder and prints information,
+ * filtering by node type and optionally by event code. Seats are named
+ * after the store's venue layout.
+ */
+void inorderTraversalPrint(const Store *store, TreeNode *root, NodeType filterType, int eventCodeFilter)
+{
+    if (root == NULL)
+        return;
+
+    inorderTraversalPrint(store, nodeLeft(root), filterType, eventCodeFilter);
+
+    if (root->type == filterType)
+    {
+        if (filterType == EVENT_NODE)
+        {
+            const Event *event = &nodeRecord(store, root)->eventData;
+            printf("----------------------------------------\n");
+            printf("  Event Code: %d\n", event->code);
+            printf("  Title: %s\n", event->title);
+            printf("  Date: %s\n", event->date);
+            printf("  Time: %s\n", event->time);
+            printf("----------------------------------------\n");
+        }
+        else if (filterType == TICKET_NODE)
+        {
+            if (eventCodeFilter == -1 || atoi(root->key + 2) == eventCodeFilter)
+            {
+                const Ticket *ticket = &nodeRecord(store, root)->ticketData;
+                char seat[SEAT_NAME_SIZE];
+                venueSeatName(&store->layout, ticket->seatId, seat);
+                printf("----------------------------------------\n");
+                printf("  Event (Code): %d\n", ticket->eventCode);
+                printf("  Seat: %s\n", seat);
+                printf("  First Name: %s\n", ticket->firstName);
+                printf("  Last Name: %s\n", ticket->lastName);
+                printf("  Tax ID: %s\n", ticket->afm);
+                printf("----------------------------------------\n");
+            }
+        }
+    }
+
+    inorderTraversalPrint(store, nodeRight(root), filterType, eventCodeFilter);
+}
+
+/**
+ * @brief Counts the nodes inorderTraversalPrint() would print for the same
+ * filter, walking the tree the same way. A ticket's event code is read from
+ * its key (see ticketKey()), so no record is touched.
+ */
+long countNodes(TreeNode *root, NodeType filterType, int eventCodeFilter)
+{
+    if (root == NULL)
+        return 0;
+
+    long count = countNodes(nodeLeft(root), filterType, eventCodeFilter);
+    if (root->type == filterType &&
+        (filterType == EVENT_NODE || eventCodeFilter == -1 || atoi(root->key + 2) == eventCodeFilter))
+    {
+        count++;
+    }
+    return count + countNodes(nodeRight(root), filterType, eventCodeFilter);
+}
+
+/**
+ * @brief Counts the nodes with keys in [from, to), visiting only the
+ * subtrees that can hold them.
+ */
+long countKeyRange(TreeNode *root, const char *from, const char *to)
+{
+    long count = 0;
+    while (root != NULL)
+    {
+        if (strcmp(root->key, from) < 0)
+        {
+            root = nodeRight(root);
+        }
+        else if (strcmp(root->key, to) >= 0)
+        {
+            root = nodeLeft(root);
+        }
+        else
+        {
+            count += 1 + countKeyRange(nodeLeft(root), from, to);
+            root = nodeRight(root);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Order-sensitive checksum of the keys of a tree, to check that two
+ * ways of applying the same operations produced the same tree contents.
+ */
+unsigned long long treeChecksum(TreeNode *root, unsigned long long hash)
+{
+    if (root == NULL)
+        return hash;
+    hash = treeChecksum(nodeLeft(root), hash);
+    for (const char *c = root->key; *c; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL; // FNV-1a
+    }
+    hash = (hash ^ 0xFF) * 1099511628211ULL; // Key separator
+    return treeChecksum(nodeRight(root), hash);
+}
+
+/**
+ * @brief Collects the keys in [from, to), in order, visiting only the
+ * subtrees that can hold them.
+ */
+static void collectKeyRange(TreeNode *root, const char *from, const char *to, char ***keys, int *count,
+                            int *capacity)
+{
+    while (root != NULL)
+    {
+        if (strcmp(root->key, from) < 0)
+        {
+            root = nodeRight(root);
+            continue;
+        }
+        if (strcmp(root->key, to) >= 0)
+        {
+            root = nodeLeft(root);
+            continue;
+        }
+
+        collectKeyRange(nodeLeft(root), from, to, keys, count, capacity);
+        if (*count >= *capacity)
+        {
+            *capacity *= 2;
+            *keys = realloc(*keys, *capacity * sizeof(char *));
+            if (!*keys)
+            {
+                perror("(!) Realloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        (*keys)[*count] = strdup(root->key);
+        (*count)++;
+        root = nodeRight(root);
+    }
+}
+
+/**
+ * @brief Collects the keys of all tickets belonging to a specific event.
+ * Used for bulk deletion before deleting the event itself. The tickets of
+ * an event form one key range, so the rest of the tree is skipped.
+ */
+void collectTicketKeysForEvent(TreeNode *root, int eventCode, char ***keys, int *count, int *capacity)
+{
+    char from[20];
+    char to[20];
+    ticketKeyRange(from, to, eventCode);
+    collectKeyRange(root, from, to, keys, count, capacity);
+}
+
+// --- Typed Tree Functions ---
+
+// Keys compare as numbers, inline, instead of through strcmp().
+#define COMPARE_NUMBERS(a, b) (((a) > (b)) - ((a) < (b)))
+#define EVENT_TREE_KEY(event) ((event)->code)
+#define TICKET_TREE_KEY(ticket) ticketOrderKey((ticket)->eventCode, (ticket)->seatId)
+
+/**
+ * @brief Ordering key of a ticket in a TicketTree: by event, then by seat,
+ * so the tickets of an event form one key range.
+ */
+int64_t ticketOrderKey(int eventCode, int seatId)
+{
+    return (int64_t)eventCode * 4294967296LL + seatId;
+}
+
+// Generates the functions TYPED_TREE_DECLARE declares, for records whose
+// key keyOf(record) extracts:
+//   Insert:     adds a copy of the record; *inserted is 0 if its key exists.
+//   Search:     the node of a key, or NULL.
+//   Delete:     removes the node of a key; *deleted tells whether there was one.
+//   CountRange: the number of keys in [from, to), visiting only the subtrees
+//               that can hold them.
+//   Free:       frees every node.
+#define TYPED_TREE_DEFINE(Name, prefix, Type, KeyType, keyOf)                         \
+    Name##Node *prefix##Insert(Name##Node *root, const Type *value, int *inserted)     \
+    {                                                                                  \
+        KeyType key = keyOf(value);                                                    \
+        Name##Node **link = &root;                                                     \
+        while (*link != NULL)                                                          \
+        {                                                                              \
+            int cmp = COMPARE_NUMBERS(key, keyOf(&(*link)->value));                    \
+            if (cmp == 0)                                                              \
+            {                                                                          \
+                *inserted = 0;                                                         \
+                return root;                                                           \
+            }                                                                          \
+            link = cmp < 0 ? &(*link)->left : &(*link)->right;                         \
+        }                                                                              \
+        Name##Node *node = malloc(sizeof(Name##Node));                                 \
+        if (!node)                                                                     \
+        {                                                                              \
+            perror("(!) Failed to allocate memory for new node");                      \
+            exit(EXIT_FAILURE);                                                        \
+        }                                                                              \
+        node->value = *value;                                                          \
+        node->left = node->right = NULL;                                               \
+        *link = node;                                                                  \
+        *inserted = 1;                                                                 \
+        return root;                                                                   \
+    }                                                                                  \
+                                                                                       \
+    Name##Node *prefix##Search(Name##Node *root, KeyType key)                          \
+    {                                                                                  \
+        while (root != NULL)                                                           \
+        {                                                                              \
+            int cmp = COMPARE_NUMBERS(key, keyOf(&root->value));                       \
+            if (cmp == 0)                                                              \
+                return root;                                                           \
+            root = cmp < 0 ? root->left : root->right;                                 \
+        }                                                                              \
+        return NULL;                                                                   \
+    }                                                                                  \
+                                                                                       \
+    Name##Node *prefix##Delete(Name##Node *root, KeyType key, int *deleted)            \
+    {                                                                                  \
+        Name##Node **link = &root;                                                     \
+        while (*link != NULL)                                                          \
+        {                                                                              \
+            int cmp = COMPARE_NUMBERS(key, keyOf(&(*link)->value));                    \
+            if (cmp == 0)                                                              \
+                break;                                                                 \
+            link = cmp < 0 ? &(*link)->left : &(*link)->right;                         \
+        }                                                                              \
+        *deleted = *link != NULL;                                                      \
+        if (*link == NULL)                                                             \
+            return root;                                                               \
+                                                                                       \
+        Name##Node *node = *link;                                                      \
+        if (node->left != NULL && node->right != NULL)                                 \
+        {                                                                              \
+            /* Two children: keep the successor's record, unlink the successor */      \
+            Name##Node **successor = &node->right;                                     \
+            while ((*successor)->left != NULL)                                         \
+            {                                                                          \
+                successor = &(*successor)->left;                                       \
+            }                                                                          \
+            node->value = (*successor)->value;                                         \
+            link = successor;                                                          \
+            node = *successor;                                                         \
+        }                                                                              \
+        *link = node->left != NULL ? node->left : node->right;                         \
+        free(node);                                                                    \
+        return root;                                                                   \
+    }                                                                                  \
+                                                                                       \
+    long prefix##CountRange(const Name##Node *root, KeyType from, KeyType to)          \
+    {                                                                                  \
+        long count = 0;                                                                \
+        while (root != NULL)                                                           \
+        {                                                                              \
+            KeyType key = keyOf(&root->value);                                         \
+            if (key < from)                                                            \
+            {                                                                          \
+                root = root->right;                                                    \
+            }                                                                          \
+            else if (key >= to)                                                        \
+            {                                                                          \
+                root = root->left;                                                     \
+            }                                                                          \
+            else                                                                       \
+            {                                                                          \
+                count += 1 + prefix##CountRange(root->left, from, to);                 \
+                root = root->right;                                                    \
+            }                                                                          \
+        }                                                                              \
+        return count;                                                                  \
+    }                                                                                  \
+                                                                                       \
+    void prefix##Free(Name##Node *root)                                                \
+    {                                                                                  \
+        while (root != NULL)                                                           \
+        {                                                                              \
+            Name##Node *right = root->right;                                           \
+            prefix##Free(root->left);                                                  \
+            free(root);                                                                \
+            root = right;                                                              \
+        }                                                                              \
+    }
+
+TYPED_TREE_DEFINE(EventTree, eventTree, Event, int, EVENT_TREE_KEY)
+TYPED_TREE_DEFINE(TicketTree, ticketTree, Ticket, int64_t, TICKET_TREE_KEY)
+
+// --- Node Arena Functions ---
+
+/**
+ * @brief Initializes a mutex, process-shared (and robust against a process
+ * dying while holding it) when it lives in a shared segment.
+ */
+static void initStoreMutex(pthread_mutex_t *mutex, int shared)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#ifndef _WIN32
+    if (shared)
+    {
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+#else
+    (void)shared;
+#endif
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/**
+ * @brief Locks a store mutex, recovering it if its previous owner died.
+ * The data it guards is still consistent: a writer that dies before its
+ * commit never published anything.
+ */
+static void lockStoreMutex(pthread_mutex_t *mutex)
+{
+    int rc = pthread_mutex_lock(mutex);
+#ifndef _WIN32
+    if (rc == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(mutex);
+    }
+#else
+    (void)rc;
+#endif
+}
+
+/**
+ * @brief Initializes an empty arena.
+ * @param shared 1 if the arena lives in a shared segment (fixed size).
+ * @param slotSize Bytes per slot: sizeof(ArenaSlot), or as little as
+ * offsetof(TreeNode, data) plus the record location for the nodes of a
+ * store backed by a data log. Every slot still holds a Version.
+ */
+void arenaInit(NodeArena *arena, int shared, size_t slotSize)
+{
+    initStoreMutex(&arena->lock, shared);
+    arena->chunks = 0;
+    arena->freeList = 0;
+    arena->growable = !shared;
+    arena->pageMode = arenaPageMode;
+    arena->slotSize = (slotSize + sizeof(RelPtr) - 1) / sizeof(RelPtr) * sizeof(RelPtr);
+    arena->retireCapacity = (int)((arena->slotSize - offsetof(RetireBlock, nodes)) / sizeof(RelPtr));
+    if (arena->retireCapacity > RETIRE_BLOCK_SIZE)
+        arena->retireCapacity = RETIRE_BLOCK_SIZE;
+    arena->slotsInUse = 0;
+    arena->chunkCount = 0;
+    arena->hugeChunks = 0;
+}
+
+/**
+ * @brief Gets the memory for a new chunk of a private arena, with the
+ * requested page size if the system provides it.
+ * @param backing Set to how the memory was obtained.
+ */
+static void *arenaMapChunk(NodeArena *arena, int *backing)
+{
+#if defined(__linux__)
+    static int warned = 0;
+
+    if (arena->pageMode == PAGES_EXPLICIT_HUGE)
+    {
+        void *memory = mmap(NULL, ARENA_CHUNK_BYTES, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            *backing = CHUNK_MAPPED;
+            return memory;
+        }
+        if (!warned)
+        {
+            warned = 1;
+            fprintf(stderr, "(!) No reserved huge pages (vm.nr_hugepages), using transparent huge pages.\n");
+        }
+    }
+    if (arena->pageMode != PAGES_SMALL)
+    {
+        // Map twice the size and keep the 2 MB-aligned middle, which the
+        // kernel can back with a single huge page.
+        size_t span = ARENA_CHUNK_BYTES + HUGE_PAGE_SIZE;
+        char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED)
+        {
+            char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+            char *end = aligned + ARENA_CHUNK_BYTES;
+            if (aligned > raw)
+                munmap(raw, aligned - raw);
+            if (raw + span > end)
+                munmap(end, raw + span - end);
+#ifdef MADV_HUGEPAGE
+            madvise(aligned, ARENA_CHUNK_BYTES, MADV_HUGEPAGE);
+#endif
+            *backing = CHUNK_MAPPED;
+            return aligned;
+        }
+    }
+#endif
+    *backing = CHUNK_MALLOC;
+    return malloc(ARENA_CHUNK_BYTES);
+}
+
+/**
+ * @brief Hands a block of memory to the arena as a new chunk of slots.
+ */
+void arenaAddChunk(NodeArena *arena, void *memory, size_t bytes)
+{
+    ArenaChunk *chunk = (ArenaChunk *)memory;
+    chunk->bytes = bytes;
+    chunk->backing = CHUNK_EXTERNAL;
+    chunk->capacity = (bytes - sizeof(ArenaChunk)) / arena->slotSize;
+    chunk->used = 0;
+    arena->chunkCount++;
+    relSet(&chunk->next, relGet(&arena->chunks));
+    relSet(&arena->chunks, chunk);
+}
+
+/**
+ * @brief Allocates one slot, reusing freed slots first.
+ * Exits the program if a shared segment is full, like any other allocation failure.
+ */
+ArenaSlot *arenaAlloc(NodeArena *arena)
+{
+    ArenaSlot *slot;
+
+    lockStoreMutex(&arena->lock);
+    slot = (ArenaSlot *)relGet(&arena->freeList);
+    if (slot != NULL)
+    {
+        relSet(&arena->freeList, relGet(&slot->nextFree));
+    }
+    else
+    {
+        ArenaChunk *chunk = (ArenaChunk *)relGet(&arena->chunks);
+        if (chunk == NULL || chunk->used == chunk->capacity)
+        {
+            if (!arena->growable)
+            {
+                pthread_mutex_unlock(&arena->lock);
+                fprintf(stderr, "(!) The shared store segment is full.\n");
+                exit(EXIT_FAILURE);
+            }
+            int backing;
+            void *memory = arenaMapChunk(arena, &backing);
+            if (!memory)
+            {
+                perror("(!) Failed to allocate memory for the node arena");
+                exit(EXIT_FAILURE);
+            }
+            arenaAddChunk(arena, memory, ARENA_CHUNK_BYTES);
+            chunk = (ArenaChunk *)memory;
+            chunk->backing = backing;
+            arena->hugeChunks += backing == CHUNK_MAPPED;
+        }
+        slot = (ArenaSlot *)((char *)chunk->slots + chunk->used++ * arena->slotSize);
+    }
+    arena->slotsInUse++;
+    pthread_mutex_unlock(&arena->lock);
+    return slot;
+}
+
+/**
+ * @brief Returns a slot to the arena's free list.
+ */
+void arenaFree(NodeArena *arena, void *slot)
+{
+    ArenaSlot *freed = (ArenaSlot *)slot;
+
+    lockStoreMutex(&arena->lock);
+    relSet(&freed->nextFree, relGet(&arena->freeList));
+    relSet(&arena->freeList, freed);
+    arena->slotsInUse--;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * @brief Releases every chunk of a private arena at once.
+ * Shared arenas are released together with their segment.
+ */
+void arenaDestroy(NodeArena *arena)
+{
+    if (arena->growable)
+    {
+        ArenaChunk *chunk = (ArenaChunk *)relGet(&arena->chunks);
+        while (chunk != NULL)
+        {
+            ArenaChunk *next = (ArenaChunk *)relGet(&chunk->next);
+            if (chunk->backing == CHUNK_MALLOC)
+                free(chunk);
+#ifndef _WIN32
+            else if (chunk->backing == CHUNK_MAPPED)
+                munmap(chunk, chunk->bytes);
+#endif
+            chunk = next;
+        }
+    }
+    arena->chunks = 0;
+    arena->freeList = 0;
+    arena->slotsInUse = 0;
+    arena->chunkCount = 0;
+    arena->hugeChunks = 0;
+    pthread_mutex_destroy(&arena->lock);
+}
+
+// --- Versioned Store (MVCC) Functions ---
+
+/**
+ * @brief Returns the record (the Event or Ticket) of a node of a store. A
+ * store backed by a data log reads it from the log's memory map, or, for a
+ * node the open transaction gave a new record, from the pending records.
+ * A pending record may move when the transaction adds another one.
+ */
+const NodeData *nodeRecord(const Store *store, const TreeNode *node)
+{
+    if (store->log == NULL)
+        return &node->data;
+    uint64_t location = atomic_load_explicit(&node->location, memory_order_acquire); // A merge may be moving it
+    if (location & LOG_PENDING)
+        return &store->pending[location & ~LOG_PENDING];
+
+    const LogSegment *segment = store->log->segments[LOG_SLOT(location)];
+    return (const NodeData *)(segment->map + LOG_OFFSET(location) + sizeof(LogRecord));
+}
+
+/**
+ * @brief Sets the type and record of a node the open transaction created.
+ * In a store backed by a data log the record waits among the pending
+ * records until the commit writes it to the log (see logWriteCommit()).
+ */
+static void nodeSetRecord(Store *store, TreeNode *node, NodeType type, const void *data)
+{
+    node->type = type;
+    if (store->log == NULL)
+    {
+        if (type == EVENT_NODE)
+            node->data.eventData = *(const Event *)data;
+        else
+            node->data.ticketData = *(const Ticket *)data;
+        return;
+    }
+
+    NodeData record; // data may be a pending record, which growing the array moves
+    memcpy(&record, data, type == EVENT_NODE ? sizeof(Event) : sizeof(Ticket));
+    if (store->pendingCount >= store->pendingCapacity)
+    {
+        store->pendingCapacity = store->pendingCapacity ? store->pendingCapacity * 2 : 64;
+        store->pending = realloc(store->pending, store->pendingCapacity * sizeof(NodeData));
+        if (!store->pending)
+        {
+            perror("(!) Realloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    store->pending[store->pendingCount] = record;
+    node->location = LOG_PENDING | store->pendingCount++;
+}
+
+/**
+ * @brief Gives a node the type and record of another one. In a store
+ * backed by a data log both then share the record's location; a record is
+ * never changed in place, so neither sees the other's later changes.
+ */
+static void nodeCopyRecord(const Store *store, TreeNode *to, const TreeNode *from)
+{
+    to->type = from->type;
+    if (store->log != NULL)
+        to->location = from->location;
+    else
+        to->data = from->data;
+}
+
+/**
+ * @brief Creates a tree node in the store's arena.
+ */
+static TreeNode *storeNewNode(Store *store, const char *key, NodeType type, void *data, unsigned long version)
+{
+    TreeNode *newNode = &arenaAlloc(&store->arena)->node;
+    strcpy(newNode->key, key);
+    nodeSetRecord(store, newNode, type, data);
+    newNode->left = newNode->right = 0; // NULL links
+    newNode->version = version;
+    atomic_init(&newNode->hits, 0);
+    return newNode;
+}
+
+/**
+ * @brief Loads the head version (an atomic relative link).
+ */
+static Version *storeHead(Store *store)
+{
+    RelPtr offset = atomic_load(&store->head);
+    return (Version *)((uintptr_t)&store->head + (uintptr_t)offset);
+}
+
+/**
+ * @brief Publishes a new head version.
+ */
+static void storeSetHead(Store *store, Version *version)
+{
+    atomic_store(&store->head, (RelPtr)((uintptr_t)version - (uintptr_t)&store->head));
+}
+
+/**
+ * @brief Background collector: periodically frees versions no reader can see.
+ * It also wakes up after every commit, so the reshape goes by the clock.
+ */
+static void *gcWorker(void *arg)
+{
+    Store *store = (Store *)arg;
+    double lastReshape = monotonicSeconds();
+
+    lockStoreMutex(&store->gcLock);
+    while (!store->gcStop)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += GC_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&store->gcWake, &store->gcLock, &deadline);
+
+        pthread_mutex_unlock(&store->gcLock);
+        storeCollect(store);
+        if (store->adaptive && (monotonicSeconds() - lastReshape) * 1000 >= RESHAPE_INTERVAL_MS)
+        {
+            storeReshape(store, 1, RESHAPE_MAX_NODES);
+            lastReshape = monotonicSeconds();
+        }
+        lockStoreMutex(&store->gcLock);
+    }
+    pthread_mutex_unlock(&store->gcLock);
+    return NULL;
+}
+
+/**
+ * @brief Sets up an empty store (version 1) in already allocated memory and
+ * starts its collector. The arena must be initialized by the caller.
+ */
+static void storeSetup(Store *store, int shared)
+{
+    pthread_condattr_t condAttr;
+
+    initStoreMutex(&store->writeLock, shared);
+    atomic_init(&store->writersWaiting, 0);
+    store->reshapeFrom[0] = '\0';
+    initStoreMutex(&store->gcLock, shared);
+    pthread_condattr_init(&condAttr);
+#ifndef _WIN32
+    if (shared)
+    {
+        pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+    }
+#endif
+    pthread_cond_init(&store->gcWake, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+
+    Version *initial = &arenaAlloc(&store->arena)->version;
+    initial->number = 1;
+    initial->root = initial->retired = initial->next = 0;
+
+    storeSetHead(store, initial);
+    atomic_init(&store->committed, initial->number);
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        atomic_init(&store->readers[i], 0);
+    }
+    relSet(&store->oldest, initial);
+    store->gcStop = 0;
+
+    if (pthread_create(&store->gcThread, NULL, gcWorker, store) != 0)
+    {
+        perror("(!) Failed to start the version collector");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Stops the collector thread of this process.
+ */
+static void storeStopCollector(Store *store)
+{
+    lockStoreMutex(&store->gcLock);
+    store->gcStop = 1;
+    pthread_cond_signal(&store->gcWake);
+    pthread_mutex_unlock(&store->gcLock);
+    pthread_join(store->gcThread, NULL);
+}
+
+/**
+ * @brief Initializes an empty private store, its records either in the
+ * nodes or in a data log, and starts its collector.
+ */
+static void storeInitPrivate(Store *store, DataLog *log)
+{
+    atomic_init(&store->magic, 0);
+    store->segmentSize = 0;
+    store->layout = defaultLayout;
+    store->adaptive = adaptiveTree;
+    store->carriedHits = 0;
+    store->index = indexCreate();
+    store->waitlists = waitlistsCreate();
+    store->log = log;
+    store->pending = NULL;
+    store->pendingCount = store->pendingCapacity = 0;
+    arenaInit(&store->arena, 0, log != NULL ? offsetof(TreeNode, location) + sizeof(uint64_t) : sizeof(ArenaSlot));
+    storeSetup(store, 0);
+}
+
+/**
+ * @brief Initializes an empty private store and starts its collector.
+ * The store books the default venue layout.
+ */
+void storeInit(Store *store)
+{
+    storeInitPrivate(store, NULL);
+}
+
+/**
+ * @brief Initializes an empty private store whose records stay in a data
+ * log: its nodes hold only a key, links and where the log keeps the record,
+ * so the arena hands out slots of that size. The log's merges repoint the
+ * nodes at the records they move; it must stay open until the store is
+ * destroyed. See logLoad() for filling the store.
+ */
+void storeInitLog(Store *store, DataLog *log)
+{
+    storeInitPrivate(store, log);
+    logSetStore(log, store);
+}
+
+/**
+ * @brief Stops the collector and frees every version of a private store.
+ * No reader or writer may be active.
+ */
+void storeDestroy(Store *store)
+{
+    if (store->log != NULL)
+        logSetStore(store->log, NULL); // Waits for a merge repointing the nodes
+    storeStopCollector(store);
+
+    // Every node, version and retire block lives in the arena.
+    arenaDestroy(&store->arena);
+    store->head = 0;
+    store->oldest = 0;
+    if (store->index != NULL)
+        indexDestroy(store->index);
+    store->index = NULL;
+    if (store->waitlists != NULL)
+        waitlistsDestroy(store->waitlists);
+    store->waitlists = NULL;
+    free(store->pending);
+    store->pending = NULL;
+
+    pthread_mutex_destroy(&store->writeLock);
+    pthread_mutex_destroy(&store->gcLock);
+    pthread_cond_destroy(&store->gcWake);
+}
+
+/**
+ * @brief Creates or attaches to a store in a named shared memory segment.
+ * The creating process initializes the segment and runs the collector;
+ * other processes read and book against the same tree in place.
+ * @param name The segment name (e.g., "/gym_main_hall").
+ * @param size The segment size in bytes, used only when creating it.
+ * @param created Set to 1 if this process created the segment.
+ * @return The mapped store, or NULL on failure.
+ */
+Store *storeOpenShared(const char *name, size_t size, int *created)
+{
+#ifndef _WIN32
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    *created = fd >= 0;
+    if (fd < 0)
+    {
+        if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0600)) < 0)
+        {
+            perror("(!) Failed to open the shared store segment");
+            return NULL;
+        }
+    }
+
+    if (*created)
+    {
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            perror("(!) Failed to size the shared store segment");
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    }
+    else
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            perror("(!) Failed to inspect the shared store segment");
+            close(fd);
+            return NULL;
+        }
+        size = (size_t)st.st_size;
+    }
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        perror("(!) Failed to map the shared store segment");
+        if (*created)
+            shm_unlink(name);
+        return NULL;
+    }
+
+    Store *store = (Store *)base;
+    if (*created)
+    {
+        // The store header is followed by the arena's only chunk.
+        size_t header = (sizeof(Store) + sizeof(ArenaSlot) - 1) / sizeof(ArenaSlot) * sizeof(ArenaSlot);
+        store->segmentSize = size;
+        store->layout = defaultLayout; // Attaching processes book with the creator's seat map
+        store->adaptive = adaptiveTree;
+        store->carriedHits = 0;
+        store->index = NULL; // The index lives in process memory, which other processes cannot see
+        store->waitlists = NULL;
+        store->log = NULL;
+        store->pending = NULL;
+        store->pendingCount = store->pendingCapacity = 0;
+        arenaInit(&store->arena, 1, sizeof(ArenaSlot));
+        arenaAddChunk(&store->arena, (char *)base + header, size - header);
+        storeSetup(store, 1);
+        atomic_store(&store->magic, STORE_MAGIC); // Publish last: attachers wait for it
+    }
+    else
+    {
+        // The creator may still be initializing the segment.
+        for (int tries = 0; atomic_load(&store->magic) != STORE_MAGIC; tries++)
+        {
+            if (tries == 1000 || size < sizeof(Store))
+            {
+                fprintf(stderr, "(!) '%s' is not an initialized store segment.\n", name);
+                munmap(base, size);
+                return NULL;
+            }
+            usleep(1000);
+        }
+    }
+    return store;
+#else
+    (void)name;
+    (void)size;
+    *created = 0;
+    fprintf(stderr, "(!) Shared memory stores are not supported on this platform.\n");
+    return NULL;
+#endif
+}
+
+/**
+ * @brief Detaches from a shared store. The creating process also stops the
+ * collector and removes the segment name; attached processes keep their
+ * mapping until they detach.
+ */
+void storeCloseShared(Store *store, const char *name, int created)
+{
+#ifndef _WIN32
+    if (created)
+    {
+        storeStopCollector(store);
+        shm_unlink(name);
+    }
+    munmap(store, store->segmentSize);
+#else
+    (void)store;
+    (void)name;
+    (void)created;
+#endif
+}
+
+/**
+ * @brief Opens a read snapshot of the latest committed version.
+ * Lock-free: the reader only publishes the version it pins in a slot.
+ */
+Snapshot storeBeginRead(Store *store)
+{
+    Snapshot snapshot;
+
+    for (;;)
+    {
+        // The pinned number may lag behind the head we read next, never exceed it,
+        // so the collector keeps everything reachable from that head.
+        unsigned long pin = atomic_load(&store->committed);
+        for (int i = 0; i < MAX_READERS; i++)
+        {
+            unsigned long expected = 0;
+            if (atomic_compare_exchange_strong(&store->readers[i], &expected, pin))
+            {
+                Version *head = storeHead(store);
+                snapshot.root = (TreeNode *)relGet(&head->root);
+                snapshot.version = head->number;
+                snapshot.slot = i;
+                return snapshot;
+            }
+        }
+        sched_yield(); // Every slot is taken, wait for a reader to finish
+    }
+}
+
+/**
+ * @brief Closes a read snapshot, allowing its version to be collected.
+ */
+void storeEndRead(Store *store, Snapshot *snapshot)
+{
+    atomic_store(&store->readers[snapshot->slot], 0);
+    snapshot->root = NULL;
+}
+
+/**
+ * @brief Starts a write transaction on top of the latest committed version.
+ * Writers are serialized; the transaction must end with a commit or an abort.
+ */
+void storeBeginWrite(Store *store, WriteTxn *txn)
+{
+    atomic_fetch_add(&store->writersWaiting, 1);
+    lockStoreMutex(&store->writeLock);
+    atomic_fetch_sub(&store->writersWaiting, 1);
+    Version *head = storeHead(store);
+
+    txn->store = store;
+    txn->root = (TreeNode *)relGet(&head->root);
+    txn->version = head->number + 1;
+    txn->retired = NULL;
+    txn->log = NULL;
+    txn->logCount = 0;
+    txn->logCapacity = 0;
+    txn->removed = NULL;
+    txn->removedCount = 0;
+    txn->removedCapacity = 0;
+}
+
+/**
+ * @brief Records an operation of the transaction for the booking journal,
+ * and the deletes for the data log of a store backed by one.
+ */
+static void txnLog(WriteTxn *txn, JournalOp op, const char *key, NodeType type, void *data)
+{
+    if (journalFile == NULL && (txn->store->log == NULL || op != JOURNAL_DELETE))
+        return;
+
+    if (txn->logCount >= txn->logCapacity)
+    {
+        txn->logCapacity = txn->logCapacity ? txn->logCapacity * 2 : 8;
+        txn->log = realloc(txn->log, txn->logCapacity * sizeof(JournalRecord));
+        if (!txn->log)
+        {
+            perror("(!) Realloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    JournalRecord *record = &txn->log[txn->logCount++];
+    memset(record, 0, sizeof(JournalRecord));
+    record->op = op;
+    record->type = type;
+    strcpy(record->key, key);
+    if (op == JOURNAL_INSERT)
+    {
+        if (type == EVENT_NODE)
+            record->data.eventData = *(Event *)data;
+        else
+            record->data.ticketData = *(Ticket *)data;
+    }
+}
+
+/**
+ * @brief Hands a committed node over to the collector once this transaction commits.
+ */
+static void txnRetire(WriteTxn *txn, TreeNode *node)
+{
+    if (txn->retired == NULL || txn->retired->count == txn->store->arena.retireCapacity)
+    {
+        RetireBlock *block = &arenaAlloc(&txn->store->arena)->retire;
+        block->count = 0;
+        relSet(&block->next, txn->retired);
+        txn->retired = block;
+    }
+    relSet(&txn->retired->nodes[txn->retired->count++], node);
+}
+
+/**
+ * @brief Returns a node the transaction may modify, copying a committed node
+ * (and retiring the original) on first write.
+ */
+static TreeNode *txnWritable(WriteTxn *txn, TreeNode *node)
+{
+    if (node->version == txn->version)
+        return node; // Already created by this transaction
+
+    TreeNode *copy = &arenaAlloc(&txn->store->arena)->node;
+    strcpy(copy->key, node->key);
+    nodeCopyRecord(txn->store, copy, node);
+    atomic_init(&copy->hits, atomic_load_explicit(&node->hits, memory_order_relaxed)); // Readers may be counting
+    setLeft(copy, nodeLeft(node)); // Relative links must be recomputed after a move
+    setRight(copy, nodeRight(node));
+    copy->version = txn->version;
+    txnRetire(txn, node);
+    return copy;
+}
+
+/**
+ * @brief Records a key the transaction deleted, for the store's hash index.
+ */
+static void txnForget(WriteTxn *txn, const char *key)
+{
+    uint64_t packed;
+    if (txn->store->index == NULL || !indexKey(key, &packed))
+        return;
+
+    if (txn->removedCount >= txn->removedCapacity)
+    {
+        txn->removedCapacity = txn->removedCapacity ? txn->removedCapacity * 2 : 8;
+        txn->removed = realloc(txn->removed, txn->removedCapacity * sizeof(uint64_t));
+        if (!txn->removed)
+        {
+            perror("(!) Realloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    txn->removed[txn->removedCount++] = packed;
+}
+
+/**
+ * @brief Path-copying insert: only the nodes on the way to the key are copied.
+ */
+static TreeNode *txnInsertRec(WriteTxn *txn, TreeNode *root, const char *key, NodeType type, void *data)
+{
+    if (root == NULL)
+    {
+        return storeNewNode(txn->store, key, type, data, txn->version);
+    }
+
+    int cmp = strcmp(key, root->key);
+    if (cmp < 0)
+    {
+        TreeNode *child = txnInsertRec(txn, nodeLeft(root), key, type, data);
+        if (child != nodeLeft(root))
+        {
+            root = txnWritable(txn, root);
+            setLeft(root, child);
+        }
+    }
+    else if (cmp > 0)
+    {
+        TreeNode *child = txnInsertRec(txn, nodeRight(root), key, type, data);
+        if (child != nodeRight(root))
+        {
+            root = txnWritable(txn, root);
+            setRight(root, child);
+        }
+    }
+    // If the key already exists, do nothing.
+    return root;
+}
+
+/**
+ * @brief Inserts a node in the version being built by the transaction.
+ */
+void txnInsert(WriteTxn *txn, const char *key, NodeType type, void *data)
+{
+    txn->root = txnInsertRec(txn, txn->root, key, type, data);
+    txnLog(txn, JOURNAL_INSERT, key, type, data);
+}
+
+/**
+ * @brief Drops a node removed by the transaction: nodes it created are freed
+ * right away, committed ones are left to the collector.
+ */
+static void txnDiscard(WriteTxn *txn, TreeNode *node)
+{
+    if (node->version == txn->version)
+    {
+        arenaFree(&txn->store->arena, node);
+    }
+    else
+    {
+        txnRetire(txn, node);
+    }
+}
+
+static TreeNode *txnRemoveNode(WriteTxn *txn, TreeNode *root);
+static void indexCommit(WriteTxn *txn);
+
+/**
+ * @brief Path-copying delete, mirroring deleteNode().
+ */
+static TreeNode *txnDeleteRec(WriteTxn *txn, TreeNode *root, const char *key)
+{
+    if (root == NULL)
+        return root;
+
+    int cmp = strcmp(key, root->key);
+    if (cmp < 0)
+    {
+        TreeNode *child = txnDeleteRec(txn, nodeLeft(root), key);
+        if (child != nodeLeft(root))
+        {
+            root = txnWritable(txn, root);
+            setLeft(root, child);
+        }
+    }
+    else if (cmp > 0)
+    {
+        TreeNode *child = txnDeleteRec(txn, nodeRight(root), key);
+        if (child != nodeRight(root))
+        {
+            root = txnWritable(txn, root);
+            setRight(root, child);
+        }
+    }
+    else
+    {
+        return txnRemoveNode(txn, root);
+    }
+    return root;
+}
+
+/**
+ * @brief Removes a node from the version being built, returning the subtree
+ * that takes its place.
+ */
+static TreeNode *txnRemoveNode(WriteTxn *txn, TreeNode *root)
+{
+    txnForget(txn, root->key);
+
+    // Node with only one child or no child
+    if (nodeLeft(root) == NULL)
+    {
+        TreeNode *temp = nodeRight(root);
+        txnDiscard(txn, root);
+        return temp;
+    }
+    else if (nodeRight(root) == NULL)
+    {
+        TreeNode *temp = nodeLeft(root);
+        txnDiscard(txn, root);
+        return temp;
+    }
+
+    // Node with two children
+    TreeNode *temp = findMin(nodeRight(root));
+    root = txnWritable(txn, root);
+    strcpy(root->key, temp->key);
+    nodeCopyRecord(txn->store, root, temp);
+    setRight(root, txnDeleteRec(txn, nodeRight(root), temp->key));
+    return root;
+}
+
+/**
+ * @brief Deletes a node from the version being built by the transaction.
+ */
+void txnDelete(WriteTxn *txn, const char *key)
+{
+    txn->root = txnDeleteRec(txn, txn->root, key);
+    txnLog(txn, JOURNAL_DELETE, key, EVENT_NODE, NULL);
+}
+
+/**
+ * @brief Path-copying update, mirroring txnInsertRec().
+ * @param updated Set to the node holding the new data, or NULL if the key
+ * does not exist.
+ */
+static TreeNode *txnUpdateRec(WriteTxn *txn, TreeNode *root, const char *key, void *data, TreeNode **updated)
+{
+    if (root == NULL)
+    {
+        *updated = NULL;
+        return NULL;
+    }
+
+    int cmp = strcmp(key, root->key);
+    if (cmp == 0)
+    {
+        root = txnWritable(txn, root);
+        nodeSetRecord(txn->store, root, root->type, data);
+        *updated = root;
+    }
+    else if (cmp < 0)
+    {
+        TreeNode *child = txnUpdateRec(txn, nodeLeft(root), key, data, updated);
+        if (child != nodeLeft(root))
+        {
+            root = txnWritable(txn, root);
+            setLeft(root, child);
+        }
+    }
+    else
+    {
+        TreeNode *child = txnUpdateRec(txn, nodeRight(root), key, data, updated);
+        if (child != nodeRight(root))
+        {
+            root = txnWritable(txn, root);
+            setRight(root, child);
+        }
+    }
+    return root;
+}
+
+/**
+ * @brief Replaces the data of a node in the version being built, keeping
+ * its key, type and place in the tree: only the path to it is copied. The
+ * journal records it as a delete and an insert of the key.
+ * @return 1 if the key exists, 0 if nothing changed.
+ */
+int txnUpdate(WriteTxn *txn, const char *key, void *data)
+{
+    TreeNode *node;
+    txn->root = txnUpdateRec(txn, txn->root, key, data, &node);
+    if (node == NULL)
+        return 0;
+
+    txnLog(txn, JOURNAL_DELETE, key, EVENT_NODE, NULL);
+    txnLog(txn, JOURNAL_INSERT, key, node->type, (void *)nodeRecord(txn->store, node));
+    return 1;
+}
+
+/**
+ * @brief Path-copying split: cuts a subtree in two at key, copying only
+ * the nodes on the way down to it.
+ * @param below Receives the subtree of the keys that sort before key.
+ * @return The subtree of the other keys.
+ */
+static TreeNode *txnSplit(WriteTxn *txn, TreeNode *root, const char *key, TreeNode **below)
+{
+    if (root == NULL)
+    {
+        *below = NULL;
+        return NULL;
+    }
+
+    TreeNode *lower;
+    if (strcmp(root->key, key) < 0)
+    {
+        // The node and its left subtree sort before key: split the right one.
+        TreeNode *upper = txnSplit(txn, nodeRight(root), key, &lower);
+        if (lower != nodeRight(root))
+        {
+            root = txnWritable(txn, root);
+            setRight(root, lower);
+        }
+        *below = root;
+        return upper;
+    }
+
+    TreeNode *upper = txnSplit(txn, nodeLeft(root), key, &lower);
+    if (upper != nodeLeft(root))
+    {
+        root = txnWritable(txn, root);
+        setLeft(root, upper);
+    }
+    *below = lower;
+    return root;
+}
+
+/**
+ * @brief Unlinks the node with the largest key from a subtree.
+ * @param max Receives that node, which the caller takes over.
+ * @return The subtree without it.
+ */
+static TreeNode *txnDetachMax(WriteTxn *txn, TreeNode *root, TreeNode **max)
+{
+    if (nodeRight(root) == NULL)
+    {
+        *max = root;
+        return nodeLeft(root);
+    }
+    TreeNode *child = txnDetachMax(txn, nodeRight(root), max);
+    root = txnWritable(txn, root);
+    setRight(root, child);
+    return root;
+}
+
+/**
+ * @brief Path-copying join of two subtrees, every key of left sorting
+ * before every key of right: the largest key of left becomes the root over
+ * both, so the result is at most one level deeper than the deeper one.
+ */
+static TreeNode *txnJoin(WriteTxn *txn, TreeNode *left, TreeNode *right)
+{
+    if (left == NULL)
+        return right;
+    if (right == NULL)
+        return left;
+
+    TreeNode *max;
+    left = txnDetachMax(txn, left, &max);
+    max = txnWritable(txn, max);
+    setLeft(max, left);
+    setRight(max, right);
+    return max;
+}
+
+/**
+ * @brief Gives every ticket of a detached subtree the event code toCode.
+ * Its keys keep their relative order, so the subtree keeps its shape; each
+ * node is copied once, as any changed node is.
+ * @param count Increased by the number of tickets relabelled.
+ */
+static TreeNode *txnRelabelTickets(WriteTxn *txn, TreeNode *root, int toCode, int *count)
+{
+    if (root == NULL)
+        return NULL;
+
+    TreeNode *left = txnRelabelTickets(txn, nodeLeft(root), toCode, count);
+    TreeNode *right = txnRelabelTickets(txn, nodeRight(root), toCode, count);
+    txnForget(txn, root->key);
+    txnLog(txn, JOURNAL_DELETE, root->key, EVENT_NODE, NULL);
+    root = txnWritable(txn, root);
+    Ticket ticket = nodeRecord(txn->store, root)->ticketData;
+    ticket.eventCode = toCode;
+    nodeSetRecord(txn->store, root, TICKET_NODE, &ticket);
+    ticketKey(root->key, toCode, ticket.seatId);
+    txnLog(txn, JOURNAL_INSERT, root->key, TICKET_NODE, &ticket);
+    setLeft(root, left);
+    setRight(root, right);
+    (*count)++;
+    return root;
+}
+
+/**
+ * @brief Orders batch operations by key, keeping submission order for equal keys.
+ */
+static int compareBatchOps(const void *a, const void *b)
+{
+    const BatchOp *x = *(BatchOp *const *)a;
+    const BatchOp *y = *(BatchOp *const *)b;
+    int cmp = strcmp(x->key, y->key);
+    if (cmp != 0)
+        return cmp;
+    return (x > y) - (x < y); // Operations come from one array: address = submission order
+}
+
+/**
+ * @brief Index of the first sorted operation whose key is not below key.
+ */
+static int batchLowerBound(BatchOp **ops, int count, const char *key)
+{
+    int lo = 0;
+    int hi = count;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (strcmp(ops[mid]->key, key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief Plays the operations of one key in submission order.
+ * @param source In: the operation whose data the key currently holds (NULL
+ * if it holds its committed data or does not exist). Out: the same after
+ * the group, or NULL if the key must end up absent.
+ * @param current The data currently stored under the key, if it exists.
+ * @return 1 if the key exists after the group.
+ */
+static int batchPlayKey(BatchOp **group, int count, int present, const NodeData *current, NodeType currentType, BatchOp **source)
+{
+    for (int i = 0; i < count; i++)
+    {
+        BatchOp *op = group[i];
+        switch (op->op)
+        {
+        case BATCH_LOOKUP:
+            op->result = present;
+            if (present)
+            {
+                op->type = currentType;
+                if (currentType == EVENT_NODE)
+                    op->data.eventData = current->eventData;
+                else
+                    op->data.ticketData = current->ticketData;
+            }
+            break;
+        case BATCH_INSERT:
+            op->result = !present;
+            if (!present)
+            {
+                present = 1;
+                *source = op;
+                current = &op->data;
+                currentType = op->type;
+            }
+            break;
+        case BATCH_DELETE:
+            op->result = present;
+            present = 0;
+            *source = NULL;
+            break;
+        }
+    }
+    return present;
+}
+
+/**
+ * @brief Builds a balanced subtree from sorted operations landing in an empty subtree.
+ */
+static TreeNode *batchBuild(WriteTxn *txn, BatchOp **ops, int count)
+{
+    // Play each key's group, compacting the operations of keys that end up
+    // present to the front; this range of ops belongs to this subtree only.
+    int survivors = 0;
+    for (int lo = 0; lo < count;)
+    {
+        int hi = lo + 1;
+        while (hi < count && strcmp(ops[hi]->key, ops[lo]->key) == 0)
+            hi++;
+        BatchOp *source = NULL;
+        if (batchPlayKey(&ops[lo], hi - lo, 0, NULL, EVENT_NODE, &source))
+        {
+            ops[survivors++] = source;
+        }
+        lo = hi;
+    }
+
+    if (survivors == 0)
+        return NULL;
+
+    int mid = survivors / 2;
+    TreeNode *root = storeNewNode(txn->store, ops[mid]->key, ops[mid]->type, &ops[mid]->data, txn->version);
+    setLeft(root, batchBuild(txn, ops, mid));
+    setRight(root, batchBuild(txn, ops + mid + 1, survivors - mid - 1));
+    return root;
+}
+
+/**
+ * @brief Merges sorted operations into a subtree in one traversal: each
+ * node splits the operations between its children and is visited (and
+ * copied) at most once, however many operations pass through it.
+ */
+static TreeNode *batchApplyRec(WriteTxn *txn, TreeNode *root, BatchOp **ops, int count)
+{
+    if (count == 0)
+        return root;
+    if (root == NULL)
+        return batchBuild(txn, ops, count);
+
+    // Operations on this node's key sit in ops[lo..hi), usually none or one.
+    int lo = batchLowerBound(ops, count, root->key);
+    int hi = lo;
+    while (hi < count && strcmp(ops[hi]->key, root->key) == 0)
+        hi++;
+
+    TreeNode *left = batchApplyRec(txn, nodeLeft(root), ops, lo);
+    TreeNode *right = batchApplyRec(txn, nodeRight(root), ops + hi, count - hi);
+    if (left != nodeLeft(root) || right != nodeRight(root))
+    {
+        root = txnWritable(txn, root);
+        setLeft(root, left);
+        setRight(root, right);
+    }
+
+    if (lo < hi)
+    {
+        BatchOp *source = NULL;
+        if (!batchPlayKey(&ops[lo], hi - lo, 1, nodeRecord(txn->store, root), root->type, &source))
+        {
+            return txnRemoveNode(txn, root);
+        }
+        if (source != NULL)
+        {
+            // Deleted and inserted again within the batch: take the new data.
+            root = txnWritable(txn, root);
+            nodeSetRecord(txn->store, root, source->type, &source->data);
+        }
+    }
+    return root;
+}
+
+/**
+ * @brief Applies a batch of inserts, lookups and deletes to the version
+ * being built. The batch is sorted by key and merged into the tree in a
+ * single coordinated traversal instead of one root-to-leaf walk per
+ * operation. Operations on the same key take effect in array order.
+ * Results are stored in each operation (see BatchOp).
+ */
+void txnApplyBatch(WriteTxn *txn, BatchOp *ops, int count)
+{
+    if (count <= 0)
+        return;
+
+    BatchOp **sorted = malloc(count * sizeof(BatchOp *));
+    if (!sorted)
+    {
+        perror("(!) Failed to allocate memory for the batch");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = &ops[i];
+        if (ops[i].op == BATCH_INSERT)
+            txnLog(txn, JOURNAL_INSERT, ops[i].key, ops[i].type, &ops[i].data);
+        else if (ops[i].op == BATCH_DELETE)
+            txnLog(txn, JOURNAL_DELETE, ops[i].key, EVENT_NODE, NULL);
+    }
+    qsort(sorted, count, sizeof(BatchOp *), compareBatchOps);
+
+    txn->root = batchApplyRec(txn, txn->root, sorted, count);
+    free(sorted);
+}
+
+/**
+ * @brief Publishes the transaction as the new head version.
+ * @return The version stamp of the commit, or 0 if the data log of the
+ * store could not take it: the transaction is then aborted.
+ */
+unsigned long storeCommit(WriteTxn *txn)
+{
+    Store *store = txn->store;
+    Version *head = storeHead(store);
+
+    // The log is the only copy of a log-backed store's new records: a commit
+    // it cannot take is rolled back there and never becomes visible.
+    if (store->log != NULL && !logWriteCommit(txn))
+    {
+        fprintf(stderr, "(!) Failed to write the commit to the data log; it was rolled back.\n");
+        storeAbort(txn);
+        return 0;
+    }
+    store->pendingCount = 0;
+
+    Version *version = &arenaAlloc(&store->arena)->version;
+    version->number = txn->version;
+    relSet(&version->root, txn->root);
+    relSet(&version->retired, txn->retired);
+    version->next = 0;
+
+    // Journal the commit before it becomes visible, still under the writer lock,
+    // so the journal order is the commit order even across processes.
+    if (journalFile != NULL)
+    {
+        JournalRecord commit;
+        memset(&commit, 0, sizeof(commit));
+        commit.op = JOURNAL_COMMIT;
+        commit.version = version->number;
+        commit.timestamp = currentTimeMicros();
+        if ((txn->logCount > 0 && fwrite(txn->log, sizeof(JournalRecord), txn->logCount, journalFile) != (size_t)txn->logCount) ||
+            fwrite(&commit, sizeof(commit), 1, journalFile) != 1 || fflush(journalFile) != 0)
+        {
+            perror("(!) Failed to write the booking journal");
+        }
+    }
+    free(txn->log);
+    txn->log = NULL;
+
+    // Readers that pin this version must find its nodes, not the ones it retired.
+    indexCommit(txn);
+    free(txn->removed);
+    txn->removed = NULL;
+
+    // Link before publishing so the collector sees a complete list up to the head.
+    relSet(&head->next, version);
+    storeSetHead(store, version);
+    atomic_store(&store->committed, version->number);
+    pthread_mutex_unlock(&store->writeLock);
+
+    lockStoreMutex(&store->gcLock);
+    pthread_cond_signal(&store->gcWake);
+    pthread_mutex_unlock(&store->gcLock);
+    return txn->version; // Not version->number: once unlocked, the version may already be collected
+}
+
+/**
+ * @brief Frees the nodes a transaction created; committed subtrees are untouched.
+ */
+static void freeTxnNodes(NodeArena *arena, TreeNode *root, unsigned long version)
+{
+    if (root == NULL || root->version != version)
+        return;
+    freeTxnNodes(arena, nodeLeft(root), version);
+    freeTxnNodes(arena, nodeRight(root), version);
+    arenaFree(arena, root);
+}
+
+/**
+ * @brief Frees a chain of retire blocks, and the nodes they list if asked to.
+ */
+static void freeRetireBlocks(NodeArena *arena, RetireBlock *block, int freeNodes)
+{
+    while (block != NULL)
+    {
+        RetireBlock *next = (RetireBlock *)relGet(&block->next);
+        for (int i = 0; freeNodes && i < block->count; i++)
+        {
+            arenaFree(arena, relGet(&block->nodes[i]));
+        }
+        arenaFree(arena, block);
+        block = next;
+    }
+}
+
+/**
+ * @brief Abandons a write transaction, leaving the head version unchanged.
+ */
+void storeAbort(WriteTxn *txn)
+{
+    NodeArena *arena = &txn->store->arena;
+    freeTxnNodes(arena, txn->root, txn->version);
+    freeRetireBlocks(arena, txn->retired, 0); // The retired nodes are still live
+    txn->store->pendingCount = 0;
+    free(txn->log);
+    txn->log = NULL;
+    free(txn->removed);
+    txn->removed = NULL;
+    txn->root = NULL;
+    txn->retired = NULL;
+    pthread_mutex_unlock(&txn->store->writeLock);
+}
+
+/**
+ * @brief Frees the nodes of versions that no open snapshot can reach.
+ * Nodes retired by commit N are only reachable from versions older than N,
+ * so they can go once every reader has pinned N or later.
+ */
+void storeCollect(Store *store)
+{
+    Version *head = storeHead(store);
+    unsigned long limit = head->number;
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pinned = atomic_load(&store->readers[i]);
+        if (pinned != 0 && pinned < limit)
+        {
+            limit = pinned;
+        }
+    }
+
+    Version *oldest = (Version *)relGet(&store->oldest);
+    while (oldest != head)
+    {
+        Version *next = (Version *)relGet(&oldest->next);
+        if (next->number > limit)
+            break;
+        freeRetireBlocks(&store->arena, (RetireBlock *)relGet(&next->retired), 1);
+        next->retired = 0;
+        arenaFree(&store->arena, oldest);
+        oldest = next;
+    }
+    relSet(&store->oldest, oldest);
+    if (store->log != NULL)
+        logReleaseSegments(store->log, limit);
+}
+
+/**
+ * @brief Sums the hit counters of a tree and counts its nodes.
+ */
+static unsigned long long treeHits(TreeNode *root, long *nodes)
+{
+    if (root == NULL)
+        return 0;
+    (*nodes)++;
+    return atomic_load_explicit(&root->hits, memory_order_relaxed) + treeHits(nodeLeft(root), nodes) +
+           treeHits(nodeRight(root), nodes);
+}
+
+/**
+ * @brief Lists the nodes of a tree in key order.
+ */
+static long collectNodes(TreeNode *root, TreeNode **nodes, long count)
+{
+    if (root == NULL)
+        return count;
+    count = collectNodes(nodeLeft(root), nodes, count);
+    nodes[count++] = root;
+    return collectNodes(nodeRight(root), nodes, count);
+}
+
+/**
+ * @brief Builds the reshaped subtree of nodes[low..high): its root is the
+ * node splitting the subtree's weight most evenly, so a key's depth grows
+ * only with the log of how rare it is. weight[i] is the weight of the nodes
+ * before i. Every node is copied, its hit counter halved to let old
+ * popularity fade.
+ */
+static TreeNode *reshapeBuild(WriteTxn *txn, TreeNode **nodes, const unsigned long long *weight, long low, long high)
+{
+    if (low >= high)
+        return NULL;
+
+    // The node whose weight range holds the middle of the subtree's weight.
+    unsigned long long middle = weight[low] + (weight[high] - weight[low]) / 2;
+    long first = low;
+    long last = high - 1;
+    while (first < last)
+    {
+        long probe = first + (last - first) / 2;
+        if (weight[probe + 1] <= middle)
+            first = probe + 1;
+        else
+            last = probe;
+    }
+
+    TreeNode *node = txnWritable(txn, nodes[first]);
+    atomic_store_explicit(&node->hits, atomic_load_explicit(&node->hits, memory_order_relaxed) / 2,
+                          memory_order_relaxed);
+    setLeft(node, reshapeBuild(txn, nodes, weight, low, first));
+    setRight(node, reshapeBuild(txn, nodes, weight, first + 1, high));
+    return node;
+}
+
+/**
+ * @brief Counts the nodes of a tree, giving up once there are more than limit.
+ * @return The node count, or a number over limit.
+ */
+static long countNodesUpTo(TreeNode *root, long limit)
+{
+    if (root == NULL || limit < 0)
+        return 0;
+    long count = 1 + countNodesUpTo(nodeLeft(root), limit - 1);
+    if (count > limit)
+        return count;
+    return count + countNodesUpTo(nodeRight(root), limit - count);
+}
+
+/**
+ * @brief Rebuilds one subtree of count nodes by access frequency.
+ */
+static TreeNode *reshapeSubtree(WriteTxn *txn, TreeNode *root, long count, ReshapePass *pass)
+{
+    TreeNode **nodes = malloc((count + 1) * sizeof(TreeNode *));
+    unsigned long long *weight = malloc((count + 1) * sizeof(unsigned long long));
+    if (!nodes || !weight)
+    {
+        perror("(!) Failed to allocate memory to reshape the tree");
+        exit(EXIT_FAILURE);
+    }
+
+    collectNodes(root, nodes, 0);
+    weight[0] = 0;
+    for (long i = 0; i < count; i++)
+    {
+        // Every key weighs at least 1, so cold ranges stay balanced.
+        unsigned long long hits = atomic_load_explicit(&nodes[i]->hits, memory_order_relaxed);
+        weight[i + 1] = weight[i] + 1 + hits;
+        pass->faded += hits - hits / 2;
+    }
+    strcpy(pass->last, nodes[count - 1]->key);
+
+    root = reshapeBuild(txn, nodes, weight, 0, count);
+    pass->placed += count;
+    pass->budget -= count;
+    free(nodes);
+    free(weight);
+    return root;
+}
+
+/**
+ * @brief Rebuilds the subtrees holding the keys after from, in key order,
+ * until the pass runs out of budget or a writer is waiting. A subtree too
+ * big for the budget keeps its root and has its children rebuilt instead.
+ */
+static TreeNode *reshapeRange(WriteTxn *txn, TreeNode *root, const char *from, ReshapePass *pass)
+{
+    if (root == NULL || pass->stopped)
+        return root;
+    if (pass->budget <= 0 || (pass->yielding && atomic_load(&txn->store->writersWaiting) > 0))
+    {
+        pass->stopped = 1;
+        return root;
+    }
+
+    TreeNode *left = nodeLeft(root);
+    TreeNode *right = nodeRight(root);
+    if (from[0] != '\0' && strcmp(root->key, from) <= 0)
+    {
+        // This node and its left subtree were done by an earlier pass.
+        right = reshapeRange(txn, right, from, pass);
+    }
+    else
+    {
+        long count = countNodesUpTo(root, pass->budget);
+        if (count <= pass->budget)
+            return reshapeSubtree(txn, root, count, pass);
+        left = reshapeRange(txn, left, from, pass);
+        right = reshapeRange(txn, right, from, pass);
+    }
+
+    if (left == nodeLeft(root) && right == nodeRight(root))
+        return root;
+    root = txnWritable(txn, root);
+    setLeft(root, left);
+    setRight(root, right);
+    return root;
+}
+
+/**
+ * @brief Rebuilds the tree by access frequency (adaptive mode): hot keys
+ * move near the root and keys nobody asks for sink, while a tree without
+ * hits comes out perfectly balanced. Snapshots cannot be restructured as
+ * they are read, so this runs as a write transaction and readers switch
+ * to the new shape with their next snapshot.
+ *
+ * A bounded pass holds the writer lock for at most maxNodes rebuilt nodes:
+ * it rebuilds whole subtrees in key order, starting after the last key the
+ * previous pass reached, and stops early as soon as a writer is waiting.
+ * Nodes above the rebuilt subtrees keep their place until a full rebuild.
+ * @param onlyIfUsed Skip the rebuild unless the tree saw at least one new
+ * hit for every two keys since the last one.
+ * @param maxNodes Nodes rebuilt at most, or 0 to rebuild the whole tree.
+ * @return The number of nodes placed, or -1 if the rebuild was skipped.
+ */
+long storeReshape(Store *store, int onlyIfUsed, long maxNodes)
+{
+    long count = 0;
+    Snapshot snapshot = storeBeginRead(store);
+    unsigned long long hits = treeHits(snapshot.root, &count);
+    storeEndRead(store, &snapshot);
+    if (onlyIfUsed && hits < store->carriedHits + (unsigned long long)count / 2)
+        return -1;
+    // Bookings come first: a pass only starts while no writer is waiting.
+    if (maxNodes > 0 && atomic_load(&store->writersWaiting) > 0)
+        return -1;
+
+    WriteTxn txn;
+    ReshapePass pass = {maxNodes > 0 ? maxNodes : LONG_MAX, 0, 0, maxNodes > 0, 0, ""};
+    storeBeginWrite(store, &txn);
+    txn.root = reshapeRange(&txn, txn.root, maxNodes > 0 ? store->reshapeFrom : "", &pass);
+    if (pass.placed == 0)
+    {
+        storeAbort(&txn);
+        return -1;
+    }
+
+    if (storeCommit(&txn) == 0)
+        return -1;
+    // The next pass carries on after this one, or starts over at the first key.
+    strcpy(store->reshapeFrom, pass.stopped ? pass.last : "");
+    store->carriedHits = hits > pass.faded ? hits - pass.faded : 0;
+    return pass.placed;
+}
+
+// --- Booking Core Functions ---
+
+/**
+ * @brief Adds an event inside a transaction unless its code is taken.
+ */
+BookingResult txnAddEvent(WriteTxn *txn, const Event *event)
+{
+    char key[20];
+    sprintf(key, "E_%d", event->code);
+    if (txnLookup(txn, key) != NULL)
+        return BOOKING_DUPLICATE;
+
+    txnInsert(txn, key, EVENT_NODE, (void *)event);
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Issues a ticket inside a transaction if its event exists and the seat is free.
+ */
+BookingResult txnAddTicket(WriteTxn *txn, const Ticket *ticket)
+{
+    char key[20];
+    char eventKey[20];
+
+    if (ticket->seatId < 0 || ticket->seatId >= txn->store->layout.seatCount)
+        return BOOKING_INVALID_SEAT;
+
+    sprintf(eventKey, "E_%d", ticket->eventCode);
+    if (txnLookup(txn, eventKey) == NULL)
+        return BOOKING_NO_EVENT;
+
+    ticketKey(key, ticket->eventCode, ticket->seatId);
+    if (txnLookup(txn, key) != NULL)
+        return BOOKING_SEAT_TAKEN;
+
+    txnInsert(txn, key, TICKET_NODE, (void *)ticket);
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Deletes an event and all its tickets inside a transaction.
+ * @param ticketCount Set to the number of tickets deleted (may be NULL).
+ */
+BookingResult txnRemoveEvent(WriteTxn *txn, int code, int *ticketCount)
+{
+    char eventKey[20];
+    sprintf(eventKey, "E_%d", code);
+    if (txnLookup(txn, eventKey) == NULL)
+        return BOOKING_NO_EVENT;
+
+    // Step 1: Collect keys of all tickets for the event
+    int count = 0;
+    int capacity = 10;
+    char **keysToDelete = malloc(capacity * sizeof(char *));
+    if (!keysToDelete)
+    {
+        perror("(!) Malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    collectTicketKeysForEvent(txn->root, code, &keysToDelete, &count, &capacity);
+
+    // Step 2: Delete all the tickets
+    for (int i = 0; i < count; i++)
+    {
+        txnDelete(txn, keysToDelete[i]);
+        free(keysToDelete[i]);
+    }
+    free(keysToDelete);
+
+    // Step 3: Delete the event itself
+    txnDelete(txn, eventKey);
+    if (ticketCount != NULL)
+        *ticketCount = count;
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Replaces the title, date and time of an event inside a
+ * transaction; its code, and so its tickets, stay as they are.
+ */
+BookingResult txnUpdateEvent(WriteTxn *txn, const Event *event)
+{
+    char key[20];
+    sprintf(key, "E_%d", event->code);
+    return txnUpdate(txn, key, (void *)event) ? BOOKING_OK : BOOKING_NO_EVENT;
+}
+
+/**
+ * @brief Hands a ticket over to the buyer of a transfer if the seller
+ * holds it.
+ */
+static BookingResult transferHolder(Ticket *ticket, const TicketTransfer *transfer)
+{
+    if (strcmp(ticket->afm, transfer->fromAfm) != 0)
+        return BOOKING_WRONG_HOLDER;
+    strcpy(ticket->afm, transfer->afm);
+    strcpy(ticket->firstName, transfer->firstName);
+    strcpy(ticket->lastName, transfer->lastName);
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Transfers a ticket to a new holder inside a transaction, in place:
+ * the ticket keeps its key and node position (see txnUpdate()).
+ * @return The outcome, also stored in transfer->result.
+ */
+BookingResult txnTransferTicket(WriteTxn *txn, TicketTransfer *transfer)
+{
+    char key[20];
+    if (transfer->seatId < 0 || transfer->seatId >= txn->store->layout.seatCount)
+    {
+        transfer->result = BOOKING_INVALID_SEAT;
+        return transfer->result;
+    }
+
+    ticketKey(key, transfer->eventCode, transfer->seatId);
+    TreeNode *node = txnLookup(txn, key);
+    if (node == NULL)
+    {
+        transfer->result = BOOKING_NO_TICKET;
+        return transfer->result;
+    }
+
+    Ticket ticket = nodeRecord(txn->store, node)->ticketData;
+    transfer->result = transferHolder(&ticket, transfer);
+    if (transfer->result == BOOKING_OK)
+        txnUpdate(txn, key, &ticket);
+    return transfer->result;
+}
+
+/**
+ * @brief Orders transfers by ticket, keeping feed order for the same ticket.
+ */
+static int compareTransfers(const void *a, const void *b)
+{
+    const TicketTransfer *x = *(TicketTransfer *const *)a;
+    const TicketTransfer *y = *(TicketTransfer *const *)b;
+    if (x->eventCode != y->eventCode)
+        return (x->eventCode > y->eventCode) - (x->eventCode < y->eventCode);
+    if (x->seatId != y->seatId)
+        return (x->seatId > y->seatId) - (x->seatId < y->seatId);
+    return (x > y) - (x < y); // Transfers come from one array: address = feed order
+}
+
+/**
+ * @brief Applies a batch of transfers inside a transaction. The transfers
+ * of one ticket are played in array order, so a ticket resold twice in the
+ * batch ends with its last buyer; every ticket that changed hands is then
+ * rewritten once, all of them in a single txnApplyBatch() pass.
+ * @return The number of transfers applied; each one's outcome is stored in
+ * its result.
+ */
+int txnApplyTransfers(WriteTxn *txn, TicketTransfer *transfers, int count)
+{
+    TicketTransfer **sorted = malloc((count + 1) * sizeof(TicketTransfer *));
+    BatchOp *ops = malloc((2 * count + 1) * sizeof(BatchOp));
+    if (!sorted || !ops)
+    {
+        perror("(!) Failed to allocate memory for the transfers");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = &transfers[i];
+    }
+    qsort(sorted, count, sizeof(TicketTransfer *), compareTransfers);
+
+    // Every lookup happens before the batch changes the tree, so all of
+    // them can go through the hash index.
+    int applied = 0;
+    int opCount = 0;
+    for (int lo = 0; lo < count;)
+    {
+        int hi = lo + 1;
+        while (hi < count && sorted[hi]->eventCode == sorted[lo]->eventCode && sorted[hi]->seatId == sorted[lo]->seatId)
+            hi++;
+
+        char key[20];
+        TreeNode *node = NULL;
+        int valid = sorted[lo]->seatId >= 0 && sorted[lo]->seatId < txn->store->layout.seatCount;
+        if (valid)
+        {
+            ticketKey(key, sorted[lo]->eventCode, sorted[lo]->seatId);
+            node = txnLookup(txn, key);
+        }
+
+        Ticket ticket;
+        int changed = 0;
+        if (node != NULL)
+            ticket = nodeRecord(txn->store, node)->ticketData;
+        for (int i = lo; i < hi; i++)
+        {
+            if (!valid)
+                sorted[i]->result = BOOKING_INVALID_SEAT;
+            else if (node == NULL)
+                sorted[i]->result = BOOKING_NO_TICKET;
+            else
+                sorted[i]->result = transferHolder(&ticket, sorted[i]);
+            if (sorted[i]->result == BOOKING_OK)
+            {
+                changed = 1;
+                applied++;
+            }
+        }
+
+        if (changed)
+        {
+            BatchOp *remove = &ops[opCount++];
+            BatchOp *insert = &ops[opCount++];
+            memset(remove, 0, sizeof(BatchOp));
+            remove->op = BATCH_DELETE;
+            strcpy(remove->key, key);
+            memset(insert, 0, sizeof(BatchOp));
+            insert->op = BATCH_INSERT;
+            strcpy(insert->key, key);
+            insert->type = TICKET_NODE;
+            insert->data.ticketData = ticket;
+        }
+        lo = hi;
+    }
+
+    txnApplyBatch(txn, ops, opCount);
+    free(sorted);
+    free(ops);
+    return applied;
+}
+
+/**
+ * @brief Moves the ticket of a seat to another seat of the same event
+ * inside a transaction. If the other seat is free, the ticket is reissued
+ * there; if it is taken and swapping is allowed, the two tickets exchange
+ * holders in place, each keeping its key and node position (see
+ * txnUpdate()). Readers see either both seats as they were or both as
+ * they end up.
+ * @param swapped Set to 1 if the holders were swapped (may be NULL).
+ */
+BookingResult txnMoveSeat(WriteTxn *txn, int eventCode, int fromSeat, int toSeat, int allowSwap, int *swapped)
+{
+    char fromKey[20];
+    char toKey[20];
+    if (swapped != NULL)
+        *swapped = 0;
+    if (fromSeat < 0 || fromSeat >= txn->store->layout.seatCount || toSeat < 0 ||
+        toSeat >= txn->store->layout.seatCount)
+        return BOOKING_INVALID_SEAT;
+
+    ticketKey(fromKey, eventCode, fromSeat);
+    TreeNode *from = txnLookup(txn, fromKey);
+    if (from == NULL)
+        return BOOKING_NO_TICKET;
+    if (fromSeat == toSeat)
+        return BOOKING_OK;
+
+    Ticket moving = nodeRecord(txn->store, from)->ticketData;
+    ticketKey(toKey, eventCode, toSeat);
+    TreeNode *to = txnLookup(txn, toKey);
+    if (to == NULL)
+    {
+        txnDelete(txn, fromKey);
+        moving.seatId = toSeat;
+        txnInsert(txn, toKey, TICKET_NODE, &moving);
+        return BOOKING_OK;
+    }
+    if (!allowSwap)
+        return BOOKING_SEAT_TAKEN;
+
+    // Each ticket keeps its seat and takes the other one's holder.
+    Ticket staying = nodeRecord(txn->store, to)->ticketData;
+    Ticket first = moving;
+    strcpy(first.afm, staying.afm);
+    strcpy(first.firstName, staying.firstName);
+    strcpy(first.lastName, staying.lastName);
+    strcpy(staying.afm, moving.afm);
+    strcpy(staying.firstName, moving.firstName);
+    strcpy(staying.lastName, moving.lastName);
+    txnUpdate(txn, fromKey, &first);
+    txnUpdate(txn, toKey, &staying);
+    if (swapped != NULL)
+        *swapped = 1;
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Cancels the ticket of a seat inside a transaction, releasing the
+ * seat (see txnOfferSeat() for passing it on).
+ */
+BookingResult txnCancelTicket(WriteTxn *txn, int eventCode, int seatId)
+{
+    char key[20];
+    if (seatId < 0 || seatId >= txn->store->layout.seatCount)
+        return BOOKING_INVALID_SEAT;
+
+    ticketKey(key, eventCode, seatId);
+    if (txnLookup(txn, key) == NULL)
+        return BOOKING_NO_TICKET;
+
+    txnDelete(txn, key);
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Moves the tickets of one event to another as one batch of deletes
+ * and inserts (see txnApplyBatch()), provided none of their seats is taken
+ * there.
+ */
+static BookingResult txnMoveTicketsBatch(WriteTxn *txn, int fromCode, int toCode, int *ticketCount)
+{
+    int count = 0;
+    int capacity = 10;
+    char **keysToMove = malloc(capacity * sizeof(char *));
+    if (!keysToMove)
+    {
+        perror("(!) Malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    collectTicketKeysForEvent(txn->root, fromCode, &keysToMove, &count, &capacity);
+
+    BatchOp *ops = malloc((2 * count + 1) * sizeof(BatchOp));
+    if (!ops)
+    {
+        perror("(!) Malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    BookingResult result = BOOKING_OK;
+    for (int i = 0; i < count; i++)
+    {
+        BatchOp *remove = &ops[2 * i];
+        BatchOp *insert = &ops[2 * i + 1];
+        memset(remove, 0, sizeof(BatchOp));
+        remove->op = BATCH_DELETE;
+        strcpy(remove->key, keysToMove[i]);
+        memset(insert, 0, sizeof(BatchOp));
+        insert->op = BATCH_INSERT;
+        insert->type = TICKET_NODE;
+        insert->data.ticketData = nodeRecord(txn->store, txnLookup(txn, keysToMove[i]))->ticketData;
+        insert->data.ticketData.eventCode = toCode;
+        ticketKey(insert->key, toCode, insert->data.ticketData.seatId);
+        if (result == BOOKING_OK && txnLookup(txn, insert->key) != NULL)
+            result = BOOKING_SEAT_TAKEN;
+        free(keysToMove[i]);
+    }
+    free(keysToMove);
+
+    if (result == BOOKING_OK)
+        txnApplyBatch(txn, ops, 2 * count);
+    free(ops);
+    if (ticketCount != NULL)
+        *ticketCount = result == BOOKING_OK ? count : 0;
+    return result;
+}
+
+/**
+ * @brief Moves every ticket of event fromCode, with its seat and holder,
+ * to event toCode inside a transaction. When toCode has no tickets yet, as
+ * when an event is rescheduled under a new code, the ticket range is split
+ * off the tree, relabelled and joined back in at its new place, touching
+ * only the nodes along the range boundaries besides the tickets themselves.
+ * When merging into an event that already sold seats, the tickets move as
+ * one batch, and only if none of their seats is taken there.
+ * @param ticketCount Set to the number of tickets moved (may be NULL).
+ */
+BookingResult txnMoveTickets(WriteTxn *txn, int fromCode, int toCode, int *ticketCount)
+{
+    char eventKey[20];
+    char from[20];
+    char to[20];
+    sprintf(eventKey, "E_%d", fromCode);
+    if (txnLookup(txn, eventKey) == NULL)
+        return BOOKING_NO_EVENT;
+    sprintf(eventKey, "E_%d", toCode);
+    if (txnLookup(txn, eventKey) == NULL)
+        return BOOKING_NO_EVENT;
+
+    int count = 0;
+    ticketKeyRange(from, to, toCode);
+    if (fromCode != toCode && countKeyRange(txn->root, from, to) > 0)
+        return txnMoveTicketsBatch(txn, fromCode, toCode, ticketCount);
+
+    if (fromCode != toCode)
+    {
+        TreeNode *before;
+        TreeNode *range;
+        ticketKeyRange(from, to, fromCode);
+        TreeNode *after = txnSplit(txn, txn->root, to, &range);
+        range = txnSplit(txn, range, from, &before);
+        range = txnRelabelTickets(txn, range, toCode, &count);
+        TreeNode *rest = txnJoin(txn, before, after);
+
+        ticketKeyRange(from, to, toCode);
+        after = txnSplit(txn, rest, from, &before);
+        txn->root = txnJoin(txn, txnJoin(txn, before, range), after);
+    }
+    if (ticketCount != NULL)
+        *ticketCount = count;
+    return BOOKING_OK;
+}
+
+/**
+ * @brief Initializes an empty request queue.
+ * @param lockFree 1 for the lock-free ring, 0 for the mutex-guarded one.
+ */
+void queueInit(RequestQueue *queue, int lockFree)
+{
+    queue->lockFree = lockFree;
+    queue->cells = (QueueCell *)malloc(REQUEST_QUEUE_SIZE * sizeof(QueueCell));
+    if (!queue->cells)
+    {
+        perror("(!) Failed to allocate memory for the request queue");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < REQUEST_QUEUE_SIZE; i++)
+    {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].request = NULL;
+    }
+    atomic_init(&queue->enqueuePos, 0);
+    queue->dequeuePos = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->count = 0;
+}
+
+void queueDestroy(RequestQueue *queue)
+{
+    free(queue->cells);
+    queue->cells = NULL;
+    pthread_mutex_destroy(&queue->lock);
+}
+
+/**
+ * @brief Adds a request to the queue.
+ * @return 1 on success, 0 if the queue is full.
+ */
+int queueSubmit(RequestQueue *queue, BookingRequest *request)
+{
+    const size_t mask = REQUEST_QUEUE_SIZE - 1;
+
+    if (!queue->lockFree)
+    {
+        pthread_mutex_lock(&queue->lock);
+        if (queue->count == REQUEST_QUEUE_SIZE)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return 0;
+        }
+        size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        queue->cells[pos & mask].request = request;
+        atomic_store_explicit(&queue->enqueuePos, pos + 1, memory_order_relaxed);
+        queue->count++;
+        pthread_mutex_unlock(&queue->lock);
+        return 1;
+    }
+
+    // A cell is free for position pos when its sequence equals pos; the
+    // producer that wins the CAS on enqueuePos owns it.
+    size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    for (;;)
+    {
+        QueueCell *cell = &queue->cells[pos & mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                cell->request = request;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0; // The consumer has not freed this cell yet: full
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Takes up to max queued requests, in submission order (consumer only).
+ * @return The number of requests stored in batch.
+ */
+int queueDrain(RequestQueue *queue, BookingRequest **batch, int max)
+{
+    const size_t mask = REQUEST_QUEUE_SIZE - 1;
+    int taken = 0;
+
+    if (!queue->lockFree)
+    {
+        pthread_mutex_lock(&queue->lock);
+        while (taken < max && queue->count > 0)
+        {
+            batch[taken++] = queue->cells[queue->dequeuePos++ & mask].request;
+            queue->count--;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        return taken;
+    }
+
+    while (taken < max)
+    {
+        QueueCell *cell = &queue->cells[queue->dequeuePos & mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence != queue->dequeuePos + 1)
+            break; // Not published yet: the batch ends here
+        batch[taken++] = cell->request;
+        // Hand the cell back to producers for the next lap of the ring.
+        atomic_store_explicit(&cell->sequence, queue->dequeuePos + REQUEST_QUEUE_SIZE, memory_order_release);
+        queue->dequeuePos++;
+    }
+    return taken;
+}
+
+/**
+ * @brief Applies one batch of requests as a single transaction, then
+ * reports each result to its submitter.
+ */
+static void applyBatch(BookingCore *core, BookingRequest **batch, int count)
+{
+    WriteTxn txn;
+    BookingResult results[MAX_BATCH];
+
+    storeBeginWrite(core->store, &txn);
+    for (int i = 0; i < count; i++)
+    {
+        switch (batch[i]->type)
+        {
+        case REQUEST_ADD_EVENT:
+            results[i] = txnAddEvent(&txn, &batch[i]->data.eventData);
+            break;
+        case REQUEST_ADD_TICKET:
+            results[i] = txnAddTicket(&txn, &batch[i]->data.ticketData);
+            break;
+        case REQUEST_REMOVE_EVENT:
+            results[i] = txnRemoveEvent(&txn, batch[i]->data.eventData.code, NULL);
+            break;
+        }
+    }
+    int saved = storeCommit(&txn) != 0;
+
+    // Results become visible only once the batch is committed.
+    for (int i = 0; i < count; i++)
+    {
+        atomic_store_explicit(&batch[i]->status, (int)(saved ? results[i] : BOOKING_NOT_SAVED), memory_order_release);
+    }
+    atomic_fetch_add(&core->applied, count);
+    core->batches++;
+    if (count > core->largestBatch)
+        core->largestBatch = count;
+}
+
+/**
+ * @brief The writer thread: drains whatever has been queued and applies it
+ * in one pass, until stopped and the queue is empty.
+ */
+static void *bookingWriter(void *arg)
+{
+    BookingCore *core = (BookingCore *)arg;
+    BookingRequest **batch = malloc(MAX_BATCH * sizeof(BookingRequest *));
+    if (!batch)
+    {
+        perror("(!) Failed to allocate memory for the writer batch");
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;)
+    {
+        int count = queueDrain(&core->queue, batch, MAX_BATCH);
+        if (count > 0)
+        {
+            applyBatch(core, batch, count);
+        }
+        else if (atomic_load(&core->stop))
+        {
+            break;
+        }
+        else
+        {
+            sched_yield(); // Nothing queued: let the producers run
+        }
+    }
+    free(batch);
+    return NULL;
+}
+
+/**
+ * @brief Starts the writer thread of a booking core over a store.
+ */
+void bookingCoreStart(BookingCore *core, Store *store, int lockFree)
+{
+    core->store = store;
+    queueInit(&core->queue, lockFree);
+    atomic_init(&core->stop, 0);
+    atomic_init(&core->applied, 0);
+    core->batches = 0;
+    core->largestBatch = 0;
+
+    if (pthread_create(&core->writer, NULL, bookingWriter, core) != 0)
+    {
+        perror("(!) Failed to start the booking writer");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Submits a request, waiting for room while the queue is full.
+ * Poll request->status to learn the outcome.
+ */
+void bookingSubmit(BookingCore *core, BookingRequest *request)
+{
+    atomic_store_explicit(&request->status, REQUEST_PENDING, memory_order_relaxed);
+    while (!queueSubmit(&core->queue, request))
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Applies every request still queued, then stops the writer thread.
+ */
+void bookingCoreStop(BookingCore *core)
+{
+    atomic_store(&core->stop, 1);
+    pthread_join(core->writer, NULL);
+    queueDestroy(&core->queue);
+}
+
+/**
+ * @brief Hands the next waiting clients their verdict, in arrival order
+ * (gatekeeper only).
+ * @return The number of clients that left the ring.
+ */
+static int waitingRoomRelease(WaitingRoom *room, int max, int verdict)
+{
+    const size_t mask = WAITING_ROOM_SIZE - 1;
+    int released = 0;
+    while (released < max)
+    {
+        AdmissionCell *cell = &room->cells[room->dequeuePos & mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence != room->dequeuePos + 1)
+            break; // Nobody (else) waiting
+        atomic_store_explicit(cell->pass, verdict, memory_order_release);
+        atomic_store_explicit(&cell->sequence, room->dequeuePos + WAITING_ROOM_SIZE, memory_order_release);
+        room->dequeuePos++;
+        released++;
+    }
+    return released;
+}
+
+/**
+ * @brief The gatekeeper thread: every ADMIT_INTERVAL_MS it admits as many
+ * waiting clients as the rate allows for the time gone by. An empty room
+ * saves up no admissions, so clients who arrive after a lull do not rush
+ * in together. Once the room closes, everyone still waiting is told.
+ */
+static void *waitingRoomGatekeeper(void *arg)
+{
+    WaitingRoom *room = arg;
+    double owed = 0;
+    double last = monotonicSeconds();
+    for (;;)
+    {
+        int stopping = atomic_load(&room->stop);
+        if (atomic_load(&room->closed))
+        {
+            room->shutOut += waitingRoomRelease(room, INT_MAX, ROOM_CLOSED);
+            if (stopping)
+                break;
+        }
+        else
+        {
+            double now = monotonicSeconds();
+            owed += (now - last) * room->rate;
+            last = now;
+            int due = owed < INT_MAX ? (int)owed : INT_MAX;
+            int admitted = waitingRoomRelease(room, due, ROOM_ADMITTED);
+            atomic_fetch_add(&room->admitted, admitted);
+            owed -= admitted;
+            if (admitted < due && owed > 1)
+                owed = 1;
+        }
+        sleepMillis(ADMIT_INTERVAL_MS);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens an empty waiting room and starts its gatekeeper.
+ * @param rate Clients admitted per second.
+ */
+void waitingRoomOpen(WaitingRoom *room, double rate)
+{
+    room->cells = (AdmissionCell *)malloc(WAITING_ROOM_SIZE * sizeof(AdmissionCell));
+    if (!room->cells)
+    {
+        perror("(!) Failed to allocate memory for the waiting room");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < WAITING_ROOM_SIZE; i++)
+    {
+        atomic_init(&room->cells[i].sequence, i);
+        room->cells[i].pass = NULL;
+    }
+    atomic_init(&room->enqueuePos, 0);
+    room->dequeuePos = 0;
+    room->rate = rate;
+    atomic_init(&room->stop, 0);
+    atomic_init(&room->closed, 0);
+    atomic_init(&room->admitted, 0);
+    atomic_init(&room->turnedAway, 0);
+    room->shutOut = 0;
+
+    if (pthread_create(&room->gatekeeper, NULL, waitingRoomGatekeeper, room) != 0)
+    {
+        perror("(!) Failed to start the waiting room gatekeeper");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Puts a client in line. The client then polls *pass until it turns
+ * ROOM_ADMITTED, or ROOM_CLOSED if the sale ends first.
+ * @return 1 if the client is in line, 0 if the room is full or closed.
+ */
+int waitingRoomEnter(WaitingRoom *room, atomic_int *pass)
+{
+    const size_t mask = WAITING_ROOM_SIZE - 1;
+    if (atomic_load_explicit(&room->closed, memory_order_relaxed))
+    {
+        atomic_fetch_add(&room->turnedAway, 1);
+        return 0;
+    }
+
+    atomic_store_explicit(pass, ROOM_WAITING, memory_order_relaxed);
+    size_t pos = atomic_load_explicit(&room->enqueuePos, memory_order_relaxed);
+    for (;;)
+    {
+        AdmissionCell *cell = &room->cells[pos & mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&room->enqueuePos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                cell->pass = pass;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            atomic_fetch_add(&room->turnedAway, 1);
+            return 0; // Full
+        }
+        else
+        {
+            pos = atomic_load_explicit(&room->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Ends the sale: nobody else gets in, and the clients still in line
+ * are told so at the gatekeeper's next round.
+ */
+void waitingRoomClose(WaitingRoom *room)
+{
+    atomic_store(&room->closed, 1);
+}
+
+/**
+ * @brief Closes the room, releases everyone still in line and stops the
+ * gatekeeper. No client may enter any more.
+ */
+void waitingRoomStop(WaitingRoom *room)
+{
+    waitingRoomClose(room);
+    atomic_store(&room->stop, 1);
+    pthread_join(room->gatekeeper, NULL);
+    free(room->cells);
+    room->cells = NULL;
+}
+
+// --- Waitlist Functions ---
+
+/**
+ * @brief Creates the empty waitlists of a private store.
+ */
+Waitlists *waitlistsCreate(void)
+{
+    Waitlists *waitlists = malloc(sizeof(Waitlists));
+    if (!waitlists)
+    {
+        perror("(!) Failed to allocate memory for the waitlists");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&waitlists->lock, NULL);
+    waitlists->lists = NULL;
+    waitlists->count = 0;
+    waitlists->capacity = 0;
+    waitlists->joined = 0;
+    return waitlists;
+}
+
+/**
+ * @brief Frees every waitlist and their waiters.
+ */
+void waitlistsDestroy(Waitlists *waitlists)
+{
+    for (int i = 0; i < waitlists->count; i++)
+    {
+        free(waitlists->lists[i].heap);
+    }
+    free(waitlists->lists);
+    pthread_mutex_destroy(&waitlists->lock);
+    free(waitlists);
+}
+
+/**
+ * @brief Finds the waitlist of an event by binary search, optionally
+ * creating it in its sorted place. The caller holds the lock.
+ * @return The waitlist, or NULL if the event has none and create is 0.
+ */
+static Waitlist *waitlistFind(Waitlists *waitlists, int eventCode, int create)
+{
+    int low = 0;
+    int high = waitlists->count;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (waitlists->lists[mid].eventCode < eventCode)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low < waitlists->count && waitlists->lists[low].eventCode == eventCode)
+        return &waitlists->lists[low];
+    if (!create)
+        return NULL;
+
+    if (waitlists->count == waitlists->capacity)
+    {
+        int capacity = waitlists->capacity == 0 ? 8 : waitlists->capacity * 2;
+        Waitlist *lists = realloc(waitlists->lists, capacity * sizeof(Waitlist));
+        if (!lists)
+        {
+            perror("(!) Failed to allocate memory for the waitlists");
+            exit(EXIT_FAILURE);
+        }
+        waitlists->lists = lists;
+        waitlists->capacity = capacity;
+    }
+    memmove(&waitlists->lists[low + 1], &waitlists->lists[low], (waitlists->count - low) * sizeof(Waitlist));
+    waitlists->count++;
+    Waitlist *list = &waitlists->lists[low];
+    list->eventCode = eventCode;
+    list->count = 0;
+    list->capacity = 0;
+    list->heap = NULL;
+    return list;
+}
+
+/**
+ * @brief Tells whether a waiter comes before another: a higher tier first,
+ * then whoever joined earlier.
+ */
+static int waitBefore(const WaitEntry *a, const WaitEntry *b)
+{
+    if (a->tier != b->tier)
+        return a->tier > b->tier;
+    return a->joined < b->joined;
+}
+
+/**
+ * @brief Makes room for one more waiter in a waitlist's heap.
+ */
+static void waitlistGrow(Waitlist *list)
+{
+    if (list->count < list->capacity)
+        return;
+    int capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+    WaitEntry *heap = realloc(list->heap, capacity * sizeof(WaitEntry));
+    if (!heap)
+    {
+        perror("(!) Failed to allocate memory for the waitlist");
+        exit(EXIT_FAILURE);
+    }
+    list->heap = heap;
+    list->capacity = capacity;
+}
+
+/**
+ * @brief Adds an entry to a waitlist's heap, which has room for it.
+ */
+static void waitlistPush(Waitlist *list, const WaitEntry *entry)
+{
+    // Sift up: move parents that come later down into the hole.
+    int i = list->count++;
+    while (i > 0 && waitBefore(entry, &list->heap[(i - 1) / 2]))
+    {
+        list->heap[i] = list->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    list->heap[i] = *entry;
+}
+
+/**
+ * @brief Puts a spectator on the waitlist of an event, in O(log w).
+ * The entry's join order is set here; its tier decides ahead of it.
+ * @return The number of spectators now waiting, or -1 if the store keeps
+ * no waitlists (a shared store).
+ */
+int waitlistJoin(Store *store, int eventCode, WaitEntry *entry)
+{
+    Waitlists *waitlists = store->waitlists;
+    if (waitlists == NULL)
+        return -1;
+
+    pthread_mutex_lock(&waitlists->lock);
+    Waitlist *list = waitlistFind(waitlists, eventCode, 1);
+    waitlistGrow(list);
+    entry->joined = ++waitlists->joined;
+    waitlistPush(list, entry);
+    int count = list->count;
+    pthread_mutex_unlock(&waitlists->lock);
+    return count;
+}
+
+/**
+ * @brief Puts a waiter txnOfferSeat() served back on their event's
+ * waitlist, in their old place, when the commit giving them the seat failed.
+ */
+void waitlistReturn(Store *store, int eventCode, const WaitEntry *entry)
+{
+    Waitlists *waitlists = store->waitlists;
+    if (waitlists == NULL)
+        return;
+
+    pthread_mutex_lock(&waitlists->lock);
+    Waitlist *list = waitlistFind(waitlists, eventCode, 1);
+    waitlistGrow(list);
+    waitlistPush(list, entry);
+    pthread_mutex_unlock(&waitlists->lock);
+}
+
+/**
+ * @brief Counts the spectators waiting for an event.
+ */
+int waitlistLength(Store *store, int eventCode)
+{
+    Waitlists *waitlists = store->waitlists;
+    if (waitlists == NULL)
+        return 0;
+
+    pthread_mutex_lock(&waitlists->lock);
+    Waitlist *list = waitlistFind(waitlists, eventCode, 0);
+    int count = list != NULL ? list->count : 0;
+    pthread_mutex_unlock(&waitlists->lock);
+    return count;
+}
+
+/**
+ * @brief Discards the waitlist of an event, once the event is deleted.
+ */
+void waitlistDrop(Store *store, int eventCode)
+{
+    Waitlists *waitlists = store->waitlists;
+    if (waitlists == NULL)
+        return;
+
+    pthread_mutex_lock(&waitlists->lock);
+    Waitlist *list = waitlistFind(waitlists, eventCode, 0);
+    if (list != NULL)
+    {
+        int i = (int)(list - waitlists->lists);
+        free(list->heap);
+        memmove(list, list + 1, (waitlists->count - i - 1) * sizeof(Waitlist));
+        waitlists->count--;
+    }
+    pthread_mutex_unlock(&waitlists->lock);
+}
+
+/**
+ * @brief Offers a released seat to the next waiter of its event inside the
+ * transaction that released it: the ticket is issued to them in the same
+ * commit, so the seat is never seen free while someone waits for it. The
+ * waiter leaves the heap in O(log w).
+ * @param served Set to the waiter who got the seat (may be NULL).
+ * @return 1 if a waiter got the seat, 0 if nobody waits or the seat could
+ * not be issued.
+ */
+int txnOfferSeat(WriteTxn *txn, int eventCode, int seatId, WaitEntry *served)
+{
+    Waitlists *waitlists = txn->store->waitlists;
+    if (waitlists == NULL)
+        return 0;
+
+    pthread_mutex_lock(&waitlists->lock);
+    Waitlist *list = waitlistFind(waitlists, eventCode, 0);
+    if (list == NULL || list->count == 0)
+    {
+        pthread_mutex_unlock(&waitlists->lock);
+        return 0;
+    }
+
+    WaitEntry next = list->heap[0];
+    Ticket ticket;
+    memset(&ticket, 0, sizeof(Ticket));
+    ticket.eventCode = eventCode;
+    ticket.seatId = seatId;
+    strcpy(ticket.afm, next.afm);
+    strcpy(ticket.firstName, next.firstName);
+    strcpy(ticket.lastName, next.lastName);
+    if (txnAddTicket(txn, &ticket) != BOOKING_OK)
+    {
+        pthread_mutex_unlock(&waitlists->lock);
+        return 0;
+    }
+
+    // Sift down: the last waiter falls from the top to its place.
+    WaitEntry last = list->heap[--list->count];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= list->count)
+            break;
+        if (child + 1 < list->count && waitBefore(&list->heap[child + 1], &list->heap[child]))
+            child++;
+        if (!waitBefore(&list->heap[child], &last))
+            break;
+        list->heap[i] = list->heap[child];
+        i = child;
+    }
+    if (list->count > 0)
+        list->heap[i] = last;
+    pthread_mutex_unlock(&waitlists->lock);
+
+    if (served != NULL)
+        *served = next;
+    return 1;
+}
+
+// --- Journal Functions ---
+
+/**
+ * @brief Returns the wall-clock time in microseconds since the epoch,
+ * comparable between processes.
+ */
+long long currentTimeMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * @brief Suspends the calling thread for the given number of milliseconds.
+ */
+void sleepMillis(int milliseconds)
+{
+    struct timespec delay;
+    delay.tv_sec = milliseconds / 1000;
+    delay.tv_nsec = (milliseconds % 1000) * 1000000L;
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief Starts appending every commit of this process to a booking journal.
+ * The journal must be attached while the store is still empty for replicas
+ * to reproduce it exactly.
+ * @return 1 on success, 0 otherwise.
+ */
+int journalOpen(const char *path)
+{
+    journalFile = fopen(path, "ab");
+    if (journalFile == NULL)
+    {
+        perror("(!) Failed to open the booking journal");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Stops journaling and closes the journal file.
+ */
+void journalClose(void)
+{
+    if (journalFile != NULL)
+    {
+        fclose(journalFile);
+        journalFile = NULL;
+    }
+}
+
+// --- Workload Trace Functions ---
+
+static const char *traceOpNames[TRACE_OP_COUNT] = {
+    "addEvent", "findEvent", "removeEvent", "printEvents",
+    "addTicket", "findTicket", "printTickets", "scanTickets"};
+
+/**
+ * @brief Writes an unsigned number in 7-bit groups, low group first, with
+ * the high bit set on every byte but the last.
+ */
+static void traceWriteVarint(FILE *file, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+/**
+ * @brief Reads a number written by traceWriteVarint().
+ * @return 1 on success, 0 at the end of the file or on a malformed number.
+ */
+static int traceReadVarint(FILE *file, unsigned long long *value)
+{
+    int c;
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if ((c = fgetc(file)) == EOF)
+            return 0;
+        *value |= (unsigned long long)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a string as its length byte followed by its characters.
+ */
+static void traceWriteString(FILE *file, const char *text)
+{
+    size_t length = strlen(text);
+    fputc((int)length, file);
+    fwrite(text, 1, length, file);
+}
+
+/**
+ * @brief Reads a string written by traceWriteString() into a buffer of the
+ * given size.
+ * @return 1 on success, 0 if the file ends or the string does not fit.
+ */
+static int traceReadString(FILE *file, char *buffer, size_t size)
+{
+    int length = fgetc(file);
+    if (length == EOF || (size_t)length >= size)
+        return 0;
+    if (fread(buffer, 1, (size_t)length, file) != (size_t)length)
+        return 0;
+    buffer[length] = '\0';
+    return 1;
+}
+
+/**
+ * @brief Starts recording the operations of this session to a new trace.
+ * @return 1 on success, 0 otherwise.
+ */
+int traceOpen(const char *path)
+{
+    traceFile = fopen(path, "wb");
+    if (traceFile == NULL)
+    {
+        perror("(!) Failed to create the workload trace");
+        return 0;
+    }
+    traceStart = currentTimeMicros();
+    traceLast = 0;
+
+    uint32_t header[2] = {TRACE_MAGIC, TRACE_FORMAT};
+    fwrite(header, sizeof(header), 1, traceFile);
+    return 1;
+}
+
+/**
+ * @brief Stops recording and closes the trace file.
+ */
+void traceClose(void)
+{
+    if (traceFile != NULL)
+    {
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+}
+
+/**
+ * @brief Appends an operation to the trace, stamped with the current time.
+ * Does nothing when no trace is being recorded.
+ */
+void traceRecord(const TraceRecord *record)
+{
+    if (traceFile == NULL)
+        return;
+
+    long long offset = currentTimeMicros() - traceStart;
+    if (offset < traceLast)
+        offset = traceLast; // The wall clock was set back
+    traceWriteVarint(traceFile, (unsigned long long)(offset - traceLast));
+    traceLast = offset;
+    fputc(record->op, traceFile);
+
+    switch (record->op)
+    {
+    case TRACE_ADD_EVENT:
+        traceWriteVarint(traceFile, (unsigned long long)record->data.eventData.code);
+        traceWriteString(traceFile, record->data.eventData.title);
+        traceWriteString(traceFile, record->data.eventData.date);
+        traceWriteString(traceFile, record->data.eventData.time);
+        break;
+    case TRACE_ADD_TICKET:
+        traceWriteVarint(traceFile, (unsigned long long)record->data.ticketData.eventCode);
+        traceWriteVarint(traceFile, (unsigned long long)(record->data.ticketData.seatId + 1)); // 0: no valid seat
+        traceWriteString(traceFile, record->data.ticketData.afm);
+        traceWriteString(traceFile, record->data.ticketData.firstName);
+        traceWriteString(traceFile, record->data.ticketData.lastName);
+        break;
+    case TRACE_FIND_TICKET:
+        traceWriteVarint(traceFile, (unsigned long long)record->code);
+        traceWriteString(traceFile, record->seat);
+        break;
+    case TRACE_SCAN_TICKETS:
+        traceWriteVarint(traceFile, (unsigned long long)record->code);
+        traceWriteVarint(traceFile, (unsigned long long)record->seatCount);
+        for (int i = 0; i < record->seatCount; i++)
+        {
+            traceWriteString(traceFile, record->seats[i]);
+        }
+        break;
+    case TRACE_PRINT_EVENTS:
+        break;
+    default:
+        traceWriteVarint(traceFile, (unsigned long long)record->code);
+    }
+}
+
+/**
+ * @brief Records an operation that takes only an event code.
+ */
+void traceCode(TraceOp op, int code)
+{
+    TraceRecord record;
+    if (traceFile == NULL)
+        return;
+    record.op = op;
+    record.code = code;
+    traceRecord(&record);
+}
+
+/**
+ * @brief Records an addEvent with the details entered so far.
+ */
+void traceAddEvent(const Event *event)
+{
+    TraceRecord record;
+    if (traceFile == NULL)
+        return;
+    record.op = TRACE_ADD_EVENT;
+    record.data.eventData = *event;
+    traceRecord(&record);
+}
+
+/**
+ * @brief Records an addTicket with the details entered so far.
+ */
+void traceAddTicket(const Ticket *ticket)
+{
+    TraceRecord record;
+    if (traceFile == NULL)
+        return;
+    record.op = TRACE_ADD_TICKET;
+    record.data.ticketData = *ticket;
+    traceRecord(&record);
+}
+
+/**
+ * @brief Reads the fields of one trace record.
+ * @return 1 on success, 0 if the file ends or holds something else.
+ */
+static int traceReadFields(FILE *file, TraceRecord *record)
+{
+    unsigned long long delta;
+    unsigned long long number;
+    int op;
+
+    if (!traceReadVarint(file, &delta) || (op = fgetc(file)) == EOF || op >= TRACE_OP_COUNT)
+        return 0;
+    record->offset += (long long)delta;
+    record->op = (TraceOp)op;
+
+    switch (record->op)
+    {
+    case TRACE_ADD_EVENT:
+        memset(&record->data.eventData, 0, sizeof(Event));
+        if (!traceReadVarint(file, &number))
+            return 0;
+        record->data.eventData.code = (int)number;
+        return traceReadString(file, record->data.eventData.title, sizeof(record->data.eventData.title)) &&
+               traceReadString(file, record->data.eventData.date, sizeof(record->data.eventData.date)) &&
+               traceReadString(file, record->data.eventData.time, sizeof(record->data.eventData.time));
+    case TRACE_ADD_TICKET:
+        memset(&record->data.ticketData, 0, sizeof(Ticket));
+        if (!traceReadVarint(file, &number))
+            return 0;
+        record->data.ticketData.eventCode = (int)number;
+        if (!traceReadVarint(file, &number) || number > MAX_VENUE_SEATS)
+            return 0;
+        record->data.ticketData.seatId = (int)number - 1;
+        return traceReadString(file, record->data.ticketData.afm, sizeof(record->data.ticketData.afm)) &&
+               traceReadString(file, record->data.ticketData.firstName, sizeof(record->data.ticketData.firstName)) &&
+               traceReadString(file, record->data.ticketData.lastName, sizeof(record->data.ticketData.lastName));
+    case TRACE_FIND_TICKET:
+        if (!traceReadVarint(file, &number))
+            return 0;
+        record->code = (int)number;
+        return traceReadString(file, record->seat, sizeof(record->seat));
+    case TRACE_SCAN_TICKETS:
+        if (!traceReadVarint(file, &number))
+            return 0;
+        record->code = (int)number;
+        if (!traceReadVarint(file, &number) || number > MAX_SCAN_SEATS)
+            return 0;
+        record->seatCount = (int)number;
+        for (int i = 0; i < record->seatCount; i++)
+        {
+            if (!traceReadString(file, record->seats[i], sizeof(record->seats[i])))
+                return 0;
+        }
+        return 1;
+    case TRACE_PRINT_EVENTS:
+        return 1;
+    default:
+        if (!traceReadVarint(file, &number))
+            return 0;
+        record->code = (int)number;
+        return 1;
+    }
+}
+
+/**
+ * @brief Reads the next operation of a trace, with its offset accumulated
+ * from the previous one read (record->offset must be 0 before the first).
+ * @return 1 on success, 0 at the end of the trace, -1 if it is damaged.
+ */
+int traceRead(FILE *file, TraceRecord *record)
+{
+    int c = fgetc(file);
+    if (c == EOF)
+        return 0;
+    ungetc(c, file);
+    return traceReadFields(file, record) ? 1 : -1;
+}
+
+/**
+ * @brief Performs a recorded operation on a store the way its menu action
+ * does, with every check it makes, but without terminal output (listings
+ * are counted instead of printed).
+ * @return 1 if the operation found or changed something, 0 otherwise.
+ */
+static int replayOperation(Store *store, const TraceRecord *record)
+{
+    char key[20];
+    WriteTxn txn;
+    Snapshot snapshot;
+    int seatId;
+    int done = 0;
+
+    switch (record->op)
+    {
+    case TRACE_ADD_EVENT:
+        sprintf(key, "E_%d", record->data.eventData.code);
+        snapshot = storeBeginRead(store);
+        done = storeLookup(store, snapshot.root, key) == NULL;
+        storeEndRead(store, &snapshot);
+        if (!done)
+            break;
+        storeBeginWrite(store, &txn);
+        done = txnAddEvent(&txn, &record->data.eventData) == BOOKING_OK;
+        if (done)
+            done = storeCommit(&txn) != 0;
+        else
+            storeAbort(&txn);
+        break;
+    case TRACE_ADD_TICKET:
+        sprintf(key, "E_%d", record->data.ticketData.eventCode);
+        snapshot = storeBeginRead(store);
+        done = storeLookup(store, snapshot.root, key) != NULL;
+        storeEndRead(store, &snapshot);
+        if (!done || record->data.ticketData.seatId < 0 || record->data.ticketData.seatId >= store->layout.seatCount)
+        {
+            done = 0;
+            break;
+        }
+        ticketKey(key, record->data.ticketData.eventCode, record->data.ticketData.seatId);
+        snapshot = storeBeginRead(store);
+        done = storeLookup(store, snapshot.root, key) == NULL;
+        storeEndRead(store, &snapshot);
+        if (!done)
+            break;
+        storeBeginWrite(store, &txn);
+        done = txnAddTicket(&txn, &record->data.ticketData) == BOOKING_OK;
+        if (done)
+            done = storeCommit(&txn) != 0;
+        else
+            storeAbort(&txn);
+        break;
+    case TRACE_REMOVE_EVENT:
+        storeBeginWrite(store, &txn);
+        done = txnRemoveEvent(&txn, record->code, NULL) == BOOKING_OK;
+        if (done)
+            done = storeCommit(&txn) != 0;
+        else
+            storeAbort(&txn);
+        break;
+    case TRACE_FIND_EVENT:
+    case TRACE_FIND_TICKET:
+        if (record->op == TRACE_FIND_EVENT)
+            sprintf(key, "E_%d", record->code);
+        else if ((seatId = validateSeat(store, record->seat)) >= 0)
+            ticketKey(key, record->code, seatId);
+        else
+            break;
+        snapshot = storeBeginRead(store);
+        done = storeLookup(store, snapshot.root, key) != NULL;
+        storeEndRead(store, &snapshot);
+        break;
+    case TRACE_PRINT_EVENTS:
+        snapshot = storeBeginRead(store);
+        done = countNodes(snapshot.root, EVENT_NODE, -1) > 0;
+        storeEndRead(store, &snapshot);
+        break;
+    case TRACE_PRINT_TICKETS:
+        sprintf(key, "E_%d", record->code);
+        snapshot = storeBeginRead(store);
+        done = storeLookup(store, snapshot.root, key) != NULL;
+        if (done)
+            countNodes(snapshot.root, TICKET_NODE, record->code);
+        storeEndRead(store, &snapshot);
+        break;
+    case TRACE_SCAN_TICKETS:
+    {
+        char keys[MAX_SCAN_SEATS][20];
+        const char *keyList[MAX_SCAN_SEATS];
+        TreeNode *results[MAX_SCAN_SEATS];
+        int valid = 0;
+        for (int i = 0; i < record->seatCount; i++)
+        {
+            seatId = validateSeat(store, record->seats[i]);
+            if (seatId < 0)
+                continue;
+            ticketKey(keys[valid], record->code, seatId);
+            keyList[valid] = keys[valid];
+            valid++;
+        }
+        snapshot = storeBeginRead(store);
+        searchNodeBatch(snapshot.root, keyList, results, valid);
+        for (int i = 0; i < valid; i++)
+        {
+            done |= results[i] != NULL;
+        }
+        storeEndRead(store, &snapshot);
+        break;
+    }
+    default:
+        break;
+    }
+    return done;
+}
+
+/**
+ * @brief Drives a store with a recorded trace, either as fast as possible
+ * or at the pace it was recorded, and reports the time spent per kind of
+ * operation. The closing checksum of the store's keys tells whether two
+ * store configurations ended up with the same contents.
+ * @return 1 if the whole trace was replayed, 0 otherwise.
+ */
+int runReplay(Store *store, const char *path, int realTime)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("(!) Failed to open the workload trace");
+        return 0;
+    }
+
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != TRACE_MAGIC || header[1] != TRACE_FORMAT)
+    {
+        fprintf(stderr, "(!) '%s' is not a workload trace.\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    long count[TRACE_OP_COUNT] = {0};
+    long hits[TRACE_OP_COUNT] = {0};
+    double total[TRACE_OP_COUNT] = {0};
+    double slowest[TRACE_OP_COUNT] = {0};
+    long operations = 0;
+    TraceRecord record;
+    int status;
+    record.offset = 0;
+
+    double start = monotonicSeconds();
+    while ((status = traceRead(file, &record)) > 0)
+    {
+        if (realTime)
+        {
+            // Wait for the moment the operation happened during the recording.
+            double wait = start + record.offset / 1e6 - monotonicSeconds();
+            if (wait > 0)
+            {
+                struct timespec delay;
+                delay.tv_sec = (time_t)wait;
+                delay.tv_nsec = (long)((wait - (double)delay.tv_sec) * 1e9);
+                nanosleep(&delay, NULL);
+            }
+        }
+
+        double begin = monotonicSeconds();
+        hits[record.op] += replayOperation(store, &record);
+        double elapsed = monotonicSeconds() - begin;
+
+        count[record.op]++;
+        total[record.op] += elapsed;
+        if (elapsed > slowest[record.op])
+            slowest[record.op] = elapsed;
+        operations++;
+    }
+    double elapsed = monotonicSeconds() - start;
+    int complete = status == 0;
+    fclose(file);
+
+    Snapshot snapshot = storeBeginRead(store);
+    unsigned long long checksum = treeChecksum(snapshot.root, 14695981039346656037ULL);
+    storeEndRead(store, &snapshot);
+
+    printf("\n--- REPLAY OF '%s' (%s speed) ---\n", path, realTime ? "original" : "maximum");
+    printf("  %-14s %10s %10s %12s %12s\n", "Operation", "Count", "Hits", "Mean (us)", "Max (us)");
+    for (int i = 0; i < TRACE_OP_COUNT; i++)
+    {
+        if (count[i] == 0)
+            continue;
+        printf("  %-14s %10ld %10ld %12.2f %12.2f\n", traceOpNames[i], count[i], hits[i],
+               total[i] * 1e6 / count[i], slowest[i] * 1e6);
+    }
+    printf("-> %ld operations in %.3f s (%.0f ops/s), recorded over %.3f s.\n", operations, elapsed,
+           elapsed > 0 ? operations / elapsed : 0.0, record.offset / 1e6);
+    printf("-> Final store checksum: %016llx\n", checksum);
+    if (!complete)
+    {
+        printf("(!) The trace is damaged after operation %ld; the rest was not replayed.\n", operations);
+    }
+    printf("--- END OF REPLAY ---\n");
+    return complete;
+}
+
+// --- Read Replica Functions ---
+
+/**
+ * @brief Updates how many journal bytes are still waiting to be applied.
+ */
+static void replicaUpdatePending(Replica *replica, long offset)
+{
+    struct stat st;
+    if (stat(replica->path, &st) == 0)
+    {
+        atomic_store(&replica->pendingBytes, (long long)st.st_size - offset);
+    }
+}
+
+/**
+ * @brief Follower thread: tails the journal and replays each commit into
+ * the local store as one transaction, so local readers never see half of it.
+ */
+static void *replicaWorker(void *arg)
+{
+    Replica *replica = (Replica *)arg;
+    FILE *file = NULL;
+    long offset = 0; // Start of the next unread record
+    BatchOp *pending = NULL; // Operations of the commit being read
+    int pendingCount = 0;
+    int pendingCapacity = 0;
+
+    while (!atomic_load(&replica->stop))
+    {
+        if (file == NULL && (file = fopen(replica->path, "rb")) == NULL)
+        {
+            sleepMillis(JOURNAL_POLL_MS); // The leader has not created it yet
+            continue;
+        }
+
+        JournalRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1)
+        {
+            // End of the journal, or a record still being written: wait for more.
+            clearerr(file);
+            fseek(file, offset, SEEK_SET);
+            replicaUpdatePending(replica, offset);
+            sleepMillis(JOURNAL_POLL_MS);
+            continue;
+        }
+        offset += sizeof(record);
+
+        if (record.op != JOURNAL_COMMIT)
+        {
+            if (pendingCount >= pendingCapacity)
+            {
+                pendingCapacity = pendingCapacity ? pendingCapacity * 2 : 16;
+                pending = realloc(pending, pendingCapacity * sizeof(BatchOp));
+                if (!pending)
+                {
+                    perror("(!) Realloc failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            BatchOp *op = &pending[pendingCount++];
+            op->op = record.op == JOURNAL_INSERT ? BATCH_INSERT : BATCH_DELETE;
+            strcpy(op->key, record.key);
+            op->type = record.type;
+            op->data = record.data;
+            continue;
+        }
+
+        // The whole commit is merged into the tree in one pass.
+        WriteTxn txn;
+        storeBeginWrite(&replica->store, &txn);
+        txnApplyBatch(&txn, pending, pendingCount);
+        storeCommit(&txn);
+        pendingCount = 0;
+
+        long long lag = currentTimeMicros() - record.timestamp;
+        atomic_store(&replica->appliedVersion, record.version);
+        atomic_fetch_add(&replica->commitsApplied, 1);
+        atomic_store(&replica->lastLag, lag);
+        atomic_fetch_add(&replica->totalLag, lag);
+        if (lag > atomic_load(&replica->maxLag))
+        {
+            atomic_store(&replica->maxLag, lag);
+        }
+        replicaUpdatePending(replica, offset);
+    }
+
+    free(pending); // Drops a commit the leader had not finished writing
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Creates an empty local store and starts following a journal.
+ * @return 1 on success, 0 otherwise.
+ */
+int replicaStart(Replica *replica, const char *path)
+{
+    storeInit(&replica->store);
+    replica->path = path;
+    atomic_init(&replica->stop, 0);
+    atomic_init(&replica->appliedVersion, 1);
+    atomic_init(&replica->commitsApplied, 0);
+    atomic_init(&replica->lastLag, 0);
+    atomic_init(&replica->totalLag, 0);
+    atomic_init(&replica->maxLag, 0);
+    atomic_init(&replica->pendingBytes, 0);
+
+    if (pthread_create(&replica->thread, NULL, replicaWorker, replica) != 0)
+    {
+        perror("(!) Failed to start the journal follower");
+        storeDestroy(&replica->store);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Stops following the journal and frees the local store.
+ */
+void replicaStop(Replica *replica)
+{
+    atomic_store(&replica->stop, 1);
+    pthread_join(replica->thread, NULL);
+    storeDestroy(&replica->store);
+}
+
+/**
+ * @brief Prints how far the replica is behind the leader.
+ */
+void printReplicationStatus(Replica *replica)
+{
+    unsigned long long commits = atomic_load(&replica->commitsApplied);
+
+    printf("\n--- REPLICATION STATUS ---\n");
+    printf("  Journal: %s\n", replica->path);
+    printf("  Applied version: %lu (%llu commits replayed)\n",
+           atomic_load(&replica->appliedVersion), commits);
+    printf("  Lag of last commit: %.3f ms\n", atomic_load(&replica->lastLag) / 1000.0);
+    printf("  Average lag: %.3f ms\n",
+           commits ? atomic_load(&replica->totalLag) / 1000.0 / commits : 0.0);
+    printf("  Maximum lag: %.3f ms\n", atomic_load(&replica->maxLag) / 1000.0);
+    printf("  Pending journal bytes: %lld\n", atomic_load(&replica->pendingBytes));
+    printf("--- END OF STATUS ---\n");
+}
+
+/**
+ * @brief Displays the read-only menu of a replica.
+ */
+void replicaMenu(Replica *replica)
+{
+    int choice;
+    do
+    {
+        printf("\n--- READ REPLICA MENU (following %s) ---\n", replica->path);
+        printf("1. Print List of Events\n");
+        printf("2. Search for Event (by Code)\n");
+        printf("3. Print List of Tickets for an Event\n");
+        printf("4. Search for Ticket (by Seat & Event Code)\n");
+        printf("5. Replication Status\n");
+        printf("6. Exit\n");
+        printf("Select [1-6]: ");
+        choice = getIntegerInput();
+
+        switch (choice)
+        {
+        case 1:
+            printEvents(&replica->store);
+            break;
+        case 2:
+            findEvent(&replica->store);
+            break;
+        case 3:
+            printTicketsForEvent(&replica->store);
+            break;
+        case 4:
+            findTicket(&replica->store);
+            break;
+        case 5:
+            printReplicationStatus(replica);
+            break;
+        case 6:
+            break;
+        default:
+            printf("(!) Invalid choice.\n");
+        }
+    } while (choice != 6);
+}
+
+// --- Hash Index Functions ---
+
+#define INDEX_EMPTY 0ULL            // Slot never used
+#define INDEX_DELETED 0xFFFFFFFEULL // Tombstone: no packed key has this low half
+
+/**
+ * @brief Scrambles a packed key so neighbouring seats spread over the table.
+ */
+static size_t indexHash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+static IndexTable *indexTableNew(size_t capacity)
+{
+    IndexTable *table = malloc(sizeof(IndexTable) + capacity * sizeof(IndexEntry));
+    if (!table)
+    {
+        perror("(!) Failed to allocate memory for the hash index");
+        exit(EXIT_FAILURE);
+    }
+    table->mask = capacity - 1;
+    table->retiredAt = 0;
+    table->nextRetired = NULL;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        atomic_init(&table->entries[i].key, INDEX_EMPTY);
+        atomic_init(&table->entries[i].node, NULL);
+        atomic_init(&table->entries[i].version, 0);
+    }
+    return table;
+}
+
+/**
+ * @brief Creates an empty hash index.
+ */
+HashIndex *indexCreate(void)
+{
+    HashIndex *index = malloc(sizeof(HashIndex));
+    if (!index)
+    {
+        perror("(!) Failed to allocate memory for the hash index");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&index->table, indexTableNew(INDEX_MIN_CAPACITY));
+    atomic_init(&index->removedAt, 0);
+    index->used = 0;
+    index->live = 0;
+    index->retired = NULL;
+    return index;
+}
+
+/**
+ * @brief Frees a hash index. No reader or writer may be active.
+ */
+void indexDestroy(HashIndex *index)
+{
+    while (index->retired != NULL)
+    {
+        IndexTable *next = index->retired->nextRetired;
+        free(index->retired);
+        index->retired = next;
+    }
+    free(atomic_load(&index->table));
+    free(index);
+}
+
+/**
+ * @brief Packs a tree key into the 64-bit key of the hash index: the event
+ * code in the high half, and the seat ID + 1 in the low half for a ticket
+ * or all ones for an event.
+ * @return 1 on success, 0 if the key is not a canonical event or ticket key.
+ */
+int indexKey(const char *key, uint64_t *packed)
+{
+    char kind = key[0];
+    if ((kind != 'E' && kind != 'T') || key[1] != '_')
+        return 0;
+
+    const char *c = key + 2;
+    int negative = *c == '-';
+    if (negative)
+        c++;
+    if (!isdigit((unsigned char)*c) || (*c == '0' && isdigit((unsigned char)c[1])))
+        return 0; // Leading zeros: not how the key would be written
+    long long code = 0;
+    while (isdigit((unsigned char)*c))
+    {
+        code = code * 10 + (*c++ - '0');
+        if (code > (long long)INT_MAX + 1)
+            return 0;
+    }
+    if (negative)
+        code = -code;
+    if (code < INT_MIN || code > INT_MAX)
+        return 0;
+    uint64_t high = (uint64_t)(uint32_t)(int)code << 32;
+
+    if (kind == 'E')
+    {
+        if (*c != '\0')
+            return 0;
+        *packed = high | 0xFFFFFFFFULL;
+        return 1;
+    }
+
+    // Seats are always written with 5 digits (see ticketKey()).
+    if (*c++ != '_')
+        return 0;
+    uint64_t seat = 0;
+    for (int digits = 0; digits < 5; digits++, c++)
+    {
+        if (!isdigit((unsigned char)*c))
+            return 0;
+        seat = seat * 10 + (uint64_t)(*c - '0');
+    }
+    if (*c != '\0')
+        return 0;
+    *packed = high | (seat + 1);
+    return 1;
+}
+
+/**
+ * @brief Probes the index for a packed key. Lock-free; the caller must
+ * hold a snapshot of the store (or its writer lock).
+ * @param version Set to the commit that pointed the key at the node found.
+ */
+static TreeNode *indexFind(HashIndex *index, uint64_t packed, unsigned long *version)
+{
+    IndexTable *table = atomic_load_explicit(&index->table, memory_order_acquire);
+    for (size_t i = indexHash(packed) & table->mask;; i = (i + 1) & table->mask)
+    {
+        uint64_t key = atomic_load_explicit(&table->entries[i].key, memory_order_acquire);
+        if (key == packed)
+        {
+            // The node is stored after its version: the version read next is at least the node's.
+            TreeNode *node = atomic_load_explicit(&table->entries[i].node, memory_order_acquire);
+            *version = atomic_load_explicit(&table->entries[i].version, memory_order_relaxed);
+            return node;
+        }
+        if (key == INDEX_EMPTY)
+            return NULL;
+    }
+}
+
+/**
+ * @brief Moves the live keys to a table of at least three times their
+ * number (and INDEX_MIN_CAPACITY), dropping the tombstones, so the load
+ * stays between one third and one half. The old table is retired
+ * as of the commit being built: readers pinned to older versions may still
+ * be probing it.
+ */
+static void indexResize(HashIndex *index, unsigned long version)
+{
+    IndexTable *old = atomic_load_explicit(&index->table, memory_order_relaxed);
+    size_t capacity = INDEX_MIN_CAPACITY;
+    while (capacity < index->live * 3)
+    {
+        capacity *= 2;
+    }
+
+    IndexTable *table = indexTableNew(capacity);
+    for (size_t i = 0; i <= old->mask; i++)
+    {
+        uint64_t key = atomic_load_explicit(&old->entries[i].key, memory_order_relaxed);
+        if (key == INDEX_EMPTY || key == INDEX_DELETED)
+            continue;
+        size_t slot = indexHash(key) & table->mask;
+        while (atomic_load_explicit(&table->entries[slot].key, memory_order_relaxed) != INDEX_EMPTY)
+        {
+            slot = (slot + 1) & table->mask;
+        }
+        atomic_store_explicit(&table->entries[slot].node,
+                              atomic_load_explicit(&old->entries[i].node, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&table->entries[slot].version,
+                              atomic_load_explicit(&old->entries[i].version, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&table->entries[slot].key, key, memory_order_relaxed);
+    }
+    index->used = index->live;
+    atomic_store_explicit(&index->table, table, memory_order_release);
+
+    old->retiredAt = version;
+    old->nextRetired = index->retired;
+    index->retired = old;
+}
+
+/**
+ * @brief Points a key at a node, adding the key if needed (writer only).
+ * The node is stored before the key so a reader that sees the key sees it.
+ */
+static void indexPut(HashIndex *index, uint64_t packed, TreeNode *node, unsigned long version)
+{
+    IndexTable *table = atomic_load_explicit(&index->table, memory_order_relaxed);
+    IndexEntry *slot = NULL;
+
+    for (size_t i = indexHash(packed) & table->mask;; i = (i + 1) & table->mask)
+    {
+        IndexEntry *entry = &table->entries[i];
+        uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+        if (key == packed)
+        {
+            atomic_store_explicit(&entry->version, version, memory_order_relaxed);
+            atomic_store_explicit(&entry->node, node, memory_order_release);
+            return;
+        }
+        if (key == INDEX_DELETED && slot == NULL)
+        {
+            slot = entry; // Reuse the first tombstone, once the key is known to be absent
+        }
+        else if (key == INDEX_EMPTY)
+        {
+            if (slot == NULL)
+            {
+                slot = entry;
+                index->used++;
+            }
+            break;
+        }
+    }
+
+    atomic_store_explicit(&slot->version, version, memory_order_relaxed);
+    atomic_store_explicit(&slot->node, node, memory_order_release);
+    atomic_store_explicit(&slot->key, packed, memory_order_release);
+    index->live++;
+    if (index->used * 2 > table->mask + 1)
+        indexResize(index, version);
+}
+
+/**
+ * @brief Leaves a tombstone in place of a key (writer only).
+ */
+static void indexRemove(HashIndex *index, uint64_t packed)
+{
+    IndexTable *table = atomic_load_explicit(&index->table, memory_order_relaxed);
+    for (size_t i = indexHash(packed) & table->mask;; i = (i + 1) & table->mask)
+    {
+        uint64_t key = atomic_load_explicit(&table->entries[i].key, memory_order_relaxed);
+        if (key == packed)
+        {
+            atomic_store_explicit(&table->entries[i].key, INDEX_DELETED, memory_order_release);
+            index->live--;
+            return;
+        }
+        if (key == INDEX_EMPTY)
+            return;
+    }
+}
+
+/**
+ * @brief Frees the retired tables no reader can be probing anymore: a table
+ * retired by commit N is unreachable for readers that pinned N or later.
+ */
+static void indexReclaim(Store *store)
+{
+    HashIndex *index = store->index;
+    if (index->retired == NULL)
+        return;
+
+    unsigned long limit = ULONG_MAX;
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pinned = atomic_load(&store->readers[i]);
+        if (pinned != 0 && pinned < limit)
+            limit = pinned;
+    }
+
+    IndexTable **link = &index->retired;
+    while (*link != NULL)
+    {
+        IndexTable *table = *link;
+        if (table->retiredAt <= limit)
+        {
+            *link = table->nextRetired;
+            free(table);
+        }
+        else
+        {
+            link = &table->nextRetired;
+        }
+    }
+}
+
+/**
+ * @brief Points the index at every node the transaction created. Path
+ * copying copies all ancestors of a changed node, so those nodes form a
+ * subtree hanging from the root.
+ */
+static void indexAddNodes(HashIndex *index, TreeNode *node, unsigned long version)
+{
+    if (node == NULL || node->version != version)
+        return;
+    uint64_t packed;
+    if (indexKey(node->key, &packed))
+        indexPut(index, packed, node, version);
+    indexAddNodes(index, nodeLeft(node), version);
+    indexAddNodes(index, nodeRight(node), version);
+}
+
+/**
+ * @brief Brings the index up to the version being committed, before it is
+ * published: deleted keys go first, then the keys of the new nodes, which
+ * also restores any deleted key the transaction inserted again.
+ */
+static void indexCommit(WriteTxn *txn)
+{
+    HashIndex *index = txn->store->index;
+    if (index == NULL)
+        return;
+
+    indexReclaim(txn->store);
+    // Stored before any tombstone, so a reader that misses a removed key sees it.
+    if (txn->removedCount > 0)
+        atomic_store_explicit(&index->removedAt, txn->version, memory_order_relaxed);
+    for (int i = 0; i < txn->removedCount; i++)
+    {
+        indexRemove(index, txn->removed[i]);
+    }
+    indexAddNodes(index, txn->root, txn->version);
+}
+
+/**
+ * @brief Looks a key up in the version whose tree is root, through the hash
+ * index when it can answer for that version, otherwise in the tree. The
+ * index follows the latest commit; its answer holds for an older snapshot
+ * only if the key's entry has not changed since. Every node of a tree is at
+ * most as new as its root, so root->version bounds the snapshot's commits.
+ * The caller must hold the snapshot (or the writer lock) while it uses the
+ * node.
+ */
+TreeNode *storeLookup(Store *store, TreeNode *root, const char *key)
+{
+    uint64_t packed;
+    if (store->index == NULL || root == NULL || !indexKey(key, &packed))
+        return searchNode(root, key);
+
+    // A slot freed by a delete may be reused while it is read: probe once
+    // more, then leave it to the tree.
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        unsigned long version = 0;
+        TreeNode *node = indexFind(store->index, packed, &version);
+        if (node == NULL)
+        {
+            // A key removed after the snapshot was taken may still be in it.
+            if (atomic_load_explicit(&store->index->removedAt, memory_order_acquire) > root->version)
+                break;
+            return NULL;
+        }
+        if (version > root->version)
+            break; // Changed after the snapshot
+        if (strcmp(node->key, key) == 0)
+        {
+            if (adaptiveTree)
+                atomic_fetch_add_explicit(&node->hits, 1, memory_order_relaxed);
+            return node;
+        }
+    }
+    return searchNode(root, key);
+}
+
+/**
+ * @brief storeLookup() for many keys; results[i] receives the node for
+ * keys[i] (or NULL). Without an index, the searches are interleaved.
+ */
+void storeLookupBatch(Store *store, TreeNode *root, const char *const *keys, TreeNode **results, int count)
+{
+    if (store->index == NULL)
+    {
+        searchNodeBatch(root, keys, results, count);
+        return;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        results[i] = storeLookup(store, root, keys[i]);
+    }
+}
+
+/**
+ * @brief Looks a key up in the version a transaction is building. Until the
+ * transaction changes something, that is the head version, which the index
+ * describes exactly; after that only its own tree is up to date.
+ */
+TreeNode *txnLookup(WriteTxn *txn, const char *key)
+{
+    if (txn->root == (TreeNode *)relGet(&storeHead(txn->store)->root))
+        return storeLookup(txn->store, txn->root, key);
+    return searchNode(txn->root, key);
+}
+
+// --- Skip List Functions ---
+
+#define SKIP_MARK ((uintptr_t)1) // Low bit of a next link: the node is deleted at that level
+
+static SkipNode *skipPtr(uintptr_t link)
+{
+    return (SkipNode *)(link & ~SKIP_MARK);
+}
+
+static int skipMarked(uintptr_t link)
+{
+    return (link & SKIP_MARK) != 0;
+}
+
+/**
+ * @brief Picks the level of a key's node from a hash of the key, so that
+ * inserting threads share no random state: level k with probability 2^-(k+1).
+ */
+static int skipLevel(const char *key)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (const char *c = key; *c; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    hash ^= hash >> 31;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 29;
+
+    int level = 0;
+    while ((hash & 1) && level < SKIP_MAX_LEVEL - 1)
+    {
+        level++;
+        hash >>= 1;
+    }
+    return level;
+}
+
+static SkipNode *skipNodeNew(const char *key, NodeType type, const void *data, int topLevel)
+{
+    SkipNode *node = malloc(sizeof(SkipNode) + (topLevel + 1) * sizeof(_Atomic uintptr_t));
+    if (!node)
+    {
+        perror("(!) Failed to allocate memory for skip list node");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(node->key, key);
+    node->type = type;
+    if (data == NULL)
+        memset(&node->data, 0, sizeof(NodeData));
+    else if (type == EVENT_NODE)
+        node->data.eventData = *(const Event *)data;
+    else
+        node->data.ticketData = *(const Ticket *)data;
+    node->topLevel = topLevel;
+    atomic_init(&node->owners, 2);
+    node->retiredEpoch = 0;
+    node->nextRetired = NULL;
+    for (int level = 0; level <= topLevel; level++)
+    {
+        atomic_init(&node->next[level], 0);
+    }
+    return node;
+}
+
+/**
+ * @brief Creates an empty skip list.
+ */
+SkipList *skipListCreate(void)
+{
+    SkipList *list = malloc(sizeof(SkipList));
+    if (!list)
+    {
+        perror("(!) Failed to allocate memory for skip list");
+        exit(EXIT_FAILURE);
+    }
+    list->head = skipNodeNew("", EVENT_NODE, NULL, SKIP_MAX_LEVEL - 1);
+    atomic_init(&list->epoch, 1);
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        atomic_init(&list->pins[i], 0);
+    }
+    atomic_init(&list->size, 0);
+    pthread_mutex_init(&list->retireLock, NULL);
+    list->retired = NULL;
+    list->retiredCount = 0;
+    return list;
+}
+
+/**
+ * @brief Frees a skip list and every node in it. No other thread may be
+ * using the list.
+ */
+void skipListDestroy(SkipList *list)
+{
+    SkipNode *node = list->head;
+    while (node != NULL)
+    {
+        SkipNode *next = skipPtr(atomic_load(&node->next[0]));
+        free(node);
+        node = next;
+    }
+    while (list->retired != NULL)
+    {
+        SkipNode *next = list->retired->nextRetired;
+        free(list->retired);
+        list->retired = next;
+    }
+    pthread_mutex_destroy(&list->retireLock);
+    free(list);
+}
+
+/**
+ * @brief Starts an operation: pins the current epoch so nodes retired from
+ * now on stay allocated until the operation ends.
+ * @return The slot to pass to skipLeave().
+ */
+static int skipEnter(SkipList *list)
+{
+    for (;;)
+    {
+        unsigned long pin = atomic_load(&list->epoch);
+        for (int i = 0; i < MAX_READERS; i++)
+        {
+            unsigned long expected = 0;
+            if (atomic_compare_exchange_strong(&list->pins[i], &expected, pin))
+                return i;
+        }
+        sched_yield(); // Every slot is taken, wait for an operation to finish
+    }
+}
+
+static void skipLeave(SkipList *list, int slot)
+{
+    atomic_store(&list->pins[slot], 0);
+}
+
+/**
+ * @brief Frees the retired nodes no running operation can still hold: those
+ * retired before the oldest pinned epoch. Called with retireLock held.
+ */
+static void skipReclaim(SkipList *list)
+{
+    unsigned long oldest = ULONG_MAX;
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        unsigned long pin = atomic_load(&list->pins[i]);
+        if (pin != 0 && pin < oldest)
+            oldest = pin;
+    }
+
+    SkipNode **link = &list->retired;
+    while (*link != NULL)
+    {
+        SkipNode *node = *link;
+        if (node->retiredEpoch < oldest)
+        {
+            *link = node->nextRetired;
+            free(node);
+            list->retiredCount--;
+        }
+        else
+        {
+            link = &node->nextRetired;
+        }
+    }
+}
+
+/**
+ * @brief Drops one claim on an unlinked node; the last claim retires it.
+ * Operations that start after the epoch advances cannot reach the node.
+ */
+static void skipRelease(SkipList *list, SkipNode *node)
+{
+    if (atomic_fetch_sub(&node->owners, 1) != 1)
+        return;
+
+    pthread_mutex_lock(&list->retireLock);
+    node->retiredEpoch = atomic_fetch_add(&list->epoch, 1);
+    node->nextRetired = list->retired;
+    list->retired = node;
+    if (++list->retiredCount >= SKIP_RECLAIM_BATCH)
+        skipReclaim(list);
+    pthread_mutex_unlock(&list->retireLock);
+}
+
+/**
+ * @brief Finds, at every level, the last node before key (preds) and the
+ * first node at or after it (succs), unlinking deleted nodes on the way.
+ * @return 1 if succs[0] holds the key.
+ */
+static int skipFind(SkipList *list, const char *key, SkipNode **preds, SkipNode **succs)
+{
+    for (;;)
+    {
+        SkipNode *pred = list->head;
+        int restart = 0;
+
+        for (int level = SKIP_MAX_LEVEL - 1; level >= 0 && !restart; level--)
+        {
+            SkipNode *curr = skipPtr(atomic_load(&pred->next[level]));
+            while (curr != NULL)
+            {
+                uintptr_t succ = atomic_load(&curr->next[level]);
+                if (skipMarked(succ))
+                {
+                    // Unlink the deleted node; if pred changed meanwhile, start over.
+                    uintptr_t expected = (uintptr_t)curr;
+                    if (!atomic_compare_exchange_strong(&pred->next[level], &expected, succ & ~SKIP_MARK))
+                    {
+                        restart = 1;
+                        break;
+                    }
+                    curr = skipPtr(succ);
+                    continue;
+                }
+                if (strcmp(curr->key, key) >= 0)
+                    break;
+                pred = curr;
+                curr = skipPtr(succ);
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+
+        if (!restart)
+            return succs[0] != NULL && strcmp(succs[0]->key, key) == 0;
+    }
+}
+
+/**
+ * @brief Returns the first live node at or after key without modifying the
+ * list, or NULL. The caller must be inside an operation.
+ */
+static SkipNode *skipSeek(SkipList *list, const char *key)
+{
+    SkipNode *pred = list->head;
+    SkipNode *curr = NULL;
+
+    for (int level = SKIP_MAX_LEVEL - 1; level >= 0; level--)
+    {
+        curr = skipPtr(atomic_load(&pred->next[level]));
+        while (curr != NULL)
+        {
+            uintptr_t succ = atomic_load(&curr->next[level]);
+            if (!skipMarked(succ))
+            {
+                if (strcmp(curr->key, key) >= 0)
+                    break;
+                pred = curr;
+            }
+            curr = skipPtr(succ);
+        }
+    }
+    return curr;
+}
+
+/**
+ * @brief Inserts a node, safe to call from several threads at once.
+ * @return 1 if inserted, 0 if the key already exists.
+ */
+int skipListInsert(SkipList *list, const char *key, NodeType type, void *data)
+{
+    SkipNode *preds[SKIP_MAX_LEVEL];
+    SkipNode *succs[SKIP_MAX_LEVEL];
+    int topLevel = skipLevel(key);
+    SkipNode *node = skipNodeNew(key, type, data, topLevel);
+    int slot = skipEnter(list);
+
+    // The node exists once it is linked at level 0.
+    for (;;)
+    {
+        if (skipFind(list, key, preds, succs))
+        {
+            skipLeave(list, slot);
+            free(node);
+            return 0;
+        }
+        for (int level = 0; level <= topLevel; level++)
+        {
+            atomic_store(&node->next[level], (uintptr_t)succs[level]);
+        }
+        uintptr_t expected = (uintptr_t)succs[0];
+        if (atomic_compare_exchange_strong(&preds[0]->next[0], &expected, (uintptr_t)node))
+            break;
+    }
+    atomic_fetch_add(&list->size, 1);
+
+    // Link the upper levels. A delete may mark the node meanwhile, which
+    // stops the linking.
+    for (int level = 1; level <= topLevel; level++)
+    {
+        int stop = 0;
+        for (;;)
+        {
+            uintptr_t link = atomic_load(&node->next[level]);
+            if (skipMarked(link))
+            {
+                stop = 1;
+                break;
+            }
+            if (skipPtr(link) != succs[level] &&
+                !atomic_compare_exchange_strong(&node->next[level], &link, (uintptr_t)succs[level]))
+                continue;
+            uintptr_t expected = (uintptr_t)succs[level];
+            if (atomic_compare_exchange_strong(&preds[level]->next[level], &expected, (uintptr_t)node))
+                break;
+            if (!skipFind(list, key, preds, succs) || succs[0] != node)
+            {
+                stop = 1; // Deleted already
+                break;
+            }
+        }
+        if (stop)
+            break;
+    }
+
+    // A delete that ran while the upper levels were being linked may have
+    // missed some of them: unlink the node again before letting go of it.
+    if (skipMarked(atomic_load(&node->next[0])))
+        skipFind(list, key, preds, succs);
+    skipRelease(list, node);
+    skipLeave(list, slot);
+    return 1;
+}
+
+/**
+ * @brief Looks up a key, safe to call from several threads at once.
+ * @return 1 and a copy of the node's type and payload if found, 0 otherwise.
+ */
+int skipListSearch(SkipList *list, const char *key, NodeType *type, NodeData *data)
+{
+    int slot = skipEnter(list);
+    SkipNode *node = skipSeek(list, key);
+    int found = node != NULL && strcmp(node->key, key) == 0;
+    if (found)
+    {
+        if (type)
+            *type = node->type;
+        if (data)
+            *data = node->data;
+    }
+    skipLeave(list, slot);
+    return found;
+}
+
+/**
+ * @brief Deletes a key, safe to call from several threads at once. The node
+ * is marked top level first; marking level 0 is the actual delete.
+ * @return 1 if this call deleted the key, 0 if it was not there.
+ */
+int skipListDelete(SkipList *list, const char *key)
+{
+    SkipNode *preds[SKIP_MAX_LEVEL];
+    SkipNode *succs[SKIP_MAX_LEVEL];
+    int slot = skipEnter(list);
+
+    if (!skipFind(list, key, preds, succs))
+    {
+        skipLeave(list, slot);
+        return 0;
+    }
+
+    SkipNode *node = succs[0];
+    for (int level = node->topLevel; level >= 1; level--)
+    {
+        uintptr_t link = atomic_load(&node->next[level]);
+        while (!skipMarked(link) &&
+               !atomic_compare_exchange_strong(&node->next[level], &link, link | SKIP_MARK))
+            ;
+    }
+
+    uintptr_t link = atomic_load(&node->next[0]);
+    for (;;)
+    {
+        if (skipMarked(link))
+        {
+            skipLeave(list, slot); // Another thread deleted it first
+            return 0;
+        }
+        if (atomic_compare_exchange_strong(&node->next[0], &link, link | SKIP_MARK))
+            break;
+    }
+    atomic_fetch_sub(&list->size, 1);
+
+    skipFind(list, key, preds, succs); // Unlinks the node at every level
+    skipRelease(list, node);
+    skipLeave(list, slot);
+    return 1;
+}
+
+/**
+ * @brief Copies the payloads of the keys in [from, to) in key order, at most
+ * max of them; to may be NULL for no upper bound and items NULL to only count
+ * them. Runs alongside writers: every key present for the whole scan is seen.
+ * @return The number of keys in range.
+ */
+long skipListScan(SkipList *list, const char *from, const char *to, NodeData *items, long max)
+{
+    long count = 0;
+    int slot = skipEnter(list);
+
+    for (SkipNode *node = skipSeek(list, from); node != NULL && count < max;)
+    {
+        if (to != NULL && strcmp(node->key, to) >= 0)
+            break;
+        uintptr_t link = atomic_load(&node->next[0]);
+        if (!skipMarked(link))
+        {
+            if (items)
+                items[count] = node->data;
+            count++;
+        }
+        node = skipPtr(link);
+    }
+    skipLeave(list, slot);
+    return count;
+}
+
+// --- Data Log Functions ---
+
+#ifndef _WIN32
+
+#define LOG_MERGE_BUFFER (1024 * 1024) // Bytes a merge collects before writing them out
+
+/**
+ * @brief Checksum (FNV-1a) of everything in a record after the checksum
+ * field. The record's size must already be known to be in bounds.
+ */
+static uint32_t logChecksum(const LogRecord *record)
+{
+    const unsigned char *bytes = (const unsigned char *)record + sizeof(record->checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < record->size - sizeof(record->checksum); i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Size of a record: the header, and for a LOG_PUT its payload.
+ */
+static size_t logRecordSize(LogOp op, NodeType type)
+{
+    if (op == LOG_DELETE)
+        return sizeof(LogRecord);
+    return sizeof(LogRecord) + (type == EVENT_NODE ? sizeof(Event) : sizeof(Ticket));
+}
+
+/**
+ * @brief Checks that a complete, undamaged record starts at the given
+ * position, with available bytes of the segment left from there.
+ */
+static int logRecordValid(const LogRecord *record, size_t available)
+{
+    uint64_t packed;
+    if (available < sizeof(LogRecord) || record->op > LOG_DELETE || record->type > TICKET_NODE)
+        return 0;
+    if (record->size != logRecordSize((LogOp)record->op, (NodeType)record->type) || record->size > available)
+        return 0;
+    if (memchr(record->key, '\0', sizeof(record->key)) == NULL || !indexKey(record->key, &packed))
+        return 0;
+    return logChecksum(record) == record->checksum;
+}
+
+/**
+ * @brief Builds the path of a segment file: gym-<number>.log, with a suffix
+ * for the temporary file of a merge.
+ */
+static void logSegmentPath(const char *directory, unsigned long number, const char *suffix, char *path)
+{
+    snprintf(path, LOG_PATH_SIZE, "%s/gym-%010lu.log%s", directory, number, suffix);
+}
+
+/**
+ * @brief Opens a segment file and maps it, at least mapSize bytes so an
+ * active segment can grow into the mapping.
+ * @return The segment, or NULL on failure.
+ */
+static LogSegment *logSegmentOpen(const char *path, unsigned long number, int flags, size_t mapSize)
+{
+    struct stat st;
+    int fd = open(path, flags, 0600);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror("(!) Failed to open a data log segment");
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    LogSegment *segment = malloc(sizeof(LogSegment));
+    if (!segment)
+    {
+        perror("(!) Failed to allocate memory for a data log segment");
+        exit(EXIT_FAILURE);
+    }
+    segment->number = number;
+    segment->fd = fd;
+    segment->size = (size_t)st.st_size;
+    segment->dead = 0;
+    segment->retiredAt = 0;
+    segment->mapSize = segment->size > mapSize ? segment->size : mapSize;
+    if (segment->mapSize == 0)
+        segment->mapSize = 1; // An empty merge result still gets a mapping
+    void *map = mmap(NULL, segment->mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("(!) Failed to map a data log segment");
+        close(fd);
+        free(segment);
+        return NULL;
+    }
+    segment->map = map;
+    return segment;
+}
+
+/**
+ * @brief Unmaps and closes a segment; the file stays.
+ */
+static void logSegmentClose(LogSegment *segment)
+{
+    munmap((void *)segment->map, segment->mapSize);
+    close(segment->fd);
+    free(segment);
+}
+
+/**
+ * @brief Finds the key directory entry of a packed key.
+ * @return The entry, or NULL if the key has no record.
+ */
+static KeyDirEntry *keyDirFind(const DataLog *log, uint64_t key)
+{
+    for (size_t i = indexHash(key) & log->keyDirMask;; i = (i + 1) & log->keyDirMask)
+    {
+        KeyDirEntry *entry = &log->keyDir[i];
+        if (entry->key == key)
+            return entry;
+        if (entry->key == INDEX_EMPTY)
+            return NULL;
+    }
+}
+
+/**
+ * @brief Rebuilds the key directory without tombstones, with room for
+ * three times its live keys.
+ */
+static void keyDirResize(DataLog *log)
+{
+    size_t capacity = INDEX_MIN_CAPACITY;
+    while (capacity < 3 * (log->keyDirLive + 1))
+    {
+        capacity *= 2;
+    }
+
+    KeyDirEntry *old = log->keyDir;
+    size_t oldCapacity = old != NULL ? log->keyDirMask + 1 : 0;
+    log->keyDir = calloc(capacity, sizeof(KeyDirEntry));
+    if (!log->keyDir)
+    {
+        perror("(!) Failed to allocate memory for the data log directory");
+        exit(EXIT_FAILURE);
+    }
+    log->keyDirMask = capacity - 1;
+    log->keyDirUsed = log->keyDirLive;
+
+    for (size_t i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].key == INDEX_EMPTY || old[i].key == INDEX_DELETED)
+            continue;
+        size_t j = indexHash(old[i].key) & log->keyDirMask;
+        while (log->keyDir[j].key != INDEX_EMPTY)
+        {
+            j = (j + 1) & log->keyDirMask;
+        }
+        log->keyDir[j] = old[i];
+    }
+    free(old);
+}
+
+/**
+ * @brief Points a key at a new record.
+ * @return 1 if the key had a record, whose location is stored in previous,
+ * 0 if it is new.
+ */
+static int keyDirPut(DataLog *log, uint64_t key, uint64_t location, uint64_t *previous)
+{
+    if ((log->keyDirUsed + 1) * 2 > log->keyDirMask + 1)
+        keyDirResize(log);
+
+    KeyDirEntry *reuse = NULL;
+    for (size_t i = indexHash(key) & log->keyDirMask;; i = (i + 1) & log->keyDirMask)
+    {
+        KeyDirEntry *entry = &log->keyDir[i];
+        if (entry->key == key)
+        {
+            *previous = entry->location;
+            entry->location = location;
+            return 1;
+        }
+        if (entry->key == INDEX_DELETED && reuse == NULL)
+        {
+            reuse = entry;
+        }
+        else if (entry->key == INDEX_EMPTY)
+        {
+            if (reuse == NULL)
+            {
+                reuse = entry;
+                log->keyDirUsed++;
+            }
+            reuse->key = key;
+            reuse->location = location;
+            log->keyDirLive++;
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Removes a key from the directory, leaving a tombstone.
+ */
+static void keyDirRemove(DataLog *log, KeyDirEntry *entry)
+{
+    entry->key = INDEX_DELETED;
+    log->keyDirLive--;
+}
+
+/**
+ * @brief Returns the record stored at a location.
+ */
+static const LogRecord *logRecordAt(const DataLog *log, uint64_t location)
+{
+    return (const LogRecord *)(log->segments[LOG_SLOT(location)]->map + LOG_OFFSET(location));
+}
+
+/**
+ * @brief Records a change of the commit being written, if one is.
+ * Called with the lock held exclusively.
+ */
+static void logRecordUndo(DataLog *log, uint64_t key, uint64_t location, int existed)
+{
+    if (!log->writingCommit)
+        return;
+    if (log->undoCount == log->undoCapacity)
+    {
+        log->undoCapacity = log->undoCapacity ? log->undoCapacity * 2 : 64;
+        log->undo = realloc(log->undo, log->undoCapacity * sizeof(LogUndo));
+        if (!log->undo)
+        {
+            perror("(!) Realloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    log->undo[log->undoCount].key = key;
+    log->undo[log->undoCount].location = location;
+    log->undo[log->undoCount].existed = existed;
+    log->undoCount++;
+}
+
+/**
+ * @brief Counts the record at a location as dead, for the merge to drop.
+ */
+static void logMarkDead(DataLog *log, uint64_t location)
+{
+    log->segments[LOG_SLOT(location)]->dead += logRecordAt(log, location)->size;
+    logRecordUndo(log, INDEX_EMPTY, location, 0);
+}
+
+/**
+ * @brief Makes a new, empty file the active segment. The previous active
+ * segment is synced first: from now on it never changes. Called with the
+ * lock held exclusively, or while the log is being opened.
+ * @return 1 on success, 0 otherwise.
+ */
+static int logStartSegment(DataLog *log)
+{
+    char path[LOG_PATH_SIZE];
+    int slot = 0;
+    while (slot < LOG_MAX_SEGMENTS && log->segments[slot] != NULL)
+    {
+        slot++;
+    }
+    if (slot == LOG_MAX_SEGMENTS)
+    {
+        fprintf(stderr, "(!) The data log has too many segment files.\n");
+        return 0;
+    }
+
+    if (log->active >= 0)
+        fdatasync(log->segments[log->active]->fd);
+    logSegmentPath(log->directory, log->nextNumber, "", path);
+    LogSegment *segment = logSegmentOpen(path, log->nextNumber, O_RDWR | O_CREAT | O_TRUNC, LOG_SEGMENT_BYTES);
+    if (segment == NULL)
+        return 0;
+    log->segments[slot] = segment;
+    log->active = slot;
+    log->nextNumber += 2; // Odd numbers are left for merges
+    return 1;
+}
+
+/**
+ * @brief Appends a record to the active segment, starting a new one when
+ * it is full. Called with the lock held exclusively.
+ * @return 1 on success, 0 if the record could not be written.
+ */
+static int logAppend(DataLog *log, const LogRecord *record, uint64_t *location)
+{
+    LogSegment *active = log->segments[log->active];
+    if (active->size + record->size > active->mapSize)
+    {
+        if (!logStartSegment(log))
+            return 0;
+        active = log->segments[log->active];
+    }
+
+    if (pwrite(active->fd, record, record->size, (off_t)active->size) != (ssize_t)record->size)
+    {
+        perror("(!) Failed to write the data log");
+        return 0; // The next append overwrites whatever part was written
+    }
+    *location = LOG_LOCATION(log->active, active->size);
+    active->size += record->size;
+    return 1;
+}
+
+/**
+ * @brief Replays one segment into the key directory, stopping at the first
+ * damaged record; the rest of the file, normally a write torn by a crash,
+ * is cut off.
+ */
+static void logReplaySegment(DataLog *log, int slot)
+{
+    LogSegment *segment = log->segments[slot];
+    size_t offset = 0;
+    while (offset < segment->size)
+    {
+        const LogRecord *record = (const LogRecord *)(segment->map + offset);
+        uint64_t packed;
+        uint64_t previous;
+        if (!logRecordValid(record, segment->size - offset))
+            break;
+        indexKey(record->key, &packed);
+
+        if (record->op == LOG_PUT)
+        {
+            if (keyDirPut(log, packed, LOG_LOCATION(slot, offset), &previous))
+                logMarkDead(log, previous);
+        }
+        else
+        {
+            KeyDirEntry *entry = keyDirFind(log, packed);
+            segment->dead += record->size; // A tombstone only matters until the merge drops its key
+            if (entry != NULL)
+            {
+                logMarkDead(log, entry->location);
+                keyDirRemove(log, entry);
+            }
+        }
+        offset += record->size;
+    }
+
+    if (offset < segment->size)
+    {
+        fprintf(stderr, "(!) Data log segment %lu is damaged after byte %zu; the rest is dropped.\n", segment->number,
+                offset);
+        if (ftruncate(segment->fd, (off_t)offset) != 0)
+            perror("(!) Failed to truncate the data log segment");
+        segment->size = offset;
+    }
+}
+
+static int compareNumbers(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Lists the segment files of a directory in replay order. Files of
+ * a merge that never finished are deleted.
+ * @return The number of segments, or -1 on failure.
+ */
+static int logListSegments(const char *directory, unsigned long *numbers)
+{
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    int count = 0;
+    if (dir == NULL)
+    {
+        if (errno == ENOENT)
+            return 0; // No log yet
+        perror("(!) Failed to open the data log directory");
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        unsigned long number;
+        int length = 0;
+        if (sscanf(entry->d_name, "gym-%lu.log%n", &number, &length) != 1 || length == 0)
+            continue;
+        if (strcmp(entry->d_name + length, ".merge") == 0)
+        {
+            char path[LOG_PATH_SIZE];
+            logSegmentPath(directory, number, ".merge", path);
+            unlink(path);
+        }
+        else if (entry->d_name[length] == '\0')
+        {
+            if (count == LOG_MAX_SEGMENTS - 1)
+            {
+                fprintf(stderr, "(!) The data log has too many segment files.\n");
+                closedir(dir);
+                return -1;
+            }
+            numbers[count++] = number;
+        }
+    }
+    closedir(dir);
+    qsort(numbers, count, sizeof(unsigned long), compareNumbers);
+    return count;
+}
+
+/**
+ * @brief Background compactor: syncs the active segment and merges the log
+ * once enough of it is dead.
+ */
+static void *logCompactor(void *arg)
+{
+    DataLog *log = (DataLog *)arg;
+
+    pthread_mutex_lock(&log->compactLock);
+    while (!log->stop)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_COMPACT_MS * 1000000L;
+        while (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&log->compactWake, &log->compactLock, &deadline);
+        if (log->stop)
+            break;
+
+        pthread_mutex_unlock(&log->compactLock);
+        size_t bytes;
+        size_t dead;
+        size_t keys;
+        logSync(log);
+        logStats(log, &bytes, &dead, &keys);
+        if (dead >= LOG_COMPACT_MIN_BYTES && dead * 100 >= bytes * (size_t)atomic_load(&log->compactPercent))
+            logCompact(log);
+        pthread_mutex_lock(&log->compactLock);
+    }
+    pthread_mutex_unlock(&log->compactLock);
+    return NULL;
+}
+
+/**
+ * @brief Opens the data log in a directory, creating both if needed:
+ * replays every segment file to rebuild the key directory, starts a new
+ * active segment and the background compactor.
+ * @return The log, or NULL on failure.
+ */
+DataLog *logOpen(const char *directory)
+{
+    unsigned long numbers[LOG_MAX_SEGMENTS];
+    if (strlen(directory) >= sizeof(((DataLog *)0)->directory))
+    {
+        fprintf(stderr, "(!) The data log directory name is too long.\n");
+        return NULL;
+    }
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST)
+    {
+        perror("(!) Failed to create the data log directory");
+        return NULL;
+    }
+    int count = logListSegments(directory, numbers);
+    if (count < 0)
+        return NULL;
+
+    DataLog *log = calloc(1, sizeof(DataLog));
+    if (!log)
+    {
+        perror("(!) Failed to allocate memory for the data log");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(log->directory, directory);
+    log->active = -1;
+    keyDirResize(log);
+
+    for (int i = 0; i < count; i++)
+    {
+        char path[LOG_PATH_SIZE];
+        logSegmentPath(directory, numbers[i], "", path);
+        log->segments[i] = logSegmentOpen(path, numbers[i], O_RDWR, 0);
+        if (log->segments[i] == NULL)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                logSegmentClose(log->segments[j]);
+            }
+            free(log->keyDir);
+            free(log);
+            return NULL;
+        }
+        logReplaySegment(log, i);
+    }
+    // The first even number past every existing file.
+    log->nextNumber = count > 0 ? numbers[count - 1] + 2 - numbers[count - 1] % 2 : 0;
+    if (!logStartSegment(log))
+    {
+        for (int i = 0; i < count; i++)
+        {
+            logSegmentClose(log->segments[i]);
+        }
+        free(log->keyDir);
+        free(log);
+        return NULL;
+    }
+
+    pthread_rwlock_init(&log->lock, NULL);
+    pthread_mutex_init(&log->mergeLock, NULL);
+    pthread_mutex_init(&log->compactLock, NULL);
+    pthread_cond_init(&log->compactWake, NULL);
+    atomic_init(&log->compactPercent, LOG_COMPACT_PERCENT);
+    atomic_init(&log->retiredSegments, 0);
+    atomic_init(&log->compactions, 0);
+    atomic_init(&log->reclaimedBytes, 0);
+    if (pthread_create(&log->compactor, NULL, logCompactor, log) != 0)
+    {
+        perror("(!) Failed to start the data log compactor");
+        exit(EXIT_FAILURE);
+    }
+    return log;
+}
+
+/**
+ * @brief Stops the compactor, syncs the active segment and closes the log.
+ * An active segment nothing was written to is deleted.
+ */
+void logClose(DataLog *log)
+{
+    pthread_mutex_lock(&log->compactLock);
+    log->stop = 1;
+    pthread_cond_signal(&log->compactWake);
+    pthread_mutex_unlock(&log->compactLock);
+    pthread_join(log->compactor, NULL);
+
+    logSync(log);
+    LogSegment *active = log->segments[log->active];
+    if (active->size == 0)
+    {
+        char path[LOG_PATH_SIZE];
+        logSegmentPath(log->directory, active->number, "", path);
+        unlink(path); // Nothing was written since the log was opened
+    }
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        if (log->segments[i] != NULL)
+            logSegmentClose(log->segments[i]);
+    }
+    pthread_rwlock_destroy(&log->lock);
+    pthread_mutex_destroy(&log->mergeLock);
+    pthread_mutex_destroy(&log->compactLock);
+    pthread_cond_destroy(&log->compactWake);
+    free(log->keyDir);
+    free(log->undo);
+    free(log);
+}
+
+/**
+ * @brief Deletes the segment files of a closed data log; other files in
+ * the directory are left alone.
+ */
+void logRemove(const char *directory)
+{
+    unsigned long numbers[LOG_MAX_SEGMENTS];
+    int count = logListSegments(directory, numbers);
+    for (int i = 0; i < count; i++)
+    {
+        char path[LOG_PATH_SIZE];
+        logSegmentPath(directory, numbers[i], "", path);
+        unlink(path);
+    }
+}
+
+/**
+ * @brief Builds a LOG_PUT record in a buffer of sizeof(LogRecord) +
+ * sizeof(NodeData) bytes.
+ */
+static void logFillPut(LogRecord *record, const char *key, NodeType type, const void *data)
+{
+    memset(record, 0, sizeof(LogRecord));
+    record->size = (uint16_t)logRecordSize(LOG_PUT, type);
+    record->op = LOG_PUT;
+    record->type = (uint8_t)type;
+    strcpy(record->key, key);
+    memcpy(record + 1, data, record->size - sizeof(LogRecord));
+    record->checksum = logChecksum(record);
+}
+
+/**
+ * @brief Appends a record for a key and points the key at it. The record
+ * it replaces, if any, becomes dead.
+ * @param overwrite 0 to leave a key that already has a record unchanged.
+ * @return 1 if the record was written, 0 if the key was left unchanged or
+ * is not an event or ticket key, -1 if the append failed.
+ */
+int logPut(DataLog *log, const char *key, NodeType type, const void *data, int overwrite)
+{
+    unsigned char buffer[sizeof(LogRecord) + sizeof(NodeData)];
+    LogRecord *record = (LogRecord *)buffer;
+    uint64_t packed;
+    uint64_t location;
+    uint64_t previous;
+    if (!indexKey(key, &packed))
+        return 0;
+
+    logFillPut(record, key, type, data);
+    pthread_rwlock_wrlock(&log->lock);
+    if (!overwrite && keyDirFind(log, packed) != NULL)
+    {
+        pthread_rwlock_unlock(&log->lock);
+        return 0;
+    }
+    if (!logAppend(log, record, &location))
+    {
+        pthread_rwlock_unlock(&log->lock);
+        return -1;
+    }
+    if (keyDirPut(log, packed, location, &previous))
+        logMarkDead(log, previous);
+    pthread_rwlock_unlock(&log->lock);
+    return 1;
+}
+
+/**
+ * @brief Copies the current record of a key out of the log.
+ * @return 1 if the key was found, 0 otherwise.
+ */
+int logGet(DataLog *log, const char *key, NodeType *type, NodeData *data)
+{
+    uint64_t packed;
+    if (!indexKey(key, &packed))
+        return 0;
+
+    pthread_rwlock_rdlock(&log->lock);
+    KeyDirEntry *entry = keyDirFind(log, packed);
+    if (entry != NULL)
+    {
+        const LogRecord *record = logRecordAt(log, entry->location);
+        *type = (NodeType)record->type;
+        memcpy(data, record + 1, record->size - sizeof(LogRecord));
+    }
+    pthread_rwlock_unlock(&log->lock);
+    return entry != NULL;
+}
+
+/**
+ * @brief Appends a tombstone for a key and drops it from the directory.
+ * Called with the lock held exclusively.
+ * @return 1 if the key was deleted, 0 if it had no record, -1 if the
+ * append failed.
+ */
+static int logAppendDelete(DataLog *log, const char *key)
+{
+    LogRecord record;
+    uint64_t packed;
+    uint64_t location;
+    if (!indexKey(key, &packed))
+        return 0;
+
+    memset(&record, 0, sizeof(record));
+    record.size = sizeof(LogRecord);
+    record.op = LOG_DELETE;
+    strcpy(record.key, key);
+    record.checksum = logChecksum(&record);
+
+    KeyDirEntry *entry = keyDirFind(log, packed);
+    if (entry == NULL)
+        return 0;
+    if (!logAppend(log, &record, &location))
+        return -1;
+    logRecordUndo(log, packed, entry->location, 1);
+    logMarkDead(log, entry->location);
+    logMarkDead(log, location);
+    keyDirRemove(log, entry);
+    return 1;
+}
+
+/**
+ * @brief Appends a tombstone for a key and drops it from the directory.
+ * @return 1 if the key was deleted, 0 if it had no record, -1 if the
+ * append failed.
+ */
+int logDelete(DataLog *log, const char *key)
+{
+    pthread_rwlock_wrlock(&log->lock);
+    int deleted = logAppendDelete(log, key);
+    pthread_rwlock_unlock(&log->lock);
+    return deleted;
+}
+
+/**
+ * @brief Makes the log hold the record of a node a transaction created:
+ * unless the key already points at the node's location, the record is
+ * appended and the node pointed at the copy. Called with the lock held
+ * exclusively.
+ * @return 1 on success, 0 if the append failed.
+ */
+static int logWriteNode(DataLog *log, Store *store, TreeNode *node)
+{
+    unsigned char buffer[sizeof(LogRecord) + sizeof(NodeData)];
+    LogRecord *record = (LogRecord *)buffer;
+    uint64_t packed;
+    uint64_t location;
+    uint64_t previous;
+    if (!indexKey(node->key, &packed))
+        return 0; // Only event and ticket keys can be kept in the log
+
+    KeyDirEntry *entry = keyDirFind(log, packed);
+    if (!(node->location & LOG_PENDING) && entry != NULL && entry->location == node->location)
+        return 1; // Copied from a committed node, record and key unchanged
+    logFillPut(record, node->key, node->type, nodeRecord(store, node));
+    if (!logAppend(log, record, &location))
+        return 0;
+    logRecordUndo(log, packed, entry != NULL ? entry->location : 0, entry != NULL);
+    if (keyDirPut(log, packed, location, &previous))
+        logMarkDead(log, previous);
+    node->location = location;
+    return 1;
+}
+
+/**
+ * @brief Writes the nodes a transaction created in a subtree; the nodes
+ * it did not create, and so everything below them, are in the log already.
+ */
+static int logWriteNodes(DataLog *log, WriteTxn *txn, TreeNode *root)
+{
+    if (root == NULL || root->version != txn->version)
+        return 1;
+    return logWriteNodes(log, txn, nodeLeft(root)) && logWriteNodes(log, txn, nodeRight(root)) &&
+           logWriteNode(log, txn->store, root);
+}
+
+/**
+ * @brief Undoes the changes of a commit the log could not take in full:
+ * the directory points at the records it did before, and the records
+ * appended since the commit started are cut off their segment files, so a
+ * restart does not replay them either. Called with the lock held
+ * exclusively.
+ * @param slot Slot of the segment that was active when the commit started.
+ * @param size Its size then.
+ */
+static void logRollback(DataLog *log, int slot, size_t size)
+{
+    uint64_t previous;
+    for (size_t i = log->undoCount; i-- > 0;)
+    {
+        const LogUndo *undo = &log->undo[i];
+        if (undo->key == INDEX_EMPTY)
+        {
+            log->segments[LOG_SLOT(undo->location)]->dead -= logRecordAt(log, undo->location)->size;
+        }
+        else if (undo->existed)
+        {
+            keyDirPut(log, undo->key, undo->location, &previous);
+        }
+        else
+        {
+            KeyDirEntry *entry = keyDirFind(log, undo->key);
+            if (entry != NULL)
+                keyDirRemove(log, entry);
+        }
+    }
+    log->undoCount = 0;
+
+    // Segments the commit started are emptied; merged ones (odd numbers) are not its.
+    unsigned long number = log->segments[slot]->number;
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        LogSegment *segment = log->segments[i];
+        if (segment == NULL || (i != slot && (segment->number <= number || segment->number % 2 != 0)))
+            continue;
+        size_t keep = i == slot ? size : 0;
+        if (ftruncate(segment->fd, (off_t)keep) != 0)
+            perror("(!) Failed to cut a rolled back commit off the data log");
+        segment->size = keep;
+    }
+}
+
+/**
+ * @brief Writes a transaction of a store backed by the log before it is
+ * published: the keys it deleted get a tombstone, the records of its nodes
+ * are appended, and its nodes are pointed at them, so no pending record is
+ * left. Either the whole commit is written or none of it: if an append
+ * fails, the changes before it are rolled back. Called under the writer
+ * lock.
+ * @return 1 if every change was written, 0 if the commit was rolled back.
+ */
+int logWriteCommit(WriteTxn *txn)
+{
+    DataLog *log = txn->store->log;
+    int ok = 1;
+
+    pthread_rwlock_wrlock(&log->lock); // Also keeps a merge from starting on the segment written to
+    int slot = log->active;
+    size_t size = log->segments[slot]->size;
+    log->writingCommit = 1;
+    for (int i = 0; ok && i < txn->logCount; i++)
+    {
+        // A key deleted and inserted again (an update) is overwritten below instead.
+        if (txn->log[i].op == JOURNAL_DELETE && txnLookup(txn, txn->log[i].key) == NULL)
+            ok = logAppendDelete(log, txn->log[i].key) >= 0;
+    }
+    ok = ok && logWriteNodes(log, txn, txn->root);
+    log->writingCommit = 0;
+    if (!ok)
+        logRollback(log, slot, size);
+    log->undoCount = 0;
+    pthread_rwlock_unlock(&log->lock);
+    return ok;
+}
+
+/**
+ * @brief Attaches the store whose nodes point at the log's records (see
+ * storeInitLog()), or detaches it (NULL) before it is destroyed. Merges
+ * keep the nodes of an attached store pointing at the records they move.
+ * Detaching releases the segments kept for the store's snapshots.
+ */
+void logSetStore(DataLog *log, Store *store)
+{
+    pthread_mutex_lock(&log->mergeLock); // Never in the middle of a merge
+    log->store = store;
+    pthread_mutex_unlock(&log->mergeLock);
+    if (store == NULL)
+        logReleaseSegments(log, LOG_RETIRING);
+}
+
+/**
+ * @brief Closes the merged-away segments no snapshot of the store can read
+ * anymore: those retired by a commit every open snapshot has reached.
+ * Called by the store's collector with the oldest version a reader pins.
+ */
+void logReleaseSegments(DataLog *log, unsigned long limit)
+{
+    LogSegment *released[LOG_MAX_SEGMENTS];
+    int count = 0;
+    if (atomic_load(&log->retiredSegments) == 0)
+        return;
+
+    pthread_rwlock_wrlock(&log->lock);
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        LogSegment *segment = log->segments[i];
+        if (segment != NULL && segment->retiredAt != 0 && segment->retiredAt <= limit)
+        {
+            released[count++] = segment;
+            log->segments[i] = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&log->lock);
+
+    atomic_fetch_sub(&log->retiredSegments, count);
+    for (int i = 0; i < count; i++)
+    {
+        logSegmentClose(released[i]); // The files went with the merge
+    }
+}
+
+/**
+ * @brief Forces the records appended so far to the disk. The compactor
+ * does this every LOG_COMPACT_MS on its own.
+ */
+void logSync(DataLog *log)
+{
+    pthread_rwlock_rdlock(&log->lock);
+    fdatasync(log->segments[log->active]->fd);
+    pthread_rwlock_unlock(&log->lock);
+}
+
+/**
+ * @brief Writes all of a buffer to a file descriptor.
+ * @return 1 on success, 0 otherwise.
+ */
+static int logWriteAll(int fd, const unsigned char *buffer, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, buffer, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        buffer += written;
+        size -= (size_t)written;
+    }
+    return 1;
+}
+
+/**
+ * @brief Points the nodes of the log's store at the records a merge moved,
+ * LOG_REPOINT_BATCH moves at a time under the store's writer lock so that
+ * bookings are not held up. A node is shared by versions and keeps its
+ * record, only at a new place, so it is changed in place. Snapshots from
+ * before the commit ending the repointing may still read the old places:
+ * the old segments are released once none is left (see
+ * logReleaseSegments()). Called with mergeLock held.
+ */
+static void logRepointNodes(DataLog *log, const LogSegment *merged, int slot, const LogMove *moves, size_t count,
+                            LogSegment **sources, int sourceCount)
+{
+    Store *store = log->store;
+    WriteTxn txn;
+    size_t done = 0;
+    for (;;)
+    {
+        storeBeginWrite(store, &txn);
+        size_t end = count - done > LOG_REPOINT_BATCH ? done + LOG_REPOINT_BATCH : count;
+        for (; done < end; done++)
+        {
+            const char *key = ((const LogRecord *)(merged->map + moves[done].to))->key;
+            TreeNode *node = txn.root;
+            int cmp;
+            while (node != NULL && (cmp = strcmp(key, node->key)) != 0)
+            {
+                node = cmp < 0 ? nodeLeft(node) : nodeRight(node);
+            }
+            if (node != NULL && atomic_load_explicit(&node->location, memory_order_relaxed) == moves[done].from)
+                atomic_store_explicit(&node->location, LOG_LOCATION(slot, moves[done].to), memory_order_release);
+        }
+        if (done == count)
+            break;
+        storeAbort(&txn); // Nothing to publish yet: let waiting writers in
+    }
+    unsigned long version = storeCommit(&txn);
+
+    pthread_rwlock_wrlock(&log->lock);
+    for (int i = 0; i < sourceCount; i++)
+    {
+        sources[i]->retiredAt = version != 0 ? version : LOG_RETIRING; // Not committed: kept until detached
+    }
+    pthread_rwlock_unlock(&log->lock);
+}
+
+/**
+ * @brief Merges every segment but a fresh active one into a single file
+ * holding only their live records. Readers and writers carry on meanwhile:
+ * the log is locked only to check records and, at the end, to repoint the
+ * keys that did not change during the merge. The merged file is numbered
+ * just after the segments it replaces, so recovery replays it before any
+ * newer record even if the old files survive a crash.
+ * With a store attached, its nodes are repointed too, and the old segments
+ * stay mapped until no snapshot can read them (see logRepointNodes()).
+ * Called with mergeLock held.
+ * @return The bytes reclaimed, 0 if there was nothing to merge, -1 on failure.
+ */
+static long logMerge(DataLog *log)
+{
+    int inputs[LOG_MAX_SEGMENTS];
+    LogSegment *sources[LOG_MAX_SEGMENTS];
+    int inputCount = 0;
+    size_t inputBytes = 0;
+    size_t deadBytes = 0;
+
+    pthread_rwlock_wrlock(&log->lock);
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        if (log->segments[i] != NULL && log->segments[i]->retiredAt == 0)
+            deadBytes += log->segments[i]->dead;
+    }
+    unsigned long number = log->segments[log->active]->number + 1;
+    if (deadBytes == 0 || !logStartSegment(log))
+    {
+        pthread_rwlock_unlock(&log->lock);
+        return deadBytes == 0 ? 0 : -1;
+    }
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        if (log->segments[i] != NULL && log->segments[i]->retiredAt == 0 && i != log->active)
+        {
+            inputs[inputCount++] = i;
+            inputBytes += log->segments[i]->size;
+        }
+    }
+    pthread_rwlock_unlock(&log->lock);
+
+    // Oldest first, so a key's records are met in the order they were written.
+    for (int i = 1; i < inputCount; i++)
+    {
+        int slot = inputs[i];
+        int j = i - 1;
+        while (j >= 0 && log->segments[inputs[j]]->number > log->segments[slot]->number)
+        {
+            inputs[j + 1] = inputs[j];
+            j--;
+        }
+        inputs[j + 1] = slot;
+    }
+    for (int i = 0; i < inputCount; i++)
+    {
+        sources[i] = log->segments[inputs[i]]; // Only merges change these slots
+    }
+
+    char path[LOG_PATH_SIZE];
+    char temporary[LOG_PATH_SIZE];
+    logSegmentPath(log->directory, number, "", path);
+    logSegmentPath(log->directory, number, ".merge", temporary);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    unsigned char *buffer = malloc(LOG_MERGE_BUFFER);
+    LogMove *moves = NULL;
+    size_t moveCount = 0;
+    size_t moveCapacity = 0;
+    size_t buffered = 0;
+    size_t written = 0;
+    int ok = fd >= 0;
+    if (!buffer)
+    {
+        perror("(!) Failed to allocate memory for the merge");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; ok && i < inputCount; i++)
+    {
+        const LogSegment *segment = sources[i];
+        for (size_t offset = 0; ok && offset < segment->size;)
+        {
+            const LogRecord *record = (const LogRecord *)(segment->map + offset);
+            uint64_t from = LOG_LOCATION(inputs[i], offset);
+            uint64_t packed;
+            offset += record->size;
+            if (record->op != LOG_PUT)
+                continue;
+
+            indexKey(record->key, &packed);
+            pthread_rwlock_rdlock(&log->lock);
+            KeyDirEntry *entry = keyDirFind(log, packed);
+            int live = entry != NULL && entry->location == from;
+            pthread_rwlock_unlock(&log->lock);
+            if (!live)
+                continue;
+
+            if (buffered + record->size > LOG_MERGE_BUFFER)
+            {
+                ok = logWriteAll(fd, buffer, buffered);
+                written += buffered;
+                buffered = 0;
+            }
+            if (moveCount == moveCapacity)
+            {
+                moveCapacity = moveCapacity ? moveCapacity * 2 : 1024;
+                moves = realloc(moves, moveCapacity * sizeof(LogMove));
+                if (!moves)
+                {
+                    perror("(!) Realloc failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            moves[moveCount].key = packed;
+            moves[moveCount].from = from;
+            moves[moveCount].to = written + buffered;
+            moveCount++;
+            memcpy(buffer + buffered, record, record->size);
+            buffered += record->size;
+        }
+    }
+    if (ok)
+        ok = logWriteAll(fd, buffer, buffered) && fdatasync(fd) == 0;
+    written += buffered;
+    if (fd >= 0)
+        close(fd);
+    free(buffer);
+
+    LogSegment *merged = NULL;
+    if (ok && rename(temporary, path) == 0)
+    {
+        int dirFd = open(log->directory, O_RDONLY);
+        if (dirFd >= 0)
+        {
+            fsync(dirFd); // Make the rename itself durable
+            close(dirFd);
+        }
+        merged = logSegmentOpen(path, number, O_RDONLY, 0);
+    }
+    if (merged == NULL)
+    {
+        perror("(!) Failed to write the merged data log segment");
+        unlink(temporary);
+        free(moves);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&log->lock);
+    int slot = 0;
+    while (slot < LOG_MAX_SEGMENTS && log->segments[slot] != NULL)
+    {
+        slot++;
+    }
+    if (slot == LOG_MAX_SEGMENTS && log->store != NULL)
+    {
+        // The old segments keep their slots while the store's snapshots read them.
+        pthread_rwlock_unlock(&log->lock);
+        fprintf(stderr, "(!) The data log has too many segment files to merge.\n");
+        logSegmentClose(merged);
+        unlink(path);
+        free(moves);
+        return -1;
+    }
+    if (slot == LOG_MAX_SEGMENTS)
+        slot = inputs[0]; // Safe to reuse: keys are repointed by comparing whole locations
+    size_t moved = 0;
+    for (size_t i = 0; i < moveCount; i++)
+    {
+        KeyDirEntry *entry = keyDirFind(log, moves[i].key);
+        if (entry != NULL && entry->location == moves[i].from)
+        {
+            entry->location = LOG_LOCATION(slot, moves[i].to);
+            moves[moved++] = moves[i]; // The store's node for the key follows it
+        }
+        else
+        {
+            merged->dead += ((const LogRecord *)(merged->map + moves[i].to))->size; // Changed during the merge
+        }
+    }
+    for (int i = 0; i < inputCount; i++)
+    {
+        if (log->store != NULL)
+            sources[i]->retiredAt = LOG_RETIRING;
+        else
+            log->segments[inputs[i]] = NULL;
+    }
+    log->segments[slot] = merged;
+    pthread_rwlock_unlock(&log->lock);
+
+    for (int i = 0; i < inputCount; i++)
+    {
+        logSegmentPath(log->directory, sources[i]->number, "", path);
+        unlink(path);
+        if (log->store == NULL)
+            logSegmentClose(sources[i]);
+    }
+    if (log->store != NULL)
+    {
+        atomic_fetch_add(&log->retiredSegments, inputCount);
+        logRepointNodes(log, merged, slot, moves, moved, sources, inputCount);
+    }
+    free(moves);
+
+    long reclaimed = (long)inputBytes - (long)written;
+    atomic_fetch_add(&log->compactions, 1);
+    atomic_fetch_add(&log->reclaimedBytes, (size_t)(reclaimed > 0 ? reclaimed : 0));
+    return reclaimed;
+}
+
+/**
+ * @brief Merges the log now, waiting for a merge already running (see
+ * logMerge()).
+ * @return The bytes reclaimed, 0 if there was nothing to merge, -1 on failure.
+ */
+long logCompact(DataLog *log)
+{
+    pthread_mutex_lock(&log->mergeLock);
+    long reclaimed = logMerge(log);
+    pthread_mutex_unlock(&log->mergeLock);
+    return reclaimed;
+}
+
+/**
+ * @brief Reports the bytes in the segment files, how many of them are
+ * dead, and the number of live keys.
+ */
+void logStats(DataLog *log, size_t *bytes, size_t *deadBytes, size_t *keys)
+{
+    *bytes = *deadBytes = 0;
+    pthread_rwlock_rdlock(&log->lock);
+    for (int i = 0; i < LOG_MAX_SEGMENTS; i++)
+    {
+        if (log->segments[i] != NULL && log->segments[i]->retiredAt == 0)
+        {
+            *bytes += log->segments[i]->size;
+            *deadBytes += log->segments[i]->dead;
+        }
+    }
+    *keys = log->keyDirLive;
+    pthread_rwlock_unlock(&log->lock);
+}
+
+/**
+ * @brief Orders live records by key, for logLoad().
+ */
+static int compareLoadedRecords(const void *a, const void *b)
+{
+    return strcmp(((const LoadedRecord *)a)->record->key, ((const LoadedRecord *)b)->record->key);
+}
+
+/**
+ * @brief Builds a balanced subtree of nodes pointing at sorted records.
+ */
+static TreeNode *logBuildTree(WriteTxn *txn, const LoadedRecord *records, long count)
+{
+    if (count == 0)
+        return NULL;
+
+    long mid = count / 2;
+    const LogRecord *record = records[mid].record;
+    TreeNode *node = &arenaAlloc(&txn->store->arena)->node;
+    strcpy(node->key, record->key);
+    node->type = (NodeType)record->type;
+    node->location = records[mid].location;
+    node->version = txn->version;
+    atomic_init(&node->hits, 0);
+    setLeft(node, logBuildTree(txn, records, mid));
+    setRight(node, logBuildTree(txn, records + mid + 1, count - mid - 1));
+    if (journalFile != NULL)
+        txnLog(txn, JOURNAL_INSERT, node->key, node->type, (void *)(record + 1));
+    return node;
+}
+
+/**
+ * @brief Fills an empty store backed by the log (see storeInitLog()) with
+ * a node for every live record, in one transaction. The nodes point at the
+ * records where they are, none is copied, and the tree comes out balanced.
+ * @return The number of records loaded, or -1 if the store could not take them.
+ */
+long logLoad(DataLog *log, Store *store)
+{
+    WriteTxn txn;
+    long count = 0;
+
+    // Taken first, so a merge moving the records repoints the new nodes after the commit.
+    storeBeginWrite(store, &txn);
+    pthread_rwlock_rdlock(&log->lock);
+    LoadedRecord *records = malloc((log->keyDirLive + 1) * sizeof(LoadedRecord));
+    if (!records)
+    {
+        perror("(!) Failed to allocate memory to load the data log");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i <= log->keyDirMask; i++)
+    {
+        const KeyDirEntry *entry = &log->keyDir[i];
+        if (entry->key == INDEX_EMPTY || entry->key == INDEX_DELETED)
+            continue;
+        records[count].record = logRecordAt(log, entry->location);
+        records[count].location = entry->location;
+        count++;
+    }
+    pthread_rwlock_unlock(&log->lock);
+    qsort(records, count, sizeof(LoadedRecord), compareLoadedRecords);
+
+    txn.root = logBuildTree(&txn, records, count);
+    if (storeCommit(&txn) == 0)
+        count = -1;
+    free(records);
+    return count;
+}
+
+#else
+
+DataLog *logOpen(const char *directory)
+{
+    (void)directory;
+    fprintf(stderr, "(!) The data log needs memory-mapped files, which this platform lacks.\n");
+    return NULL;
+}
+
+void logClose(DataLog *log) { (void)log; }
+void logRemove(const char *directory) { (void)directory; }
+int logPut(DataLog *log, const char *key, NodeType type, const void *data, int overwrite) { return 0; }
+int logGet(DataLog *log, const char *key, NodeType *type, NodeData *data) { return 0; }
+int logDelete(DataLog *log, const char *key) { return 0; }
+int logWriteCommit(WriteTxn *txn) { return 0; }
+void logSetStore(DataLog *log, Store *store) { (void)log; (void)store; }
+void logReleaseSegments(DataLog *log, unsigned long limit) { (void)log; (void)limit; }
+void logSync(DataLog *log) { (void)log; }
+long logCompact(DataLog *log) { return -1; }
+void logStats(DataLog *log, size_t *bytes, size_t *deadBytes, size_t *keys) { *bytes = *deadBytes = *keys = 0; }
+long logLoad(DataLog *log, Store *store) { return 0; }
+
+#endif
+
+// --- LSM Tree Functions ---
+
+#ifndef _WIN32
+
+/**
+ * @brief Allocates an empty memtable.
+ */
+static Memtable *memtableCreate(void)
+{
+    size_t capacity = 1;
+    while (capacity < 2 * LSM_MEMTABLE_ENTRIES)
+    {
+        capacity *= 2;
+    }
+
+    Memtable *memtable = malloc(sizeof(Memtable));
+    if (memtable != NULL)
+    {
+        memtable->entries = malloc(LSM_MEMTABLE_ENTRIES * sizeof(LsmEntry));
+        memtable->slots = calloc(capacity, sizeof(KeyDirEntry));
+    }
+    if (!memtable || !memtable->entries || !memtable->slots)
+    {
+        perror("(!) Failed to allocate memory for a memtable");
+        exit(EXIT_FAILURE);
+    }
+    memtable->count = 0;
+    memtable->mask = capacity - 1;
+    return memtable;
+}
+
+static void memtableFree(Memtable *memtable)
+{
+    free(memtable->entries);
+    free(memtable->slots);
+    free(memtable);
+}
+
+/**
+ * @brief Finds the entry of a packed key in a memtable.
+ * @return The entry, or NULL if the memtable has none.
+ */
+static LsmEntry *memtableFind(Memtable *memtable, uint64_t key)
+{
+    for (size_t i = indexHash(key) & memtable->mask;; i = (i + 1) & memtable->mask)
+    {
+        if (memtable->slots[i].key == key)
+            return &memtable->entries[memtable->slots[i].location];
+        if (memtable->slots[i].key == INDEX_EMPTY)
+            return NULL;
+    }
+}
+
+/**
+ * @brief Writes a record to a memtable, replacing its entry for the key if
+ * it has one. The memtable must not be full.
+ */
+static void memtablePut(Memtable *memtable, uint64_t key, const char *keyText, NodeType type, const void *data,
+                        int deleted)
+{
+    LsmEntry *entry = NULL;
+    size_t i = indexHash(key) & memtable->mask;
+    while (memtable->slots[i].key != INDEX_EMPTY)
+    {
+        if (memtable->slots[i].key == key)
+        {
+            entry = &memtable->entries[memtable->slots[i].location];
+            break;
+        }
+        i = (i + 1) & memtable->mask;
+    }
+    if (entry == NULL)
+    {
+        memtable->slots[i].key = key;
+        memtable->slots[i].location = memtable->count;
+        entry = &memtable->entries[memtable->count++];
+        memset(entry, 0, sizeof(LsmEntry));
+        strcpy(entry->key, keyText);
+    }
+
+    entry->type = (uint8_t)type;
+    entry->deleted = (uint8_t)deleted;
+    if (!deleted)
+        memcpy(&entry->data, data, type == EVENT_NODE ? sizeof(Event) : sizeof(Ticket));
+}
+
+/**
+ * @brief The two hashes a key's Bloom filter bits are derived from.
+ */
+static void lsmBloomHashes(uint64_t key, uint64_t *first, uint64_t *second)
+{
+    *first = indexHash(key);
+    *second = indexHash(key ^ 0x9E3779B97F4A7C15ULL) | 1;
+}
+
+/**
+ * @brief Checks a run's Bloom filter.
+ * @return 0 if the run certainly lacks the key, 1 if it may have it.
+ */
+static int lsmBloomMayContain(const LsmRun *run, uint64_t first, uint64_t second)
+{
+    uint64_t bits = run->header->bloomBits;
+    for (uint32_t i = 0; i < run->header->hashes; i++)
+    {
+        uint64_t bit = (first + i * second) % bits;
+        if (!(run->bloom[bit / 64] & (1ULL << (bit % 64))))
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Binary search of a run for a key.
+ * @return The entry, or NULL if the run lacks the key.
+ */
+static const LsmEntry *lsmRunFind(const LsmRun *run, const char *key)
+{
+    long low = 0;
+    long high = (long)run->header->count - 1;
+    while (low <= high)
+    {
+        long middle = low + (high - low) / 2;
+        int cmp = strcmp(key, run->entries[middle].key);
+        if (cmp == 0)
+            return &run->entries[middle];
+        if (cmp < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Offset of a run's Bloom filter: just after the entries, aligned
+ * for 64-bit words.
+ */
+static size_t lsmBloomOffset(uint64_t count)
+{
+    size_t offset = sizeof(LsmRunHeader) + count * sizeof(LsmEntry);
+    return (offset + 7) & ~(size_t)7;
+}
+
+static void lsmRunPath(const char *directory, unsigned long number, const char *suffix, char *path)
+{
+    snprintf(path, LOG_PATH_SIZE, "%s/lsm-%010lu.run%s", directory, number, suffix);
+}
+
+/**
+ * @brief Opens and maps a run file, checking that its header and size agree.
+ * @return The run, or NULL if the file cannot be used.
+ */
+static LsmRun *lsmRunOpen(const char *path, unsigned long number)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LsmRunHeader))
+    {
+        fprintf(stderr, "(!) Failed to open the LSM run %s.\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("(!) Failed to map an LSM run");
+        close(fd);
+        return NULL;
+    }
+    const LsmRunHeader *header = map;
+    if (header->magic != LSM_MAGIC || header->bloomBits == 0 ||
+        (size_t)st.st_size != lsmBloomOffset(header->count) + (header->bloomBits + 63) / 64 * sizeof(uint64_t))
+    {
+        fprintf(stderr, "(!) The LSM run %s is damaged.\n", path);
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    LsmRun *run = malloc(sizeof(LsmRun));
+    if (!run)
+    {
+        perror("(!) Failed to allocate memory for an LSM run");
+        exit(EXIT_FAILURE);
+    }
+    run->number = number;
+    run->firstNumber = (unsigned long)header->firstNumber;
+    run->fd = fd;
+    run->header = header;
+    run->mapSize = (size_t)st.st_size;
+    run->entries = (const LsmEntry *)(header + 1);
+    run->bloom = (const uint64_t *)((const char *)map + lsmBloomOffset(header->count));
+    return run;
+}
+
+static void lsmRunClose(LsmRun *run)
+{
+    munmap((void *)run->header, run->mapSize);
+    close(run->fd);
+    free(run);
+}
+
+/**
+ * @brief Starts writing a run numbered number. maxCount bounds the entries
+ * it will get, to size the Bloom filter.
+ */
+static void lsmRunBegin(LsmRunWriter *writer, const LsmTree *lsm, unsigned long number, uint64_t maxCount)
+{
+    lsmRunPath(lsm->directory, number, "", writer->path);
+    lsmRunPath(lsm->directory, number, ".tmp", writer->temporary);
+    writer->fd = open(writer->temporary, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    writer->ok = writer->fd >= 0;
+    writer->buffer = malloc(LOG_MERGE_BUFFER);
+    writer->bloomBits = (maxCount > 0 ? maxCount : 1) * LSM_BLOOM_BITS;
+    writer->bloom = calloc((writer->bloomBits + 63) / 64, sizeof(uint64_t));
+    if (!writer->buffer || !writer->bloom)
+    {
+        perror("(!) Failed to allocate memory for an LSM run");
+        exit(EXIT_FAILURE);
+    }
+    writer->buffered = sizeof(LsmRunHeader); // Filled in by lsmRunFinish()
+    writer->written = 0;
+    writer->count = 0;
+}
+
+/**
+ * @brief Adds the next entry, in key order, to a run being written.
+ */
+static void lsmRunAdd(LsmRunWriter *writer, const LsmEntry *entry)
+{
+    uint64_t packed;
+    uint64_t first;
+    uint64_t second;
+    indexKey(entry->key, &packed);
+    lsmBloomHashes(packed, &first, &second);
+    for (uint32_t i = 0; i < LSM_BLOOM_HASHES; i++)
+    {
+        uint64_t bit = (first + i * second) % writer->bloomBits;
+        writer->bloom[bit / 64] |= 1ULL << (bit % 64);
+    }
+
+    if (writer->buffered + sizeof(LsmEntry) > LOG_MERGE_BUFFER)
+    {
+        writer->ok = writer->ok && logWriteAll(writer->fd, writer->buffer, writer->buffered);
+        writer->written += writer->buffered;
+        writer->buffered = 0;
+    }
+    memcpy(writer->buffer + writer->buffered, entry, sizeof(LsmEntry));
+    writer->buffered += sizeof(LsmEntry);
+    writer->count++;
+}
+
+/**
+ * @brief Writes the header and Bloom filter of a run, syncs it and moves it
+ * into place.
+ * @return The run, opened, or NULL on failure.
+ */
+static LsmRun *lsmRunFinish(LsmRunWriter *writer, LsmTree *lsm, unsigned long number, unsigned long firstNumber)
+{
+    static const unsigned char padding[8] = {0};
+    LsmRunHeader header;
+    size_t end = sizeof(LsmRunHeader) + writer->count * sizeof(LsmEntry);
+    size_t bloomBytes = (writer->bloomBits + 63) / 64 * sizeof(uint64_t);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = LSM_MAGIC;
+    header.hashes = LSM_BLOOM_HASHES;
+    header.count = writer->count;
+    header.bloomBits = writer->bloomBits;
+    header.firstNumber = firstNumber;
+
+    writer->ok = writer->ok && logWriteAll(writer->fd, writer->buffer, writer->buffered) &&
+                 logWriteAll(writer->fd, padding, lsmBloomOffset(writer->count) - end) &&
+                 logWriteAll(writer->fd, (const unsigned char *)writer->bloom, bloomBytes) &&
+                 pwrite(writer->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 fdatasync(writer->fd) == 0;
+    if (writer->fd >= 0)
+        close(writer->fd);
+    free(writer->buffer);
+    free(writer->bloom);
+
+    LsmRun *run = NULL;
+    if (writer->ok && rename(writer->temporary, writer->path) == 0)
+        run = lsmRunOpen(writer->path, number);
+    if (run == NULL)
+    {
+        perror("(!) Failed to write an LSM run");
+        unlink(writer->temporary);
+        return NULL;
+    }
+    atomic_fetch_add(&lsm->bytesWritten, lsmBloomOffset(writer->count) + bloomBytes);
+    return run;
+}
+
+static int compareEntryKeys(const void *a, const void *b)
+{
+    const LsmEntry *x = *(const LsmEntry *const *)a;
+    const LsmEntry *y = *(const LsmEntry *const *)b;
+    return strcmp(x->key, y->key);
+}
+
+/**
+ * @brief Writes a full memtable as a new run and puts it in front of the
+ * others. Runs on the background thread; lookups keep reading the
+ * memtable until the run is in place.
+ * @return 1 on success, 0 otherwise.
+ */
+static int lsmFlushMemtable(LsmTree *lsm, Memtable *memtable)
+{
+    LsmRunWriter writer;
+    const LsmEntry **sorted = malloc((memtable->count > 0 ? memtable->count : 1) * sizeof(LsmEntry *));
+    if (!sorted)
+    {
+        perror("(!) Failed to allocate memory for a flush");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < memtable->count; i++)
+    {
+        sorted[i] = &memtable->entries[i];
+    }
+    qsort(sorted, memtable->count, sizeof(LsmEntry *), compareEntryKeys);
+
+    unsigned long number = lsm->nextNumber++;
+    lsmRunBegin(&writer, lsm, number, (uint64_t)memtable->count);
+    for (int i = 0; i < memtable->count; i++)
+    {
+        lsmRunAdd(&writer, sorted[i]);
+    }
+    free(sorted);
+    LsmRun *run = lsmRunFinish(&writer, lsm, number, number);
+    if (run == NULL)
+        return 0;
+
+    pthread_rwlock_wrlock(&lsm->runsLock);
+    memmove(&lsm->runs[1], &lsm->runs[0], lsm->runCount * sizeof(LsmRun *));
+    lsm->runs[0] = run;
+    lsm->runCount++;
+    pthread_rwlock_unlock(&lsm->runsLock);
+    atomic_fetch_add(&lsm->flushes, 1);
+    return 1;
+}
+
+/**
+ * @brief Size-tiered merging: takes the newest runs for as long as the
+ * next older run is no more than twice their total, and merges them into
+ * one run once there are LSM_MERGE_RUNS of them (or runs are running out).
+ * Newer records win; tombstones are dropped when the oldest run takes part,
+ * since nothing older is left for them to hide. Runs on the background
+ * thread, the only one that adds or removes runs.
+ */
+static void lsmMergeRuns(LsmTree *lsm)
+{
+    for (;;)
+    {
+        // The run list only changes on this thread: reading it needs no lock.
+        int count = 1;
+        uint64_t total = lsm->runCount > 0 ? lsm->runs[0]->header->count : 0;
+        while (count < lsm->runCount && lsm->runs[count]->header->count <= 2 * total)
+        {
+            total += lsm->runs[count]->header->count;
+            count++;
+        }
+        if (count < LSM_MERGE_RUNS)
+        {
+            if (lsm->runCount < LSM_MAX_RUNS - 1)
+                return;
+            // Out of room for runs: merge them all.
+            for (total = 0, count = 0; count < lsm->runCount; count++)
+            {
+                total += lsm->runs[count]->header->count;
+            }
+        }
+
+        LsmRunWriter writer;
+        long cursors[LSM_MAX_RUNS] = {0};
+        int dropTombstones = count == lsm->runCount;
+        unsigned long number = lsm->nextNumber++;
+        lsmRunBegin(&writer, lsm, number, total);
+
+        for (;;)
+        {
+            // The smallest key among the cursors; for equal keys the newest run wins.
+            const LsmEntry *winner = NULL;
+            for (int i = 0; i < count; i++)
+            {
+                if (cursors[i] >= (long)lsm->runs[i]->header->count)
+                    continue;
+                const LsmEntry *entry = &lsm->runs[i]->entries[cursors[i]];
+                if (winner == NULL || strcmp(entry->key, winner->key) < 0)
+                    winner = entry;
+            }
+            if (winner == NULL)
+                break;
+
+            if (!winner->deleted || !dropTombstones)
+                lsmRunAdd(&writer, winner);
+            char key[20];
+            strcpy(key, winner->key);
+            for (int i = 0; i < count; i++)
+            {
+                if (cursors[i] < (long)lsm->runs[i]->header->count &&
+                    strcmp(lsm->runs[i]->entries[cursors[i]].key, key) == 0)
+                    cursors[i]++;
+            }
+        }
+
+        LsmRun *merged = lsmRunFinish(&writer, lsm, number, lsm->runs[count - 1]->firstNumber);
+        if (merged == NULL)
+            return;
+
+        LsmRun *inputs[LSM_MAX_RUNS];
+        memcpy(inputs, lsm->runs, count * sizeof(LsmRun *));
+        pthread_rwlock_wrlock(&lsm->runsLock);
+        lsm->runs[0] = merged;
+        memmove(&lsm->runs[1], &lsm->runs[count], (lsm->runCount - count) * sizeof(LsmRun *));
+        lsm->runCount -= count - 1;
+        pthread_rwlock_unlock(&lsm->runsLock);
+
+        for (int i = 0; i < count; i++)
+        {
+            char path[LOG_PATH_SIZE];
+            lsmRunPath(lsm->directory, inputs[i]->number, "", path);
+            lsmRunClose(inputs[i]);
+            unlink(path);
+        }
+        atomic_fetch_add(&lsm->merges, 1);
+    }
+}
+
+/**
+ * @brief Background thread: flushes each memtable that fills up, then
+ * merges runs as needed. On close it flushes what is left first.
+ */
+static void *lsmWorker(void *arg)
+{
+    LsmTree *lsm = (LsmTree *)arg;
+
+    pthread_mutex_lock(&lsm->lock);
+    for (;;)
+    {
+        while (!lsm->stop && lsm->immutable == NULL)
+        {
+            pthread_cond_wait(&lsm->work, &lsm->lock);
+        }
+        Memtable *memtable = lsm->immutable;
+        if (memtable == NULL)
+            break;
+        pthread_mutex_unlock(&lsm->lock);
+
+        int flushed = lsmFlushMemtable(lsm, memtable);
+
+        pthread_mutex_lock(&lsm->lock);
+        if (flushed)
+        {
+            lsm->immutable = NULL;
+            pthread_cond_broadcast(&lsm->flushed);
+            pthread_mutex_unlock(&lsm->lock);
+            memtableFree(memtable);
+            lsmMergeRuns(lsm);
+            pthread_mutex_lock(&lsm->lock);
+        }
+        else
+        {
+            // Keep the records readable and try again later; writers wait meanwhile.
+            pthread_mutex_unlock(&lsm->lock);
+            sleepMillis(LOG_COMPACT_MS);
+            pthread_mutex_lock(&lsm->lock);
+        }
+    }
+    pthread_mutex_unlock(&lsm->lock);
+    return NULL;
+}
+
+/**
+ * @brief Lists the run files of a directory, newest first, deleting the
+ * files of runs that were never finished.
+ * @return The number of runs, or -1 on failure.
+ */
+static int lsmListRuns(const char *directory, unsigned long *numbers)
+{
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    int count = 0;
+    if (dir == NULL)
+    {
+        if (errno == ENOENT)
+            return 0;
+        perror("(!) Failed to open the LSM directory");
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        unsigned long number;
+        int length = 0;
+        if (sscanf(entry->d_name, "lsm-%lu.run%n", &number, &length) != 1 || length == 0)
+            continue;
+        if (strcmp(entry->d_name + length, ".tmp") == 0)
+        {
+            char path[LOG_PATH_SIZE];
+            lsmRunPath(directory, number, ".tmp", path);
+            unlink(path);
+        }
+        else if (entry->d_name[length] == '\0')
+        {
+            if (count == LSM_MAX_RUNS)
+            {
+                fprintf(stderr, "(!) The LSM tree has too many runs.\n");
+                closedir(dir);
+                return -1;
+            }
+            numbers[count++] = number;
+        }
+    }
+    closedir(dir);
+    qsort(numbers, count, sizeof(unsigned long), compareNumbers);
+    for (int i = 0; i < count / 2; i++)
+    {
+        unsigned long swap = numbers[i];
+        numbers[i] = numbers[count - 1 - i];
+        numbers[count - 1 - i] = swap;
+    }
+    return count;
+}
+
+/**
+ * @brief Opens the LSM tree in a directory, creating both if needed, with
+ * the runs found there, and starts its background thread. Runs a finished
+ * merge replaced, left behind by a crash, are deleted.
+ * @return The tree, or NULL on failure.
+ */
+LsmTree *lsmOpen(const char *directory)
+{
+    unsigned long numbers[LSM_MAX_RUNS];
+    if (strlen(directory) >= sizeof(((LsmTree *)0)->directory))
+    {
+        fprintf(stderr, "(!) The LSM directory name is too long.\n");
+        return NULL;
+    }
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST)
+    {
+        perror("(!) Failed to create the LSM directory");
+        return NULL;
+    }
+    int count = lsmListRuns(directory, numbers);
+    if (count < 0)
+        return NULL;
+
+    LsmTree *lsm = calloc(1, sizeof(LsmTree));
+    if (!lsm)
+    {
+        perror("(!) Failed to allocate memory for the LSM tree");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(lsm->directory, directory);
+    lsm->nextNumber = count > 0 ? numbers[0] + 1 : 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        char path[LOG_PATH_SIZE];
+        lsmRunPath(directory, numbers[i], "", path);
+        if (lsm->runCount > 0 && numbers[i] >= lsm->runs[lsm->runCount - 1]->firstNumber)
+        {
+            unlink(path); // Already merged into a newer run
+            continue;
+        }
+        LsmRun *run = lsmRunOpen(path, numbers[i]);
+        if (run == NULL)
+        {
+            for (int j = 0; j < lsm->runCount; j++)
+            {
+                lsmRunClose(lsm->runs[j]);
+            }
+            free(lsm);
+            return NULL;
+        }
+        lsm->runs[lsm->runCount++] = run;
+    }
+
+    lsm->active = memtableCreate();
+    pthread_mutex_init(&lsm->lock, NULL);
+    pthread_cond_init(&lsm->work, NULL);
+    pthread_cond_init(&lsm->flushed, NULL);
+    pthread_rwlock_init(&lsm->runsLock, NULL);
+    if (pthread_create(&lsm->worker, NULL, lsmWorker, lsm) != 0)
+    {
+        perror("(!) Failed to start the LSM background thread");
+        exit(EXIT_FAILURE);
+    }
+    return lsm;
+}
+
+/**
+ * @brief Hands the active memtable to the background thread, waiting first
+ * for the previous one to be flushed. Called with the lock held.
+ */
+static void lsmRotate(LsmTree *lsm)
+{
+    if (lsm->immutable != NULL)
+    {
+        atomic_fetch_add(&lsm->stalls, 1);
+        while (lsm->immutable != NULL)
+        {
+            pthread_cond_wait(&lsm->flushed, &lsm->lock);
+        }
+    }
+    lsm->immutable = lsm->active;
+    lsm->active = memtableCreate();
+    pthread_cond_signal(&lsm->work);
+}
+
+/**
+ * @brief Flushes the memtable to a run and waits until it is on disk.
+ */
+void lsmFlush(LsmTree *lsm)
+{
+    pthread_mutex_lock(&lsm->lock);
+    if (lsm->active->count > 0)
+        lsmRotate(lsm);
+    while (lsm->immutable != NULL)
+    {
+        pthread_cond_wait(&lsm->flushed, &lsm->lock);
+    }
+    pthread_mutex_unlock(&lsm->lock);
+}
+
+/**
+ * @brief Flushes the memtable, stops the background thread and closes the
+ * tree; the runs stay in the directory.
+ */
+void lsmClose(LsmTree *lsm)
+{
+    lsmFlush(lsm);
+    pthread_mutex_lock(&lsm->lock);
+    lsm->stop = 1;
+    pthread_cond_signal(&lsm->work);
+    pthread_mutex_unlock(&lsm->lock);
+    pthread_join(lsm->worker, NULL);
+
+    for (int i = 0; i < lsm->runCount; i++)
+    {
+        lsmRunClose(lsm->runs[i]);
+    }
+    memtableFree(lsm->active);
+    pthread_mutex_destroy(&lsm->lock);
+    pthread_cond_destroy(&lsm->work);
+    pthread_cond_destroy(&lsm->flushed);
+    pthread_rwlock_destroy(&lsm->runsLock);
+    free(lsm);
+}
+
+/**
+ * @brief Deletes the run files of a closed LSM tree; other files in the
+ * directory are left alone.
+ */
+void lsmRemove(const char *directory)
+{
+    unsigned long numbers[LSM_MAX_RUNS];
+    int count = lsmListRuns(directory, numbers);
+    for (int i = 0; i < count; i++)
+    {
+        char path[LOG_PATH_SIZE];
+        lsmRunPath(directory, numbers[i], "", path);
+        unlink(path);
+    }
+}
+
+/**
+ * @brief Writes a record or a tombstone to the active memtable, handing
+ * the memtable over for flushing once it is full.
+ */
+static int lsmWrite(LsmTree *lsm, const char *key, NodeType type, const void *data, int deleted)
+{
+    uint64_t packed;
+    if (!indexKey(key, &packed))
+        return 0;
+
+    pthread_mutex_lock(&lsm->lock);
+    memtablePut(lsm->active, packed, key, type, data, deleted);
+    if (lsm->active->count == LSM_MEMTABLE_ENTRIES)
+        lsmRotate(lsm);
+    pthread_mutex_unlock(&lsm->lock);
+    return 1;
+}
+
+/**
+ * @brief Stores a record for a key, replacing any older one. Nothing is
+ * read: whether the key existed is left to lookups to sort out.
+ * @return 1 on success, 0 for a malformed key.
+ */
+int lsmPut(LsmTree *lsm, const char *key, NodeType type, const void *data)
+{
+    return lsmWrite(lsm, key, type, data, 0);
+}
+
+/**
+ * @brief Writes a tombstone for a key.
+ * @return 1 on success, 0 for a malformed key.
+ */
+int lsmDelete(LsmTree *lsm, const char *key)
+{
+    return lsmWrite(lsm, key, EVENT_NODE, NULL, 1);
+}
+
+/**
+ * @brief Copies out the newest record of a key: from the memtables, or
+ * from the newest run that has the key.
+ * @return 1 if the key was found, 0 if it is missing or deleted.
+ */
+int lsmGet(LsmTree *lsm, const char *key, NodeType *type, NodeData *data)
+{
+    uint64_t packed;
+    uint64_t first;
+    uint64_t second;
+    const LsmEntry *entry = NULL;
+    int found = 0;
+    if (!indexKey(key, &packed))
+        return 0;
+
+    pthread_mutex_lock(&lsm->lock);
+    entry = memtableFind(lsm->active, packed);
+    if (entry == NULL && lsm->immutable != NULL)
+        entry = memtableFind(lsm->immutable, packed);
+    if (entry != NULL)
+    {
+        found = !entry->deleted;
+        *type = (NodeType)entry->type;
+        memcpy(data, &entry->data, sizeof(NodeData));
+    }
+    pthread_mutex_unlock(&lsm->lock);
+    if (entry != NULL)
+        return found;
+
+    // A memtable flushed meanwhile is already among the runs.
+    lsmBloomHashes(packed, &first, &second);
+    pthread_rwlock_rdlock(&lsm->runsLock);
+    for (int i = 0; i < lsm->runCount && entry == NULL; i++)
+    {
+        if (!lsmBloomMayContain(lsm->runs[i], first, second))
+        {
+            atomic_fetch_add_explicit(&lsm->bloomSkips, 1, memory_order_relaxed);
+            continue;
+        }
+        entry = lsmRunFind(lsm->runs[i], key);
+        if (entry == NULL)
+        {
+            atomic_fetch_add_explicit(&lsm->falsePositives, 1, memory_order_relaxed);
+            continue;
+        }
+        found = !entry->deleted;
+        *type = (NodeType)entry->type;
+        memcpy(data, &entry->data, sizeof(NodeData));
+    }
+    pthread_rwlock_unlock(&lsm->runsLock);
+    return found;
+}
+
+#else
+
+LsmTree *lsmOpen(const char *directory)
+{
+    (void)directory;
+    fprintf(stderr, "(!) The LSM tree needs memory-mapped files, which this platform lacks.\n");
+    return NULL;
+}
+
+void lsmClose(LsmTree *lsm) { (void)lsm; }
+void lsmRemove(const char *directory) { (void)directory; }
+int lsmPut(LsmTree *lsm, const char *key, NodeType type, const void *data) { return 0; }
+int lsmDelete(LsmTree *lsm, const char *key) { return 0; }
+int lsmGet(LsmTree *lsm, const char *key, NodeType *type, NodeData *data) { return 0; }
+void lsmFlush(LsmTree *lsm) { (void)lsm; }
+
+#endif
+
+// --- Paged Tree Functions ---
+
+#ifndef _WIN32
+
+#define LEAF_CAPACITY ((int)((PAGE_SIZE - sizeof(PageHeader)) / sizeof(PageRecord)))
+#define INNER_CAPACITY ((int)((PAGE_SIZE - sizeof(PageHeader)) / sizeof(PageBranch)))
+
+static PageRecord *pageRecords(PageHeader *page)
+{
+    return (PageRecord *)(page + 1);
+}
+
+static PageBranch *pageBranches(PageHeader *page)
+{
+    return (PageBranch *)(page + 1);
+}
+
+static void pageRead(PagedTree *tree, uint32_t number, void *buffer)
+{
+    if (pread(tree->fd, buffer, PAGE_SIZE, (off_t)number * PAGE_SIZE) != PAGE_SIZE)
+    {
+        perror("(!) Failed to read a page of the paged tree");
+        exit(EXIT_FAILURE);
+    }
+    tree->reads++;
+}
+
+static void pageWrite(PagedTree *tree, uint32_t number, const void *buffer)
+{
+    if (pwrite(tree->fd, buffer, PAGE_SIZE, (off_t)number * PAGE_SIZE) != PAGE_SIZE)
+    {
+        perror("(!) Failed to write a page of the paged tree");
+        exit(EXIT_FAILURE);
+    }
+    tree->writes++;
+}
+
+/**
+ * @brief Makes sure the page -> frame map covers every page of the file.
+ */
+static void growFrameMap(PagedTree *tree)
+{
+    if (tree->header.pageCount <= tree->frameOfCapacity)
+        return;
+
+    size_t capacity = tree->frameOfCapacity ? tree->frameOfCapacity : 1024;
+    while (capacity < tree->header.pageCount)
+    {
+        capacity *= 2;
+    }
+    tree->frameOf = realloc(tree->frameOf, capacity * sizeof(int32_t));
+    if (!tree->frameOf)
+    {
+        perror("(!) Realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = tree->frameOfCapacity; i < capacity; i++)
+    {
+        tree->frameOf[i] = -1;
+    }
+    tree->frameOfCapacity = capacity;
+}
+
+/**
+ * @brief Picks a frame for a page about to be brought in, with the clock
+ * algorithm: the hand passes over pinned frames and gives referenced ones
+ * a second chance, and the first other frame is evicted, written back if
+ * dirty.
+ * @return The index of the now free frame.
+ */
+static size_t poolVictim(PagedTree *tree)
+{
+    for (size_t step = 0; step < 2 * tree->frameCount + 1; step++)
+    {
+        size_t index = tree->hand;
+        BufferFrame *frame = &tree->frames[index];
+        tree->hand = (tree->hand + 1) % tree->frameCount;
+
+        if (frame->pins > 0)
+            continue;
+        if (frame->page != 0 && frame->referenced)
+        {
+            frame->referenced = 0;
+            continue;
+        }
+        if (frame->page != 0)
+        {
+            if (frame->dirty)
+                pageWrite(tree, frame->page, tree->memory + index * PAGE_SIZE);
+            tree->frameOf[frame->page] = -1;
+            frame->page = 0;
+        }
+        return index;
+    }
+    fprintf(stderr, "(!) Every page of the buffer pool is pinned.\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Pins a page in the buffer pool, reading it in on a miss.
+ * @return The page's data, valid until pageRelease().
+ */
+static PageHeader *pageFetch(PagedTree *tree, uint32_t number)
+{
+    int32_t index = tree->frameOf[number];
+    if (index >= 0)
+    {
+        tree->hits++;
+    }
+    else
+    {
+        index = (int32_t)poolVictim(tree);
+        pageRead(tree, number, tree->memory + (size_t)index * PAGE_SIZE);
+        tree->frames[index].page = number;
+        tree->frames[index].dirty = 0;
+        tree->frameOf[number] = index;
+    }
+    tree->frames[index].pins++;
+    tree->frames[index].referenced = 1;
+    return (PageHeader *)(tree->memory + (size_t)index * PAGE_SIZE);
+}
+
+/**
+ * @brief Unpins a page, noting whether the caller changed it.
+ */
+static void pageRelease(PagedTree *tree, PageHeader *page, int dirty)
+{
+    size_t index = (size_t)((unsigned char *)page - tree->memory) / PAGE_SIZE;
+    tree->frames[index].pins--;
+    if (dirty)
+        tree->frames[index].dirty = 1;
+}
+
+/**
+ * @brief Adds an empty page at the end of the file, pinned and dirty; it
+ * reaches the disk when evicted or flushed.
+ */
+static PageHeader *pageAllocate(PagedTree *tree, uint32_t *number, int leaf)
+{
+    *number = tree->header.pageCount++;
+    growFrameMap(tree);
+
+    size_t index = poolVictim(tree);
+    PageHeader *page = (PageHeader *)(tree->memory + index * PAGE_SIZE);
+    memset(page, 0, PAGE_SIZE);
+    page->leaf = (uint16_t)leaf;
+    tree->frames[index].page = *number;
+    tree->frames[index].pins = 1;
+    tree->frames[index].referenced = 1;
+    tree->frames[index].dirty = 1;
+    tree->frameOf[*number] = (int32_t)index;
+    return page;
+}
+
+/**
+ * @brief Binary search of a leaf.
+ * @return The position of the first record whose key is not below key;
+ * found tells whether that record has the key.
+ */
+static int leafPosition(PageHeader *leaf, const char *key, int *found)
+{
+    PageRecord *records = pageRecords(leaf);
+    int low = 0;
+    int high = leaf->count;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (strcmp(records[middle].key, key) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    *found = low < leaf->count && strcmp(records[low].key, key) == 0;
+    return low;
+}
+
+/**
+ * @brief Binary search of an inner page.
+ * @return How many separators are not above key: 0 means the leftmost
+ * child, i the child of separator i - 1.
+ */
+static int innerPosition(PageHeader *inner, const char *key)
+{
+    PageBranch *branches = pageBranches(inner);
+    int low = 0;
+    int high = inner->count;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (strcmp(branches[middle].key, key) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static uint32_t innerChild(PageHeader *inner, int position)
+{
+    return position == 0 ? inner->next : pageBranches(inner)[position - 1].child;
+}
+
+/**
+ * @brief Walks from the root to the leaf that holds key or would hold it.
+ * @return The leaf, pinned.
+ */
+static PageHeader *pagedFindLeaf(PagedTree *tree, const char *key)
+{
+    PageHeader *page = pageFetch(tree, tree->header.root);
+    while (!page->leaf)
+    {
+        uint32_t child = innerChild(page, innerPosition(page, key));
+        pageRelease(tree, page, 0);
+        page = pageFetch(tree, child);
+    }
+    return page;
+}
+
+/**
+ * @brief Inserts a record below a page. A page that overflows is split in
+ * two; the new right half is reported through split for the parent to
+ * link (split->child is 0 when nothing split).
+ * @return 1 if inserted, 0 if the key already exists.
+ */
+static int pagedInsertRec(PagedTree *tree, uint32_t number, const PageRecord *record, PageBranch *split)
+{
+    PageHeader *page = pageFetch(tree, number);
+    split->child = 0;
+
+    if (page->leaf)
+    {
+        int found;
+        int position = leafPosition(page, record->key, &found);
+        PageRecord *records = pageRecords(page);
+        if (found)
+        {
+            pageRelease(tree, page, 0);
+            return 0;
+        }
+        if (page->count < LEAF_CAPACITY)
+        {
+            memmove(&records[position + 1], &records[position], (page->count - position) * sizeof(PageRecord));
+            records[position] = *record;
+            page->count++;
+            pageRelease(tree, page, 1);
+            return 1;
+        }
+
+        PageRecord all[LEAF_CAPACITY + 1];
+        int total = page->count + 1;
+        int half = total / 2;
+        memcpy(all, records, position * sizeof(PageRecord));
+        all[position] = *record;
+        memcpy(&all[position + 1], &records[position], (page->count - position) * sizeof(PageRecord));
+
+        uint32_t rightNumber;
+        PageHeader *right = pageAllocate(tree, &rightNumber, 1);
+        memcpy(records, all, half * sizeof(PageRecord));
+        page->count = (uint16_t)half;
+        memcpy(pageRecords(right), &all[half], (total - half) * sizeof(PageRecord));
+        right->count = (uint16_t)(total - half);
+        right->next = page->next;
+        page->next = rightNumber;
+
+        strcpy(split->key, pageRecords(right)[0].key);
+        split->child = rightNumber;
+        pageRelease(tree, right, 1);
+        pageRelease(tree, page, 1);
+        return 1;
+    }
+
+    PageBranch childSplit;
+    int position = innerPosition(page, record->key);
+    int inserted = pagedInsertRec(tree, innerChild(page, position), record, &childSplit);
+    if (childSplit.child == 0)
+    {
+        pageRelease(tree, page, 0);
+        return inserted;
+    }
+
+    PageBranch *branches = pageBranches(page);
+    if (page->count < INNER_CAPACITY)
+    {
+        memmove(&branches[position + 1], &branches[position], (page->count - position) * sizeof(PageBranch));
+        branches[position] = childSplit;
+        page->count++;
+        pageRelease(tree, page, 1);
+        return inserted;
+    }
+
+    // The middle separator moves up; its child becomes the right page's leftmost.
+    PageBranch all[INNER_CAPACITY + 1];
+    int total = page->count + 1;
+    int middle = total / 2;
+    memcpy(all, branches, position * sizeof(PageBranch));
+    all[position] = childSplit;
+    memcpy(&all[position + 1], &branches[position], (page->count - position) * sizeof(PageBranch));
+
+    uint32_t rightNumber;
+    PageHeader *right = pageAllocate(tree, &rightNumber, 0);
+    memcpy(branches, all, middle * sizeof(PageBranch));
+    page->count = (uint16_t)middle;
+    right->next = all[middle].child;
+    memcpy(pageBranches(right), &all[middle + 1], (total - middle - 1) * sizeof(PageBranch));
+    right->count = (uint16_t)(total - middle - 1);
+
+    strcpy(split->key, all[middle].key);
+    split->child = rightNumber;
+    pageRelease(tree, right, 1);
+    pageRelease(tree, page, 1);
+    return inserted;
+}
+
+/**
+ * @brief Opens a paged tree file, creating it if it does not exist, with a
+ * buffer pool of poolPages pages.
+ * @return The tree, or NULL on failure.
+ */
+PagedTree *pagedOpen(const char *path, size_t poolPages)
+{
+    struct stat st;
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror("(!) Failed to open the paged tree file");
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    PagedTree *tree = calloc(1, sizeof(PagedTree));
+    if (!tree)
+    {
+        perror("(!) Failed to allocate memory for the paged tree");
+        exit(EXIT_FAILURE);
+    }
+    tree->fd = fd;
+
+    if (st.st_size == 0)
+    {
+        // A new file: the header page and an empty leaf as the root.
+        unsigned char page[PAGE_SIZE];
+        memset(page, 0, PAGE_SIZE);
+        tree->header.magic = PAGE_MAGIC;
+        tree->header.root = 1;
+        tree->header.pageCount = 2;
+        tree->header.height = 1;
+        memcpy(page, &tree->header, sizeof(PageFileHeader));
+        pageWrite(tree, 0, page);
+        memset(page, 0, PAGE_SIZE);
+        ((PageHeader *)page)->leaf = 1;
+        pageWrite(tree, 1, page);
+        tree->writes = 0;
+    }
+    else if (pread(fd, &tree->header, sizeof(PageFileHeader), 0) != (ssize_t)sizeof(PageFileHeader) ||
+             tree->header.magic != PAGE_MAGIC || (off_t)tree->header.pageCount * PAGE_SIZE > st.st_size)
+    {
+        fprintf(stderr, "(!) %s is not a paged tree file, or it is damaged.\n", path);
+        close(fd);
+        free(tree);
+        return NULL;
+    }
+
+    tree->frameCount = poolPages < MIN_POOL_PAGES ? MIN_POOL_PAGES : poolPages;
+    tree->frames = calloc(tree->frameCount, sizeof(BufferFrame));
+    if (!tree->frames || posix_memalign((void **)&tree->memory, PAGE_SIZE, tree->frameCount * PAGE_SIZE) != 0)
+    {
+        perror("(!) Failed to allocate memory for the buffer pool");
+        exit(EXIT_FAILURE);
+    }
+    growFrameMap(tree);
+    pthread_mutex_init(&tree->lock, NULL);
+    return tree;
+}
+
+/**
+ * @brief Writes every dirty page and the header back and syncs the file.
+ */
+void pagedFlush(PagedTree *tree)
+{
+    unsigned char page[PAGE_SIZE];
+
+    pthread_mutex_lock(&tree->lock);
+    for (size_t i = 0; i < tree->frameCount; i++)
+    {
+        if (tree->frames[i].page != 0 && tree->frames[i].dirty)
+        {
+            pageWrite(tree, tree->frames[i].page, tree->memory + i * PAGE_SIZE);
+            tree->frames[i].dirty = 0;
+        }
+    }
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, &tree->header, sizeof(PageFileHeader));
+    pageWrite(tree, 0, page);
+    fdatasync(tree->fd);
+    pthread_mutex_unlock(&tree->lock);
+}
+
+/**
+ * @brief Flushes the tree and frees its buffer pool; the file stays.
+ */
+void pagedClose(PagedTree *tree)
+{
+    pagedFlush(tree);
+    close(tree->fd);
+    pthread_mutex_destroy(&tree->lock);
+    free(tree->frames);
+    free(tree->memory);
+    free(tree->frameOf);
+    free(tree);
+}
+
+/**
+ * @brief Inserts a record, splitting pages up to the root as needed.
+ * @return 1 if inserted, 0 if the key already exists.
+ */
+int pagedInsert(PagedTree *tree, const char *key, NodeType type, const void *data)
+{
+    PageRecord record;
+    PageBranch split;
+    memset(&record, 0, sizeof(record));
+    strcpy(record.key, key);
+    record.type = type;
+    memcpy(&record.data, data, type == EVENT_NODE ? sizeof(Event) : sizeof(Ticket));
+
+    pthread_mutex_lock(&tree->lock);
+    int inserted = pagedInsertRec(tree, tree->header.root, &record, &split);
+    if (split.child != 0)
+    {
+        uint32_t rootNumber;
+        PageHeader *root = pageAllocate(tree, &rootNumber, 0);
+        root->next = tree->header.root;
+        pageBranches(root)[0] = split;
+        root->count = 1;
+        pageRelease(tree, root, 1);
+        tree->header.root = rootNumber;
+        tree->header.height++;
+    }
+    tree->header.keys += inserted;
+    pthread_mutex_unlock(&tree->lock);
+    return inserted;
+}
+
+/**
+ * @brief Copies out the record of a key.
+ * @return 1 if the key was found, 0 otherwise.
+ */
+int pagedSearch(PagedTree *tree, const char *key, NodeType *type, NodeData *data)
+{
+    int found;
+    pthread_mutex_lock(&tree->lock);
+    PageHeader *leaf = pagedFindLeaf(tree, key);
+    int position = leafPosition(leaf, key, &found);
+    if (found)
+    {
+        *type = (NodeType)pageRecords(leaf)[position].type;
+        *data = pageRecords(leaf)[position].data;
+    }
+    pageRelease(tree, leaf, 0);
+    pthread_mutex_unlock(&tree->lock);
+    return found;
+}
+
+/**
+ * @brief Deletes the record of a key. Pages are not merged when they run
+ * low: a later insert in the same key range fills them again.
+ * @return 1 if the key was deleted, 0 if it was not found.
+ */
+int pagedDelete(PagedTree *tree, const char *key)
+{
+    int found;
+    pthread_mutex_lock(&tree->lock);
+    PageHeader *leaf = pagedFindLeaf(tree, key);
+    int position = leafPosition(leaf, key, &found);
+    if (found)
+    {
+        PageRecord *records = pageRecords(leaf);
+        memmove(&records[position], &records[position + 1], (leaf->count - position - 1) * sizeof(PageRecord));
+        leaf->count--;
+        tree->header.keys--;
+    }
+    pageRelease(tree, leaf, found);
+    pthread_mutex_unlock(&tree->lock);
+    return found;
+}
+
+/**
+ * @brief Copies the payloads of the keys in [from, to) in key order, at most
+ * max of them; to may be NULL for no upper bound and items NULL to only count
+ * them. Follows the chain of leaves, so only the pages in range are read.
+ * @return The number of keys in range.
+ */
+long pagedScan(PagedTree *tree, const char *from, const char *to, NodeData *items, long max)
+{
+    long count = 0;
+    int found;
+    pthread_mutex_lock(&tree->lock);
+    PageHeader *leaf = pagedFindLeaf(tree, from);
+    int position = leafPosition(leaf, from, &found);
+    for (;;)
+    {
+        PageRecord *records = pageRecords(leaf);
+        for (; position < leaf->count; position++)
+        {
+            if (to != NULL && strcmp(records[position].key, to) >= 0)
+            {
+                pageRelease(tree, leaf, 0);
+                pthread_mutex_unlock(&tree->lock);
+                return count;
+            }
+            if (items != NULL && count < max)
+                items[count] = records[position].data;
+            count++;
+        }
+
+        uint32_t next = leaf->next;
+        pageRelease(tree, leaf, 0);
+        if (next == 0)
+            break;
+        leaf = pageFetch(tree, next);
+        position = 0;
+    }
+    pthread_mutex_unlock(&tree->lock);
+    return count;
+}
+
+#else
+
+PagedTree *pagedOpen(const char *path, size_t poolPages)
+{
+    (void)path;
+    (void)poolPages;
+    fprintf(stderr, "(!) The paged tree needs positioned file I/O, which this platform lacks.\n");
+    return NULL;
+}
+
+void pagedClose(PagedTree *tree) { (void)tree; }
+void pagedFlush(PagedTree *tree) { (void)tree; }
+int pagedInsert(PagedTree *tree, const char *key, NodeType type, const void *data) { return 0; }
+int pagedSearch(PagedTree *tree, const char *key, NodeType *type, NodeData *data) { return 0; }
+int pagedDelete(PagedTree *tree, const char *key) { return 0; }
+long pagedScan(PagedTree *tree, const char *from, const char *to, NodeData *items, long max) { return 0; }
+
+#endif
+
+// --- Performance Counter Functions ---
+
+#ifdef __linux__
+/**
+ * @brief Opens one disabled perf event counting the calling thread in user space.
+ * @return The event's file descriptor, or -1 if the kernel or CPU lacks it.
+ */
+static int perfEventOpen(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // Permitted to unprivileged users (perf_event_paranoid <= 2)
+    attr.exclude_hv = 1;
+    // With more events than hardware counters the kernel time-shares them;
+    // the enabled/running times let us scale the counts back up.
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/**
+ * @brief Opens every counter the system supports; the others read as unavailable.
+ */
+void perfCountersOpen(PerfCounters *counters)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        counters->fd[i] = -1;
+        counters->value[i] = -1;
+    }
+#ifdef __linux__
+    counters->fd[PERF_CYCLES] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fd[PERF_INSTRUCTIONS] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fd[PERF_CACHE_MISSES] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters->fd[PERF_BRANCH_MISSES] = perfEventOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counters->fd[PERF_DTLB_MISSES] = perfEventOpen(PERF_TYPE_HW_CACHE,
+                                                   PERF_COUNT_HW_CACHE_DTLB |
+                                                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters->fd[PERF_PAGE_FAULTS] = perfEventOpen(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#endif
+}
+
+/**
+ * @brief Resets and starts the counters.
+ */
+void perfCountersStart(PerfCounters *counters)
+{
+#ifdef __linux__
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        if (counters->fd[i] >= 0)
+        {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void)counters;
+#endif
+}
+
+/**
+ * @brief Stops the counters and stores the counts since perfCountersStart().
+ */
+void perfCountersStop(PerfCounters *counters)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        counters->value[i] = -1;
+#ifdef __linux__
+        unsigned long long reading[3]; // Count, time enabled, time running
+        if (counters->fd[i] >= 0)
+        {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters->fd[i], reading, sizeof(reading)) == (ssize_t)sizeof(reading))
+            {
+                if (reading[2] > 0 && reading[2] < reading[1])
+                    counters->value[i] = (long long)((double)reading[0] * reading[1] / reading[2]);
+                else
+                    counters->value[i] = (long long)reading[0];
+            }
+        }
+#endif
+    }
+}
+
+void perfCountersClose(PerfCounters *counters)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+#ifndef _WIN32
+        if (counters->fd[i] >= 0)
+            close(counters->fd[i]);
+#endif
+        counters->fd[i] = -1;
+    }
+}
+
+/**
+ * @brief Formats a counter value per operation, or "n/a" if unavailable.
+ */
+static const char *perOperation(char *buffer, long long value, long operations)
+{
+    if (value < 0)
+        strcpy(buffer, "n/a");
+    else
+        sprintf(buffer, "%.3f", (double)value / operations);
+    return buffer;
+}
+
+/**
+ * @brief Prints the column headings for printPhaseResult().
+ */
+void printPhaseHeader(const char *title)
+{
+    printf("\n--- %s ---\n", title);
+    printf("  %-12s %10s %9s %10s %11s %7s %13s %14s %13s\n", "Phase", "Ops", "Time (s)", "ns/op",
+           "Cycles/op", "IPC", "LLC miss/op", "Branch miss/op", "dTLB miss/op");
+}
+
+/**
+ * @brief Prints the timing and per-operation counter values of one
+ * benchmark phase; counters the system lacks print as n/a.
+ */
+void printPhaseResult(const char *phase, long operations, double seconds, const PerfCounters *counters)
+{
+    char cycles[32];
+    char ipc[32];
+    char cacheMisses[32];
+    char branchMisses[32];
+    char tlbMisses[32];
+    long long instructions = counters->value[PERF_INSTRUCTIONS];
+    long long cycleCount = counters->value[PERF_CYCLES];
+
+    if (instructions >= 0 && cycleCount > 0)
+        sprintf(ipc, "%.2f", (double)instructions / cycleCount);
+    else
+        strcpy(ipc, "n/a");
+
+    printf("  %-12s %10ld %9.3f %10.1f %11s %7s %13s %14s %13s\n", phase, operations, seconds,
+           seconds * 1e9 / operations,
+           perOperation(cycles, cycleCount, operations), ipc,
+           perOperation(cacheMisses, counters->value[PERF_CACHE_MISSES], operations),
+           perOperation(branchMisses, counters->value[PERF_BRANCH_MISSES], operations),
+           perOperation(tlbMisses, counters->value[PERF_DTLB_MISSES], operations));
+}
+
+// --- Benchmark Functions ---
+
+/**
+ * @brief Returns a monotonic clock reading in seconds, for timing.
+ */
+double monotonicSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Small deterministic generator (xorshift64*) so runs are repeatable.
+ */
+unsigned int benchmarkRandom(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (unsigned int)((*state * 2685821657736338717ULL) >> 32);
+}
+
+/**
+ * @brief Runs the benchmark selected on the command line ("--bench NAME ...").
+ * @return The program's exit status.
+ */
+int runBenchmark(const char *name, int argc, char *argv[])
+{
+    if (strcmp(name, "queue") == 0)
+    {
+        int producers = argc > 0 ? atoi(argv[0]) : 4;
+        int requests = argc > 1 ? atoi(argv[1]) : 100000;
+        if (producers < 1 || requests < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench queue [PRODUCERS] [REQUESTS_PER_PRODUCER]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkQueue(producers, requests);
+        return 0;
+    }
+
+    if (strcmp(name, "batch") == 0)
+    {
+        int keys = argc > 0 ? atoi(argv[0]) : 200000;
+        int operations = argc > 1 ? atoi(argv[1]) : 65536;
+        if (keys < 1 || operations < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench batch [KEYS] [OPERATIONS_PER_SIZE]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkBatch(keys, operations);
+        return 0;
+    }
+
+    if (strcmp(name, "prefetch") == 0)
+    {
+        int keys = argc > 0 ? atoi(argv[0]) : 2000000;
+        int lookups = argc > 1 ? atoi(argv[1]) : 2000000;
+        if (keys < 1 || lookups < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench prefetch [KEYS] [LOOKUPS]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkPrefetch(keys, lookups);
+        return 0;
+    }
+
+    if (strcmp(name, "hugepages") == 0)
+    {
+        int keys = argc > 0 ? atoi(argv[0]) : 10000000;
+        int lookups = argc > 1 ? atoi(argv[1]) : 2000000;
+        if (keys < 1 || lookups < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench hugepages [KEYS] [LOOKUPS]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkHugePages(keys, lookups);
+        return 0;
+    }
+
+    if (strcmp(name, "phases") == 0)
+    {
+        int events = argc > 0 ? atoi(argv[0]) : 500;
+        int tickets = argc > 1 ? atoi(argv[1]) : (defaultLayout.seatCount + 1) / 2;
+        if (events < 1 || tickets < 1 || tickets > defaultLayout.seatCount)
+        {
+            fprintf(stderr, "(!) Usage: --bench phases [EVENTS] [TICKETS_PER_EVENT (max %d)]\n", defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkPhases(events, tickets);
+        return 0;
+    }
+
+    if (strcmp(name, "onsale") == 0)
+    {
+        int clients = argc > 0 ? atoi(argv[0]) : 20000;
+        int threads = argc > 1 ? atoi(argv[1]) : 4;
+        int mode = -1; // All
+        if (argc > 2 && strcmp(argv[2], "all") != 0)
+            mode = strcmp(argv[2], "room") == 0    ? 2
+                   : strcmp(argv[2], "queue") == 0  ? 1
+                   : strcmp(argv[2], "direct") == 0 ? 0
+                                                    : -2;
+        double rate = argc > 3 ? atof(argv[3]) : 20000;
+        if (clients < 1 || threads < 1 || threads > 256 || mode == -2 || rate < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench onsale [CLIENTS] [THREADS] [direct|queue|room|all] [ADMISSIONS_PER_SECOND]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkOnSale(clients, threads, mode, rate);
+        return 0;
+    }
+
+    if (strcmp(name, "zipf") == 0)
+    {
+        int keys = argc > 0 ? atoi(argv[0]) : 1000000;
+        int lookups = argc > 1 ? atoi(argv[1]) : 2000000;
+        double theta = argc > 2 ? atof(argv[2]) : 0.99;
+        if (keys < 1 || lookups < 1 || theta <= 0 || theta > 3)
+        {
+            fprintf(stderr, "(!) Usage: --bench zipf [KEYS] [LOOKUPS] [THETA (0-3, default 0.99)]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkZipf(keys, lookups, theta);
+        return 0;
+    }
+
+    if (strcmp(name, "skiplist") == 0)
+    {
+        int threads = argc > 0 ? atoi(argv[0]) : 4;
+        int keys = argc > 1 ? atoi(argv[1]) : 1000000;
+        int operations = argc > 2 ? atoi(argv[2]) : 2000000;
+        if (threads < 1 || threads > MAX_READERS || keys < 1 || operations < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench skiplist [THREADS (max %d)] [KEYS] [OPERATIONS]\n", MAX_READERS);
+            return EXIT_FAILURE;
+        }
+        benchmarkSkipList(threads, keys, operations);
+        return 0;
+    }
+
+    if (strcmp(name, "hashindex") == 0)
+    {
+        int keys = argc > 0 ? atoi(argv[0]) : 10000000;
+        int lookups = argc > 1 ? atoi(argv[1]) : 2000000;
+        if (keys < 1 || keys > INT_MAX / 2 - 200000 || lookups < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench hashindex [KEYS] [LOOKUPS]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkHashIndex(keys, lookups);
+        return 0;
+    }
+
+    if (strcmp(name, "datalog") == 0)
+    {
+        int records = argc > 0 ? atoi(argv[0]) : 1000000;
+        const char *directory = argc > 1 ? argv[1] : "gym-datalog-bench";
+        if (records < 3 || records > INT_MAX / 2)
+        {
+            fprintf(stderr, "(!) Usage: --bench datalog [RECORDS] [DIRECTORY]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkDataLog(records, directory);
+        return 0;
+    }
+
+    if (strcmp(name, "lsm") == 0)
+    {
+        int inserts = argc > 0 ? atoi(argv[0]) : 2000000;
+        const char *directory = argc > 1 ? argv[1] : "gym-lsm-bench";
+        if (inserts < 10 || inserts > INT_MAX / 2)
+        {
+            fprintf(stderr, "(!) Usage: --bench lsm [INSERTS] [DIRECTORY]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkLsm(inserts, directory);
+        return 0;
+    }
+
+    if (strcmp(name, "paged") == 0)
+    {
+        int records = argc > 0 ? atoi(argv[0]) : 2000000;
+        int poolMegabytes = argc > 1 ? atoi(argv[1]) : 8;
+        const char *path = argc > 2 ? argv[2] : "gym-paged-bench.pages";
+        if (records < 1 || records > INT_MAX / 2 || poolMegabytes < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench paged [RECORDS] [POOL_MB] [FILE]\n");
+            return EXIT_FAILURE;
+        }
+        benchmarkPaged(records, poolMegabytes, path);
+        return 0;
+    }
+
+    if (strcmp(name, "typed") == 0)
+    {
+        int events = argc > 0 ? atoi(argv[0]) : 250;
+        int ticketsPerEvent = argc > 1 ? atoi(argv[1]) : 4000;
+        if (events < 1 || ticketsPerEvent < 1 || ticketsPerEvent > defaultLayout.seatCount ||
+            events > (INT_MAX - events) / ticketsPerEvent)
+        {
+            fprintf(stderr, "(!) Usage: --bench typed [EVENTS] [TICKETS_PER_EVENT (max %d)]\n", defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkTyped(events, ticketsPerEvent);
+        return 0;
+    }
+
+    if (strcmp(name, "move") == 0)
+    {
+        int events = argc > 0 ? atoi(argv[0]) : 250;
+        int ticketsPerEvent = argc > 1 ? atoi(argv[1]) : 4000;
+        int moves = argc > 2 ? atoi(argv[2]) : 50;
+        if (events < 1 || ticketsPerEvent < 1 || ticketsPerEvent > defaultLayout.seatCount ||
+            events > INT_MAX / ticketsPerEvent || moves < 1 || 3 * moves > events)
+        {
+            fprintf(stderr, "(!) Usage: --bench move [EVENTS] [TICKETS_PER_EVENT (max %d)] [MOVES (max EVENTS/3)]\n",
+                    defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkMove(events, ticketsPerEvent, moves);
+        return 0;
+    }
+
+    if (strcmp(name, "edit") == 0)
+    {
+        int events = argc > 0 ? atoi(argv[0]) : 250;
+        int ticketsPerEvent = argc > 1 ? atoi(argv[1]) : 4000;
+        int edits = argc > 2 ? atoi(argv[2]) : 100;
+        if (events < 1 || ticketsPerEvent < 1 || ticketsPerEvent > defaultLayout.seatCount ||
+            events > INT_MAX / ticketsPerEvent || edits < 1)
+        {
+            fprintf(stderr, "(!) Usage: --bench edit [EVENTS] [TICKETS_PER_EVENT (max %d)] [EDITS]\n",
+                    defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkEdit(events, ticketsPerEvent, edits);
+        return 0;
+    }
+
+    if (strcmp(name, "transfer") == 0)
+    {
+        int events = argc > 0 ? atoi(argv[0]) : 250;
+        int ticketsPerEvent = argc > 1 ? atoi(argv[1]) : 4000;
+        int transfers = argc > 2 ? atoi(argv[2]) : 100000;
+        if (events < 1 || ticketsPerEvent < 1 || ticketsPerEvent > defaultLayout.seatCount ||
+            events > INT_MAX / ticketsPerEvent || transfers < 1 || transfers > events * ticketsPerEvent / 3)
+        {
+            fprintf(stderr, "(!) Usage: --bench transfer [EVENTS] [TICKETS_PER_EVENT (max %d)] [TRANSFERS (max a third of the tickets)]\n",
+                    defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkTransfer(events, ticketsPerEvent, transfers);
+        return 0;
+    }
+
+    if (strcmp(name, "waitlist") == 0)
+    {
+        int waiters = argc > 0 ? atoi(argv[0]) : 100000;
+        int bookings = argc > 1 ? atoi(argv[1]) : defaultLayout.seatCount;
+        if (waiters < 1 || bookings < 1 || bookings > defaultLayout.seatCount)
+        {
+            fprintf(stderr, "(!) Usage: --bench waitlist [WAITERS] [BOOKINGS (max %d)]\n", defaultLayout.seatCount);
+            return EXIT_FAILURE;
+        }
+        benchmarkWaitlist(waiters, bookings);
+        return 0;
+    }
+
+    fprintf(stderr, "(!) Unknown benchmark '%s'. Available: queue, batch, prefetch, hugepages, phases, onsale, zipf, skiplist, hashindex, datalog, lsm, paged, typed, move, edit, transfer, waitlist\n", name);
+    return EXIT_FAILURE;
+}
+
+static void *benchmarkProducer(void *arg)
+{
+    ProducerArgs *args = (ProducerArgs *)arg;
+    for (int i = 0; i < args->count; i++)
+    {
+        bookingSubmit(args->core, &args->requests[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fills a ticket with the n-th seat of the defaultLayout.
+ */
+static void benchmarkTicket(Ticket *ticket, int eventCode, int n)
+{
+    memset(ticket, 0, sizeof(Ticket));
+    ticket->eventCode = eventCode;
+    ticket->seatId = n % defaultLayout.seatCount;
+    sprintf(ticket->afm, "%010u", (unsigned int)n);
+    strcpy(ticket->firstName, "Bench");
+    strcpy(ticket->lastName, "Spectator");
+}
+
+/**
+ * @brief Measures booking throughput through the lock-free queue and through
+ * the mutex queue, with several producer threads feeding one writer.
+ */
+void benchmarkQueue(int producers, int requestsPerProducer)
+{
+    const int seatsPerEvent = defaultLayout.seatCount;
+    int total = producers * requestsPerProducer;
+    int events = (total + seatsPerEvent - 1) / seatsPerEvent;
+
+    printf("\n--- REQUEST QUEUE BENCHMARK (%d producers x %d ticket requests) ---\n",
+           producers, requestsPerProducer);
+    printf("  %-10s %14s %12s %12s %10s\n", "Queue", "Requests/s", "Avg batch", "Max batch", "Time (s)");
+
+    for (int lockFree = 1; lockFree >= 0; lockFree--)
+    {
+        Store store;
+        BookingCore core;
+        BookingRequest *requests = malloc(total * sizeof(BookingRequest));
+        pthread_t *threads = malloc(producers * sizeof(pthread_t));
+        ProducerArgs *args = malloc(producers * sizeof(ProducerArgs));
+        if (!requests || !threads || !args)
+        {
+            perror("(!) Failed to allocate memory for the benchmark");
+            exit(EXIT_FAILURE);
+        }
+
+        // Every request books a distinct seat, spread over as many events as needed.
+        storeInit(&store);
+        WriteTxn txn;
+        storeBeginWrite(&store, &txn);
+        for (int e = 0; e < events; e++)
+        {
+            Event event;
+            memset(&event, 0, sizeof(Event));
+            event.code = e;
+            sprintf(event.title, "Benchmark Event %d", e);
+            txnAddEvent(&txn, &event);
+        }
+        storeCommit(&txn);
+        for (int i = 0; i < total; i++)
+        {
+            requests[i].type = REQUEST_ADD_TICKET;
+            benchmarkTicket(&requests[i].data.ticketData, i / seatsPerEvent, i % seatsPerEvent);
+        }
+        // Shuffle so the unbalanced tree stays shallow and the queue is what gets measured.
+        unsigned long long seed = 42;
+        for (int i = total - 1; i > 0; i--)
+        {
+            int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+            NodeData swap = requests[i].data;
+            requests[i].data = requests[j].data;
+            requests[j].data = swap;
+        }
+
+        bookingCoreStart(&core, &store, lockFree);
+        double start = monotonicSeconds();
+        for (int p = 0; p < producers; p++)
+        {
+            args[p].core = &core;
+            args[p].requests = &requests[p * requestsPerProducer];
+            args[p].count = requestsPerProducer;
+            pthread_create(&threads[p], NULL, benchmarkProducer, &args[p]);
+        }
+        for (int p = 0; p < producers; p++)
+        {
+            pthread_join(threads[p], NULL);
+        }
+        bookingCoreStop(&core); // Returns once every request is applied
+        double elapsed = monotonicSeconds() - start;
+
+        int booked = 0;
+        for (int i = 0; i < total; i++)
+        {
+            booked += atomic_load(&requests[i].status) == BOOKING_OK;
+        }
+        printf("  %-10s %14.0f %12.1f %12d %10.3f%s\n", lockFree ? "lock-free" : "mutex",
+               total / elapsed, (double)total / core.batches, core.largestBatch, elapsed,
+               booked == total ? "" : "  (!) some bookings failed");
+
+        storeDestroy(&store);
+        free(requests);
+        free(threads);
+        free(args);
+    }
+    printf("--- END OF BENCHMARK ---\n");
+}
+
+/**
+ * @brief Fills the ticket and tree key of the n-th seat of the benchmark
+ * key space (4000 seats per event).
+ */
+static void benchmarkKey(char *key, Ticket *ticket, int n)
+{
+    benchmarkTicket(ticket, n / defaultLayout.seatCount, n % defaultLayout.seatCount);
+    ticketKey(key, ticket->eventCode, ticket->seatId);
+}
+
+/**
+ * @brief Fills a store with keys random distinct keys out of twice as many
+ * possible ones, inserted one by one in random order.
+ */
+static void benchmarkFillStore(Store *store, int keys, unsigned long long seed)
+{
+    int space = keys * 2;
+    int *order = malloc(space * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < space; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = space - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    for (int i = 0; i < keys; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        txnInsert(&txn, key, TICKET_NODE, &ticket);
+    }
+    storeCommit(&txn);
+    free(order);
+}
+
+/**
+ * @brief Compares applying batches of mixed operations one at a time
+ * against sorted batch merging, for batch sizes 1 to 4096.
+ */
+void benchmarkBatch(int keys, int operations)
+{
+    Store single;
+    Store batched;
+    BatchOp *ops = malloc(MAX_BATCH * sizeof(BatchOp));
+    if (!ops)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    storeInit(&single);
+    storeInit(&batched);
+    benchmarkFillStore(&single, keys, 7);
+    benchmarkFillStore(&batched, keys, 7);
+
+    printf("\n--- BATCH APPLY BENCHMARK (%d keys, %d operations per size: 50%% lookups, 25%% inserts, 25%% deletes) ---\n",
+           keys, operations);
+    printf("  %-10s %16s %16s %10s\n", "Batch", "One-by-one op/s", "Merged op/s", "Speedup");
+
+    for (int size = 1; size <= MAX_BATCH; size *= 2)
+    {
+        double singleTime = 0;
+        double batchedTime = 0;
+        long singleHits = 0;
+        long batchedHits = 0;
+        unsigned long long seed = 1000 + size;
+
+        for (int done = 0; done < operations; done += size)
+        {
+            int count = operations - done < size ? operations - done : size;
+            for (int i = 0; i < count; i++)
+            {
+                Ticket ticket;
+                unsigned int roll = benchmarkRandom(&seed) % 4;
+                ops[i].op = roll < 2 ? BATCH_LOOKUP : roll == 2 ? BATCH_INSERT : BATCH_DELETE;
+                benchmarkKey(ops[i].key, &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)(keys * 2)));
+                ops[i].type = TICKET_NODE;
+                ops[i].data.ticketData = ticket;
+            }
+
+            WriteTxn txn;
+            double start = monotonicSeconds();
+            storeBeginWrite(&single, &txn);
+            for (int i = 0; i < count; i++)
+            {
+                if (ops[i].op == BATCH_LOOKUP)
+                    ops[i].result = searchNode(txn.root, ops[i].key) != NULL;
+                else if (ops[i].op == BATCH_INSERT)
+                    txnInsert(&txn, ops[i].key, TICKET_NODE, &ops[i].data);
+                else
+                    txnDelete(&txn, ops[i].key);
+            }
+            storeCommit(&txn);
+            singleTime += monotonicSeconds() - start;
+            for (int i = 0; i < count; i++)
+            {
+                singleHits += ops[i].op == BATCH_LOOKUP && ops[i].result;
+            }
+
+            start = monotonicSeconds();
+            storeBeginWrite(&batched, &txn);
+            txnApplyBatch(&txn, ops, count);
+            storeCommit(&txn);
+            batchedTime += monotonicSeconds() - start;
+            for (int i = 0; i < count; i++)
+            {
+                batchedHits += ops[i].op == BATCH_LOOKUP && ops[i].result;
+            }
+        }
+        printf("  %-10d %16.0f %16.0f %9.2fx%s\n", size, operations / singleTime,
+               operations / batchedTime, singleTime / batchedTime,
+               singleHits == batchedHits ? "" : "  (!) lookup results differ");
+    }
+
+    Snapshot a = storeBeginRead(&single);
+    Snapshot b = storeBeginRead(&batched);
+    if (treeChecksum(a.root, 14695981039346656037ULL) != treeChecksum(b.root, 14695981039346656037ULL))
+    {
+        printf("(!) The two stores ended up with different contents.\n");
+    }
+    storeEndRead(&single, &a);
+    storeEndRead(&batched, &b);
+    printf("--- END OF BENCHMARK ---\n");
+
+    storeDestroy(&single);
+    storeDestroy(&batched);
+    free(ops);
+}
+
+/**
+ * @brief Measures random lookups in a tree larger than the last-level cache:
+ * one searchNode() at a time versus batched searches with 1 to 32 lookups
+ * in flight.
+ */
+void benchmarkPrefetch(int keys, int lookups)
+{
+    Store store;
+    char (*keyData)[20] = malloc((size_t)lookups * sizeof(*keyData));
+    const char **keyList = malloc((size_t)lookups * sizeof(char *));
+    TreeNode **results = malloc((size_t)lookups * sizeof(TreeNode *));
+    if (!keyData || !keyList || !results)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    storeInit(&store);
+    benchmarkFillStore(&store, keys, 11);
+
+    // Lookups for random keys of the key space: about half of them exist.
+    unsigned long long seed = 99;
+    for (int i = 0; i < lookups; i++)
+    {
+        Ticket ticket;
+        benchmarkKey(keyData[i], &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)(keys * 2)));
+        keyList[i] = keyData[i];
+    }
+
+    Snapshot snapshot = storeBeginRead(&store);
+    printf("\n--- PREFETCH BENCHMARK (%d keys, about %.0f MB of nodes, %d lookups) ---\n",
+           keys, keys * (double)sizeof(ArenaSlot) / (1024 * 1024), lookups);
+    printf("  %-22s %14s %10s %8s\n", "Search", "Lookups/s", "ns/lookup", "Found");
+
+    int found = 0;
+    double start = monotonicSeconds();
+    for (int i = 0; i < lookups; i++)
+    {
+        found += searchNode(snapshot.root, keyList[i]) != NULL;
+    }
+    double baseline = monotonicSeconds() - start;
+    printf("  %-22s %14.0f %10.1f %8d\n", "searchNode (one by one)", lookups / baseline,
+           baseline * 1e9 / lookups, found);
+
+    for (int width = 1; width <= MAX_LOOKUP_GROUP; width *= 2)
+    {
+        char label[32];
+        start = monotonicSeconds();
+        searchNodeInterleaved(snapshot.root, keyList, results, lookups, width);
+        double elapsed = monotonicSeconds() - start;
+
+        found = 0;
+        for (int i = 0; i < lookups; i++)
+        {
+            found += results[i] != NULL;
+        }
+        sprintf(label, "batched, %d in flight", width);
+        printf("  %-22s %14.0f %10.1f %8d  %.2fx\n", label, lookups / elapsed,
+               elapsed * 1e9 / lookups, found, baseline / elapsed);
+    }
+    printf("--- END OF BENCHMARK ---\n");
+    storeEndRead(&store, &snapshot);
+
+    storeDestroy(&store);
+    free(keyData);
+    free(keyList);
+    free(results);
+}
+
+/**
+ * @brief Returns how many kilobytes of this process are backed by huge pages
+ * (transparent and hugetlb), or -1 if the kernel does not report it.
+ */
+static long hugePageKilobytes(void)
+{
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long total = -1;
+    if (file == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        long kilobytes;
+        if (sscanf(line, "AnonHugePages: %ld kB", &kilobytes) == 1 ||
+            sscanf(line, "Private_Hugetlb: %ld kB", &kilobytes) == 1)
+        {
+            total = (total < 0 ? 0 : total) + kilobytes;
+        }
+    }
+    fclose(file);
+    return total;
+}
+
+/**
+ * @brief Builds a large tree with the node arena on each page size and
+ * measures random lookups, with data TLB misses from the perf counters.
+ */
+void benchmarkHugePages(int keys, int lookups)
+{
+    const char *names[] = {"4 KB pages", "transparent huge", "explicit huge"};
+    PageMode saved = arenaPageMode;
+    PerfCounters counters;
+    char (*keyData)[20] = malloc((size_t)lookups * sizeof(*keyData));
+    if (!keyData)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned long long seed = 5;
+    for (int i = 0; i < lookups; i++)
+    {
+        Ticket ticket;
+        benchmarkKey(keyData[i], &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)(keys * 2)));
+    }
+
+    perfCountersOpen(&counters);
+    printf("\n--- HUGE PAGE ARENA BENCHMARK (%d nodes, about %.0f MB, %d lookups) ---\n",
+           keys, keys * (double)sizeof(ArenaSlot) / (1024 * 1024), lookups);
+    printf("  %-18s %9s %12s %10s %14s %8s %9s %12s\n", "Arena pages", "Build (s)", "Faults/node",
+           "ns/lookup", "dTLB miss/lkp", "Found", "Huge MB", "Huge chunks");
+
+    for (int mode = PAGES_SMALL; mode <= PAGES_EXPLICIT_HUGE; mode++)
+    {
+        Store store;
+        char faults[32];
+        char misses[32];
+
+        arenaPageMode = (PageMode)mode;
+        storeInit(&store);
+
+        perfCountersStart(&counters);
+        double start = monotonicSeconds();
+        benchmarkFillStore(&store, keys, 3);
+        double build = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        perOperation(faults, counters.value[PERF_PAGE_FAULTS], keys);
+        long hugeKb = hugePageKilobytes();
+
+        Snapshot snapshot = storeBeginRead(&store);
+        int found = 0;
+        perfCountersStart(&counters);
+        start = monotonicSeconds();
+        for (int i = 0; i < lookups; i++)
+        {
+            found += searchNode(snapshot.root, keyData[i]) != NULL;
+        }
+        double elapsed = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        storeEndRead(&store, &snapshot);
+
+        printf("  %-18s %9.2f %12s %10.1f %14s %8d %9.0f %5zu of %zu\n", names[mode], build, faults,
+               elapsed * 1e9 / lookups, perOperation(misses, counters.value[PERF_DTLB_MISSES], lookups),
+               found, hugeKb < 0 ? -1.0 : hugeKb / 1024.0, store.arena.hugeChunks, store.arena.chunkCount);
+        storeDestroy(&store);
+    }
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    arenaPageMode = saved;
+    free(keyData);
+}
+
+/**
+ * @brief Runs the main store operations phase by phase (insert, search,
+ * list, removeEvent) and reports timings with hardware counters per phase.
+ */
+void benchmarkPhases(int events, int ticketsPerEvent)
+{
+    Store store;
+    PerfCounters counters;
+    long tickets = (long)events * ticketsPerEvent;
+    unsigned long long seed = 17;
+    char title[128];
+
+    // Events and seats in random order, so the tree is not a list.
+    int *order = malloc(tickets * sizeof(int));
+    int *eventOrder = malloc(events * sizeof(int));
+    if (!order || !eventOrder)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < tickets; i++)
+    {
+        order[i] = (int)i;
+    }
+    for (long i = tickets - 1; i > 0; i--)
+    {
+        long j = benchmarkRandom(&seed) % (unsigned long)(i + 1);
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    for (int i = 0; i < events; i++)
+    {
+        eventOrder[i] = i;
+    }
+    for (int i = events - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = eventOrder[i];
+        eventOrder[i] = eventOrder[j];
+        eventOrder[j] = swap;
+    }
+
+    storeInit(&store);
+    perfCountersOpen(&counters);
+    sprintf(title, "STORE PHASES BENCHMARK (%d events x %d tickets)", events, ticketsPerEvent);
+    printPhaseHeader(title);
+
+    // Insert: every event, then every ticket, through the booking operations.
+    WriteTxn txn;
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    storeBeginWrite(&store, &txn);
+    for (int i = 0; i < events; i++)
+    {
+        Event event;
+        memset(&event, 0, sizeof(Event));
+        event.code = eventOrder[i];
+        sprintf(event.title, "Benchmark Event %d", event.code);
+        txnAddEvent(&txn, &event);
+    }
+    for (long i = 0; i < tickets; i++)
+    {
+        Ticket ticket;
+        benchmarkTicket(&ticket, order[i] / ticketsPerEvent, order[i] % ticketsPerEvent);
+        txnAddTicket(&txn, &ticket);
+    }
+    storeCommit(&txn);
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("insert", events + tickets, elapsed, &counters);
+
+    // Search: every ticket once, in random order.
+    Snapshot snapshot = storeBeginRead(&store);
+    long found = 0;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (long i = 0; i < tickets; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkTicket(&ticket, order[i] / ticketsPerEvent, order[i] % ticketsPerEvent);
+        ticketKey(key, ticket.eventCode, ticket.seatId);
+        found += searchNode(snapshot.root, key) != NULL;
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("search", tickets, elapsed, &counters);
+
+    // List: the tickets of a sample of events, each a full tree walk.
+    int listed = events < 20 ? events : 20;
+    long listedTickets = 0;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < listed; i++)
+    {
+        listedTickets += countNodes(snapshot.root, TICKET_NODE, eventOrder[i]);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    storeEndRead(&store, &snapshot);
+    printPhaseResult("list", listed, elapsed, &counters);
+
+    // removeEvent: every event with its tickets, one transaction each.
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < events; i++)
+    {
+        storeBeginWrite(&store, &txn);
+        txnRemoveEvent(&txn, eventOrder[i], NULL);
+        storeCommit(&txn);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("removeEvent", events, elapsed, &counters);
+
+    if (found != tickets || listedTickets != (long)listed * ticketsPerEvent)
+    {
+        printf("(!) Found %ld of %ld tickets and listed %ld of %ld.\n", found, tickets,
+               listedTickets, (long)listed * ticketsPerEvent);
+    }
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(order);
+    free(eventOrder);
+}
+
+/**
+ * @brief Picks the seat an on-sale client goes for: front sections and the
+ * front rows within a section are the most wanted.
+ */
+static void saleChooseSeat(SaleWorker *worker, Ticket *ticket)
+{
+    const VenueLayout *layout = &worker->store->layout;
+    int section = 0;
+    while (section < layout->sectionCount - 1 && benchmarkRandom(&worker->seed) % 100 < 45)
+    {
+        section++; // First section 55%, second 25%, third 11%, ...
+    }
+    unsigned int seats = (unsigned int)(layout->sectionFirst[section + 1] - layout->sectionFirst[section]);
+    unsigned int first = benchmarkRandom(&worker->seed) % seats;
+    unsigned int second = benchmarkRandom(&worker->seed) % seats;
+    ticket->seatId = layout->sectionFirst[section] + (int)(first < second ? first : second);
+}
+
+/**
+ * @brief Books a client's held seat, directly or through the writer queue.
+ */
+static void saleBook(SaleWorker *worker, SaleClient *client)
+{
+    worker->attempts++;
+    if (worker->core != NULL)
+    {
+        bookingSubmit(worker->core, &client->request);
+        client->state = CLIENT_WAITING;
+        return;
+    }
+
+    WriteTxn txn;
+    storeBeginWrite(worker->store, &txn);
+    BookingResult result = txnAddTicket(&txn, &client->request.data.ticketData);
+    if (result == BOOKING_OK)
+        storeCommit(&txn);
+    else
+        storeAbort(&txn);
+    atomic_store_explicit(&client->request.status, result, memory_order_relaxed);
+    client->state = CLIENT_WAITING;
+}
+
+/**
+ * @brief Advances one client by one step.
+ * @return 1 if the client did something, 0 if it is only waiting.
+ */
+static int saleStep(SaleWorker *worker, SaleClient *client)
+{
+    Ticket *ticket = &client->request.data.ticketData;
+    char key[20];
+
+    switch (client->state)
+    {
+    case CLIENT_QUEUED:
+    {
+        int pass = atomic_load_explicit(&client->pass, memory_order_acquire);
+        if (pass == ROOM_WAITING)
+            return 0;
+        if (pass == ROOM_CLOSED)
+        {
+            worker->shutOut++;
+            client->state = CLIENT_DONE;
+            return 1;
+        }
+        client->state = CLIENT_BROWSE;
+        return 1;
+    }
+    case CLIENT_BROWSE:
+    {
+        if (client->attempts == SALE_MAX_ATTEMPTS)
+        {
+            worker->gaveUp++;
+            client->state = CLIENT_DONE;
+            return 1;
+        }
+        client->attempts++;
+        saleChooseSeat(worker, ticket);
+        ticketKey(key, worker->eventCode, ticket->seatId);
+        Snapshot snapshot = storeBeginRead(worker->store);
+        int taken = storeLookup(worker->store, snapshot.root, key) != NULL;
+        storeEndRead(worker->store, &snapshot);
+        worker->browses++;
+        if (taken)
+        {
+            worker->seenTaken++;
+            return 1; // Pick another seat next turn
+        }
+        client->holdRounds = (int)(benchmarkRandom(&worker->seed) % (SALE_MAX_HOLD + 1));
+        client->state = CLIENT_HOLD;
+        return 1;
+    }
+    case CLIENT_HOLD:
+        if (client->holdRounds-- > 0)
+            return 1;
+        if (benchmarkRandom(&worker->seed) % 100 < SALE_ABANDON_PERCENT)
+        {
+            worker->abandoned++;
+            client->state = CLIENT_DONE;
+            return 1;
+        }
+        saleBook(worker, client);
+        return 1;
+    case CLIENT_WAITING:
+    {
+        int status = atomic_load_explicit(&client->request.status, memory_order_acquire);
+        if (status == REQUEST_PENDING)
+            return 0;
+        if (status == BOOKING_OK)
+        {
+            worker->booked++;
+            client->state = CLIENT_DONE;
+            if (worker->room != NULL && atomic_fetch_add(worker->sold, 1) + 1 == worker->store->layout.seatCount)
+                waitingRoomClose(worker->room); // Sold out: send the rest of the line home
+        }
+        else
+        {
+            worker->lostRaces++; // Someone else paid for the seat first: retry
+            client->state = CLIENT_BROWSE;
+        }
+        return 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Load generator thread: lines its clients up in the waiting room,
+ * if there is one, then steps every client of its share in turn until all
+ * of them are done.
+ */
+static void *saleWorker(void *arg)
+{
+    SaleWorker *worker = arg;
+    int active = worker->count;
+    for (int i = 0; worker->room != NULL && i < worker->count; i++)
+    {
+        if (!waitingRoomEnter(worker->room, &worker->clients[i].pass))
+        {
+            worker->shutOut++;
+            worker->clients[i].state = CLIENT_DONE;
+        }
+    }
+    while (active > 0)
+    {
+        int progress = 0;
+        active = 0;
+        for (int i = 0; i < worker->count; i++)
+        {
+            if (worker->clients[i].state == CLIENT_DONE)
+                continue;
+            progress |= saleStep(worker, &worker->clients[i]);
+            active += worker->clients[i].state != CLIENT_DONE;
+        }
+        if (!progress)
+            sched_yield(); // Everyone is waiting for the writer
+    }
+    return NULL;
+}
+
+/**
+ * @brief Rehearses the on-sale of one big event: clients want seats at the
+ * front, check a seat is free, hold it for a while, then pay or walk away,
+ * and try another seat when someone else got there first. Run with the
+ * bookings committed by the client threads themselves, through the single
+ * writer's queue, by client threads admitted through a waiting room at
+ * rate clients per second, or all three (mode 0, 1, 2 or -1).
+ */
+void benchmarkOnSale(int clients, int threads, int mode, double rate)
+{
+    const char *variants[3] = {"direct", "queue", "room"};
+    const int venueSeats = defaultLayout.seatCount;
+
+    printf("\n--- ON-SALE LOAD TEST (%d clients on %d threads, %d seats) ---\n", clients, threads, venueSeats);
+    printf("  %-8s %10s %12s %9s %10s %10s %9s %9s %9s\n", "Writes", "Time (s)", "Bookings/s", "Booked",
+           "Sold (%)", "Lost race", "Seen sold", "Abandon", "Gave up");
+
+    unsigned long long roomAdmitted = 0;
+    unsigned long long roomShutOut = 0;
+    unsigned long long roomTurnedAway = 0;
+    for (int variant = 0; variant <= 2; variant++)
+    {
+        if (mode != -1 && mode != variant)
+            continue;
+
+        Store store;
+        BookingCore core;
+        WaitingRoom room;
+        atomic_long soldSoFar;
+        atomic_init(&soldSoFar, 0);
+        SaleClient *saleClients = calloc(clients, sizeof(SaleClient));
+        SaleWorker *workers = calloc(threads, sizeof(SaleWorker));
+        pthread_t *handles = malloc(threads * sizeof(pthread_t));
+        if (!saleClients || !workers || !handles)
+        {
+            perror("(!) Failed to allocate memory for the benchmark");
+            exit(EXIT_FAILURE);
+        }
+
+        storeInit(&store);
+        WriteTxn txn;
+        Event event;
+        memset(&event, 0, sizeof(Event));
+        event.code = 1;
+        strcpy(event.title, "Stadium Concert");
+        storeBeginWrite(&store, &txn);
+        txnAddEvent(&txn, &event);
+        storeCommit(&txn);
+
+        for (int i = 0; i < clients; i++)
+        {
+            SaleClient *client = &saleClients[i];
+            client->state = variant == 2 ? CLIENT_QUEUED : CLIENT_BROWSE;
+            client->request.type = REQUEST_ADD_TICKET;
+            benchmarkTicket(&client->request.data.ticketData, event.code, i);
+        }
+
+        if (variant == 1)
+            bookingCoreStart(&core, &store, 1);
+        if (variant == 2)
+            waitingRoomOpen(&room, rate);
+        double start = monotonicSeconds();
+        for (int t = 0; t < threads; t++)
+        {
+            SaleWorker *worker = &workers[t];
+            worker->store = &store;
+            worker->core = variant == 1 ? &core : NULL;
+            worker->room = variant == 2 ? &room : NULL;
+            worker->sold = &soldSoFar;
+            worker->eventCode = event.code;
+            worker->clients = &saleClients[(long)clients * t / threads];
+            worker->count = (int)((long)clients * (t + 1) / threads - (long)clients * t / threads);
+            worker->seed = 1000003ULL * (t + 1);
+            pthread_create(&handles[t], NULL, saleWorker, worker);
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_join(handles[t], NULL);
+        }
+        if (variant == 1)
+            bookingCoreStop(&core);
+        double elapsed = monotonicSeconds() - start;
+        if (variant == 2)
+        {
+            waitingRoomStop(&room);
+            roomAdmitted = atomic_load(&room.admitted);
+            roomShutOut = room.shutOut;
+            roomTurnedAway = atomic_load(&room.turnedAway);
+        }
+
+        SaleWorker total;
+        memset(&total, 0, sizeof(SaleWorker));
+        for (int t = 0; t < threads; t++)
+        {
+            total.browses += workers[t].browses;
+            total.seenTaken += workers[t].seenTaken;
+            total.attempts += workers[t].attempts;
+            total.lostRaces += workers[t].lostRaces;
+            total.booked += workers[t].booked;
+            total.abandoned += workers[t].abandoned;
+            total.gaveUp += workers[t].gaveUp;
+            total.shutOut += workers[t].shutOut;
+        }
+
+        Snapshot snapshot = storeBeginRead(&store);
+        long sold = countNodes(snapshot.root, TICKET_NODE, event.code);
+        storeEndRead(&store, &snapshot);
+
+        printf("  %-8s %10.3f %12.0f %9ld %10.1f %9.1f%% %8.1f%% %9ld %9ld%s\n", variants[variant],
+               elapsed, total.booked / elapsed, total.booked, 100.0 * sold / venueSeats,
+               total.attempts ? 100.0 * total.lostRaces / total.attempts : 0.0,
+               total.browses ? 100.0 * total.seenTaken / total.browses : 0.0,
+               total.abandoned, total.gaveUp, sold == total.booked ? "" : "  (!) sold seats do not match bookings");
+
+        storeDestroy(&store);
+        free(saleClients);
+        free(workers);
+        free(handles);
+    }
+    printf("  Lost race: bookings refused because the seat sold during the hold.\n");
+    printf("  Seen sold: seat checks that found the seat already taken.\n");
+    if (mode == -1 || mode == 2)
+        printf("  Room: %.0f admissions/s; %llu admitted, %llu still waiting at sell-out, %llu turned away.\n", rate,
+               roomAdmitted, roomShutOut, roomTurnedAway);
+    printf("--- END OF BENCHMARK ---\n");
+}
+
+/**
+ * @brief Draws key ranks from a Zipf distribution: rank r (from 0) is
+ * drawn with probability proportional to 1 / (r + 1)^theta.
+ */
+static void zipfSample(const double *cdf, int keys, int *ranks, int count, unsigned long long seed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        double u = (benchmarkRandom(&seed) + 0.5) / 4294967296.0;
+        int low = 0;
+        int high = keys - 1;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (cdf[middle] < u)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        ranks[i] = low;
+    }
+}
+
+/**
+ * @brief Number of nodes a search for a key visits.
+ */
+static int searchDepth(TreeNode *root, const char *key)
+{
+    int depth = 1;
+    for (TreeNode *node = root; node != NULL; depth++)
+    {
+        int cmp = strcmp(key, node->key);
+        if (cmp == 0)
+            return depth;
+        node = cmp < 0 ? nodeLeft(node) : nodeRight(node);
+    }
+    return depth;
+}
+
+/**
+ * @brief Times one pass of Zipf lookups against the current version of a
+ * store and prints it as a benchmark phase with its average search depth.
+ */
+static void zipfPhase(const char *phase, Store *store, char (*keys)[20], const int *ranks, int lookups,
+                      PerfCounters *counters)
+{
+    Snapshot snapshot = storeBeginRead(store);
+    long found = 0;
+    perfCountersStart(counters);
+    double start = monotonicSeconds();
+    for (int i = 0; i < lookups; i++)
+    {
+        found += searchNode(snapshot.root, keys[ranks[i]]) != NULL;
+    }
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(counters);
+
+    double depth = 0;
+    for (int i = 0; i < lookups; i++)
+    {
+        depth += searchDepth(snapshot.root, keys[ranks[i]]);
+    }
+    storeEndRead(store, &snapshot);
+
+    printPhaseResult(phase, lookups, elapsed, counters);
+    printf("  %-12s average depth %.1f%s\n", "", depth / lookups, found == lookups ? "" : "  (!) keys missing");
+}
+
+/**
+ * @brief Compares lookups on a skewed (Zipf) workload in the tree as built
+ * by random inserts, in a balanced tree, and in the tree reshaped by access
+ * frequency after a warm-up with the same distribution.
+ */
+void benchmarkZipf(int keys, int lookups, double theta)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    int savedAdaptive = adaptiveTree;
+
+    char (*rankedKeys)[20] = malloc((size_t)keys * sizeof(*rankedKeys));
+    double *cdf = malloc((size_t)keys * sizeof(double));
+    int *ranks = malloc((size_t)lookups * sizeof(int));
+    TreeNode **nodes = malloc((size_t)keys * sizeof(TreeNode *));
+    if (!rankedKeys || !cdf || !ranks || !nodes)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    adaptiveTree = 0; // Reshaped by hand between the phases, never by the collector
+    storeInit(&store);
+    benchmarkFillStore(&store, keys, 11);
+
+    // Popularity ranks are handed out in random key order.
+    Snapshot snapshot = storeBeginRead(&store);
+    collectNodes(snapshot.root, nodes, 0);
+    storeEndRead(&store, &snapshot);
+    unsigned long long seed = 23;
+    for (int i = keys - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        TreeNode *swap = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = swap;
+    }
+    for (int i = 0; i < keys; i++)
+    {
+        strcpy(rankedKeys[i], nodes[i]->key);
+    }
+
+    double total = 0;
+    for (int i = 0; i < keys; i++)
+    {
+        total += 1.0 / pow(i + 1, theta);
+        cdf[i] = total;
+    }
+    for (int i = 0; i < keys; i++)
+    {
+        cdf[i] /= total;
+    }
+    zipfSample(cdf, keys, ranks, lookups, 29);
+
+    perfCountersOpen(&counters);
+    sprintf(title, "ZIPF LOOKUP BENCHMARK (%d keys, %d lookups, theta %.2f)", keys, lookups, theta);
+    printPhaseHeader(title);
+
+    zipfPhase("random BST", &store, rankedKeys, ranks, lookups, &counters);
+
+    double start = monotonicSeconds();
+    storeReshape(&store, 0, 0); // No hits yet: comes out balanced
+    double balance = monotonicSeconds() - start;
+    zipfPhase("balanced", &store, rankedKeys, ranks, lookups, &counters);
+
+    // Warm up on a different sample of the same distribution, then reshape.
+    int *warmup = malloc((size_t)lookups * sizeof(int));
+    if (!warmup)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    zipfSample(cdf, keys, warmup, lookups, 31);
+    adaptiveTree = 1;
+    snapshot = storeBeginRead(&store);
+    for (int i = 0; i < lookups; i++)
+    {
+        searchNode(snapshot.root, rankedKeys[warmup[i]]);
+    }
+    storeEndRead(&store, &snapshot);
+    free(warmup);
+
+    start = monotonicSeconds();
+    storeReshape(&store, 0, 0);
+    double reshape = monotonicSeconds() - start;
+    zipfPhase("adaptive", &store, rankedKeys, ranks, lookups, &counters);
+
+    printf("  Rebuilds took %.3f s (balanced) and %.3f s (by frequency).\n", balance, reshape);
+    printf("--- END OF BENCHMARK ---\n");
+
+    adaptiveTree = savedAdaptive;
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(rankedKeys);
+    free(cdf);
+    free(ranks);
+    free(nodes);
+}
+
+/**
+ * @brief Counts up to max keys at or after from in a plain tree, in order.
+ */
+static int treeScan(TreeNode *node, const char *from, int count, int max)
+{
+    if (node == NULL || count >= max)
+        return count;
+    int cmp = strcmp(node->key, from);
+    if (cmp > 0)
+        count = treeScan(nodeLeft(node), from, count, max);
+    if (cmp >= 0 && count < max)
+        count++;
+    return treeScan(nodeRight(node), from, count, max);
+}
+
+#define ENGINE_SCAN_LENGTH 50 // Keys read by a scan of the skip list benchmark
+
+/**
+ * @brief Applies one operation of the mixed workload to the worker's index:
+ * a roll below 80 searches, below 89 inserts, below 98 deletes, and the
+ * rest scan ENGINE_SCAN_LENGTH keys from the given one.
+ * @return 1 if the key was found, inserted or deleted, or the scan was full.
+ */
+static int engineApply(EngineWorker *worker, unsigned int roll, const char *key, Ticket *ticket)
+{
+    int result = 0;
+
+    if (worker->engine == ENGINE_SKIP_LIST)
+    {
+        if (roll < 80)
+            return skipListSearch(worker->list, key, NULL, NULL);
+        if (roll < 89)
+            return skipListInsert(worker->list, key, TICKET_NODE, ticket);
+        if (roll < 98)
+            return skipListDelete(worker->list, key);
+        return skipListScan(worker->list, key, NULL, NULL, ENGINE_SCAN_LENGTH) == ENGINE_SCAN_LENGTH;
+    }
+
+    if (worker->engine == ENGINE_MUTEX_TREE)
+    {
+        pthread_mutex_lock(worker->lock);
+        TreeNode *root = *worker->root;
+        if (roll < 80)
+        {
+            result = searchNode(root, key) != NULL;
+        }
+        else if (roll < 98)
+        {
+            result = (searchNode(root, key) == NULL) == (roll < 89);
+            if (result)
+                *worker->root = roll < 89 ? insertNode(root, key, TICKET_NODE, ticket) : deleteNode(root, key);
+        }
+        else
+        {
+            result = treeScan(root, key, 0, ENGINE_SCAN_LENGTH) == ENGINE_SCAN_LENGTH;
+        }
+        pthread_mutex_unlock(worker->lock);
+        return result;
+    }
+
+    if (roll < 80 || roll >= 98)
+    {
+        Snapshot snapshot = storeBeginRead(worker->store);
+        if (roll < 80)
+            result = searchNode(snapshot.root, key) != NULL;
+        else
+            result = treeScan(snapshot.root, key, 0, ENGINE_SCAN_LENGTH) == ENGINE_SCAN_LENGTH;
+        storeEndRead(worker->store, &snapshot);
+        return result;
+    }
+
+    WriteTxn txn;
+    storeBeginWrite(worker->store, &txn);
+    result = (searchNode(txn.root, key) == NULL) == (roll < 89);
+    if (!result)
+    {
+        storeAbort(&txn);
+        return 0;
+    }
+    if (roll < 89)
+        txnInsert(&txn, key, TICKET_NODE, ticket);
+    else
+        txnDelete(&txn, key);
+    storeCommit(&txn);
+    return 1;
+}
+
+static void *engineWorker(void *arg)
+{
+    EngineWorker *worker = (EngineWorker *)arg;
+    for (int i = 0; i < worker->operations; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        unsigned int roll = benchmarkRandom(&worker->seed) % 100;
+        benchmarkKey(key, &ticket, (int)(benchmarkRandom(&worker->seed) % (unsigned int)worker->keySpace));
+        worker->hits += engineApply(worker, roll, key, &ticket);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs the mixed workload on one index with the given number of
+ * threads, each starting from the same seed as in the other indexes.
+ * @return Operations per second.
+ */
+static double engineRun(EngineWorker *shared, int threads, int operations, long *hits)
+{
+    EngineWorker *workers = malloc(threads * sizeof(EngineWorker));
+    pthread_t *handles = malloc(threads * sizeof(pthread_t));
+    if (!workers || !handles)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = monotonicSeconds();
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t] = *shared;
+        workers[t].operations = (int)((long)operations * (t + 1) / threads - (long)operations * t / threads);
+        workers[t].seed = 1000003ULL * (t + 1);
+        workers[t].hits = 0;
+        pthread_create(&handles[t], NULL, engineWorker, &workers[t]);
+    }
+    *hits = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(handles[t], NULL);
+        *hits += workers[t].hits;
+    }
+    double elapsed = monotonicSeconds() - start;
+
+    free(workers);
+    free(handles);
+    return operations / elapsed;
+}
+
+/**
+ * @brief Compares the throughput of the lock-free skip list, a plain tree
+ * behind a mutex and the versioned store on a mixed workload (80% searches,
+ * 9% inserts, 9% deletes, 2% short ordered scans), from 1 thread up to the
+ * given number, doubling each time. Every index starts with the same keys.
+ */
+void benchmarkSkipList(int threads, int keys, int operations)
+{
+    int space = keys * 2;
+    int *order = malloc(space * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < space; i++)
+    {
+        order[i] = i;
+    }
+    unsigned long long seed = 5;
+    for (int i = space - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    printf("\n--- CONCURRENT INDEX BENCHMARK (%d keys, %d operations: 80%% searches, 9%% inserts, 9%% deletes, 2%% scans of %d) ---\n",
+           keys, operations, ENGINE_SCAN_LENGTH);
+    printf("  %-8s %16s %16s %16s %12s\n", "Threads", "Skip list op/s", "Mutex tree op/s", "MVCC store op/s",
+           "Skip/mutex");
+
+    for (int count = 1;; count = count * 2 < threads && count * 2 > count ? count * 2 : threads)
+    {
+        double rate[ENGINE_COUNT];
+        long hits[ENGINE_COUNT];
+        EngineWorker shared;
+        SkipList *list = skipListCreate();
+        TreeNode *root = NULL;
+        pthread_mutex_t lock;
+        Store store;
+
+        pthread_mutex_init(&lock, NULL);
+        storeInit(&store);
+        WriteTxn txn;
+        storeBeginWrite(&store, &txn);
+        for (int i = 0; i < keys; i++)
+        {
+            char key[20];
+            Ticket ticket;
+            benchmarkKey(key, &ticket, order[i]);
+            skipListInsert(list, key, TICKET_NODE, &ticket);
+            root = insertNode(root, key, TICKET_NODE, &ticket);
+            txnInsert(&txn, key, TICKET_NODE, &ticket);
+        }
+        storeCommit(&txn);
+
+        memset(&shared, 0, sizeof(EngineWorker));
+        shared.list = list;
+        shared.root = &root;
+        shared.lock = &lock;
+        shared.store = &store;
+        shared.keySpace = space;
+        for (int engine = 0; engine < ENGINE_COUNT; engine++)
+        {
+            shared.engine = (IndexEngine)engine;
+            rate[engine] = engineRun(&shared, count, operations, &hits[engine]);
+        }
+
+        // One thread follows the same operations in every index, so the
+        // results must agree; with more they depend on the interleaving.
+        long listed = skipListScan(list, "", NULL, NULL, LONG_MAX);
+        int consistent = listed == atomic_load(&list->size) &&
+                         (count > 1 || (hits[ENGINE_SKIP_LIST] == hits[ENGINE_MUTEX_TREE] &&
+                                        hits[ENGINE_MUTEX_TREE] == hits[ENGINE_MVCC_STORE]));
+        printf("  %-8d %16.0f %16.0f %16.0f %11.2fx%s\n", count, rate[ENGINE_SKIP_LIST], rate[ENGINE_MUTEX_TREE],
+               rate[ENGINE_MVCC_STORE], rate[ENGINE_SKIP_LIST] / rate[ENGINE_MUTEX_TREE],
+               consistent ? "" : "  (!) results differ");
+
+        skipListDestroy(list);
+        freeTree(root);
+        pthread_mutex_destroy(&lock);
+        storeDestroy(&store);
+        if (count == threads)
+            break;
+    }
+    printf("--- END OF BENCHMARK ---\n");
+    free(order);
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+#define LATENCY_SAMPLES 200000 // Lookups timed one by one by benchmarkHashIndex()
+
+/**
+ * @brief Times lookups one at a time, through the hash index or in the
+ * tree, and prints the median, 99th percentile and worst latency with the
+ * cost of reading the clock taken out.
+ */
+static void lookupLatency(const char *label, Store *store, TreeNode *root, const char *const *keys, int count,
+                          int useIndex, double *samples, double clockCost)
+{
+    struct timespec before;
+    struct timespec after;
+    if (count > LATENCY_SAMPLES)
+        count = LATENCY_SAMPLES;
+
+    for (int i = 0; i < count; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        TreeNode *node = useIndex ? storeLookup(store, root, keys[i]) : searchNode(root, keys[i]);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        samples[i] = (after.tv_sec - before.tv_sec) * 1e9 + (after.tv_nsec - before.tv_nsec) - clockCost;
+        if (node == (TreeNode *)samples) // Never true: keeps the lookup from being optimized out
+            samples[i] = 0;
+    }
+    qsort(samples, count, sizeof(double), compareDoubles);
+    printf("  %-12s %10.0f %10.0f %10.0f\n", label, samples[count / 2], samples[(long)count * 99 / 100],
+           samples[count - 1]);
+}
+
+/**
+ * @brief Compares point lookups through the hash index with searches of
+ * the tree (one at a time and batched) in the same store, then measures
+ * the lookup latency distribution and what maintaining the index adds to
+ * small commits.
+ */
+void benchmarkHashIndex(int keys, int lookups)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    char (*keyData)[20] = malloc((size_t)lookups * sizeof(*keyData));
+    const char **keyList = malloc((size_t)lookups * sizeof(char *));
+    TreeNode **results = malloc((size_t)lookups * sizeof(TreeNode *));
+    double *samples = malloc(LATENCY_SAMPLES * sizeof(double));
+    if (!keyData || !keyList || !results || !samples)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    storeInit(&store);
+    benchmarkFillStore(&store, keys, 13);
+
+    // Lookups for random keys of the key space: about half of them exist.
+    unsigned long long seed = 17;
+    for (int i = 0; i < lookups; i++)
+    {
+        Ticket ticket;
+        benchmarkKey(keyData[i], &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)(keys * 2)));
+        keyList[i] = keyData[i];
+    }
+
+    perfCountersOpen(&counters);
+    sprintf(title, "HASH INDEX BENCHMARK (%d keys, %d lookups)", keys, lookups);
+    printPhaseHeader(title);
+
+    Snapshot snapshot = storeBeginRead(&store);
+    long found[3] = {0, 0, 0};
+
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    for (int i = 0; i < lookups; i++)
+    {
+        found[0] += searchNode(snapshot.root, keyList[i]) != NULL;
+    }
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("tree", lookups, elapsed, &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    searchNodeBatch(snapshot.root, keyList, results, lookups);
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    for (int i = 0; i < lookups; i++)
+    {
+        found[1] += results[i] != NULL;
+    }
+    printPhaseResult("tree batch", lookups, elapsed, &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < lookups; i++)
+    {
+        found[2] += storeLookup(&store, snapshot.root, keyList[i]) != NULL;
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("hash", lookups, elapsed, &counters);
+
+    IndexTable *table = atomic_load(&store.index->table);
+    printf("  Found %ld of %d keys%s. Index: %zu slots, %.0f MB (%.1f bytes per key).\n", found[2], lookups,
+           found[0] == found[1] && found[1] == found[2] ? "" : "  (!) lookup results differ", table->mask + 1,
+           (table->mask + 1) * (double)sizeof(IndexEntry) / (1024 * 1024),
+           (table->mask + 1) * (double)sizeof(IndexEntry) / keys);
+
+    // The clock is read twice per sample; measure what that costs alone.
+    struct timespec before;
+    struct timespec after;
+    double clockCost = 1e9;
+    for (int i = 0; i < 1000; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        double cost = (after.tv_sec - before.tv_sec) * 1e9 + (after.tv_nsec - before.tv_nsec);
+        if (cost < clockCost)
+            clockCost = cost;
+    }
+    printf("\n  %-12s %10s %10s %10s\n", "Latency (ns)", "p50", "p99", "max");
+    lookupLatency("tree", &store, snapshot.root, keyList, lookups, 0, samples, clockCost);
+    lookupLatency("hash", &store, snapshot.root, keyList, lookups, 1, samples, clockCost);
+    storeEndRead(&store, &snapshot);
+
+    // Small commits, first keeping the index up to date, then without it,
+    // of keys past the filled key space in random order, so every commit
+    // inserts and the tree does not degenerate.
+    int commits = keys < 100000 ? keys : 100000;
+    int *order = malloc(2 * commits * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < 2 * commits; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = 2 * commits - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    printf("\n  %-12s %10s %12s\n", "Commits", "Count", "us/commit");
+    for (int indexed = 1; indexed >= 0; indexed--)
+    {
+        if (!indexed)
+        {
+            indexDestroy(store.index);
+            store.index = NULL;
+        }
+        start = monotonicSeconds();
+        for (int i = 0; i < commits; i++)
+        {
+            char key[20];
+            Ticket ticket;
+            WriteTxn txn;
+            benchmarkKey(key, &ticket, keys * 2 + order[(indexed ? 0 : commits) + i]);
+            storeBeginWrite(&store, &txn);
+            txnInsert(&txn, key, TICKET_NODE, &ticket);
+            storeCommit(&txn);
+        }
+        elapsed = monotonicSeconds() - start;
+        printf("  %-12s %10d %12.2f\n", indexed ? "with index" : "tree only", commits, elapsed * 1e6 / commits);
+    }
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(order);
+    free(keyData);
+    free(keyList);
+    free(results);
+    free(samples);
+}
+
+#define LOG_BENCH_GROUP 1000 // Puts benchmarkDataLog() syncs to the disk at once
+
+static void *benchmarkMerge(void *arg)
+{
+    MergeArgs *args = (MergeArgs *)arg;
+    double start = monotonicSeconds();
+    args->reclaimed = logCompact(args->log);
+    args->seconds = monotonicSeconds() - start;
+    return NULL;
+}
+
+/**
+ * @brief Runs gets of random tickets against a data log.
+ * @return The number found.
+ */
+static long dataLogGets(DataLog *log, int records, int count, unsigned long long *seed)
+{
+    long found = 0;
+    for (int i = 0; i < count; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        benchmarkKey(key, &ticket, (int)(benchmarkRandom(seed) % (unsigned int)records));
+        found += logGet(log, key, &type, &data);
+    }
+    return found;
+}
+
+/**
+ * @brief Measures the data log on a write-heavy on-sale: puts synced to
+ * the disk in groups, gets, cancellations of two tickets in three, gets
+ * while a merge drops the dead records, and recovery of the key directory
+ * from the files. The log's own segment files in the directory are
+ * deleted before and after.
+ */
+void benchmarkDataLog(int records, const char *directory)
+{
+    PerfCounters counters;
+    char title[384];
+    size_t bytes;
+    size_t dead;
+    size_t keys;
+    unsigned long long seed = 23;
+    int *order = malloc(records * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < records; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = records - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    logRemove(directory);
+    DataLog *log = logOpen(directory);
+    if (log == NULL)
+    {
+        free(order);
+        return;
+    }
+    atomic_store(&log->compactPercent, 101); // Merges are started by the benchmark only
+
+    perfCountersOpen(&counters);
+    snprintf(title, sizeof(title), "DATA LOG BENCHMARK (%d tickets in %s)", records, directory);
+    printPhaseHeader(title);
+
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        logPut(log, key, TICKET_NODE, &ticket, 1);
+        if ((i + 1) % LOG_BENCH_GROUP == 0)
+            logSync(log);
+    }
+    logSync(log);
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("put", records, elapsed, &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    long found = dataLogGets(log, records, records, &seed);
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("get", records, elapsed, &counters);
+
+    long cancelled = 0;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        if (order[i] % 3 == 0)
+            continue;
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        cancelled += logDelete(log, key) > 0;
+    }
+    logSync(log);
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("cancel", cancelled, elapsed, &counters);
+    logStats(log, &bytes, &dead, &keys);
+    printf("  Before the merge: %.1f MB in files, %.1f MB dead, %zu keys (%ld of %d gets found).\n",
+           bytes / (1024.0 * 1024), dead / (1024.0 * 1024), keys, found, records);
+
+    // Gets carry on while another thread merges the segments.
+    MergeArgs merge = {log, 0, 0};
+    pthread_t merger;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    if (pthread_create(&merger, NULL, benchmarkMerge, &merge) != 0)
+    {
+        perror("(!) Failed to start the merge thread");
+        exit(EXIT_FAILURE);
+    }
+    found = dataLogGets(log, records, records, &seed);
+    pthread_join(merger, NULL);
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("get + merge", records, elapsed, &counters);
+    logStats(log, &bytes, &dead, &keys);
+    printf("  Merge: %.2f s, %.1f MB reclaimed. After: %.1f MB in files, %.1f MB dead, %zu keys.\n", merge.seconds,
+           merge.reclaimed / (1024.0 * 1024), bytes / (1024.0 * 1024), dead / (1024.0 * 1024), keys);
+
+    size_t expected = keys;
+    logClose(log);
+    start = monotonicSeconds();
+    log = logOpen(directory);
+    elapsed = monotonicSeconds() - start;
+    if (log == NULL)
+    {
+        perfCountersClose(&counters);
+        free(order);
+        return;
+    }
+    logStats(log, &bytes, &dead, &keys);
+    printf("  Recovery: %.3f s for %.1f MB, %zu keys%s.\n", elapsed, bytes / (1024.0 * 1024), keys,
+           keys == expected && (long)keys == records - cancelled ? "" : "  (!) keys lost or resurrected");
+
+    long wrong = 0;
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        benchmarkKey(key, &ticket, i);
+        int present = logGet(log, key, &type, &data);
+        if (present != (i % 3 == 0) || (present && memcmp(&data.ticketData, &ticket, sizeof(Ticket)) != 0))
+            wrong++;
+    }
+    printf("  Checked every ticket after recovery: %ld wrong.\n", wrong);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    logClose(log);
+    logRemove(directory);
+    free(order);
+}
+
+#define LSM_BENCH_COMMIT 100 // Inserts per transaction when benchmarkLsm() fills the versioned store
+
+/**
+ * @brief Notes the time each tenth of a run of inserts finished.
+ */
+static void markTenth(double *marks, int done, int total, double start)
+{
+    if ((long)done * 10 % total < 10)
+        marks[(long)done * 10 / total] = monotonicSeconds() - start;
+}
+
+/**
+ * @brief Prints the overall insert rate of an engine and the rate of its
+ * slowest tenth of the inserts, which exposes stalls an average hides.
+ */
+static void printSustainedRate(const char *engine, const double *marks, int inserts)
+{
+    double slowest = 0;
+    for (int i = 1; i <= 10; i++)
+    {
+        if (marks[i] - marks[i - 1] > slowest)
+            slowest = marks[i] - marks[i - 1];
+    }
+    printf("  %-12s %14.0f %16.0f\n", engine, inserts / marks[10], inserts / 10.0 / slowest);
+}
+
+/**
+ * @brief Compares sustained insert throughput, as in a sellout, of the
+ * plain tree, the versioned store and the LSM tree, then the cost of point
+ * lookups (half of them for missing keys) and how well the LSM tree's
+ * Bloom filters spare it from searching runs.
+ */
+void benchmarkLsm(int inserts, const char *directory)
+{
+    PerfCounters counters;
+    char title[384];
+    double marks[3][11];
+    long found[2] = {0, 0};
+    unsigned long long seed = 29;
+    int *order = malloc(inserts * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < inserts; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = inserts - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    lsmRemove(directory);
+    LsmTree *lsm = lsmOpen(directory);
+    if (lsm == NULL)
+    {
+        free(order);
+        return;
+    }
+
+    perfCountersOpen(&counters);
+    snprintf(title, sizeof(title), "LSM TREE BENCHMARK (%d inserts, runs in %s)", inserts, directory);
+    printPhaseHeader(title);
+
+    TreeNode *root = NULL;
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    marks[0][0] = 0;
+    for (int i = 0; i < inserts; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        root = insertNode(root, key, TICKET_NODE, &ticket);
+        markTenth(marks[0], i + 1, inserts, start);
+    }
+    perfCountersStop(&counters);
+    printPhaseResult("tree insert", inserts, marks[0][10], &counters);
+
+    Store store;
+    storeInit(&store);
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    marks[1][0] = 0;
+    for (int i = 0; i < inserts; i += LSM_BENCH_COMMIT)
+    {
+        WriteTxn txn;
+        int end = i + LSM_BENCH_COMMIT < inserts ? i + LSM_BENCH_COMMIT : inserts;
+        storeBeginWrite(&store, &txn);
+        for (int j = i; j < end; j++)
+        {
+            char key[20];
+            Ticket ticket;
+            benchmarkKey(key, &ticket, order[j]);
+            txnInsert(&txn, key, TICKET_NODE, &ticket);
+        }
+        storeCommit(&txn);
+        for (int j = i; j < end; j++)
+        {
+            markTenth(marks[1], j + 1, inserts, start);
+        }
+    }
+    perfCountersStop(&counters);
+    printPhaseResult("store insert", inserts, marks[1][10], &counters);
+    storeDestroy(&store);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    marks[2][0] = 0;
+    for (int i = 0; i < inserts; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        lsmPut(lsm, key, TICKET_NODE, &ticket);
+        markTenth(marks[2], i + 1, inserts, start);
+    }
+    perfCountersStop(&counters);
+    printPhaseResult("lsm insert", inserts, marks[2][10], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    lsmFlush(lsm);
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("lsm flush", 1, elapsed, &counters);
+
+    unsigned long long lookupSeed = seed;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < inserts; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)(inserts * 2)));
+        found[0] += searchNode(root, key) != NULL;
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("tree get", inserts, elapsed, &counters);
+
+    unsigned long long skips = atomic_load(&lsm->bloomSkips);
+    unsigned long long falsePositives = atomic_load(&lsm->falsePositives);
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < inserts; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        benchmarkKey(key, &ticket, (int)(benchmarkRandom(&lookupSeed) % (unsigned int)(inserts * 2)));
+        found[1] += lsmGet(lsm, key, &type, &data);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("lsm get", inserts, elapsed, &counters);
+    skips = atomic_load(&lsm->bloomSkips) - skips;
+    falsePositives = atomic_load(&lsm->falsePositives) - falsePositives;
+
+    printf("\n  %-12s %14s %16s\n", "Sustained", "inserts/s", "slowest tenth/s");
+    printSustainedRate("tree", marks[0], inserts);
+    printSustainedRate("store", marks[1], inserts);
+    printSustainedRate("lsm", marks[2], inserts);
+
+    pthread_rwlock_rdlock(&lsm->runsLock);
+    int runs = lsm->runCount;
+    pthread_rwlock_unlock(&lsm->runsLock);
+    printf("\n  LSM: %d runs after %lu flushes and %lu merges, %lu write stalls, %.1f MB written "
+           "(write amplification %.2f).\n",
+           runs, atomic_load(&lsm->flushes), atomic_load(&lsm->merges), atomic_load(&lsm->stalls),
+           atomic_load(&lsm->bytesWritten) / (1024.0 * 1024),
+           atomic_load(&lsm->bytesWritten) / ((double)inserts * sizeof(LsmEntry)));
+    printf("  Bloom filters skipped %.2f runs per lookup; %.2f%% of the runs they let through lacked the key.\n",
+           (double)skips / inserts, skips + falsePositives ? 100.0 * falsePositives / (skips + falsePositives) : 0.0);
+    printf("  Found %ld of %d keys%s.\n", found[1], inserts, found[0] == found[1] ? "" : "  (!) lookup results differ");
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    lsmClose(lsm);
+    lsmRemove(directory);
+    freeTree(root);
+    free(order);
+}
+
+#define PAGED_BENCH_SCANS 200 // Events benchmarkPaged() lists
+
+/**
+ * @brief Stores the buffer pool's hits, reads and writes since mark was
+ * taken in use, and takes mark again.
+ */
+static void poolUse(const PagedTree *tree, unsigned long long *mark, unsigned long long *use)
+{
+    use[0] = tree->hits - mark[0];
+    use[1] = tree->reads - mark[1];
+    use[2] = tree->writes - mark[2];
+    mark[0] = tree->hits;
+    mark[1] = tree->reads;
+    mark[2] = tree->writes;
+}
+
+/**
+ * @brief Runs the paged tree with a buffer pool much smaller than its
+ * file: random inserts, lookups spread over every key, lookups where one
+ * event in a hundred gets nine in ten of them, and listings of events,
+ * with the pool's hit ratio and page I/O per operation for each.
+ */
+void benchmarkPaged(int records, int poolMegabytes, const char *path)
+{
+    PerfCounters counters;
+    char title[384];
+    const char *phases[5] = {"insert", "get uniform", "get hot", "scan event", "get reopened"};
+    unsigned long long pool[5][3];
+    long operations[5];
+    unsigned long long seed = 31;
+    struct stat st;
+    if (stat(path, &st) == 0)
+    {
+        fprintf(stderr, "(!) %s already exists; the benchmark needs a new file.\n", path);
+        return;
+    }
+
+    int *order = malloc(records * sizeof(int));
+    NodeData *items = malloc(defaultLayout.seatCount * sizeof(NodeData));
+    if (!order || !items)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < records; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = records - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    size_t poolPages = (size_t)poolMegabytes * 1024 * 1024 / PAGE_SIZE;
+    PagedTree *tree = pagedOpen(path, poolPages);
+    if (tree == NULL)
+    {
+        free(order);
+        free(items);
+        return;
+    }
+    unsigned long long mark[3] = {0, 0, 0};
+
+    perfCountersOpen(&counters);
+    snprintf(title, sizeof(title), "PAGED TREE BENCHMARK (%d tickets, %d MB buffer pool)", records, poolMegabytes);
+    printPhaseHeader(title);
+
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkKey(key, &ticket, order[i]);
+        pagedInsert(tree, key, TICKET_NODE, &ticket);
+    }
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[0], records, elapsed, &counters);
+    operations[0] = records;
+    poolUse(tree, mark, pool[0]);
+
+    long found = 0;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        benchmarkKey(key, &ticket, (int)(benchmarkRandom(&seed) % (unsigned int)records));
+        found += pagedSearch(tree, key, &type, &data);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[1], records, elapsed, &counters);
+    operations[1] = records;
+    poolUse(tree, mark, pool[1]);
+
+    // One event in a hundred (at least one) draws nine lookups in ten.
+    int events = (records + defaultLayout.seatCount - 1) / defaultLayout.seatCount;
+    int hotEvents = events / 100 > 0 ? events / 100 : 1;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        int n = (int)(benchmarkRandom(&seed) % (unsigned int)records);
+        if (benchmarkRandom(&seed) % 10 != 0)
+            n = n % (hotEvents * defaultLayout.seatCount) % records;
+        benchmarkKey(key, &ticket, n);
+        found += pagedSearch(tree, key, &type, &data);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[2], records, elapsed, &counters);
+    operations[2] = records;
+    poolUse(tree, mark, pool[2]);
+
+    long listed = 0;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < PAGED_BENCH_SCANS; i++)
+    {
+        char from[20];
+        char to[20];
+        int code = (int)(benchmarkRandom(&seed) % (unsigned int)events);
+        ticketKey(from, code, 0);
+        ticketKey(to, code, defaultLayout.seatCount);
+        listed += pagedScan(tree, from, to, items, defaultLayout.seatCount);
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[3], PAGED_BENCH_SCANS, elapsed, &counters);
+    operations[3] = PAGED_BENCH_SCANS;
+    poolUse(tree, mark, pool[3]);
+
+    // Close and reopen: the data comes back from the file, through a cold pool.
+    unsigned int pages = tree->header.pageCount;
+    pagedClose(tree);
+    tree = pagedOpen(path, poolPages);
+    if (tree == NULL)
+    {
+        perfCountersClose(&counters);
+        free(order);
+        free(items);
+        return;
+    }
+    long wrong = tree->header.keys != (uint64_t)records;
+    mark[0] = mark[1] = mark[2] = 0; // Counts start over with the reopened tree
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < records; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        NodeType type;
+        NodeData data;
+        benchmarkKey(key, &ticket, order[i]);
+        if (!pagedSearch(tree, key, &type, &data) || memcmp(&data.ticketData, &ticket, sizeof(Ticket)) != 0)
+            wrong++;
+    }
+    elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[4], records, elapsed, &counters);
+    operations[4] = records;
+    poolUse(tree, mark, pool[4]);
+
+    printf("\n  %-12s %10s %10s %10s\n", "Buffer pool", "hit ratio", "reads/op", "writes/op");
+    for (int i = 0; i < 5; i++)
+    {
+        unsigned long long requests = pool[i][0] + pool[i][1];
+        printf("  %-12s %9.1f%% %10.2f %10.2f\n", phases[i], requests ? 100.0 * pool[i][0] / requests : 0.0,
+               (double)pool[i][1] / operations[i], (double)pool[i][2] / operations[i]);
+    }
+    printf("\n  File: %.1f MB in %u pages of %d bytes, %.0f times the pool. Tree height %u.\n",
+           (double)pages * PAGE_SIZE / (1024 * 1024), pages, PAGE_SIZE, (double)pages / tree->frameCount,
+           tree->header.height);
+    printf("  Found %ld of %d lookups, listed %.0f tickets per event; %ld records wrong after reopening.\n", found,
+           2 * records, (double)listed / PAGED_BENCH_SCANS, wrong);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    pagedClose(tree);
+    unlink(path);
+    free(order);
+    free(items);
+}
+
+/**
+ * @brief Compares the union tree (string keys, type tag, NodeData union)
+ * with the trees TYPED_TREE_DEFINE generates for events and tickets, on
+ * the same records in the same random order: insert, search, list the
+ * tickets of every event and delete half of the records.
+ */
+void benchmarkTyped(int events, int ticketsPerEvent)
+{
+    PerfCounters counters;
+    char title[128];
+    const char *phases[4] = {"insert", "search", "list events", "delete half"};
+    int total = events + events * ticketsPerEvent;
+    char (*keys)[20] = malloc((size_t)total * sizeof(*keys));
+    Ticket *tickets = malloc((size_t)events * ticketsPerEvent * sizeof(Ticket));
+    Event *eventList = malloc(events * sizeof(Event));
+    int *order = malloc(total * sizeof(int));
+    if (!keys || !tickets || !eventList || !order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    // Record i < events is event i; the others are tickets, one event's seats after another's.
+    for (int e = 0; e < events; e++)
+    {
+        memset(&eventList[e], 0, sizeof(Event));
+        eventList[e].code = e;
+        strcpy(eventList[e].date, "01/01/2030");
+        strcpy(eventList[e].time, "20:00");
+        sprintf(eventList[e].title, "Benchmark Event %d", e);
+        sprintf(keys[e], "E_%d", e);
+    }
+    for (int i = 0; i < events * ticketsPerEvent; i++)
+    {
+        benchmarkTicket(&tickets[i], i / ticketsPerEvent, i % ticketsPerEvent);
+        ticketKey(keys[events + i], tickets[i].eventCode, tickets[i].seatId);
+    }
+    unsigned long long seed = 37;
+    for (int i = 0; i < total; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = total - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    perfCountersOpen(&counters);
+    long found[2] = {0, 0};
+    long listed[2] = {0, 0};
+    double seconds[2][4];
+
+    sprintf(title, "UNION TREE (%d events, %d tickets each)", events, ticketsPerEvent);
+    printPhaseHeader(title);
+    TreeNode *root = NULL;
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    for (int i = 0; i < total; i++)
+    {
+        int n = order[i];
+        if (n < events)
+            root = insertNode(root, keys[n], EVENT_NODE, &eventList[n]);
+        else
+            root = insertNode(root, keys[n], TICKET_NODE, &tickets[n - events]);
+    }
+    seconds[0][0] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[0], total, seconds[0][0], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = total - 1; i >= 0; i--)
+    {
+        found[0] += searchNode(root, keys[order[i]]) != NULL;
+    }
+    seconds[0][1] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[1], total, seconds[0][1], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int e = 0; e < events; e++)
+    {
+        char from[20];
+        char to[20];
+        ticketKeyRange(from, to, e);
+        listed[0] += countKeyRange(root, from, to);
+    }
+    seconds[0][2] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[2], events, seconds[0][2], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < total; i += 2)
+    {
+        root = deleteNode(root, keys[order[i]]);
+    }
+    seconds[0][3] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[3], (total + 1) / 2, seconds[0][3], &counters);
+    long unionLeft = countNodes(root, EVENT_NODE, -1) + countNodes(root, TICKET_NODE, -1);
+    freeTree(root);
+
+    sprintf(title, "TYPED TREES (%d events, %d tickets each)", events, ticketsPerEvent);
+    printPhaseHeader(title);
+    EventTreeNode *eventRoot = NULL;
+    TicketTreeNode *ticketRoot = NULL;
+    int changed;
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < total; i++)
+    {
+        int n = order[i];
+        if (n < events)
+            eventRoot = eventTreeInsert(eventRoot, &eventList[n], &changed);
+        else
+            ticketRoot = ticketTreeInsert(ticketRoot, &tickets[n - events], &changed);
+    }
+    seconds[1][0] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[0], total, seconds[1][0], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = total - 1; i >= 0; i--)
+    {
+        int n = order[i];
+        if (n < events)
+            found[1] += eventTreeSearch(eventRoot, n) != NULL;
+        else
+            found[1] += ticketTreeSearch(ticketRoot, ticketOrderKey(tickets[n - events].eventCode,
+                                                                    tickets[n - events].seatId)) != NULL;
+    }
+    seconds[1][1] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[1], total, seconds[1][1], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int e = 0; e < events; e++)
+    {
+        listed[1] += ticketTreeCountRange(ticketRoot, ticketOrderKey(e, 0), ticketOrderKey(e + 1, 0));
+    }
+    seconds[1][2] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[2], events, seconds[1][2], &counters);
+
+    perfCountersStart(&counters);
+    start = monotonicSeconds();
+    for (int i = 0; i < total; i += 2)
+    {
+        int n = order[i];
+        if (n < events)
+            eventRoot = eventTreeDelete(eventRoot, n, &changed);
+        else
+            ticketRoot = ticketTreeDelete(ticketRoot, ticketOrderKey(tickets[n - events].eventCode,
+                                                                     tickets[n - events].seatId), &changed);
+    }
+    seconds[1][3] = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult(phases[3], (total + 1) / 2, seconds[1][3], &counters);
+    long typedLeft = ticketTreeCountRange(ticketRoot, ticketOrderKey(0, 0), ticketOrderKey(events, 0)) +
+                     (eventRoot != NULL ? eventTreeCountRange(eventRoot, 0, events) : 0);
+    eventTreeFree(eventRoot);
+    ticketTreeFree(ticketRoot);
+
+    printf("\n  %-12s %10s\n", "Speedup", "typed");
+    for (int p = 0; p < 4; p++)
+    {
+        printf("  %-12s %9.2fx\n", phases[p], seconds[0][p] / seconds[1][p]);
+    }
+    double unionBytes = (double)total * sizeof(TreeNode);
+    double typedBytes =
+        (double)events * sizeof(EventTreeNode) + (double)events * ticketsPerEvent * sizeof(TicketTreeNode);
+    printf("\n  Node size: union %zu bytes; typed %zu (event), %zu (ticket).\n", sizeof(TreeNode),
+           sizeof(EventTreeNode), sizeof(TicketTreeNode));
+    printf("  Nodes: union %.1f MB, typed %.1f MB (%.0f%% less).\n", unionBytes / (1024 * 1024),
+           typedBytes / (1024 * 1024), 100.0 * (1 - typedBytes / unionBytes));
+    printf("  Found %ld/%ld of %d records, listed %ld/%ld tickets, %ld/%ld left after deleting%s.\n", found[0],
+           found[1], total, listed[0], listed[1], unionLeft, typedLeft,
+           found[0] == found[1] && listed[0] == listed[1] && unionLeft == typedLeft ? ""
+                                                                                   : "  (!) results differ");
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    free(keys);
+    free(tickets);
+    free(eventList);
+    free(order);
+}
+
+/**
+ * @brief Fills a store with events 0..events-1, the first filled of them
+ * with ticketsPerEvent tickets each, inserted in random order in one commit.
+ */
+static void benchmarkFillEvents(Store *store, int events, int filled, int ticketsPerEvent, unsigned long long seed)
+{
+    int total = filled * ticketsPerEvent;
+    int *order = malloc(total * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < total; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = total - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    for (int e = 0; e < events; e++)
+    {
+        Event event;
+        memset(&event, 0, sizeof(Event));
+        event.code = e;
+        strcpy(event.date, "01/01/2030");
+        strcpy(event.time, "20:00");
+        sprintf(event.title, "Benchmark Event %d", e);
+        txnAddEvent(&txn, &event);
+    }
+    for (int i = 0; i < total; i++)
+    {
+        char key[20];
+        Ticket ticket;
+        benchmarkTicket(&ticket, order[i] / ticketsPerEvent, order[i] % ticketsPerEvent);
+        ticketKey(key, ticket.eventCode, ticket.seatId);
+        txnInsert(&txn, key, TICKET_NODE, &ticket);
+    }
+    storeCommit(&txn);
+    free(order);
+}
+
+/**
+ * @brief Depth of the deepest node of a tree.
+ */
+static int treeHeight(TreeNode *root)
+{
+    if (root == NULL)
+        return 0;
+    int left = treeHeight(nodeLeft(root));
+    int right = treeHeight(nodeRight(root));
+    return 1 + (left > right ? left : right);
+}
+
+/**
+ * @brief Moves the tickets of an event the way a caller without
+ * txnMoveTickets() would: a delete and an insert per ticket, in random
+ * order so the tree does not degenerate.
+ * @return The number of tickets moved.
+ */
+static int moveTicketsOneByOne(WriteTxn *txn, int fromCode, int toCode, unsigned long long *seed)
+{
+    int count = 0;
+    int capacity = 10;
+    char **keys = malloc(capacity * sizeof(char *));
+    if (!keys)
+    {
+        perror("(!) Malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    collectTicketKeysForEvent(txn->root, fromCode, &keys, &count, &capacity);
+    for (int i = count - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(seed) % (unsigned int)(i + 1));
+        char *swap = keys[i];
+        keys[i] = keys[j];
+        keys[j] = swap;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        char key[20];
+        Ticket ticket = nodeRecord(txn->store, txnLookup(txn, keys[i]))->ticketData;
+        txnDelete(txn, keys[i]);
+        ticket.eventCode = toCode;
+        ticketKey(key, toCode, ticket.seatId);
+        txnInsert(txn, key, TICKET_NODE, &ticket);
+        free(keys[i]);
+    }
+    free(keys);
+    return count;
+}
+
+/**
+ * @brief Moves the tickets of whole events to new event codes in a filled
+ * store, one commit per event: one ticket at a time, as one batch, and by
+ * splitting the ticket range off the tree and joining it back in.
+ */
+void benchmarkMove(int events, int ticketsPerEvent, int moves)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    const char *methods[3] = {"one by one", "batch", "split/join"};
+
+    // The tickets move to empty events past the filled ones.
+    storeInit(&store);
+    benchmarkFillEvents(&store, events + 3 * moves, events, ticketsPerEvent, 41);
+    WriteTxn txn;
+    unsigned long long seed = 43;
+    Snapshot snapshot = storeBeginRead(&store);
+    int height = treeHeight(snapshot.root);
+    storeEndRead(&store, &snapshot);
+
+    perfCountersOpen(&counters);
+    sprintf(title, "TICKET MOVE BENCHMARK (%d events of %d tickets, %d moves per method)", events, ticketsPerEvent,
+            moves);
+    printPhaseHeader(title);
+    long moved[3] = {0, 0, 0};
+    double seconds[3];
+    for (int method = 0; method < 3; method++)
+    {
+        perfCountersStart(&counters);
+        double start = monotonicSeconds();
+        for (int i = 0; i < moves; i++)
+        {
+            int fromCode = method * moves + i;
+            int count = 0;
+            storeBeginWrite(&store, &txn);
+            if (method == 0)
+                count = moveTicketsOneByOne(&txn, fromCode, events + fromCode, &seed);
+            else if (method == 1)
+                txnMoveTicketsBatch(&txn, fromCode, events + fromCode, &count);
+            else
+                txnMoveTickets(&txn, fromCode, events + fromCode, &count);
+            storeCommit(&txn);
+            moved[method] += count;
+        }
+        seconds[method] = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        printPhaseResult(methods[method], moves, seconds[method], &counters);
+    }
+
+    // Every moved event must hold all its tickets under the new code and none under the old one.
+    snapshot = storeBeginRead(&store);
+    long wrong = 0;
+    for (int e = 0; e < 3 * moves; e++)
+    {
+        char from[20];
+        char to[20];
+        ticketKeyRange(from, to, e);
+        wrong += countKeyRange(snapshot.root, from, to) != 0;
+        ticketKeyRange(from, to, events + e);
+        wrong += countKeyRange(snapshot.root, from, to) != ticketsPerEvent;
+    }
+    printf("\n  %-12s %12s %14s\n", "Move", "ms/event", "us/ticket");
+    for (int method = 0; method < 3; method++)
+    {
+        printf("  %-12s %12.3f %14.3f\n", methods[method], seconds[method] * 1e3 / moves,
+               seconds[method] * 1e6 / moved[method]);
+    }
+    printf("  Moved %ld + %ld + %ld tickets, %ld events wrong. Tree height %d before, %d after.\n", moved[0],
+           moved[1], moved[2], wrong, height, treeHeight(snapshot.root));
+    storeEndRead(&store, &snapshot);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+}
+
+/**
+ * @brief Reschedules events of a filled store, one commit per edit: the
+ * way it had to be done before txnUpdateEvent(), deleting the event with
+ * its tickets and adding them all back, then in place.
+ */
+void benchmarkEdit(int events, int ticketsPerEvent, int edits)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    Ticket *tickets = malloc(ticketsPerEvent * sizeof(Ticket));
+    if (!tickets)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    storeInit(&store);
+    benchmarkFillEvents(&store, events, events, ticketsPerEvent, 47);
+    perfCountersOpen(&counters);
+    sprintf(title, "EVENT EDIT BENCHMARK (%d events of %d tickets, %d edits)", events, ticketsPerEvent, edits);
+    printPhaseHeader(title);
+
+    unsigned long long seed = 53;
+    double seconds[2];
+    for (int inPlace = 0; inPlace <= 1; inPlace++)
+    {
+        perfCountersStart(&counters);
+        double start = monotonicSeconds();
+        for (int i = 0; i < edits; i++)
+        {
+            Event event;
+            WriteTxn txn;
+            memset(&event, 0, sizeof(Event));
+            event.code = (int)(benchmarkRandom(&seed) % (unsigned int)events);
+            sprintf(event.title, "Benchmark Event %d", event.code);
+            sprintf(event.date, "%02d/01/2031", 1 + i % 28);
+            strcpy(event.time, inPlace ? "21:00" : "19:00");
+
+            storeBeginWrite(&store, &txn);
+            if (inPlace)
+            {
+                txnUpdateEvent(&txn, &event);
+            }
+            else
+            {
+                // The tickets are shuffled so adding them back keeps the tree shallow.
+                for (int t = 0; t < ticketsPerEvent; t++)
+                {
+                    benchmarkTicket(&tickets[t], event.code, t);
+                }
+                for (int t = ticketsPerEvent - 1; t > 0; t--)
+                {
+                    int j = (int)(benchmarkRandom(&seed) % (unsigned int)(t + 1));
+                    Ticket swap = tickets[t];
+                    tickets[t] = tickets[j];
+                    tickets[j] = swap;
+                }
+                txnRemoveEvent(&txn, event.code, NULL);
+                txnAddEvent(&txn, &event);
+                for (int t = 0; t < ticketsPerEvent; t++)
+                {
+                    txnAddTicket(&txn, &tickets[t]);
+                }
+            }
+            storeCommit(&txn);
+        }
+        seconds[inPlace] = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        printPhaseResult(inPlace ? "in place" : "re-add", edits, seconds[inPlace], &counters);
+    }
+
+    Snapshot snapshot = storeBeginRead(&store);
+    long kept = countNodes(snapshot.root, TICKET_NODE, -1);
+    storeEndRead(&store, &snapshot);
+    printf("\n  In place: %.0f times faster. %ld of %ld tickets kept.\n", seconds[0] / seconds[1], kept,
+           (long)events * ticketsPerEvent);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(tickets);
+}
+
+/**
+ * @brief Resells tickets of a filled store, a different set of tickets per
+ * phase: deleting and reissuing each one, transferring each one in place,
+ * one commit per ticket either way, and applying them as a feed would,
+ * TRANSFER_BATCH per commit.
+ */
+void benchmarkTransfer(int events, int ticketsPerEvent, int transfers)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    const char *phases[3] = {"reissue", "in place", "feed batch"};
+    int total = events * ticketsPerEvent;
+    int *order = malloc(total * sizeof(int));
+    TicketTransfer *batch = malloc(transfers * sizeof(TicketTransfer));
+    if (!order || !batch)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    storeInit(&store);
+    benchmarkFillEvents(&store, events, events, ticketsPerEvent, 59);
+    unsigned long long seed = 61;
+    for (int i = 0; i < total; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = total - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    perfCountersOpen(&counters);
+    sprintf(title, "TICKET TRANSFER BENCHMARK (%d tickets, %d transfers per phase)", total, transfers);
+    printPhaseHeader(title);
+    int applied[3] = {0, 0, 0};
+    for (int phase = 0; phase < 3; phase++)
+    {
+        for (int i = 0; i < transfers; i++)
+        {
+            Ticket ticket;
+            int n = order[phase * transfers + i];
+            benchmarkTicket(&ticket, n / ticketsPerEvent, n % ticketsPerEvent);
+            memset(&batch[i], 0, sizeof(TicketTransfer));
+            batch[i].eventCode = ticket.eventCode;
+            batch[i].seatId = ticket.seatId;
+            strcpy(batch[i].fromAfm, ticket.afm);
+            sprintf(batch[i].afm, "%010d", total + n);
+            strcpy(batch[i].firstName, "Resale");
+            strcpy(batch[i].lastName, "Buyer");
+        }
+
+        perfCountersStart(&counters);
+        double start = monotonicSeconds();
+        WriteTxn txn;
+        if (phase == 2)
+        {
+            for (int i = 0; i < transfers; i += TRANSFER_BATCH)
+            {
+                storeBeginWrite(&store, &txn);
+                applied[phase] += txnApplyTransfers(&txn, &batch[i], transfers - i < TRANSFER_BATCH ? transfers - i
+                                                                                                     : TRANSFER_BATCH);
+                storeCommit(&txn);
+            }
+        }
+        for (int i = 0; phase < 2 && i < transfers; i++)
+        {
+            storeBeginWrite(&store, &txn);
+            if (phase == 1)
+            {
+                applied[phase] += txnTransferTicket(&txn, &batch[i]) == BOOKING_OK;
+            }
+            else
+            {
+                // What a resale took before: the ticket is deleted and issued again.
+                char key[20];
+                ticketKey(key, batch[i].eventCode, batch[i].seatId);
+                Ticket ticket = nodeRecord(&store, txnLookup(&txn, key))->ticketData;
+                transferHolder(&ticket, &batch[i]);
+                txnDelete(&txn, key);
+                applied[phase] += txnAddTicket(&txn, &ticket) == BOOKING_OK;
+            }
+            storeCommit(&txn);
+        }
+        double elapsed = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        printPhaseResult(phases[phase], transfers, elapsed, &counters);
+    }
+
+    Snapshot snapshot = storeBeginRead(&store);
+    long resold = 0;
+    for (int i = 0; i < 3 * transfers; i++)
+    {
+        char key[20];
+        ticketKey(key, order[i] / ticketsPerEvent, order[i] % ticketsPerEvent);
+        TreeNode *node = storeLookup(&store, snapshot.root, key);
+        resold += node != NULL && strcmp(nodeRecord(&store, node)->ticketData.lastName, "Buyer") == 0;
+    }
+    storeEndRead(&store, &snapshot);
+    printf("  Applied %d + %d + %d transfers; %ld of %d tickets show their buyer.\n", applied[0], applied[1],
+           applied[2], resold, 3 * transfers);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(order);
+    free(batch);
+}
+
+/**
+ * @brief Measures bookings with and without a long waitlist beside them,
+ * joining the waitlist of a sold-out event, and cancelling its tickets one
+ * commit at a time, each seat going to the next waiter in the same commit.
+ * Checks that the waiters were served in priority order.
+ */
+void benchmarkWaitlist(int waiters, int bookings)
+{
+    Store store;
+    PerfCounters counters;
+    char title[128];
+    int seats = defaultLayout.seatCount;
+    int offers = waiters < seats ? waiters : seats;
+    int *order = malloc(seats * sizeof(int));
+    if (!order)
+    {
+        perror("(!) Failed to allocate memory for the benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    // Event 0 is sold out; events 1 and 2 take the bookings.
+    storeInit(&store);
+    benchmarkFillEvents(&store, 3, 1, seats, 67);
+    unsigned long long seed = 71;
+    for (int i = 0; i < seats; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = seats - 1; i > 0; i--)
+    {
+        int j = (int)(benchmarkRandom(&seed) % (unsigned int)(i + 1));
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    perfCountersOpen(&counters);
+    sprintf(title, "WAITLIST BENCHMARK (%d waiters, %d bookings per phase)", waiters, bookings);
+    printPhaseHeader(title);
+    int booked = 0;
+    for (int phase = 0; phase < 3; phase++)
+    {
+        perfCountersStart(&counters);
+        double start = monotonicSeconds();
+        if (phase == 1)
+        {
+            for (int i = 0; i < waiters; i++)
+            {
+                WaitEntry entry;
+                memset(&entry, 0, sizeof(WaitEntry));
+                entry.tier = (int)(benchmarkRandom(&seed) % 4);
+                sprintf(entry.afm, "%010d", i);
+                strcpy(entry.firstName, "Waiting");
+                strcpy(entry.lastName, "Spectator");
+                waitlistJoin(&store, 0, &entry);
+            }
+        }
+        for (int i = 0; phase != 1 && i < bookings; i++)
+        {
+            Ticket ticket;
+            WriteTxn txn;
+            benchmarkTicket(&ticket, phase == 0 ? 1 : 2, order[i]);
+            storeBeginWrite(&store, &txn);
+            booked += txnAddTicket(&txn, &ticket) == BOOKING_OK;
+            storeCommit(&txn);
+        }
+        double elapsed = monotonicSeconds() - start;
+        perfCountersStop(&counters);
+        printPhaseResult(phase == 0 ? "book, no wait" : phase == 1 ? "join" : "book, waiting", phase == 1 ? waiters : bookings,
+                         elapsed, &counters);
+    }
+
+    perfCountersStart(&counters);
+    double start = monotonicSeconds();
+    int served = 0;
+    int inOrder = 1;
+    WaitEntry previous;
+    for (int i = 0; i < offers; i++)
+    {
+        WriteTxn txn;
+        WaitEntry next;
+        storeBeginWrite(&store, &txn);
+        txnCancelTicket(&txn, 0, order[i]);
+        if (txnOfferSeat(&txn, 0, order[i], &next))
+        {
+            if (served > 0 && (next.tier > previous.tier || (next.tier == previous.tier && next.joined < previous.joined)))
+                inOrder = 0;
+            previous = next;
+            served++;
+        }
+        storeCommit(&txn);
+    }
+    double elapsed = monotonicSeconds() - start;
+    perfCountersStop(&counters);
+    printPhaseResult("cancel+offer", offers, elapsed, &counters);
+
+    char from[20];
+    char to[20];
+    ticketKeyRange(from, to, 0);
+    Snapshot snapshot = storeBeginRead(&store);
+    long sold = countKeyRange(snapshot.root, from, to);
+    storeEndRead(&store, &snapshot);
+    printf("  Booked %d of %d; served %d waiters %s, %d still waiting; event 0 holds %ld of %d seats.\n", booked,
+           2 * bookings, served, inOrder ? "in priority order" : "OUT OF ORDER", waitlistLength(&store, 0), sold, seats);
+    printf("--- END OF BENCHMARK ---\n");
+
+    perfCountersClose(&counters);
+    storeDestroy(&store);
+    free(order);
+}
+
+// --- Event Management Functions ---
+
+/**
+ * @brief Commits a change made from the menu, telling the clerk when it
+ * could not be saved and was undone.
+ * @return 1 if the change was committed, 0 otherwise.
+ */
+static int commitChange(WriteTxn *txn)
+{
+    if (storeCommit(txn) != 0)
+        return 1;
+    printf("(!) The change could not be saved and was undone. Please try again.\n");
+    return 0;
+}
+
+/**
+ * @brief Adds a new event to the tree.
+ */
+void addEvent(Store *store)
+{
+    Event newEvent;
+    char key[20];
+    memset(&newEvent, 0, sizeof(Event));
+
+    printf("\n--- Add New Event ---\n");
+    printf("Enter event code (integer): ");
+    newEvent.code = getIntegerInput();
+    if (newEvent.code < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    sprintf(key, "E_%d", newEvent.code);
+    Snapshot snapshot = storeBeginRead(store);
+    int exists = storeLookup(store, snapshot.root, key) != NULL;
+    storeEndRead(store, &snapshot);
+    if (exists)
+    {
+        traceAddEvent(&newEvent);
+        printf("(!) Error: An event with this code already exists.\n");
+        return;
+    }
+
+    printf("Enter event title: ");
+    getStringInput(newEvent.title, sizeof(newEvent.title));
+    printf("Enter date (DD/MM/YYYY): ");
+    getStringInput(newEvent.date, sizeof(newEvent.date));
+    printf("Enter time (HH:MM): ");
+    getStringInput(newEvent.time, sizeof(newEvent.time));
+    traceAddEvent(&newEvent);
+
+    // Re-check inside the transaction: another clerk may have added it meanwhile.
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    if (txnAddEvent(&txn, &newEvent) != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        printf("(!) Error: An event with this code already exists.\n");
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    printf("-> Event '%s' added successfully.\n", newEvent.title);
+}
+
+/**
+ * @brief Searches for and displays an event by its code.
+ */
+void findEvent(Store *store)
+{
+    int code;
+    char key[20];
+    printf("\n--- Search for Event ---\n");
+    printf("Enter event code to search for: ");
+    code = getIntegerInput();
+    if (code < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    traceCode(TRACE_FIND_EVENT, code);
+    sprintf(key, "E_%d", code);
+    Snapshot snapshot = storeBeginRead(store);
+    TreeNode *result = storeLookup(store, snapshot.root, key);
+
+    if (result != NULL)
+    {
+        printf("-> Event found:\n");
+        inorderTraversalPrint(store, result, EVENT_NODE, -1);
+    }
+    else
+    {
+        printf("(!) No event found with code %d.\n", code);
+    }
+    storeEndRead(store, &snapshot);
+}
+
+/**
+ * @brief Deletes an event and all its associated tickets.
+ */
+void removeEvent(Store *store)
+{
+    int code;
+    printf("\n--- Delete Event ---\n");
+    printf("Enter event code to delete: ");
+    code = getIntegerInput();
+    if (code < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    traceCode(TRACE_REMOVE_EVENT, code);
+
+    // The whole cascade is one transaction, so readers see the event
+    // either with all its tickets or not at all.
+    WriteTxn txn;
+    int count = 0;
+    storeBeginWrite(store, &txn);
+    if (txnRemoveEvent(&txn, code, &count) != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        printf("(!) No event found with code %d.\n", code);
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    waitlistDrop(store, code);
+    printf("-> Deleting %d tickets associated with the event...\n", count);
+    printf("-> Event with code %d and all its tickets have been deleted.\n", code);
+}
+
+/**
+ * @brief Reads a replacement for a text field; an empty line keeps the
+ * current value.
+ */
+static void editField(const char *prompt, char *field, int size)
+{
+    char buffer[128]; // Room for the whole line, so no rest of it is left for the next prompt
+    printf("%s [%s]: ", prompt, field);
+    getStringInput(buffer, sizeof(buffer));
+    if (buffer[0] != '\0')
+    {
+        buffer[size - 1] = '\0'; // Every event field is shorter than the buffer
+        strcpy(field, buffer);
+    }
+}
+
+/**
+ * @brief Changes the title, date or time of an event in place, keeping all
+ * its tickets.
+ */
+void editEvent(Store *store)
+{
+    int code;
+    char key[20];
+    printf("\n--- Edit Event ---\n");
+    printf("Enter event code to edit: ");
+    code = getIntegerInput();
+    if (code < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    sprintf(key, "E_%d", code);
+    Snapshot snapshot = storeBeginRead(store);
+    TreeNode *node = storeLookup(store, snapshot.root, key);
+    Event event;
+    if (node != NULL)
+        event = nodeRecord(store, node)->eventData;
+    storeEndRead(store, &snapshot);
+    if (node == NULL)
+    {
+        printf("(!) No event found with code %d.\n", code);
+        return;
+    }
+
+    printf("Press Enter to keep a value.\n");
+    editField("Enter event title", event.title, sizeof(event.title));
+    editField("Enter date (DD/MM/YYYY)", event.date, sizeof(event.date));
+    editField("Enter time (HH:MM)", event.time, sizeof(event.time));
+
+    // The event may have been deleted while the clerk was typing.
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    if (txnUpdateEvent(&txn, &event) != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        printf("(!) No event found with code %d.\n", code);
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    printf("-> Event %d updated: '%s' on %s at %s.\n", code, event.title, event.date, event.time);
+}
+
+/**
+ * @brief Moves all tickets of an event to another event, e.g. when an event
+ * is rescheduled under a new code or merged into another one.
+ */
+void moveTickets(Store *store)
+{
+    printf("\n--- Move Tickets to Another Event ---\n");
+    printf("Enter event code to move the tickets from: ");
+    int fromCode = getIntegerInput();
+    printf("Enter event code to move them to: ");
+    int toCode = getIntegerInput();
+    if (fromCode < 0 || toCode < 0 || fromCode == toCode)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    // One transaction: readers see every ticket under one event or the other.
+    WriteTxn txn;
+    int count = 0;
+    storeBeginWrite(store, &txn);
+    BookingResult result = txnMoveTickets(&txn, fromCode, toCode, &count);
+    if (result != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        if (result == BOOKING_NO_EVENT)
+            printf("(!) Both events must exist.\n");
+        else
+            printf("(!) Error: Some of the seats are already booked for event %d.\n", toCode);
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    printf("-> Moved %d tickets from event %d to event %d.\n", count, fromCode, toCode);
+}
+
+/**
+ * @brief Prints the list of all registered events.
+ */
+void printEvents(Store *store)
+{
+    traceCode(TRACE_PRINT_EVENTS, 0);
+    Snapshot snapshot = storeBeginRead(store);
+    printf("\n--- LIST OF ALL EVENTS ---\n");
+    inorderTraversalPrint(store, snapshot.root, EVENT_NODE, -1);
+    printf("--- END OF LIST ---\n");
+    storeEndRead(store, &snapshot);
+}
+
+/**
+ * @brief Displays the event management menu.
+ */
+void eventMenu(Store *store)
+{
+    int choice;
+    do
     {
-        if (filterType == EVENT_NODE)
+        printf("\n--- Event Management Menu ---\n");
+        printf("1. Add Event\n");
+        printf("2. Search for Event (by Code)\n");
+        printf("3. Delete Event (by Code)\n");
+        printf("4. Edit Event (Title, Date, Time)\n");
+        printf("5. Move Tickets to Another Event\n");
+        printf("6. Print List of Events\n");
+        printf("7. Return to Main Menu\n");
+        printf("Select [1-7]: ");
+        choice = getIntegerInput();
+
+        switch (choice)
         {
-            printf("----------------------------------------\n");
-            printf("  Event Code: %d\n", root->data.eventData.code);
-            printf("  Title: %s\n", root->data.eventData.title);
-            printf("  Date: %s\n", root->data.eventData.date);
-            printf("  Time: %s\n", root->data.eventData.time);
-            printf("----------------------------------------\n");
+        case 1:
+            addEvent(store);
+            break;
+        case 2:
+            findEvent(store);
+            break;
+        case 3:
+            removeEvent(store);
+            break;
+        case 4:
+            editEvent(store);
+            break;
+        case 5:
+            moveTickets(store);
+            break;
+        case 6:
+            printEvents(store);
+            break;
+        case 7:
+            break;
+        default:
+            printf("(!) Invalid choice.\n");
         }
-        else if (filterType == TICKET_NODE)
+    } while (choice != 7);
+}
+
+// --- Ticket Management Functions ---
+
+/**
+ * @brief Offers a spectator a place on the waitlist of a sold-out event.
+ */
+static void joinWaitlist(Store *store, int eventCode)
+{
+    WaitEntry entry;
+    char answer[8];
+    memset(&entry, 0, sizeof(WaitEntry));
+    if (store->waitlists == NULL)
+    {
+        printf("(!) This venue keeps no waitlists.\n");
+        return;
+    }
+
+    printf("Join the waitlist of event %d? (y/n): ", eventCode);
+    getStringInput(answer, sizeof(answer));
+    if (answer[0] != 'y' && answer[0] != 'Y')
+        return;
+    printf("Enter spectator's Tax ID: ");
+    getStringInput(entry.afm, sizeof(entry.afm));
+    printf("Enter spectator's first name: ");
+    getStringInput(entry.firstName, sizeof(entry.firstName));
+    printf("Enter spectator's last name: ");
+    getStringInput(entry.lastName, sizeof(entry.lastName));
+    printf("Enter membership tier (0 = none, higher tiers get seats first): ");
+    entry.tier = getIntegerInput();
+    if (entry.tier < 0)
+    {
+        printf("(!) Invalid tier.\n");
+        return;
+    }
+
+    int waiting = waitlistJoin(store, eventCode, &entry);
+    printf("-> %s %s joined the waitlist of event %d (%d waiting).\n", entry.firstName, entry.lastName, eventCode,
+           waiting);
+}
+
+/**
+ * @brief Adds (issues) a new ticket for an event.
+ */
+void addTicket(Store *store)
+{
+    Ticket newTicket;
+    char seat[SEAT_NAME_SIZE];
+    char key[20];
+    char eventKey[20];
+    memset(&newTicket, 0, sizeof(Ticket));
+    newTicket.seatId = -1;
+
+    printf("\n--- Issue Ticket ---\n");
+    printf("Enter event code: ");
+    newTicket.eventCode = getIntegerInput();
+    if (newTicket.eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    sprintf(eventKey, "E_%d", newTicket.eventCode);
+    Snapshot snapshot = storeBeginRead(store);
+    int eventExists = storeLookup(store, snapshot.root, eventKey) != NULL;
+    storeEndRead(store, &snapshot);
+    if (!eventExists)
+    {
+        traceAddTicket(&newTicket);
+        printf("(!) Error: No event exists with code %d.\n", newTicket.eventCode);
+        return;
+    }
+
+    printf("Enter seat (e.g., c149): ");
+    getStringInput(seat, sizeof(seat));
+    newTicket.seatId = validateSeat(store, seat);
+    if (newTicket.seatId < 0)
+    {
+        traceAddTicket(&newTicket);
+        printf("(!) Error: Invalid seat. The venue has %d sections of numbered seats (%c1 is the first).\n",
+               store->layout.sectionCount, store->layout.sectionName[0]);
+        return;
+    }
+
+    ticketKey(key, newTicket.eventCode, newTicket.seatId);
+    snapshot = storeBeginRead(store);
+    int booked = storeLookup(store, snapshot.root, key) != NULL;
+    int soldOut = 0;
+    if (booked)
+    {
+        // Only a refused booking pays for counting the event's tickets.
+        char from[20];
+        char to[20];
+        ticketKeyRange(from, to, newTicket.eventCode);
+        soldOut = countKeyRange(snapshot.root, from, to) >= store->layout.seatCount;
+    }
+    storeEndRead(store, &snapshot);
+    if (booked)
+    {
+        traceAddTicket(&newTicket);
+        if (!soldOut)
         {
-            if (eventCodeFilter == -1 || root->data.ticketData.eventCode == eventCodeFilter)
-            {
-                printf("----------------------------------------\n");
-                printf("  Event (Code): %d\n", root->data.ticketData.eventCode);
-                printf("  Seat: %s\n", root->data.ticketData.seat);
-                printf("  First Name: %s\n", root->data.ticketData.firstName);
-                printf("  Last Name: %s\n", root->data.ticketData.lastName);
-                printf("  Tax ID: %s\n", root->data.ticketData.afm);
-                printf("----------------------------------------\n");
-            }
+            printf("(!) Error: Seat %s is already booked for this event.\n", seat);
+            return;
+        }
+        printf("(!) Error: Event %d is sold out.\n", newTicket.eventCode);
+        joinWaitlist(store, newTicket.eventCode);
+        return;
+    }
+
+    printf("Enter spectator's Tax ID: ");
+    getStringInput(newTicket.afm, sizeof(newTicket.afm));
+    printf("Enter spectator's first name: ");
+    getStringInput(newTicket.firstName, sizeof(newTicket.firstName));
+    printf("Enter spectator's last name: ");
+    getStringInput(newTicket.lastName, sizeof(newTicket.lastName));
+    traceAddTicket(&newTicket);
+
+    // Re-check inside the transaction: the event may have been removed or
+    // the seat sold by another clerk while the details were being typed.
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    BookingResult result = txnAddTicket(&txn, &newTicket);
+    if (result == BOOKING_NO_EVENT)
+    {
+        storeAbort(&txn);
+        printf("(!) Error: No event exists with code %d.\n", newTicket.eventCode);
+        return;
+    }
+    if (result == BOOKING_SEAT_TAKEN)
+    {
+        storeAbort(&txn);
+        printf("(!) Error: Seat %s is already booked for this event.\n", seat);
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    printf("-> Ticket for seat %s issued successfully.\n", seat);
+}
+
+/**
+ * @brief Searches for and displays a ticket by event code and seat number.
+ */
+void findTicket(Store *store)
+{
+    int eventCode;
+    char seat[SEAT_NAME_SIZE];
+    char key[20];
+
+    printf("\n--- Search for Ticket ---\n");
+    printf("Enter event code: ");
+    eventCode = getIntegerInput();
+    if (eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    printf("Enter seat number (e.g., c149): ");
+    getStringInput(seat, sizeof(seat));
+
+    if (traceFile != NULL)
+    {
+        TraceRecord record;
+        record.op = TRACE_FIND_TICKET;
+        record.code = eventCode;
+        strcpy(record.seat, seat);
+        traceRecord(&record);
+    }
+
+    int seatId = validateSeat(store, seat);
+    if (seatId < 0)
+    {
+        printf("(!) Error: The venue has no seat %s.\n", seat);
+        return;
+    }
+
+    ticketKey(key, eventCode, seatId);
+    Snapshot snapshot = storeBeginRead(store);
+    TreeNode *result = storeLookup(store, snapshot.root, key);
+
+    if (result != NULL)
+    {
+        printf("-> Ticket found:\n");
+        inorderTraversalPrint(store, result, TICKET_NODE, eventCode);
+    }
+    else
+    {
+        printf("(!) No booking found for seat %s in event %d.\n", seat, eventCode);
+    }
+    storeEndRead(store, &snapshot);
+}
+
+/**
+ * @brief Prints all tickets issued for a specific event.
+ */
+void printTicketsForEvent(Store *store)
+{
+    int eventCode;
+    char eventKey[20];
+    printf("\n--- Print Tickets for an Event ---\n");
+    printf("Enter event code: ");
+    eventCode = getIntegerInput();
+    if (eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    traceCode(TRACE_PRINT_TICKETS, eventCode);
+    sprintf(eventKey, "E_%d", eventCode);
+    Snapshot snapshot = storeBeginRead(store);
+    if (storeLookup(store, snapshot.root, eventKey) == NULL)
+    {
+        storeEndRead(store, &snapshot);
+        printf("(!) Error: No event exists with code %d.\n", eventCode);
+        return;
+    }
+
+    printf("\n--- LIST OF TICKETS FOR EVENT %d ---\n", eventCode);
+    inorderTraversalPrint(store, snapshot.root, TICKET_NODE, eventCode);
+    printf("--- END OF LIST ---\n");
+    storeEndRead(store, &snapshot);
+    int waiting = waitlistLength(store, eventCode);
+    if (waiting > 0)
+        printf("-> %d spectators on the waitlist.\n", waiting);
+}
+
+/**
+ * @brief Validates a queue of tickets at the gate: all seats entered are
+ * looked up together, through the hash index or one batched, prefetching
+ * search of the tree.
+ */
+void scanTickets(Store *store)
+{
+    int eventCode;
+    char line[1024];
+    char keys[MAX_SCAN_SEATS][20];
+    const char *keyList[MAX_SCAN_SEATS];
+    char *seats[MAX_SCAN_SEATS];
+    int seatIds[MAX_SCAN_SEATS];
+    TreeNode *found[MAX_SCAN_SEATS];
+    TreeNode *results[MAX_SCAN_SEATS];
+    int count = 0;
+    int valid = 0;
+
+    printf("\n--- Scan Tickets at the Gate ---\n");
+    printf("Enter event code: ");
+    eventCode = getIntegerInput();
+    if (eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+
+    printf("Enter the seats to scan, separated by spaces (e.g., a1 c149 h500): ");
+    getStringInput(line, sizeof(line));
+    for (char *seat = strtok(line, " \t"); seat != NULL && count < MAX_SCAN_SEATS; seat = strtok(NULL, " \t"))
+    {
+        if (strlen(seat) >= SEAT_NAME_SIZE)
+            seat[SEAT_NAME_SIZE - 1] = '\0'; // Longer than any seat: cannot match
+        seats[count] = seat;
+        seatIds[count] = validateSeat(store, seat);
+        if (seatIds[count] >= 0)
+        {
+            ticketKey(keys[valid], eventCode, seatIds[count]);
+            keyList[valid] = keys[valid];
+            valid++;
+        }
+        count++;
+    }
+    if (count == 0)
+    {
+        printf("(!) No seats entered.\n");
+        return;
+    }
+
+    if (traceFile != NULL)
+    {
+        TraceRecord record;
+        record.op = TRACE_SCAN_TICKETS;
+        record.code = eventCode;
+        record.seatCount = count;
+        for (int i = 0; i < count; i++)
+        {
+            strcpy(record.seats[i], seats[i]);
+        }
+        traceRecord(&record);
+    }
+
+    // Seats the venue does not have are rejected without a lookup.
+    Snapshot snapshot = storeBeginRead(store);
+    storeLookupBatch(store, snapshot.root, keyList, found, valid);
+    for (int i = 0, next = 0; i < count; i++)
+    {
+        results[i] = seatIds[i] >= 0 ? found[next++] : NULL;
+    }
+
+    int admitted = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i] != NULL)
+        {
+            const Ticket *ticket = &nodeRecord(store, results[i])->ticketData;
+            printf("-> %s: ADMIT (%s %s)\n", seats[i], ticket->firstName, ticket->lastName);
+            admitted++;
+        }
+        else
+        {
+            printf("(!) %s: REJECT, no booking for this seat in event %d.\n", seats[i], eventCode);
+        }
+    }
+    storeEndRead(store, &snapshot);
+    printf("-> Scanned %d tickets: %d admitted, %d rejected.\n", count, admitted, count - admitted);
+}
+
+/**
+ * @brief Moves a spectator to another seat of the same event, or swaps the
+ * holders of two seats, in one step.
+ */
+void moveSeat(Store *store)
+{
+    char fromSeat[SEAT_NAME_SIZE];
+    char toSeat[SEAT_NAME_SIZE];
+    char key[20];
+    char answer[8];
+
+    printf("\n--- Move or Swap Seats ---\n");
+    printf("Enter event code: ");
+    int eventCode = getIntegerInput();
+    if (eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+    printf("Enter the ticket's seat (e.g., c149): ");
+    getStringInput(fromSeat, sizeof(fromSeat));
+    printf("Enter the new seat (e.g., a149): ");
+    getStringInput(toSeat, sizeof(toSeat));
+    int fromId = validateSeat(store, fromSeat);
+    int toId = validateSeat(store, toSeat);
+    if (fromId < 0 || toId < 0)
+    {
+        printf("(!) Error: The venue has no seat %s.\n", fromId < 0 ? fromSeat : toSeat);
+        return;
+    }
+
+    // A taken seat is only swapped with the clerk's consent.
+    int allowSwap = 0;
+    ticketKey(key, eventCode, toId);
+    Snapshot snapshot = storeBeginRead(store);
+    TreeNode *holder = fromId != toId ? storeLookup(store, snapshot.root, key) : NULL;
+    if (holder != NULL)
+    {
+        printf("Seat %s is held by %s %s. Swap the two tickets? (y/n): ", toSeat,
+               nodeRecord(store, holder)->ticketData.firstName, nodeRecord(store, holder)->ticketData.lastName);
+        storeEndRead(store, &snapshot);
+        getStringInput(answer, sizeof(answer));
+        if (answer[0] != 'y' && answer[0] != 'Y')
+        {
+            printf("-> Nothing changed.\n");
+            return;
         }
+        allowSwap = 1;
+    }
+    else
+    {
+        storeEndRead(store, &snapshot);
+    }
+
+    WriteTxn txn;
+    int swapped = 0;
+    WaitEntry served;
+    storeBeginWrite(store, &txn);
+    BookingResult result = txnMoveSeat(&txn, eventCode, fromId, toId, allowSwap, &swapped);
+    if (result != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        if (result == BOOKING_NO_TICKET)
+            printf("(!) No booking found for seat %s in event %d.\n", fromSeat, eventCode);
+        else
+            printf("(!) Error: Seat %s has just been booked. Nothing changed.\n", toSeat);
+        return;
+    }
+    int offered = !swapped && fromId != toId && txnOfferSeat(&txn, eventCode, fromId, &served);
+    if (!commitChange(&txn))
+    {
+        if (offered)
+            waitlistReturn(store, eventCode, &served);
+        return;
+    }
+    if (swapped)
+        printf("-> Swapped the holders of seats %s and %s.\n", fromSeat, toSeat);
+    else
+        printf("-> Ticket moved from seat %s to seat %s.\n", fromSeat, toSeat);
+    if (offered)
+        printf("-> Seat %s went to %s %s from the waitlist.\n", fromSeat, served.firstName, served.lastName);
+}
+
+/**
+ * @brief Cancels a ticket. The released seat goes to the next spectator on
+ * the event's waitlist, if anyone waits.
+ */
+void cancelTicket(Store *store)
+{
+    char seat[SEAT_NAME_SIZE];
+    printf("\n--- Cancel Ticket ---\n");
+    printf("Enter event code: ");
+    int eventCode = getIntegerInput();
+    if (eventCode < 0)
+    {
+        printf("(!) Invalid code.\n");
+        return;
+    }
+    printf("Enter seat (e.g., c149): ");
+    getStringInput(seat, sizeof(seat));
+    int seatId = validateSeat(store, seat);
+    if (seatId < 0)
+    {
+        printf("(!) Error: The venue has no seat %s.\n", seat);
+        return;
     }
 
-    inorderTraversalPrint(root->right, filterType, eventCodeFilter);
+    WriteTxn txn;
+    WaitEntry served;
+    storeBeginWrite(store, &txn);
+    if (txnCancelTicket(&txn, eventCode, seatId) != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        printf("(!) No booking found for seat %s in event %d.\n", seat, eventCode);
+        return;
+    }
+    int offered = txnOfferSeat(&txn, eventCode, seatId, &served);
+    if (!commitChange(&txn))
+    {
+        if (offered)
+            waitlistReturn(store, eventCode, &served);
+        return;
+    }
+    printf("-> Ticket for seat %s cancelled.\n", seat);
+    if (offered)
+        printf("-> Seat %s went to %s %s from the waitlist (%d still waiting).\n", seat, served.firstName,
+               served.lastName, waitlistLength(store, eventCode));
 }
 
 /**
- * @brief Collects the keys of all tickets belonging to a specific event.
- * Used for bulk deletion before deleting the event itself.
+ * @brief Says why a ticket transfer was refused.
  */
-void collectTicketKeysForEvent(TreeNode *root, int eventCode, char ***keys, int *count, int *capacity)
+static const char *transferError(BookingResult result)
 {
-    if (root == NULL)
-        return;
-
-    collectTicketKeysForEvent(root->left, eventCode, keys, count, capacity);
-
-    if (root->type == TICKET_NODE && root->data.ticketData.eventCode == eventCode)
+    switch (result)
     {
-        if (*count >= *capacity)
-        {
-            *capacity *= 2;
-            *keys = realloc(*keys, *capacity * sizeof(char *));
-            if (!*keys)
-            {
-                perror("(!) Realloc failed");
-                exit(EXIT_FAILURE);
-            }
-        }
-        (*keys)[*count] = strdup(root->key);
-        (*count)++;
+    case BOOKING_INVALID_SEAT:
+        return "The venue has no such seat";
+    case BOOKING_NO_TICKET:
+        return "No booking found for the seat";
+    case BOOKING_WRONG_HOLDER:
+        return "The seller does not hold the ticket";
+    case BOOKING_NOT_SAVED:
+        return "The data log could not save the transfer";
+    default:
+        return "Transfer refused";
     }
-
-    collectTicketKeysForEvent(root->right, eventCode, keys, count, capacity);
 }
 
-// --- Event Management Functions ---
-
 /**
- * @brief Adds a new event to the tree.
+ * @brief Transfers a ticket to another spectator (a resale), keeping its
+ * event and seat.
  */
-void addEvent(TreeNode **root)
+void transferTicket(Store *store)
 {
-    Event newEvent;
-    char key[20];
+    TicketTransfer transfer;
+    char seat[SEAT_NAME_SIZE];
+    memset(&transfer, 0, sizeof(TicketTransfer));
 
-    printf("\n--- Add New Event ---\n");
-    printf("Enter event code (integer): ");
-    newEvent.code = getIntegerInput();
-    if (newEvent.code < 0)
+    printf("\n--- Transfer Ticket ---\n");
+    printf("Enter event code: ");
+    transfer.eventCode = getIntegerInput();
+    if (transfer.eventCode < 0)
     {
         printf("(!) Invalid code.\n");
         return;
     }
-
-    sprintf(key, "E_%d", newEvent.code);
-    if (searchNode(*root, key) != NULL)
+    printf("Enter seat (e.g., c149): ");
+    getStringInput(seat, sizeof(seat));
+    transfer.seatId = validateSeat(store, seat);
+    if (transfer.seatId < 0)
     {
-        printf("(!) Error: An event with this code already exists.\n");
+        printf("(!) Error: The venue has no seat %s.\n", seat);
         return;
     }
 
-    printf("Enter event title: ");
-    getStringInput(newEvent.title, sizeof(newEvent.title));
-    printf("Enter date (DD/MM/YYYY): ");
-    getStringInput(newEvent.date, sizeof(newEvent.date));
-    printf("Enter time (HH:MM): ");
-    getStringInput(newEvent.time, sizeof(newEvent.time));
+    printf("Enter the current holder's Tax ID: ");
+    getStringInput(transfer.fromAfm, sizeof(transfer.fromAfm));
+    printf("Enter the new spectator's Tax ID: ");
+    getStringInput(transfer.afm, sizeof(transfer.afm));
+    printf("Enter the new spectator's first name: ");
+    getStringInput(transfer.firstName, sizeof(transfer.firstName));
+    printf("Enter the new spectator's last name: ");
+    getStringInput(transfer.lastName, sizeof(transfer.lastName));
 
-    *root = insertNode(*root, key, EVENT_NODE, &newEvent);
-    printf("-> Event '%s' added successfully.\n", newEvent.title);
+    WriteTxn txn;
+    storeBeginWrite(store, &txn);
+    if (txnTransferTicket(&txn, &transfer) != BOOKING_OK)
+    {
+        storeAbort(&txn);
+        printf("(!) Error: %s (seat %s, event %d).\n", transferError(transfer.result), seat, transfer.eventCode);
+        return;
+    }
+    if (!commitChange(&txn))
+        return;
+    printf("-> Ticket for seat %s transferred to %s %s.\n", seat, transfer.firstName, transfer.lastName);
 }
 
 /**
- * @brief Searches for and displays an event by its code.
+ * @brief Cuts the next comma-separated field off a feed line, without the
+ * spaces around it.
+ * @return The field, or NULL if the line has no more fields.
  */
-void findEvent(TreeNode *root)
+static char *feedField(char **cursor)
 {
-    int code;
-    char key[20];
-    printf("\n--- Search for Event ---\n");
-    printf("Enter event code to search for: ");
-    code = getIntegerInput();
-    if (code < 0)
-    {
-        printf("(!) Invalid code.\n");
-        return;
-    }
-
-    sprintf(key, "E_%d", code);
-    TreeNode *result = searchNode(root, key);
+    if (*cursor == NULL)
+        return NULL;
 
-    if (result != NULL)
+    char *field = *cursor + strspn(*cursor, " \t");
+    char *comma = strchr(field, ',');
+    if (comma != NULL)
     {
-        printf("-> Event found:\n");
-        inorderTraversalPrint(result, EVENT_NODE, -1);
+        *comma = '\0';
+        *cursor = comma + 1;
     }
     else
     {
-        printf("(!) No event found with code %d.\n", code);
+        field[strcspn(field, "\r\n")] = '\0';
+        *cursor = NULL;
     }
+
+    char *end = field + strlen(field);
+    while (end > field && (end[-1] == ' ' || end[-1] == '\t'))
+        *--end = '\0';
+    return field;
 }
 
 /**
- * @brief Deletes an event and all its associated tickets.
+ * @brief Parses one "EVENT,SEAT,SELLER_TAX_ID,BUYER_TAX_ID,FIRST_NAME,LAST_NAME"
+ * line of a transfer feed. The seat is checked later, when the transfer is
+ * applied.
+ * @return 1 on success, 0 if the line is malformed.
  */
-void removeEvent(TreeNode **root)
+static int parseTransfer(char *line, const VenueLayout *layout, TicketTransfer *transfer, char *seat)
 {
-    int code;
-    char eventKey[20];
-    printf("\n--- Delete Event ---\n");
-    printf("Enter event code to delete: ");
-    code = getIntegerInput();
-    if (code < 0)
+    char *cursor = line;
+    char *fields[6];
+    for (int i = 0; i < 6; i++)
     {
-        printf("(!) Invalid code.\n");
-        return;
+        fields[i] = feedField(&cursor);
+        if (fields[i] == NULL)
+            return 0;
     }
+    if (cursor != NULL)
+        return 0; // More than six fields
 
-    sprintf(eventKey, "E_%d", code);
-    if (searchNode(*root, eventKey) == NULL)
+    char *end;
+    long code = strtol(fields[0], &end, 10);
+    if (*fields[0] == '\0' || *end != '\0' || code < 0 || code > INT_MAX ||
+        strlen(fields[1]) >= SEAT_NAME_SIZE || strlen(fields[2]) >= sizeof(transfer->fromAfm) ||
+        strlen(fields[3]) >= sizeof(transfer->afm) || strlen(fields[4]) >= sizeof(transfer->firstName) ||
+        strlen(fields[5]) >= sizeof(transfer->lastName))
+        return 0;
+
+    memset(transfer, 0, sizeof(TicketTransfer));
+    transfer->eventCode = (int)code;
+    strcpy(seat, fields[1]);
+    transfer->seatId = venueSeatId(layout, seat);
+    strcpy(transfer->fromAfm, fields[2]);
+    strcpy(transfer->afm, fields[3]);
+    strcpy(transfer->firstName, fields[4]);
+    strcpy(transfer->lastName, fields[5]);
+    return 1;
+}
+
+/**
+ * @brief Applies the transfers of a marketplace feed file, TRANSFER_BATCH
+ * lines per transaction (see txnApplyTransfers()). Blank lines and lines
+ * starting with '#' are skipped; refused transfers are reported with their
+ * line number and do not stop the others.
+ * @return The number of transfers applied, or -1 if the file cannot be read.
+ */
+int applyTransferFeed(Store *store, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
     {
-        printf("(!) No event found with code %d.\n", code);
-        return;
+        perror("(!) Failed to open the transfer feed");
+        return -1;
     }
 
-    // Step 1: Collect keys of all tickets for the event
-    int count = 0;
-    int capacity = 10;
-    char **keysToDelete = malloc(capacity * sizeof(char *));
-    if (!keysToDelete)
+    TicketTransfer *transfers = malloc(TRANSFER_BATCH * sizeof(TicketTransfer));
+    int *lines = malloc(TRANSFER_BATCH * sizeof(int));
+    char (*seats)[SEAT_NAME_SIZE] = malloc(TRANSFER_BATCH * sizeof(*seats));
+    if (!transfers || !lines || !seats)
     {
-        perror("(!) Malloc failed");
-        return;
+        perror("(!) Failed to allocate memory for the transfer feed");
+        exit(EXIT_FAILURE);
     }
-    collectTicketKeysForEvent(*root, code, &keysToDelete, &count, &capacity);
 
-    // Step 2: Delete all the tickets
-    printf("-> Deleting %d tickets associated with the event...\n", count);
-    for (int i = 0; i < count; i++)
+    char line[256];
+    int lineNumber = 0;
+    int count = 0;
+    int total = 0;
+    int applied = 0;
+    int done = 0;
+    while (!done)
     {
-        *root = deleteNode(*root, keysToDelete[i]);
-        free(keysToDelete[i]);
+        done = fgets(line, sizeof(line), file) == NULL;
+        if (!done)
+        {
+            lineNumber++;
+            if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#')
+                continue;
+            if (!parseTransfer(line, &store->layout, &transfers[count], seats[count]))
+            {
+                fprintf(stderr, "(!) %s:%d: expected EVENT,SEAT,SELLER_TAX_ID,BUYER_TAX_ID,FIRST_NAME,LAST_NAME.\n",
+                        path, lineNumber);
+                total++;
+                continue;
+            }
+            lines[count++] = lineNumber;
+        }
+
+        if (count == TRANSFER_BATCH || (done && count > 0))
+        {
+            WriteTxn txn;
+            storeBeginWrite(store, &txn);
+            int batchApplied = txnApplyTransfers(&txn, transfers, count);
+            if (storeCommit(&txn) != 0)
+                applied += batchApplied;
+            else
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    if (transfers[i].result == BOOKING_OK)
+                        transfers[i].result = BOOKING_NOT_SAVED;
+                }
+            }
+            for (int i = 0; i < count; i++)
+            {
+                if (transfers[i].result != BOOKING_OK)
+                    fprintf(stderr, "(!) %s:%d: %s (seat %s, event %d).\n", path, lines[i],
+                            transferError(transfers[i].result), seats[i], transfers[i].eventCode);
+            }
+            total += count;
+            count = 0;
+        }
     }
-    free(keysToDelete);
+    fclose(file);
+    free(transfers);
+    free(lines);
+    free(seats);
 
-    // Step 3: Delete the event itself
-    *root = deleteNode(*root, eventKey);
-    printf("-> Event with code %d and all its tickets have been deleted.\n", code);
+    printf("-> Applied %d of %d transfers from %s.\n", applied, total, path);
+    return applied;
 }
 
 /**
- * @brief Prints the list of all registered events.
+ * @brief Asks for a marketplace feed file and applies its transfers.
  */
-void printEvents(TreeNode *root)
+void transferFeed(Store *store)
 {
-    printf("\n--- LIST OF ALL EVENTS ---\n");
-    inorderTraversalPrint(root, EVENT_NODE, -1);
-    printf("--- END OF LIST ---\n");
+    char path[256];
+    printf("\n--- Apply Marketplace Transfer Feed ---\n");
+    printf("Enter the feed file (EVENT,SEAT,SELLER_TAX_ID,BUYER_TAX_ID,FIRST_NAME,LAST_NAME per line): ");
+    getStringInput(path, sizeof(path));
+    if (path[0] == '\0')
+    {
+        printf("(!) No file given.\n");
+        return;
+    }
+    applyTransferFeed(store, path);
 }
 
 /**
- * @brief Displays the event management menu.
+ * @brief Displays the ticket management menu.
  */
-void eventMenu(TreeNode **root)
+void ticketMenu(Store *store)
 {
     int choice;
     do
     {
-        printf("\n--- Event Management Menu ---\n");
-        printf("1. Add Event\n");
-        printf("2. Search for Event (by Code)\n");
-        printf("3. Delete Event (by Code)\n");
-        printf("4. Print List of Events\n");
-        printf("5. Return to Main Menu\n");
-        printf("Select [1-5]: ");
+        printf("\n--- Ticket Management Menu ---\n");
+        printf("1. Issue Ticket\n");
+        printf("2. Search for Ticket (by Seat & Event Code)\n");
+        printf("3. Print List of Tickets for an Event\n");
+        printf("4. Scan Tickets at the Gate\n");
+        printf("5. Move or Swap Seats\n");
+        printf("6. Transfer Ticket to Another Spectator\n");
+        printf("7. Apply Marketplace Transfer Feed\n");
+        printf("8. Cancel Ticket\n");
+        printf("9. Return to Main Menu\n");
+        printf("Select [1-9]: ");
         choice = getIntegerInput();
 
         switch (choice)
         {
         case 1:
-            addEvent(root);
+            addTicket(store);
             break;
         case 2:
-            findEvent(*root);
+            findTicket(store);
             break;
         case 3:
-            removeEvent(root);
+            printTicketsForEvent(store);
             break;
         case 4:
-            printEvents(*root);
+            scanTickets(store);
             break;
         case 5:
+            moveSeat(store);
+            break;
+        case 6:
+            transferTicket(store);
+            break;
+        case 7:
+            transferFeed(store);
+            break;
+        case 8:
+            cancelTicket(store);
+            break;
+        case 9:
             break;
         default:
             printf("(!) Invalid choice.\n");
         }
-    } while (choice != 5);
+    } while (choice != 9);
 }
 
-// --- Ticket Management Functions ---
+// --- Venue Management Functions ---
 
 /**
- * @brief Adds (issues) a new ticket for an event.
+ * @brief Opens a new, empty private venue with the given seat map.
+ * @return 1 on success, 0 if the name is taken or no more venues fit.
  */
-void addTicket(TreeNode **root)
+int venueStoreOpen(VenueStore *venues, int *count, const char *name, const VenueLayout *layout)
 {
-    Ticket newTicket;
-    char key[20];
-    char eventKey[20];
-
-    printf("\n--- Issue Ticket ---\n");
-    printf("Enter event code: ");
-    newTicket.eventCode = getIntegerInput();
-    if (newTicket.eventCode < 0)
+    if (*count == MAX_VENUES || name[0] == '\0')
+        return 0;
+    for (int i = 0; i < *count; i++)
     {
-        printf("(!) Invalid code.\n");
-        return;
+        if (strcmp(venues[i].name, name) == 0)
+            return 0;
     }
 
-    sprintf(eventKey, "E_%d", newTicket.eventCode);
-    if (searchNode(*root, eventKey) == NULL)
+    VenueStore *venueStore = &venues[*count];
+    venueStore->store = malloc(sizeof(Store));
+    if (!venueStore->store)
     {
-        printf("(!) Error: No event exists with code %d.\n", newTicket.eventCode);
-        return;
+        perror("(!) Failed to allocate memory for the store");
+        exit(EXIT_FAILURE);
     }
+    storeInit(venueStore->store);
+    venueStore->store->layout = *layout;
+    snprintf(venueStore->name, sizeof(venueStore->name), "%s", name);
+    venueStore->segment = NULL;
+    venueStore->created = 0;
+    (*count)++;
+    return 1;
+}
 
-    printf("Enter seat (e.g., c149): ");
-    getStringInput(newTicket.seat, sizeof(newTicket.seat));
-    if (!validateSeat(newTicket.seat))
+/**
+ * @brief Closes a venue. Its nodes are never visited: the whole arena is
+ * released chunk by chunk, so dropping a venue costs the same however many
+ * tickets it holds. A shared venue is detached instead.
+ */
+void venueStoreClose(VenueStore *venueStore)
+{
+    if (venueStore->segment != NULL)
     {
-        printf("(!) Error: Invalid seat. Section 'a'-'h' and number 1-500.\n");
-        return;
+        storeCloseShared(venueStore->store, venueStore->segment, venueStore->created);
     }
-
-    sprintf(key, "T_%d_%s", newTicket.eventCode, newTicket.seat);
-    if (searchNode(*root, key) != NULL)
+    else
     {
-        printf("(!) Error: Seat %s is already booked for this event.\n", newTicket.seat);
-        return;
+        storeDestroy(venueStore->store);
+        free(venueStore->store);
     }
-
-    printf("Enter spectator's Tax ID: ");
-    getStringInput(newTicket.afm, sizeof(newTicket.afm));
-    printf("Enter spectator's first name: ");
-    getStringInput(newTicket.firstName, sizeof(newTicket.firstName));
-    printf("Enter spectator's last name: ");
-    getStringInput(newTicket.lastName, sizeof(newTicket.lastName));
-
-    *root = insertNode(*root, key, TICKET_NODE, &newTicket);
-    printf("-> Ticket for seat %s issued successfully.\n", newTicket.seat);
+    venueStore->store = NULL;
 }
 
 /**
- * @brief Searches for and displays a ticket by event code and seat number.
+ * @brief Prints every venue with its seat map, contents and memory use.
  */
-void findTicket(TreeNode *root)
+void printVenues(const VenueStore *venues, int count, int current)
 {
-    int eventCode;
-    char seat[5];
-    char key[20];
-
-    printf("\n--- Search for Ticket ---\n");
-    printf("Enter event code: ");
-    eventCode = getIntegerInput();
-    if (eventCode < 0)
+    printf("\n--- LIST OF VENUES ---\n");
+    printf("  %-3s %-20s %8s %8s %8s %9s %8s %10s\n", "", "Venue", "Seats", "Events", "Tickets",
+           "Version", "Chunks", "Slots");
+    for (int i = 0; i < count; i++)
     {
-        printf("(!) Invalid code.\n");
-        return;
-    }
+        Store *store = venues[i].store;
+        Snapshot snapshot = storeBeginRead(store);
+        long events = countNodes(snapshot.root, EVENT_NODE, -1);
+        long tickets = countNodes(snapshot.root, TICKET_NODE, -1);
+        storeEndRead(store, &snapshot);
 
-    printf("Enter seat number (e.g., c149): ");
-    getStringInput(seat, sizeof(seat));
+        lockStoreMutex(&store->arena.lock);
+        size_t chunks = store->arena.chunkCount;
+        size_t slots = store->arena.slotsInUse;
+        pthread_mutex_unlock(&store->arena.lock);
 
-    sprintf(key, "T_%d_%s", eventCode, seat);
-    TreeNode *result = searchNode(root, key);
-
-    if (result != NULL)
-    {
-        printf("-> Ticket found:\n");
-        inorderTraversalPrint(result, TICKET_NODE, eventCode);
-    }
-    else
-    {
-        printf("(!) No booking found for seat %s in event %d.\n", seat, eventCode);
+        printf("  %-3s %-20s %8d %8ld %8ld %9lu %8zu %10zu%s\n", i == current ? "*" : "", venues[i].name,
+               store->layout.seatCount, events, tickets, snapshot.version, chunks, slots,
+               venues[i].segment != NULL ? "  (shared)" : "");
     }
+    printf("--- END OF LIST ---\n");
 }
 
 /**
- * @brief Prints all tickets issued for a specific event.
+ * @brief Finds a venue by name.
+ * @return Its index, or -1 if there is none.
  */
-void printTicketsForEvent(TreeNode *root)
+static int findVenue(const VenueStore *venues, int count, const char *name)
 {
-    int eventCode;
-    char eventKey[20];
-    printf("\n--- Print Tickets for an Event ---\n");
-    printf("Enter event code: ");
-    eventCode = getIntegerInput();
-    if (eventCode < 0)
-    {
-        printf("(!) Invalid code.\n");
-        return;
-    }
-
-    sprintf(eventKey, "E_%d", eventCode);
-    if (searchNode(root, eventKey) == NULL)
+    for (int i = 0; i < count; i++)
     {
-        printf("(!) Error: No event exists with code %d.\n", eventCode);
-        return;
+        if (strcmp(venues[i].name, name) == 0)
+            return i;
     }
-
-    printf("\n--- LIST OF TICKETS FOR EVENT %d ---\n", eventCode);
-    inorderTraversalPrint(root, TICKET_NODE, eventCode);
-    printf("--- END OF LIST ---\n");
+    return -1;
 }
 
 /**
- * @brief Displays the ticket management menu.
+ * @brief Displays the venue management menu.
  */
-void ticketMenu(TreeNode **root)
+void venueMenu(VenueStore *venues, int *count, int *current)
 {
+    char name[32];
+    char path[256];
     int choice;
     do
     {
-        printf("\n--- Ticket Management Menu ---\n");
-        printf("1. Issue Ticket\n");
-        printf("2. Search for Ticket (by Seat & Event Code)\n");
-        printf("3. Print List of Tickets for an Event\n");
-        printf("4. Return to Main Menu\n");
-        printf("Select [1-4]: ");
+        printf("\n--- Venue Management Menu ---\n");
+        printf("1. List Venues\n");
+        printf("2. Open a New Venue\n");
+        printf("3. Switch Venue\n");
+        printf("4. Drop a Venue\n");
+        printf("5. Return to Main Menu\n");
+        printf("Select [1-5]: ");
         choice = getIntegerInput();
 
         switch (choice)
         {
         case 1:
-            addTicket(root);
+            printVenues(venues, *count, *current);
             break;
         case 2:
-            findTicket(*root);
+        {
+            VenueLayout layout = defaultLayout;
+            if (journalFile != NULL || dataLog != NULL || traceFile != NULL)
+            {
+                printf("(!) The journal, the data log and the workload trace follow a single venue.\n");
+                break;
+            }
+            printf("Enter venue name: ");
+            getStringInput(name, sizeof(name));
+            printf("Enter seat map file (empty for the default layout): ");
+            getStringInput(path, sizeof(path));
+            if (path[0] != '\0' && !venueLoad(&layout, path))
+                break;
+            if (!venueStoreOpen(venues, count, name, &layout))
+            {
+                printf("(!) Error: The name is empty or taken, or %d venues are already open.\n", MAX_VENUES);
+                break;
+            }
+            *current = *count - 1;
+            printf("-> Venue '%s' opened with %d seats; now working on it.\n", name, layout.seatCount);
             break;
+        }
         case 3:
-            printTicketsForEvent(*root);
+        {
+            printf("Enter venue name: ");
+            getStringInput(name, sizeof(name));
+            int index = findVenue(venues, *count, name);
+            if (index < 0)
+            {
+                printf("(!) No venue named '%s'.\n", name);
+                break;
+            }
+            *current = index;
+            printf("-> Now working on venue '%s'.\n", name);
             break;
+        }
         case 4:
+        {
+            printf("Enter venue name: ");
+            getStringInput(name, sizeof(name));
+            int index = findVenue(venues, *count, name);
+            if (index < 0)
+            {
+                printf("(!) No venue named '%s'.\n", name);
+                break;
+            }
+            if (*count == 1)
+            {
+                printf("(!) Error: The last venue cannot be dropped.\n");
+                break;
+            }
+            if (index == 0 && (journalFile != NULL || dataLog != NULL || traceFile != NULL))
+            {
+                printf("(!) Error: The journal, the data log or the workload trace follows this venue.\n");
+                break;
+            }
+            venueStoreClose(&venues[index]);
+            memmove(&venues[index], &venues[index + 1], (*count - index - 1) * sizeof(VenueStore));
+            (*count)--;
+            if (*current == index)
+                *current = 0;
+            else if (*current > index)
+                (*current)--;
+            printf("-> Venue '%s' and all its data have been dropped.\n", name);
+            break;
+        }
+        case 5:
             break;
         default:
             printf("(!) Invalid choice.\n");
         }
-    } while (choice != 4);
+    } while (choice != 5);
 }